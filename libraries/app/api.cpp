@@ -27,6 +27,7 @@
 #include <graphene/app/api.hpp>
 #include <graphene/app/api_access.hpp>
 #include <graphene/app/application.hpp>
+#include <graphene/api_helper_indexes/api_helper_indexes.hpp>
 #include <graphene/chain/database.hpp>
 #include <graphene/chain/get_config.hpp>
 #include <graphene/utilities/key_conversion.hpp>
@@ -181,8 +182,7 @@ namespace graphene { namespace app {
     void network_broadcast_api::broadcast_transaction(const precomputable_transaction& trx)
     {
        FC_ASSERT( _app.p2p_node() != nullptr, "Not connected to P2P network, can't broadcast!" );
-       _app.chain_database()->precompute_parallel( trx ).wait();
-       _app.chain_database()->push_transaction(trx);
+       _app.submit_transaction( trx ).wait();
        _app.p2p_node()->broadcast_transaction(trx);
     }
 
@@ -207,9 +207,8 @@ namespace graphene { namespace app {
     void network_broadcast_api::broadcast_transaction_with_callback(confirmation_callback cb, const precomputable_transaction& trx)
     {
        FC_ASSERT( _app.p2p_node() != nullptr, "Not connected to P2P network, can't broadcast!" );
-       _app.chain_database()->precompute_parallel( trx ).wait();
        _callbacks[trx.id()] = cb;
-       _app.chain_database()->push_transaction(trx);
+       _app.submit_transaction( trx ).wait();
        _app.p2p_node()->broadcast_transaction(trx);
     }
 
@@ -619,11 +618,32 @@ range_proof_info crypto_api::range_get_info(const std::vector<char> &proof) {
                   ("configured_limit", configured_limit) );
 
        asset_id_type asset_id = database_api.get_asset_id_from_string( asset );
-       const auto& bal_idx = _db.get_index_type< account_balance_index >().indices().get< by_asset_balance >();
-       auto range = bal_idx.equal_range( boost::make_tuple( asset_id ) );
 
        vector<account_asset_balance> result;
 
+       auto add_holder = [this,&result]( account_id_type owner, share_type balance ) {
+          const auto account = _db.find(owner);
+
+          account_asset_balance aab;
+          aab.name       = account->name;
+          aab.account_id = account->id;
+          aab.amount     = balance.value;
+
+          result.push_back(aab);
+       };
+
+       if( const auto* holders_idx = get_asset_holders_index() )
+       {
+          // jump to the start-th holder in the ranked index
+          auto range = holders_idx->get_holders( asset_id, start );
+          for( auto itr = range.first; itr != range.second && result.size() < limit; ++itr )
+             add_holder( itr->owner, itr->balance );
+          return result;
+       }
+
+       const auto& bal_idx = _db.get_index_type< account_balance_index >().indices().get< by_asset_balance >();
+       auto range = bal_idx.equal_range( boost::make_tuple( asset_id ) );
+
        uint32_t index = 0;
        for( const account_balance_object& bal : boost::make_iterator_range( range.first, range.second ) )
        {
@@ -636,27 +656,15 @@ range_proof_info crypto_api::range_get_info(const std::vector<char> &proof) {
           if( index++ < start )
              continue;
 
-          const auto account = _db.find(bal.owner);
-
-          account_asset_balance aab;
-          aab.name       = account->name;
-          aab.account_id = account->id;
-          aab.amount     = bal.balance.value;
-
-          result.push_back(aab);
+          add_holder( bal.owner, bal.balance );
        }
 
        return result;
     }
     // get number of asset holders.
     int asset_api::get_asset_holders_count( std::string asset ) const {
-       const auto& bal_idx = _db.get_index_type< account_balance_index >().indices().get< by_asset_balance >();
        asset_id_type asset_id = database_api.get_asset_id_from_string( asset );
-       auto range = bal_idx.equal_range( boost::make_tuple( asset_id ) );
-
-       int count = boost::distance(range) - 1;
-
-       return count;
+       return count_asset_balances( asset_id ) - 1;
     }
     // function to get vector of system assets with holders count.
     vector<asset_holders> asset_api::get_all_asset_holders() const {
@@ -669,10 +677,7 @@ range_proof_info crypto_api::range_get_info(const std::vector<char> &proof) {
           asset_id_type asset_id;
           asset_id = dasset_obj.id;
 
-          const auto& bal_idx = _db.get_index_type< account_balance_index >().indices().get< by_asset_balance >();
-          auto range = bal_idx.equal_range( boost::make_tuple( asset_id ) );
-
-          int count = boost::distance(range) - 1;
+          int count = count_asset_balances( asset_id ) - 1;
 
           asset_holders ah;
           ah.asset_id       = asset_id;
@@ -684,6 +689,23 @@ range_proof_info crypto_api::range_get_info(const std::vector<char> &proof) {
        return result;
     }
 
+    const graphene::api_helper_indexes::asset_holders_index* asset_api::get_asset_holders_index() const
+    {
+       if( !_app.get_options().has_api_helper_indexes_plugin )
+          return nullptr;
+       return &_db.get_index_type< primary_index< account_balance_index > >()
+                  .get_secondary_index< graphene::api_helper_indexes::asset_holders_index >();
+    }
+
+    int asset_api::count_asset_balances( asset_id_type asset_id ) const
+    {
+       if( const auto* holders_idx = get_asset_holders_index() )
+          return holders_idx->get_balance_count( asset_id );
+
+       const auto& bal_idx = _db.get_index_type< account_balance_index >().indices().get< by_asset_balance >();
+       return boost::distance( bal_idx.equal_range( boost::make_tuple( asset_id ) ) );
+    }
+
    // orders_api
    flat_set<uint16_t> orders_api::get_tracked_groups()const
    {
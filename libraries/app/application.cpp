@@ -477,6 +477,22 @@ void application_impl::open_chain_database() const
       _chain_db->enable_standby_votes_tracking( _options->at("enable-standby-votes-tracking").as<bool>() );
    }
 
+   if( _options->count("incremental-checkpoints") > 0 )
+      _chain_db->enable_incremental_checkpoints( _options->at("incremental-checkpoints").as<bool>() );
+
+   if( _options->count("replay-lookahead-bytes") > 0 )
+      _chain_db->set_replay_lookahead( _options->at("replay-lookahead-bytes").as<uint64_t>() );
+
+   if( _options->count("parallel-block-checks") > 0 )
+      _chain_db->set_parallel_block_checks( _options->at("parallel-block-checks").as<bool>() );
+
+   if( _options->count("parallel-vote-tally") > 0 )
+      _chain_db->enable_parallel_vote_tally( _options->at("parallel-vote-tally").as<bool>() );
+
+   if( _options->count("incremental-vote-tally") > 0 && _options->at("incremental-vote-tally").as<bool>() )
+      _chain_db->enable_incremental_vote_tally( true, _options->count("check-vote-tally") > 0
+                                                      && _options->at("check-vote-tally").as<bool>() );
+
    if( _options->count("replay-blockchain") > 0 || _options->count("revalidate-blockchain") > 0 )
       _chain_db->wipe( _data_dir / "blockchain", false );
 
@@ -524,6 +540,7 @@ void application_impl::startup()
       enable_p2p_network = _options->at("enable-p2p-network").as<bool>();
 
    open_chain_database();
+   _trx_prevalidator = std::make_unique<graphene::chain::transaction_prevalidator>( *_chain_db );
 
    startup_plugins();
 
@@ -665,8 +682,7 @@ void application_impl::handle_transaction(const graphene::net::trx_message& tran
       trx_count = 0;
    }
 
-   _chain_db->precompute_parallel( transaction_message.trx ).wait();
-   _chain_db->push_transaction( transaction_message.trx );
+   _self.submit_transaction( transaction_message.trx ).wait();
 } FC_CAPTURE_AND_RETHROW( (transaction_message) ) }
 
 void application_impl::handle_message(const message& message_to_process)
@@ -1021,6 +1037,8 @@ void application_impl::shutdown()
    else
       ilog( "P2P network is disabled" );
 
+   _trx_prevalidator.reset();
+
    if( _chain_db )
    {
       ilog( "Closing chain database" );
@@ -1125,6 +1143,21 @@ void application::set_program_options(boost::program_options::options_descriptio
          ("api-access", bpo::value<boost::filesystem::path>(), "JSON file specifying API permissions")
          ("io-threads", bpo::value<uint16_t>()->implicit_value(0),
           "Number of IO threads, default to 0 for auto-configuration")
+         ("incremental-checkpoints", bpo::value<bool>()->implicit_value(true),
+          "Whether to save only the objects changed since the previous save when writing the object database "
+          "to disk. Set it to true to make shutdown and replay checkpoints faster on large states.")
+         ("replay-lookahead-bytes", bpo::value<uint64_t>()->default_value(GRAPHENE_DEFAULT_REPLAY_LOOKAHEAD_BYTES),
+          "Bytes of blocks to read and precompute in parallel ahead of the block being applied during replay")
+         ("parallel-block-checks", bpo::value<bool>()->implicit_value(true),
+          "Whether to check the transaction authorities of incoming blocks on worker threads before applying them")
+         ("parallel-vote-tally", bpo::value<bool>()->implicit_value(true),
+          "Whether to compute the vote tallies of chain maintenance on worker threads")
+         ("incremental-vote-tally", bpo::value<bool>()->implicit_value(true),
+          "Whether to keep the vote tallies of chain maintenance and only count accounts that changed again. "
+          "Takes precedence over parallel-vote-tally")
+         ("check-vote-tally", bpo::value<bool>()->implicit_value(true),
+          "With incremental-vote-tally, also count all accounts in every maintenance interval and stop if the "
+          "results differ. For testing")
          ("enable-subscribe-to-all", bpo::value<bool>()->implicit_value(true),
           "Whether allow API clients to subscribe to universal object creation and removal events")
          ("enable-standby-votes-tracking", bpo::value<bool>()->implicit_value(true),
@@ -1286,6 +1319,16 @@ std::shared_ptr<chain::database> application::chain_database() const
    return my->_chain_db;
 }
 
+fc::future<chain::processed_transaction> application::submit_transaction( const chain::precomputable_transaction& trx )
+{
+   if( my->_trx_prevalidator )
+      return my->_trx_prevalidator->submit( trx );
+   // not started up, check and push right away
+   my->_chain_db->precompute_parallel( trx ).wait();
+   return fc::future<chain::processed_transaction>(
+         fc::promise<chain::processed_transaction>::create( my->_chain_db->push_transaction( trx ) ) );
+}
+
 void application::set_block_production(bool producing_blocks)
 {
    my->set_block_production(producing_blocks);
@@ -6,6 +6,7 @@
 #include <graphene/app/application.hpp>
 #include <graphene/app/api_access.hpp>
 #include <graphene/chain/genesis_state.hpp>
+#include <graphene/chain/transaction_prevalidator.hpp>
 #include <graphene/protocol/types.hpp>
 #include <graphene/net/message.hpp>
 
@@ -215,6 +216,7 @@ class application_impl : public net::node_delegate, public std::enable_shared_fr
       api_access _apiaccess;
 
       std::shared_ptr<graphene::chain::database>            _chain_db;
+      std::unique_ptr<graphene::chain::transaction_prevalidator> _trx_prevalidator;
       std::shared_ptr<graphene::net::node>                  _p2p_network;
       std::shared_ptr<fc::http::websocket_server>      _websocket_server;
       std::shared_ptr<fc::http::websocket_tls_server>  _websocket_tls_server;
@@ -44,18 +44,9 @@ database_api_impl::database_api_impl( graphene::chain::database& db, const appli
 :_db(db), _app_options(app_options)
 {
    dlog("creating database api ${x}", ("x",int64_t(this)) );
-   _new_connection = _db.new_objects.connect([this](const vector<object_id_type>& ids,
-                                                    const flat_set<account_id_type>& impacted_accounts) {
-                                on_objects_new(ids, impacted_accounts);
-                                });
-   _change_connection = _db.changed_objects.connect([this](const vector<object_id_type>& ids,
-                                                           const flat_set<account_id_type>& impacted_accounts) {
-                                on_objects_changed(ids, impacted_accounts);
-                                });
-   _removed_connection = _db.removed_objects.connect([this](const vector<object_id_type>& ids,
-                                                            const vector<const object*>& objs,
-                                                            const flat_set<account_id_type>& impacted_accounts) {
-                                on_objects_removed(ids, objs, impacted_accounts);
+   _object_changes_connection = _db.object_changes.connect(
+                                [this](const std::shared_ptr<const object_change_batch>& batch) {
+                                on_objects_changed(batch);
                                 });
    _applied_block_connection = _db.applied_block.connect([this](const signed_block&){ on_applied_block(); });
 
@@ -72,6 +63,15 @@ database_api_impl::database_api_impl( graphene::chain::database& db, const appli
    {
       amount_in_collateral_index = nullptr;
    }
+   try
+   {
+      order_book_index = &_db.get_index_type< primary_index< limit_order_index > >()
+                            .get_secondary_index<graphene::api_helper_indexes::order_book_index>();
+   }
+   catch( fc::assert_exception& e )
+   {
+      order_book_index = nullptr;
+   }
 }
 
 database_api_impl::~database_api_impl()
@@ -181,7 +181,10 @@ void database_api_impl::cancel_all_subscriptions( bool reset_callback, bool rese
       _subscribe_callback = std::function<void(const fc::variant&)>();
 
    if ( reset_market_subscriptions )
+   {
       _market_subscriptions.clear();
+      _market_depth_subscriptions.clear();
+   }
 
    _notify_remove_create = false;
    _subscribed_accounts.clear();
@@ -1447,6 +1450,35 @@ void database_api_impl::unsubscribe_from_market(const std::string& a, const std:
    _market_subscriptions.erase(std::make_pair(asset_a_id,asset_b_id));
 }
 
+void database_api::subscribe_to_market_depth( std::function<void(const variant&)> callback,
+                                              const std::string& base, const std::string& quote )
+{
+   my->subscribe_to_market_depth( callback, base, quote );
+}
+
+void database_api_impl::subscribe_to_market_depth( std::function<void(const variant&)> callback,
+                                                   const std::string& base, const std::string& quote )
+{
+   FC_ASSERT( order_book_index, "api_helper_indexes plugin is not enabled on this server." );
+
+   auto base_id = get_asset_from_string(base)->id;
+   auto quote_id = get_asset_from_string(quote)->id;
+   FC_ASSERT(base_id != quote_id);
+   _market_depth_subscriptions[ std::make_pair(base_id,quote_id) ] = callback;
+}
+
+void database_api::unsubscribe_from_market_depth( const std::string& base, const std::string& quote )
+{
+   my->unsubscribe_from_market_depth( base, quote );
+}
+
+void database_api_impl::unsubscribe_from_market_depth( const std::string& base, const std::string& quote )
+{
+   auto base_id = get_asset_from_string(base)->id;
+   auto quote_id = get_asset_from_string(quote)->id;
+   _market_depth_subscriptions.erase( std::make_pair(base_id,quote_id) );
+}
+
 market_ticker database_api::get_ticker( const string& base, const string& quote )const
 {
     return my->get_ticker( base, quote );
@@ -1552,6 +1584,62 @@ order_book database_api_impl::get_order_book( const string& base, const string&
    return result;
 }
 
+namespace {
+   /// Converts the orders selling at one price to an order book entry of the market base:quote
+   order level_to_order( const price& sell_price, share_type for_sale,
+                         const asset_object& base, const asset_object& quote )
+   {
+      order ord;
+      ord.price = price_to_string( sell_price, base, quote );
+      const share_type receive = share_type( fc::uint128_t( for_sale.value ) * sell_price.quote.amount.value
+                                             / sell_price.base.amount.value );
+      if( sell_price.base.asset_id == base.id )
+      {
+         ord.quote = quote.amount_to_string( receive );
+         ord.base = base.amount_to_string( for_sale );
+      }
+      else
+      {
+         ord.quote = quote.amount_to_string( for_sale );
+         ord.base = base.amount_to_string( receive );
+      }
+      return ord;
+   }
+}
+
+order_book database_api::get_order_book_levels( const string& base, const string& quote, unsigned limit )const
+{
+   return my->get_order_book_levels( base, quote, limit );
+}
+
+order_book database_api_impl::get_order_book_levels( const string& base, const string& quote, unsigned limit )const
+{
+   FC_ASSERT( _app_options, "Internal error" );
+   FC_ASSERT( order_book_index, "api_helper_indexes plugin is not enabled on this server." );
+   const auto configured_limit = _app_options->api_limit_get_order_book;
+   FC_ASSERT( limit <= configured_limit,
+              "limit can not be greater than ${configured_limit}",
+              ("configured_limit", configured_limit) );
+
+   order_book result;
+   result.base = base;
+   result.quote = quote;
+
+   auto assets = lookup_asset_symbols( {base, quote} );
+   FC_ASSERT( assets[0], "Invalid base asset symbol: ${s}", ("s",base) );
+   FC_ASSERT( assets[1], "Invalid quote asset symbol: ${s}", ("s",quote) );
+
+   auto add_levels = [this,limit,&assets]( asset_id_type sell, asset_id_type receive, vector<order>& side ) {
+      auto range = order_book_index->get_levels( sell, receive );
+      for( auto itr = range.first; itr != range.second && side.size() < limit; ++itr )
+         side.push_back( level_to_order( itr->first, itr->second.for_sale, *assets[0], *assets[1] ) );
+   };
+   add_levels( assets[0]->id, assets[1]->id, result.bids );
+   add_levels( assets[1]->id, assets[0]->id, result.asks );
+
+   return result;
+}
+
 vector<market_ticker> database_api::get_top_markets(uint32_t limit)const
 {
    return my->get_top_markets(limit);
@@ -3592,61 +3680,93 @@ void database_api_impl::broadcast_market_updates( const market_queue_type& queue
    }
 }
 
-void database_api_impl::on_objects_removed( const vector<object_id_type>& ids,
-                                            const vector<const object*>& objs,
-                                            const flat_set<account_id_type>& impacted_accounts )
+void database_api_impl::on_objects_changed( const std::shared_ptr<const object_change_batch>& batch )
 {
-   handle_object_changed(_notify_remove_create, false, ids, impacted_accounts,
-      [objs](object_id_type id) -> const object* {
-         auto it = std::find_if(
-               objs.begin(), objs.end(),
-               [id](const object* o) {return o != nullptr && o->id == id;});
-
-         if (it != objs.end())
-            return *it;
-
-         return nullptr;
-      }
-   );
+   handle_object_changed(_notify_remove_create, true, batch->created);
+   handle_object_changed(false, true, batch->changed);
+   handle_object_changed(_notify_remove_create, false, batch->removed);
+   if( !_market_depth_subscriptions.empty() && order_book_index )
+      handle_order_book_changed(*batch);
 }
 
-void database_api_impl::on_objects_new( const vector<object_id_type>& ids,
-                                        const flat_set<account_id_type>& impacted_accounts )
+void database_api_impl::handle_order_book_changed( const object_change_batch& batch )
 {
-   handle_object_changed(_notify_remove_create, true, ids, impacted_accounts,
-      std::bind(&object_database::find_object, &_db, std::placeholders::_1)
-   );
-}
+   // prices of the levels touched by the block, by asset sold and asset received
+   map< pair<asset_id_type,asset_id_type>, std::set< price, std::greater<price> > > touched;
+   for( const object_change_set* changes : { &batch.created, &batch.changed, &batch.removed } )
+   {
+      for( size_t i = 0; i < changes->ids.size(); ++i )
+      {
+         if( !changes->ids[i].is<limit_order_object>() || !changes->objects[i].value )
+            continue;
+         const auto& o = static_cast<const limit_order_object&>( *changes->objects[i].value );
+         touched[ std::make_pair( o.sell_price.base.asset_id, o.sell_price.quote.asset_id ) ].insert( o.sell_price );
+      }
+   }
+   if( touched.empty() )
+      return;
 
-void database_api_impl::on_objects_changed( const vector<object_id_type>& ids,
-                                            const flat_set<account_id_type>& impacted_accounts )
-{
-   handle_object_changed(false, true, ids, impacted_accounts,
-      std::bind(&object_database::find_object, &_db, std::placeholders::_1)
-   );
+   market_queue_type broadcast_queue;
+   for( const auto& sub : _market_depth_subscriptions )
+   {
+      const auto bids = touched.find( sub.first );
+      const auto asks = touched.find( std::make_pair( sub.first.second, sub.first.first ) );
+      if( bids == touched.end() && asks == touched.end() )
+         continue;
+
+      const asset_object& base = sub.first.first(_db);
+      const asset_object& quote = sub.first.second(_db);
+      order_book_update update;
+      update.block_num = batch.block_num;
+      update.base = base.symbol;
+      update.quote = quote.symbol;
+      auto add_levels = [this,&touched,&base,&quote]( decltype(bids) prices, vector<order>& side ) {
+         if( prices == touched.end() )
+            return;
+         for( const price& p : prices->second )
+         {
+            const auto* level = order_book_index->find_level( p );
+            side.push_back( level_to_order( p, level != nullptr ? level->for_sale : share_type(0), base, quote ) );
+         }
+      };
+      add_levels( bids, update.bids );
+      add_levels( asks, update.asks );
+      broadcast_queue[sub.first].emplace_back( fc::variant( update, GRAPHENE_MAX_NESTED_OBJECTS ) );
+   }
+
+   if( !broadcast_queue.empty() )
+   {
+      auto capture_this = shared_from_this();
+      fc::async([capture_this, this, broadcast_queue](){
+          for( const auto& item : broadcast_queue )
+          {
+            auto sub = _market_depth_subscriptions.find(item.first);
+            if( sub != _market_depth_subscriptions.end() )
+               for( const auto& update : item.second )
+                  sub->second( update );
+          }
+      });
+   }
 }
 
-void database_api_impl::handle_object_changed( bool force_notify,
-                                               bool full_object,
-                                               const vector<object_id_type>& ids,
-                                               const flat_set<account_id_type>& impacted_accounts,
-                                               std::function<const object*(object_id_type id)> find_object )
+void database_api_impl::handle_object_changed( bool force_notify, bool full_object, const object_change_set& changes )
 {
    if( _subscribe_callback )
    {
       vector<variant> updates;
+      const bool impacted = is_impacted_account(changes.accounts_impacted);
 
-      for(auto id : ids)
+      for( size_t i = 0; i < changes.ids.size(); ++i )
       {
-         if( force_notify || is_subscribed_to_item(id) || is_impacted_account(impacted_accounts) )
+         const object_id_type id = changes.ids[i];
+         if( force_notify || is_subscribed_to_item(id) || impacted )
          {
             if( full_object )
             {
-               auto obj = find_object(id);
-               if( obj )
-               {
-                  updates.emplace_back( obj->to_variant() );
-               }
+               // serialized once per block for all subscribers
+               const variant& value = changes.objects[i].to_variant();
+               if( !value.is_null() )
+                  updates.emplace_back( value );
             }
             else
             {
@@ -3663,19 +3783,20 @@ void database_api_impl::handle_object_changed( bool force_notify,
    {
       market_queue_type broadcast_queue;
 
-      for(auto id : ids)
+      for( size_t i = 0; i < changes.ids.size(); ++i )
       {
+         const object_id_type id = changes.ids[i];
          if( id.is<call_order_object>() )
          {
-            enqueue_if_subscribed_to_market<call_order_object>( find_object(id), broadcast_queue, full_object );
+            enqueue_if_subscribed_to_market<call_order_object>( changes.objects[i], broadcast_queue, full_object );
          }
          else if( id.is<limit_order_object>() )
          {
-            enqueue_if_subscribed_to_market<limit_order_object>( find_object(id), broadcast_queue, full_object );
+            enqueue_if_subscribed_to_market<limit_order_object>( changes.objects[i], broadcast_queue, full_object );
          }
          else if( id.is<force_settlement_object>() )
          {
-            enqueue_if_subscribed_to_market<force_settlement_object>( find_object(id), broadcast_queue,
+            enqueue_if_subscribed_to_market<force_settlement_object>( changes.objects[i], broadcast_queue,
                                                                       full_object );
          }
       }
@@ -105,12 +105,17 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       void subscribe_to_market( std::function<void(const variant&)> callback,
                                 const std::string& a, const std::string& b );
       void unsubscribe_from_market(const std::string& a, const std::string& b);
+      void subscribe_to_market_depth( std::function<void(const variant&)> callback,
+                                      const std::string& base, const std::string& quote );
+      void unsubscribe_from_market_depth( const std::string& base, const std::string& quote );
 
       market_ticker                      get_ticker( const string& base, const string& quote,
                                                      bool skip_order_book = false )const;
       market_volume                      get_24_volume( const string& base, const string& quote )const;
       order_book                         get_order_book( const string& base, const string& quote,
                                                          unsigned limit = 50 )const;
+      order_book                         get_order_book_levels( const string& base, const string& quote,
+                                                                unsigned limit = 50 )const;
       vector<market_ticker>              get_top_markets( uint32_t limit )const;
       vector<market_trade>               get_trade_history( const string& base, const string& quote,
                                                             fc::time_point_sec start, fc::time_point_sec stop,
@@ -300,32 +305,26 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       }
 
       template<typename T>
-      void enqueue_if_subscribed_to_market(const object* obj, market_queue_type& queue, bool full_object=true)
+      void enqueue_if_subscribed_to_market(const object_change& change, market_queue_type& queue, bool full_object=true)
       {
-         const T* order = dynamic_cast<const T*>(obj);
+         const T* order = dynamic_cast<const T*>(change.value.get());
          FC_ASSERT( order != nullptr);
 
          const auto& market = get_order_market( *order );
 
          auto sub = _market_subscriptions.find( market );
          if( sub != _market_subscriptions.end() ) {
-            queue[market].emplace_back( full_object ? obj->to_variant() : fc::variant(obj->id, 1) );
+            queue[market].emplace_back( full_object ? change.to_variant() : fc::variant(order->id, 1) );
          }
       }
 
       void broadcast_updates( const vector<variant>& updates );
       void broadcast_market_updates( const market_queue_type& queue);
-      void handle_object_changed( bool force_notify,
-                                  bool full_object,
-                                  const vector<object_id_type>& ids,
-                                  const flat_set<account_id_type>& impacted_accounts,
-                                  std::function<const object*(object_id_type id)> find_object );
-
-      /** called every time a block is applied to report the objects that were changed */
-      void on_objects_new(const vector<object_id_type>& ids, const flat_set<account_id_type>& impacted_accounts);
-      void on_objects_changed(const vector<object_id_type>& ids, const flat_set<account_id_type>& impacted_accounts);
-      void on_objects_removed(const vector<object_id_type>& ids, const vector<const object*>& objs,
-                              const flat_set<account_id_type>& impacted_accounts);
+      void handle_object_changed( bool force_notify, bool full_object, const object_change_set& changes );
+      void handle_order_book_changed( const object_change_batch& batch );
+
+      /** called every time a block is applied to report the objects that were created, changed or removed */
+      void on_objects_changed( const std::shared_ptr<const object_change_batch>& batch );
       void on_applied_block();
 
       ////////////////////////////////////////////////
@@ -342,18 +341,19 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       std::function<void(const fc::variant&)> _pending_trx_callback;
       std::function<void(const fc::variant&)> _block_applied_callback;
 
-      boost::signals2::scoped_connection _new_connection;
-      boost::signals2::scoped_connection _change_connection;
-      boost::signals2::scoped_connection _removed_connection;
+      boost::signals2::scoped_connection _object_changes_connection;
       boost::signals2::scoped_connection _applied_block_connection;
       boost::signals2::scoped_connection _pending_trx_connection;
 
       map< pair<asset_id_type,asset_id_type>, std::function<void(const variant&)> > _market_subscriptions;
+      /// Keyed by base and quote, in the order they were subscribed with
+      map< pair<asset_id_type,asset_id_type>, std::function<void(const variant&)> > _market_depth_subscriptions;
 
       graphene::chain::database& _db;
       const application_options* _app_options = nullptr;
 
       const graphene::api_helper_indexes::amount_in_collateral_index* amount_in_collateral_index;
+      const graphene::api_helper_indexes::order_book_index* order_book_index;
 };
 
 } } // graphene::app
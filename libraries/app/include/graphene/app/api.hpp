@@ -50,6 +50,10 @@
 #include <string>
 #include <vector>
 
+namespace graphene { namespace api_helper_indexes {
+   class asset_holders_index;
+} }
+
 namespace graphene { namespace app {
    using namespace graphene::chain;
    using namespace graphene::market_history;
@@ -418,6 +422,11 @@ public:
          vector<asset_holders> get_all_asset_holders() const;
 
       private:
+         /// Returns the holders index of the api_helper_indexes plugin, or nullptr if the plugin is not enabled
+         const graphene::api_helper_indexes::asset_holders_index* get_asset_holders_index() const;
+         /// Number of balance objects of an asset, including zero balances
+         int count_asset_balances( asset_id_type asset_id ) const;
+
          graphene::app::application& _app;
          graphene::chain::database& _db;
          graphene::app::database_api database_api;
@@ -93,6 +93,17 @@ namespace graphene { namespace app {
      vector< order >             asks;
    };
 
+   /// Price levels of a market which changed in a block, with their totals after the block
+   struct order_book_update
+   {
+     uint32_t                    block_num = 0;
+     string                      base;
+     string                      quote;
+     /// A level whose last order went away is sent with zero amounts
+     vector< order >             bids;
+     vector< order >             asks;
+   };
+
    struct market_ticker
    {
       time_point_sec             time;
@@ -183,6 +194,7 @@ FC_REFLECT( graphene::app::full_account,
 
 FC_REFLECT( graphene::app::order, (price)(quote)(base) )
 FC_REFLECT( graphene::app::order_book, (base)(quote)(bids)(asks) )
+FC_REFLECT( graphene::app::order_book_update, (block_num)(base)(quote)(bids)(asks) )
 FC_REFLECT( graphene::app::market_ticker,
             (time)(base)(quote)(latest)(lowest_ask)(lowest_ask_base_size)(lowest_ask_quote_size)
             (highest_bid)(highest_bid_base_size)(highest_bid_quote_size)(percent_change)(base_volume)(quote_volume)(mto_id) )
@@ -132,6 +132,11 @@ namespace graphene { namespace app {
 
          net::node_ptr                    p2p_node();
          std::shared_ptr<chain::database> chain_database()const;
+         /**
+          * Checks @p trx on worker threads and pushes it to the chain database in a batch with others
+          * @return a future holding the processed transaction or the exception that rejected it
+          */
+         fc::future<chain::processed_transaction> submit_transaction( const chain::precomputable_transaction& trx );
          void set_api_limit();
          void set_block_production(bool producing_blocks);
          fc::optional< api_access_info > get_api_access_info( const string& username )const;
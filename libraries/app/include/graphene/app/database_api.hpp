@@ -582,6 +582,27 @@ class database_api
        */
       void unsubscribe_from_market( const std::string& a, const std::string& b );
 
+      /**
+       * @brief Request notification when price levels of the order book of the market base:quote change
+       * @param callback Callback method which is called after each block that changed the order book
+       * @param base symbol name or ID of the base asset
+       * @param quote symbol name or ID of the quote asset
+       *
+       * Callback will be passed a variant containing an order_book_update with the levels which changed in the
+       * block. Together with a snapshot from get_order_book_levels() this keeps a copy of the book current.
+       *
+       * @note This requires the api_helper_indexes plugin to be enabled
+       */
+      void subscribe_to_market_depth( std::function<void(const variant&)> callback,
+                                      const std::string& base, const std::string& quote );
+
+      /**
+       * @brief Unsubscribe from order book updates of the market base:quote
+       * @param base symbol name or ID of the base asset
+       * @param quote symbol name or ID of the quote asset
+       */
+      void unsubscribe_from_market_depth( const std::string& base, const std::string& quote );
+
       /**
        * @brief Returns the ticker for the market assetA:assetB
        * @param base symbol name or ID of the base asset
@@ -607,6 +628,17 @@ class database_api
        */
       order_book get_order_book( const string& base, const string& quote, unsigned limit = 50 )const;
 
+      /**
+       * @brief Returns the order book for the market base:quote with the orders at each price added up
+       * @param base symbol name or ID of the base asset
+       * @param quote symbol name or ID of the quote asset
+       * @param limit number of price levels to retrieve, for bids and asks each, capped at 50
+       * @return Price levels of the market, best first
+       *
+       * @note This requires the api_helper_indexes plugin to be enabled
+       */
+      order_book get_order_book_levels( const string& base, const string& quote, unsigned limit = 50 )const;
+
       /**
        * @brief Returns vector of tickers sorted by reverse base_volume
        * Note: this API is experimental and subject to change in next releases
@@ -1217,6 +1249,7 @@ FC_API(graphene::app::database_api,
 
    // Markets / feeds
    (get_order_book)
+   (get_order_book_levels)
    (get_limit_orders)
    (get_limit_orders_by_account)
    (get_account_limit_orders)
@@ -1227,6 +1260,8 @@ FC_API(graphene::app::database_api,
    (get_margin_positions)
    (subscribe_to_market)
    (unsubscribe_from_market)
+   (subscribe_to_market_depth)
+   (unsubscribe_from_market_depth)
    (get_ticker)
    (get_24_volume)
    (get_top_markets)
@@ -109,54 +109,45 @@ time_point_sec asset_object::get_lottery_expiration() const
       return lottery_options->end_date;
    return time_point_sec();
 }
-vector<account_id_type> asset_object::get_holders( database& db ) const
+lottery_ticket_ranges asset_object::get_ticket_ranges( database& db ) const
 {
    auto& asset_bal_idx = db.get_index_type< account_balance_index >().indices().get< by_asset_balance >();
-   
-   uint64_t max_supply = get_id()(db).options.max_supply.value;
-   
-   vector<account_id_type> holders; // repeating if balance > 1
-   holders.reserve(max_supply);
+
+   lottery_ticket_ranges ranges;
+   uint64_t tickets = 0;
    const auto range = asset_bal_idx.equal_range( boost::make_tuple( get_id() ) );
    for( const account_balance_object& bal : boost::make_iterator_range( range.first, range.second ) )
-      for( uint64_t balance = bal.balance.value; balance > 0; --balance)
-         holders.push_back( bal.owner );
-   return holders;
+   {
+      if( bal.balance <= 0 )
+         continue;
+      tickets += bal.balance.value;
+      ranges.holders.push_back( bal.owner );
+      ranges.ends.push_back( tickets );
+   }
+   return ranges;
 }
 
-vector<uint64_t> asset_object::get_ticket_ids( database& db ) const
+optional<uint64_t> asset_object::get_ticket_id( database& db, account_id_type holder, uint64_t offset ) const
 {
-   auto& asset_bal_idx = db.get_index_type< account_balance_index >().indices().get< by_asset_balance >();
-   vector<uint64_t> ids;
-   const auto range = asset_bal_idx.equal_range( boost::make_tuple( get_id() ) );
-
-   for( const account_balance_object& bal : boost::make_iterator_range( range.first, range.second ) )
+   const auto& stats = holder(db).statistics(db);
+   const account_transaction_history_object* ath = db.find( stats.most_recent_op );
+   uint64_t tickets = 0;
+   while( ath != nullptr )
    {
-      const auto& stats = bal.owner(db).statistics(db);
-      const account_transaction_history_object* ath = static_cast<const account_transaction_history_object*>(&stats.most_recent_op(db));
-      for( uint64_t balance = bal.balance.value; balance > 0;)
+      const operation_history_object* oho = db.find( ath->operation_id );
+      if( oho != nullptr && oho->op.which() == operation::tag<ticket_purchase_operation>::value
+            && get_id() == oho->op.get<ticket_purchase_operation>().lottery )
       {
-         if(ath != nullptr)
-         {
-            const operation_history_object& oho = db.get<operation_history_object>( ath->operation_id );
-            if( oho.op.which() == operation::tag<ticket_purchase_operation>::value && get_id() == oho.op.get<ticket_purchase_operation>().lottery)
-            {
-               uint64_t tickets_count = oho.op.get<ticket_purchase_operation>().tickets_to_buy;
-               ids.insert(ids.end(), tickets_count, oho.id.instance());
-               balance -= tickets_count;
-               assert(balance >= 0);
-            }
-
-            if( ath->next == account_transaction_history_id_type() )
-            {
-               ath = nullptr;
-               break;
-            }
-            else ath = db.find(ath->next);
-         }
+         tickets += oho->op.get<ticket_purchase_operation>().tickets_to_buy;
+         if( offset < tickets )
+            return oho->id.instance();
       }
+
+      if( ath->next == account_transaction_history_id_type() )
+         break;
+      ath = db.find( ath->next );
    }
-   return ids;
+   return {};
 }
 
 void asset_object::distribute_benefactors_part( database& db )
@@ -180,46 +171,49 @@ map< account_id_type, vector< uint16_t > > asset_object::distribute_winners_part
 {
    transaction_evaluation_state eval( &db );
       
-   auto holders = get_holders( db );
-   vector<uint64_t> ticket_ids = get_ticket_ids(db);
-   FC_ASSERT( dynamic_data( db ).current_supply == holders.size() );
+   const lottery_ticket_ranges sold = get_ticket_ranges( db );
+   const uint64_t sold_count = sold.total();
+   FC_ASSERT( dynamic_data( db ).current_supply == sold_count );
    map<account_id_type, vector<uint16_t> > structurized_participants;
-   for( account_id_type holder : holders )
-   {
-      if( !structurized_participants.count( holder ) )
-         structurized_participants.emplace( holder, vector< uint16_t >() );
-   }
+   for( account_id_type holder : sold.holders )
+      structurized_participants.emplace( holder, vector< uint16_t >() );
    uint64_t jackpot = get_id()( db ).dynamic_data( db ).current_supply.value * lottery_options->ticket_price.amount.value;
-   auto winner_numbers = db.get_winner_numbers( get_id(), holders.size(), lottery_options->winning_tickets.size() );
+   auto winner_numbers = db.get_winner_numbers( get_id(), sold_count, lottery_options->winning_tickets.size() );
    
    auto& tickets( lottery_options->winning_tickets );
    
-   if( holders.size() < tickets.size() ) {
+   if( sold_count < tickets.size() ) {
       uint16_t percents_to_distribute = 0;
-      for( auto i = tickets.begin() + holders.size(); i != tickets.end(); ) {
+      for( auto i = tickets.begin() + sold_count; i != tickets.end(); ) {
          percents_to_distribute += *i;
          i = tickets.erase(i);
       }
-      for( auto t = tickets.begin(); t != tickets.begin() + holders.size(); ++t )
-         *t += percents_to_distribute / holders.size();
+      for( auto t = tickets.begin(); t != tickets.begin() + sold_count; ++t )
+         *t += percents_to_distribute / sold_count;
    }
    auto sweeps_distribution_percentage = db.get_global_properties().parameters.sweeps_distribution_percentage();
    for( size_t c = 0; c < winner_numbers.size(); ++c ) {
       auto winner_num = winner_numbers[c];
+      const size_t winner_holder = sold.find( winner_num );
+      FC_ASSERT( winner_holder < sold.holders.size() );
       lottery_reward_operation reward_op;
       reward_op.lottery = get_id();
       reward_op.is_benefactor_reward = false;
-      reward_op.winner = holders[winner_num];
-      if(db.head_block_time() > HARDFORK_BSIP_40_TIME && ticket_ids.size() > winner_num)
+      reward_op.winner = sold.holders[winner_holder];
+      if(db.head_block_time() > HARDFORK_BSIP_40_TIME)
       {
-         const static_variant<uint64_t, void_t> tkt_id = ticket_ids[winner_num];
-         reward_op.winner_ticket_id = tkt_id;
+         const optional<uint64_t> ticket_id = get_ticket_id( db, reward_op.winner, sold.offset( winner_num, winner_holder ) );
+         if( ticket_id.valid() )
+         {
+            const static_variant<uint64_t, void_t> tkt_id = *ticket_id;
+            reward_op.winner_ticket_id = tkt_id;
+         }
       }
       reward_op.win_percentage = tickets[c];
       reward_op.amount = asset( jackpot * tickets[c] * ( 1. - sweeps_distribution_percentage / (double)GRAPHENE_100_PERCENT ) / GRAPHENE_100_PERCENT , db.get_balance(id).asset_id );
       db.apply_operation(eval, reward_op);
       
-      structurized_participants[ holders[ winner_num ] ].push_back( tickets[c] );
+      structurized_participants[ reward_op.winner ].push_back( tickets[c] );
    }
    return structurized_participants;
 }
@@ -26,6 +26,9 @@
 #include <fc/io/raw.hpp>
 #include <boost/endian/buffers.hpp>
 
+#include <cstring>
+#include <fstream>
+
 namespace graphene { namespace chain {
 
 struct index_entry
@@ -43,40 +46,163 @@ FC_REFLECT( graphene::chain::index_entry, (block_pos)(block_size)(block_id) );
 
 namespace graphene { namespace chain {
 
+static_assert( block_database::data_segment_size % 4096 == 0, "data segments must be page aligned" );
+static_assert( (block_database::index_chunk_entries * sizeof(index_entry)) % 4096 == 0,
+               "index chunks must be page aligned" );
+
+typedef std::shared_lock<std::shared_timed_mutex> read_lock;
+typedef std::unique_lock<std::shared_timed_mutex> write_lock;
+
+constexpr uint64_t block_database::data_segment_size;
+constexpr uint64_t block_database::index_chunk_entries;
+
+static const uint64_t index_chunk_size = block_database::index_chunk_entries * sizeof(index_entry);
+
+block_database::block_database() {}
+
+block_database::~block_database()
+{
+   if( is_open() )
+      close();
+}
+
 void block_database::open( const fc::path& dbdir )
 { try {
    fc::create_directories(dbdir);
-   _block_num_to_pos.exceptions(std::ios_base::failbit | std::ios_base::badbit);
-   _blocks.exceptions(std::ios_base::failbit | std::ios_base::badbit);
 
    _index_filename = dbdir / "index";
-   if( !fc::exists( _index_filename ) )
+   _blocks_filename = dbdir / "blocks";
+   if( !fc::exists( _index_filename ) || !fc::exists( _blocks_filename ) )
    {
-     _block_num_to_pos.open( _index_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
+      std::ofstream index_out( _index_filename.generic_string().c_str(), std::ofstream::binary | std::ofstream::trunc );
+      std::ofstream blocks_out( _blocks_filename.generic_string().c_str(), std::ofstream::binary | std::ofstream::trunc );
    }
-   else
+
+   // no readers can exist before open() returns, so the mutex is not needed here
+   const uint64_t index_file_size = fc::file_size( _index_filename );
+   const uint64_t blocks_file_size = fc::file_size( _blocks_filename );
+
+   _index_file.reset( new fc::file_mapping( _index_filename.generic_string().c_str(), fc::read_write ) );
+   _blocks_file.reset( new fc::file_mapping( _blocks_filename.generic_string().c_str(), fc::read_write ) );
+   _index_chunks.clear();
+   _data_segments.clear();
+   _index_end = index_file_size / sizeof(index_entry);
+   _data_end = blocks_file_size;
+   reserve_index( std::max<uint64_t>( _index_end, 1 ) );
+   reserve_data( std::max<uint64_t>( _data_end, 1 ) );
+
+   // Drop trailing entries that do not refer to a complete block. These are left behind by a
+   // crash between growing the files and writing to them, or by blocks removed from the end.
+   while( _index_end > 0 )
    {
-     _block_num_to_pos.open( _index_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+      index_entry& e = entry_at( _index_end - 1 );
+      if( e.block_size.value() > 0 && e.block_pos.value() + e.block_size.value() <= blocks_file_size )
+      {
+         try
+         {
+            const optional<signed_block> block = read_block( e );
+            if( block.valid() && block->id() == e.block_id )
+               break;
+         }
+         catch (const fc::exception&)
+         {
+         }
+         catch (const std::exception&)
+         {
+         }
+      }
+      e = index_entry();
+      --_index_end;
+   }
+
+   _data_end = 0;
+   for( uint64_t num = 0; num < _index_end; ++num )
+   {
+      const index_entry& e = entry_at( num );
+      const uint64_t end = e.block_pos.value() + e.block_size.value();
+      if( e.block_size.value() > 0 && end <= blocks_file_size && end > _data_end )
+         _data_end = end;
    }
 } FC_CAPTURE_AND_RETHROW( (dbdir) ) }
 
 bool block_database::is_open()const
 {
-  return _blocks.is_open();
+  return _blocks_file != nullptr;
 }
 
 void block_database::close()
 {
-  _blocks.close();
-  _block_num_to_pos.close();
+   write_lock lock( _mutex );
+   if( _blocks_file == nullptr )
+      return;
+
+   for( const region_ptr& r : _index_chunks )
+      r->flush();
+   for( const region_ptr& r : _data_segments )
+      r->flush();
+   _index_chunks.clear();
+   _data_segments.clear();
+   _index_file.reset();
+   _blocks_file.reset();
+
+   // trim the preallocated tails so that the files only hold what has been written
+   fc::resize_file( _index_filename, _index_end * sizeof(index_entry) );
+   fc::resize_file( _blocks_filename, _data_end );
 }
 
 void block_database::flush()
 {
-  _blocks.flush();
-  _block_num_to_pos.flush();
+   read_lock lock( _mutex );
+   for( const region_ptr& r : _data_segments )
+      r->flush();
+   for( const region_ptr& r : _index_chunks )
+      r->flush();
+}
+
+index_entry& block_database::entry_at( uint64_t block_num )const
+{
+   const region_ptr& chunk = _index_chunks[ block_num / index_chunk_entries ];
+   return static_cast<index_entry*>( chunk->get_address() )[ block_num % index_chunk_entries ];
+}
+
+void block_database::reserve_index( uint64_t entries )
+{
+   const uint64_t chunks = ( entries + index_chunk_entries - 1 ) / index_chunk_entries;
+   if( chunks <= _index_chunks.size() )
+      return;
+   if( fc::file_size( _index_filename ) < chunks * index_chunk_size )
+      fc::resize_file( _index_filename, chunks * index_chunk_size );
+   while( _index_chunks.size() < chunks )
+      _index_chunks.emplace_back( std::make_shared<fc::mapped_region>( *_index_file, fc::read_write,
+                                                                       _index_chunks.size() * index_chunk_size,
+                                                                       index_chunk_size ) );
+}
+
+void block_database::reserve_data( uint64_t bytes )
+{
+   const uint64_t segments = ( bytes + data_segment_size - 1 ) / data_segment_size;
+   if( segments <= _data_segments.size() )
+      return;
+   if( fc::file_size( _blocks_filename ) < segments * data_segment_size )
+      fc::resize_file( _blocks_filename, segments * data_segment_size );
+   while( _data_segments.size() < segments )
+      _data_segments.emplace_back( std::make_shared<fc::mapped_region>( *_blocks_file, fc::read_write,
+                                                                        _data_segments.size() * data_segment_size,
+                                                                        data_segment_size ) );
+}
+
+void block_database::write_data( uint64_t pos, const char* data, size_t size )
+{
+   while( size > 0 )
+   {
+      const uint64_t offset = pos % data_segment_size;
+      const size_t len = std::min<uint64_t>( size, data_segment_size - offset );
+      char* dest = static_cast<char*>( _data_segments[ pos / data_segment_size ]->get_address() ) + offset;
+      memcpy( dest, data, len );
+      pos += len;
+      data += len;
+      size -= len;
+   }
 }
 
 void block_database::store( const block_id_type& _id, const signed_block& b )
@@ -87,90 +213,136 @@ void block_database::store( const block_id_type& _id, const signed_block& b )
       id = b.id();
       elog( "id argument of block_database::store() was not initialized for block ${id}", ("id", id) );
    }
-   _block_num_to_pos.seekp( sizeof( index_entry ) * int64_t(block_header::num_from_id(id)) );
-   index_entry e;
-   _blocks.seekp( 0, _blocks.end );
-   auto vec = fc::raw::pack( b );
-   e.block_pos  = _blocks.tellp();
-   e.block_size = vec.size();
+   const uint64_t block_num = block_header::num_from_id(id);
+   const size_t size = fc::raw::pack_size( b );
+
+   write_lock lock( _mutex );
+   FC_ASSERT( is_open(), "block_database is not open" );
+
+   // Start the block in a fresh segment if it would straddle a boundary, so it can be read in place
+   uint64_t pos = _data_end;
+   const uint64_t segment_left = data_segment_size - pos % data_segment_size;
+   if( size > segment_left && size <= data_segment_size )
+      pos += segment_left;
+   reserve_data( pos + size );
+   if( pos % data_segment_size + size <= data_segment_size )
+   {
+      char* dest = static_cast<char*>( _data_segments[ pos / data_segment_size ]->get_address() )
+                   + pos % data_segment_size;
+      fc::datastream<char*> ds( dest, size );
+      fc::raw::pack( ds, b );
+   }
+   else
+   {
+      const auto vec = fc::raw::pack( b );
+      write_data( pos, vec.data(), vec.size() );
+   }
+   _data_end = pos + size;
+
+   reserve_index( block_num + 1 );
+   index_entry& e = entry_at( block_num );
+   e.block_pos  = pos;
+   e.block_size = size;
    e.block_id   = id;
-   _blocks.write( vec.data(), vec.size() );
-   _block_num_to_pos.write( (char*)&e, sizeof(e) );
+   if( block_num >= _index_end )
+      _index_end = block_num + 1;
 }
 
 void block_database::remove( const block_id_type& id )
 { try {
-   index_entry e;
-   int64_t index_pos = sizeof(e) * int64_t(block_header::num_from_id(id));
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= index_pos )
+   const uint64_t block_num = block_header::num_from_id(id);
+   write_lock lock( _mutex );
+   if( block_num >= _index_end )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block ${id} not contained in block database", ("id", id));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
+   index_entry& e = entry_at( block_num );
    if( e.block_id == id )
-   {
       e.block_size = 0;
-      _block_num_to_pos.seekp( sizeof(e) * int64_t(block_header::num_from_id(id)) );
-      _block_num_to_pos.write( (char*)&e, sizeof(e) );
-   }
 } FC_CAPTURE_AND_RETHROW( (id) ) }
 
+optional<index_entry> block_database::read_index_entry( uint32_t block_num )const
+{
+   read_lock lock( _mutex );
+   if( block_num >= _index_end )
+      return optional<index_entry>();
+   return entry_at( block_num );
+}
+
+optional<signed_block> block_database::read_block( const index_entry& e )const
+{
+   const uint64_t pos = e.block_pos.value();
+   const uint64_t size = e.block_size.value();
+   if( size == 0 )
+      return optional<signed_block>();
+
+   region_ptr segment;
+   vector<char> spanning;
+   {
+      read_lock lock( _mutex );
+      if( pos + size > _data_end )
+         return optional<signed_block>();
+      if( pos % data_segment_size + size <= data_segment_size )
+         segment = _data_segments[ pos / data_segment_size ];
+      else
+      {
+         // only blocks written by the former stream-based implementation can cross a segment boundary
+         spanning.resize( size );
+         uint64_t p = pos;
+         for( size_t done = 0; done < size; )
+         {
+            const uint64_t offset = p % data_segment_size;
+            const size_t len = std::min<uint64_t>( size - done, data_segment_size - offset );
+            memcpy( spanning.data() + done,
+                    static_cast<const char*>( _data_segments[ p / data_segment_size ]->get_address() ) + offset,
+                    len );
+            p += len;
+            done += len;
+         }
+      }
+   }
+
+   // The segment is kept alive by the shared pointer, so unpacking happens outside of the lock
+   const char* data = segment ? static_cast<const char*>( segment->get_address() ) + pos % data_segment_size
+                              : spanning.data();
+   fc::datastream<const char*> ds( data, size );
+   signed_block result;
+   fc::raw::unpack( ds, result );
+   return result;
+}
+
 bool block_database::contains( const block_id_type& id )const
 {
    if( id == block_id_type() )
       return false;
 
-   index_entry e;
-   int64_t index_pos = sizeof(e) * int64_t(block_header::num_from_id(id));
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() < int64_t(index_pos + sizeof(e)) )
-      return false;
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-   return e.block_id == id && e.block_size.value() > 0;
+   const optional<index_entry> e = read_index_entry( block_header::num_from_id(id) );
+   return e.valid() && e->block_id == id && e->block_size.value() > 0;
 }
 
 block_id_type block_database::fetch_block_id( uint32_t block_num )const
 {
    assert( block_num != 0 );
-   index_entry e;
-   int64_t index_pos = sizeof(e) * int64_t(block_num);
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= index_pos )
+   const optional<index_entry> e = read_index_entry( block_num );
+   if( !e.valid() )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block number ${block_num} not contained in block database", ("block_num", block_num));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-   FC_ASSERT( e.block_id != block_id_type(), "Empty block_id in block_database (maybe corrupt on disk?)" );
-   return e.block_id;
+   FC_ASSERT( e->block_id != block_id_type(), "Empty block_id in block_database (maybe corrupt on disk?)" );
+   return e->block_id;
 }
 
 optional<signed_block> block_database::fetch_optional( const block_id_type& id )const
 {
    try
    {
-      index_entry e;
-      int64_t index_pos = sizeof(e) * int64_t(block_header::num_from_id(id));
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( _block_num_to_pos.tellg() <= index_pos )
-         return {};
-
-      _block_num_to_pos.seekg( index_pos );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-      if( e.block_id != id ) return optional<signed_block>();
-
-      vector<char> data( e.block_size.value() );
-      _blocks.seekg( e.block_pos.value() );
-      if (e.block_size.value())
-         _blocks.read( data.data(), e.block_size.value() );
-      auto result = fc::raw::unpack<signed_block>(data);
-      FC_ASSERT( result.id() == e.block_id );
-      return result;
+      const uint32_t block_num = block_header::num_from_id(id);
+      const optional<index_entry> e = read_index_entry( block_num );
+      if( !e.valid() || e->block_id != id )
+         return optional<signed_block>();
+
+      optional<signed_block> result = read_block( *e );
+      // the index entry carries the block id, so a cheap consistency check replaces re-hashing the block
+      if( result.valid() && result->block_num() == block_num )
+         return result;
    }
    catch (const fc::exception&)
    {
@@ -185,21 +357,13 @@ optional<signed_block> block_database::fetch_by_number( uint32_t block_num )cons
 {
    try
    {
-      index_entry e;
-      int64_t index_pos = sizeof(e) * int64_t(block_num);
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( _block_num_to_pos.tellg() <= index_pos )
-         return {};
-
-      _block_num_to_pos.seekg( index_pos, _block_num_to_pos.beg );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-      vector<char> data( e.block_size.value() );
-      _blocks.seekg( e.block_pos.value() );
-      _blocks.read( data.data(), e.block_size.value() );
-      auto result = fc::raw::unpack<signed_block>(data);
-      FC_ASSERT( result.id() == e.block_id );
-      return result;
+      const optional<index_entry> e = read_index_entry( block_num );
+      if( !e.valid() || block_header::num_from_id( e->block_id ) != block_num )
+         return optional<signed_block>();
+
+      optional<signed_block> result = read_block( *e );
+      if( result.valid() && result->block_num() == block_num )
+         return result;
    }
    catch (const fc::exception&)
    {
@@ -210,53 +374,26 @@ optional<signed_block> block_database::fetch_by_number( uint32_t block_num )cons
    return optional<signed_block>();
 }
 
-optional<index_entry> block_database::last_index_entry()const {
-   try
-   {
-      index_entry e;
-
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      std::streampos pos = _block_num_to_pos.tellg();
-      if( pos < long(sizeof(index_entry)) )
-         return optional<index_entry>();
-
-      pos -= pos % sizeof(index_entry);
+optional<block_database::block_extent> block_database::fetch_extent( uint32_t block_num )const
+{
+   const optional<index_entry> e = read_index_entry( block_num );
+   if( !e.valid() || e->block_size.value() == 0 || block_header::num_from_id( e->block_id ) != block_num )
+      return optional<block_extent>();
+   block_extent result;
+   result.position = e->block_pos.value();
+   result.size = e->block_size.value();
+   return result;
+}
 
-      _blocks.seekg( 0, _block_num_to_pos.end );
-      const std::streampos blocks_size = _blocks.tellg();
-      while( pos > 0 )
-      {
-         pos -= sizeof(index_entry);
-         _block_num_to_pos.seekg( pos );
-         _block_num_to_pos.read( (char*)&e, sizeof(e) );
-         if( _block_num_to_pos.gcount() == sizeof(e) && e.block_size.value() > 0
-                && int64_t(e.block_pos.value() + e.block_size.value()) <= blocks_size )
-            try
-            {
-               vector<char> data( e.block_size.value() );
-               _blocks.seekg( e.block_pos.value() );
-               _blocks.read( data.data(), e.block_size.value() );
-               if( _blocks.gcount() == long(e.block_size.value()) )
-               {
-                  const signed_block block = fc::raw::unpack<signed_block>(data);
-                  if( block.id() == e.block_id )
-                     return e;
-               }
-            }
-            catch (const fc::exception&)
-            {
-            }
-            catch (const std::exception&)
-            {
-            }
-         fc::resize_file( _index_filename, pos );
-      }
-   }
-   catch (const fc::exception&)
-   {
-   }
-   catch (const std::exception&)
+optional<index_entry> block_database::last_index_entry()const
+{
+   read_lock lock( _mutex );
+   // open() has already dropped unusable entries from the end, only removed blocks need to be skipped
+   for( uint64_t num = _index_end; num > 0; --num )
    {
+      const index_entry& e = entry_at( num - 1 );
+      if( e.block_size.value() > 0 && e.block_pos.value() + e.block_size.value() <= _data_end )
+         return e;
    }
    return optional<index_entry>();
 }
@@ -275,15 +412,10 @@ optional<block_id_type> block_database::last_id()const
    return optional<block_id_type>();
 }
 
-size_t block_database::blocks_current_position()const
-{
-   return (size_t)_blocks.tellg();
-}
-
 size_t block_database::total_block_size()const
 {
-   _blocks.seekg( 0, _blocks.end );
-   return (size_t)_blocks.tellg();
+   read_lock lock( _mutex );
+   return (size_t)_data_end;
 }
 
 } }
@@ -5,6 +5,7 @@
 #include <graphene/chain/hardfork.hpp>
 
 #include <graphene/chain/block_summary_object.hpp>
+#include <graphene/chain/custom_authority_object.hpp>
 #include <graphene/chain/global_property_object.hpp>
 #include <graphene/chain/operation_history_object.hpp>
 
@@ -20,6 +21,10 @@
 #include <fc/io/raw.hpp>
 #include <fc/thread/parallel.hpp>
 
+#include <algorithm>
+#include <future>
+#include <limits>
+
 namespace graphene { namespace chain {
 
 bool database::is_known_block( const block_id_type& id )const
@@ -47,24 +52,44 @@ optional<signed_block> database::fetch_block_by_id( const block_id_type& id )con
    auto b = _fork_db.fetch_block( id );
    if( !b )
       return _block_id_to_block.fetch_optional(id);
-   return b->data;
+   return *b->data;
 }
 
 optional<signed_block> database::fetch_block_by_number( uint32_t num )const
 {
    auto results = _fork_db.fetch_block_by_number(num);
    if( results.size() == 1 )
-      return results[0]->data;
+      return *results[0]->data;
    else
       return _block_id_to_block.fetch_by_number(num);
 }
 
-const signed_transaction& database::get_recent_transaction(const transaction_id_type& trx_id) const
+signed_transaction database::get_recent_transaction(const transaction_id_type& trx_id) const
 {
    auto& index = get_index_type<transaction_index>().indices().get<by_trx_id>();
    auto itr = index.find(trx_id);
    FC_ASSERT(itr != index.end());
-   return itr->trx;
+   if( itr->block_num != 0 )
+   {
+      optional<signed_block> block = fetch_block_by_number( itr->block_num );
+      if( block.valid() && itr->trx_in_block < block->transactions.size()
+            && block->transactions[itr->trx_in_block].id() == trx_id )
+         return std::move( block->transactions[itr->trx_in_block] );
+   }
+   else if( const processed_transaction* trx = _find_pending_transaction( trx_id, itr->trx_in_block ) )
+      return *trx;
+   FC_THROW( "Transaction ${id} is known but could not be found in its block or the pending transactions",
+             ("id", trx_id) );
+}
+
+const processed_transaction* database::_find_pending_transaction( const transaction_id_type& trx_id,
+                                                                uint16_t position )const
+{
+   // the position was truncated to 16 bits, so in a very long pending list it may be any of these
+   for( size_t i = position; i < _pending_tx.size(); i += size_t( std::numeric_limits<uint16_t>::max() ) + 1 )
+      if( _pending_tx[i].id() == trx_id )
+         return &_pending_tx[i];
+   return nullptr;
 }
 
 std::vector<block_id_type> database::get_block_ids_on_fork(block_id_type head_of_fork) const
@@ -122,17 +147,17 @@ bool database::_push_block(const signed_block& new_block)
 
    const shared_ptr<fork_item> new_head = _fork_db.push_block(new_block);
    //If the head block from the longest chain does not build off of the current head, we need to switch forks.
-   if( new_head->data.previous != head_block_id() )
+   if( new_head->previous_id() != head_block_id() )
    {
       //If the newly pushed block is the same height as head, we get head back in new_head
       //Only switch forks if new_head is actually higher than head
-      if( new_head->data.block_num() > head_block_num() )
+      if( new_head->num > head_block_num() )
       {
-         wlog( "Switching to fork: ${id}", ("id",new_head->data.id()) );
-         auto branches = _fork_db.fetch_branch_from(new_head->data.id(), head_block_id());
+         wlog( "Switching to fork: ${id}", ("id",new_head->id) );
+         auto branches = _fork_db.fetch_branch_from(new_head->id, head_block_id());
 
          // pop blocks until we hit the forked block
-         while( head_block_id() != branches.second.back()->data.previous )
+         while( head_block_id() != branches.second.back()->previous_id() )
          {
             ilog( "popping block #${n} ${id}", ("n",head_block_num())("id",head_block_id()) );
             pop_block();
@@ -141,13 +166,13 @@ bool database::_push_block(const signed_block& new_block)
          // push all blocks on the new fork
          for( auto ritr = branches.first.rbegin(); ritr != branches.first.rend(); ++ritr )
          {
-               ilog( "pushing block from fork #${n} ${id}", ("n",(*ritr)->data.block_num())("id",(*ritr)->id) );
+               ilog( "pushing block from fork #${n} ${id}", ("n",(*ritr)->num)("id",(*ritr)->id) );
                optional<fc::exception> except;
                try {
                   undo_database::session session = _undo_db.start_undo_session();
-                  apply_block( (*ritr)->data, skip );
+                  apply_block( *(*ritr)->data, skip );
                   update_witnesses( **ritr );
-                  _block_id_to_block.store( (*ritr)->id, (*ritr)->data );
+                  _block_id_to_block.store( (*ritr)->id, *(*ritr)->data );
                   session.commit();
                }
                catch ( const fc::exception& e ) { except = e; }
@@ -157,27 +182,27 @@ bool database::_push_block(const signed_block& new_block)
                   // remove the rest of branches.first from the fork_db, those blocks are invalid
                   while( ritr != branches.first.rend() )
                   {
-                     ilog( "removing block from fork_db #${n} ${id}", ("n",(*ritr)->data.block_num())("id",(*ritr)->id) );
+                     ilog( "removing block from fork_db #${n} ${id}", ("n",(*ritr)->num)("id",(*ritr)->id) );
                      _fork_db.remove( (*ritr)->id );
                      ++ritr;
                   }
                   _fork_db.set_head( branches.second.front() );
 
                   // pop all blocks from the bad fork
-                  while( head_block_id() != branches.second.back()->data.previous )
+                  while( head_block_id() != branches.second.back()->previous_id() )
                   {
                      ilog( "popping block #${n} ${id}", ("n",head_block_num())("id",head_block_id()) );
                      pop_block();
                   }
 
-                  ilog( "Switching back to fork: ${id}", ("id",branches.second.front()->data.id()) );
+                  ilog( "Switching back to fork: ${id}", ("id",branches.second.front()->id) );
                   // restore all blocks from the good fork
                   for( auto ritr2 = branches.second.rbegin(); ritr2 != branches.second.rend(); ++ritr2 )
                   {
-                     ilog( "pushing block #${n} ${id}", ("n",(*ritr2)->data.block_num())("id",(*ritr2)->id) );
+                     ilog( "pushing block #${n} ${id}", ("n",(*ritr2)->num)("id",(*ritr2)->id) );
                      auto session = _undo_db.start_undo_session();
-                     apply_block( (*ritr2)->data, skip );
-                     _block_id_to_block.store( (*ritr2)->id, (*ritr2)->data );
+                     apply_block( *(*ritr2)->data, skip );
+                     _block_id_to_block.store( (*ritr2)->id, *(*ritr2)->data );
                      session.commit();
                   }
                   throw *except;
@@ -267,8 +292,20 @@ processed_transaction database::_push_transaction( const precomputable_transacti
    // apply the changes.
 
    auto temp_session = _undo_db.start_undo_session();
-   auto processed_trx = _apply_transaction( trx );
+   // Remember what the authority check read, so the transaction can skip it when restored after a block
+   authority_reads reads;
+   processed_transaction processed_trx;
+   _current_authority_reads = &reads;
+   try {
+      processed_trx = _apply_transaction( trx );
+   } catch( ... ) {
+      _current_authority_reads = nullptr;
+      throw;
+   }
+   _current_authority_reads = nullptr;
    _pending_tx.push_back(processed_trx);
+   if( !(get_node_properties().skip_flags & skip_transaction_signatures) )
+      _pending_authority_reads[ processed_trx.id() ] = std::move( reads );
 
    // notify_changed_objects();
    // The transaction applied successfully. Merge its changes into the pending block session.
@@ -481,9 +518,88 @@ void database::pop_block()
       FC_ASSERT( fork_db_head, "Trying to pop() block that's not in fork database!?" );
    }
    pop_undo();
-   _popped_tx.insert( _popped_tx.begin(), fork_db_head->data.transactions.begin(), fork_db_head->data.transactions.end() );
+   _popped_tx.insert( _popped_tx.begin(), fork_db_head->data->transactions.begin(), fork_db_head->data->transactions.end() );
 } FC_CAPTURE_AND_RETHROW() }
 
+void database::_restore_pending_transactions( std::vector<processed_transaction>&& pending,
+                                             const block_id_type& prior_head )
+{
+   auto prior_reads = std::move( _pending_authority_reads );
+   _pending_authority_reads.clear();
+
+   // Authority checks can only be reused if the state they read moved forward by a single block, whose changes are
+   // then the newest session on the undo stack
+   bool reuse_authority_checks = false;
+   flat_set<account_id_type> changed_accounts;
+   if( _popped_tx.empty() && !prior_reads.empty() && _undo_db.enabled() && _undo_db.size() > 0
+         && head_block_num() > 0 && head_block_id() != prior_head )
+   {
+      auto head = _fork_db.fetch_block( head_block_id() );
+      if( head && head->previous_id() == prior_head )
+      {
+         reuse_authority_checks = true;
+         const undo_state& changes = _undo_db.head();
+         auto note_change = [&]( const object_id_type& id, const object* old_value ) {
+            if( id.space() != protocol_ids )
+            {
+               if( id.is<global_property_id_type>() )
+                  reuse_authority_checks = false; // e.g. a new max_authority_depth
+               return;
+            }
+            if( id.is<account_id_type>() )
+               changed_accounts.insert( account_id_type( id ) );
+            else if( id.is<custom_authority_id_type>() )
+            {
+               const object* obj = old_value != nullptr ? old_value : find_object( id );
+               if( obj != nullptr )
+                  changed_accounts.insert( static_cast<const custom_authority_object*>( obj )->account );
+            }
+         };
+         for( const auto& item : changes.old_values )
+            note_change( item.first, item.second );
+         for( const auto& item : changes.removed )
+            note_change( item.first, item.second );
+         for( const auto& id : changes.new_ids )
+            note_change( id, nullptr );
+      }
+   }
+
+   const fc::time_point_sec now = head_block_time();
+   auto restore = [&]( const precomputable_transaction& tx ) {
+      // Expired and included transactions would be rejected anyway, drop them before doing any work
+      if( tx.expiration < now || is_known_transaction( tx.id() ) )
+         return;
+      try {
+         auto itr = reuse_authority_checks ? prior_reads.find( tx.id() ) : prior_reads.end();
+         bool unaffected = itr != prior_reads.end() && !itr->second.uses_custom_authorities;
+         if( unaffected )
+            for( const auto& account : itr->second.accounts )
+               if( changed_accounts.find( account ) != changed_accounts.end() )
+               {
+                  unaffected = false;
+                  break;
+               }
+         if( unaffected )
+         {
+            detail::with_skip_flags( *this, get_node_properties().skip_flags | skip_transaction_signatures, [&]()
+            {
+               _push_transaction( tx );
+            });
+            _pending_authority_reads[ tx.id() ] = std::move( itr->second );
+         }
+         else
+            _push_transaction( tx );
+      } catch( const fc::exception& ) { // ignore invalid transactions
+      }
+   };
+
+   for( const auto& tx : _popped_tx )
+      restore( tx );
+   _popped_tx.clear();
+   for( const processed_transaction& tx : pending )
+      restore( tx );
+}
+
 void database::clear_pending()
 { try {
    assert( (_pending_tx.size() == 0) || _pending_tx_session.valid() );
@@ -544,6 +660,36 @@ void database::apply_block( const signed_block& next_block, uint32_t skip )
    return;
 }
 
+template< typename Step >
+void database::_run_housekeeping( housekeeping_step step, Step&& run )
+{
+   const fc::time_point start = fc::time_point::now();
+   run();
+   const fc::microseconds elapsed = fc::time_point::now() - start;
+   housekeeping_timing& timing = _housekeeping_timings[step];
+   ++timing.blocks;
+   timing.total += elapsed;
+   if( elapsed > timing.longest )
+      timing.longest = elapsed;
+}
+
+const char* database::housekeeping_step_name( housekeeping_step step )
+{
+   switch( step )
+   {
+      case housekeeping_tickets:              return "tickets";
+      case housekeeping_expired_transactions: return "expired transactions";
+      case housekeeping_expired_proposals:    return "expired proposals";
+      case housekeeping_expired_orders:       return "expired orders";
+      case housekeeping_expired_htlcs:        return "expired htlcs";
+      case housekeeping_expired_feeds:        return "expired feeds";
+      case housekeeping_core_exchange_rates:  return "core exchange rates";
+      case housekeeping_withdraw_permissions: return "withdraw permissions";
+      case housekeeping_witness_schedule:     return "witness schedule";
+      default:                                return "unknown";
+   }
+}
+
 void database::_apply_block( const signed_block& next_block )
 { try {
    uint32_t next_block_num = next_block.block_num();
@@ -576,6 +722,16 @@ void database::_apply_block( const signed_block& next_block )
    _current_block_num    = next_block_num;
    _current_trx_in_block = 0;
 
+   // Optimistically check authorities in parallel, then redo the checks invalidated by earlier transactions
+   vector< optional<authority_reads> > checked;
+   std::unique_ptr<write_tracker> account_writes;
+   if( _parallel_block_checks && !(skip & skip_transaction_signatures) && next_block.transactions.size() > 1 )
+   {
+      checked = _check_block_authorities( next_block );
+      account_writes = std::make_unique<write_tracker>( *this );
+      account_writes->watch<account_object>();
+   }
+
    for( const auto& trx : next_block.transactions )
    {
       /* We do not need to push the undo state for each transaction
@@ -584,9 +740,18 @@ void database::_apply_block( const signed_block& next_block )
        * for transactions when validating broadcast transactions or
        * when building a block.
        */
-      apply_transaction( trx, skip );
+      uint32_t trx_skip = skip;
+      if( !checked.empty() && checked[_current_trx_in_block].valid() )
+      {
+         const auto& accounts = checked[_current_trx_in_block]->accounts;
+         if( std::none_of( accounts.begin(), accounts.end(),
+                           [&account_writes]( account_id_type id ) { return account_writes->written( id ); } ) )
+            trx_skip |= skip_transaction_signatures;
+      }
+      apply_transaction( trx, trx_skip );
       ++_current_trx_in_block;
    }
+   account_writes.reset();
 
    _current_op_in_trx    = 0;
    _current_virtual_op   = 0;
@@ -596,20 +761,22 @@ void database::_apply_block( const signed_block& next_block )
    update_signing_witness(signing_witness, next_block);
    update_last_irreversible_block();
 
-   process_tickets();
+   _run_housekeeping( housekeeping_tickets, [this] { process_tickets(); } );
 
    // Are we at the maintenance interval?
    if( maint_needed )
       perform_chain_maintenance(next_block, global_props);
 
    create_block_summary(next_block);
-   clear_expired_transactions();
-   clear_expired_proposals();
-   clear_expired_orders();
-   clear_expired_htlcs();
-   update_expired_feeds();       // this will update expired feeds and some core exchange rates
-   update_core_exchange_rates(); // this will update remaining core exchange rates
-   update_withdraw_permissions();
+   _run_housekeeping( housekeeping_expired_transactions, [this] { clear_expired_transactions(); } );
+   _run_housekeeping( housekeeping_expired_proposals, [this] { clear_expired_proposals(); } );
+   _run_housekeeping( housekeeping_expired_orders, [this] { clear_expired_orders(); } );
+   _run_housekeeping( housekeeping_expired_htlcs, [this] { clear_expired_htlcs(); } );
+   // this will update expired feeds and some core exchange rates
+   _run_housekeeping( housekeeping_expired_feeds, [this] { update_expired_feeds(); } );
+   // this will update remaining core exchange rates
+   _run_housekeeping( housekeeping_core_exchange_rates, [this] { update_core_exchange_rates(); } );
+   _run_housekeeping( housekeeping_withdraw_permissions, [this] { update_withdraw_permissions(); } );
 
    // n.b., update_maintenance_flag() happens this late
    // because get_slot_time() / get_slot_at_time() is needed above
@@ -617,7 +784,7 @@ void database::_apply_block( const signed_block& next_block )
    // update_global_dynamic_data() as perhaps these methods only need
    // to be called for header validation?
    update_maintenance_flag( maint_needed );
-   update_witness_schedule();
+   _run_housekeeping( housekeeping_witness_schedule, [this] { update_witness_schedule(); } );
    if( !_node_property_object.debug_updates.empty() )
       apply_debug_updates();
 
@@ -635,19 +802,95 @@ processed_transaction database::apply_transaction(const signed_transaction& trx,
    processed_transaction result;
    detail::with_skip_flags( *this, skip, [&]()
    {
-      result = _apply_transaction(trx);
+      result = _apply_transaction(trx, true);
    });
    return result;
 }
 
-processed_transaction database::_apply_transaction(const signed_transaction& trx)
+void database::_verify_authority( const signed_transaction& trx, authority_reads* reads,
+                                  bool with_custom_authorities )const
+{
+   bool allow_non_immediate_owner = true;
+   auto get_active = [this,reads]( account_id_type id ) {
+      if( reads != nullptr )
+         reads->accounts.insert( id );
+      return &id(*this).active;
+   };
+   auto get_owner  = [this,reads]( account_id_type id ) {
+      if( reads != nullptr )
+         reads->accounts.insert( id );
+      return &id(*this).owner;
+   };
+   auto get_custom = [this,reads,with_custom_authorities]( account_id_type id, const operation& op,
+                                                           rejected_predicate_map* rejects ) {
+      // custom authority objects cache their predicates on first use, so they are not touched from worker threads
+      if( !with_custom_authorities )
+         return vector<authority>();
+      auto viable = get_viable_custom_authorities(id, op, rejects);
+      if( reads != nullptr && !viable.empty() )
+         reads->uses_custom_authorities = true;
+      return viable;
+   };
+
+   trx.verify_authority(get_chain_id(), get_active, get_owner, get_custom, allow_non_immediate_owner,
+                        false, get_global_properties().parameters.max_authority_depth);
+}
+
+vector< optional<database::authority_reads> > database::_check_block_authorities( const signed_block& block )const
+{
+   vector< optional<authority_reads> > results( block.transactions.size() );
+   _run_on_workers( block.transactions.size(), [this,&block,&results]( size_t begin, size_t end ) {
+      for( size_t i = begin; i < end; ++i )
+      {
+         authority_reads reads;
+         try {
+            _verify_authority( block.transactions[i], &reads, false );
+            results[i] = std::move( reads );
+         } catch( ... ) { // checked again when the transaction is applied
+         }
+      }
+   });
+   return results;
+}
+
+void database::_run_on_workers( size_t count, const std::function<void(size_t,size_t)>& work )const
+{
+   if( count == 0 )
+      return;
+   const size_t chunks = std::min<size_t>( fc::asio::default_io_service_scope::get_num_threads(), count );
+   const size_t chunk_size = ( count + chunks - 1 ) / chunks;
+
+   std::vector< std::promise<void> > finished( chunks );
+   std::vector< std::future<void> > waits;
+   waits.reserve( chunks );
+   for( auto& done : finished )
+      waits.push_back( done.get_future() );
+   for( size_t chunk = 0; chunk < chunks; ++chunk )
+   {
+      fc::do_parallel( [&work,&finished,chunk,chunk_size,count] () {
+         try {
+            work( chunk * chunk_size, std::min( count, ( chunk + 1 ) * chunk_size ) );
+            finished[chunk].set_value();
+         } catch( ... ) {
+            finished[chunk].set_exception( std::current_exception() );
+         }
+      });
+   }
+   // Block this thread rather than waiting on fc futures: no other task may run here and modify the state while
+   // the workers are reading it
+   for( auto& wait : waits )
+      wait.wait();
+   for( auto& wait : waits )
+      wait.get();
+}
+
+processed_transaction database::_apply_transaction(const signed_transaction& trx, bool in_block)
 { try {
    uint32_t skip = get_node_properties().skip_flags;
 
    trx.validate();
 
    auto& trx_idx = get_mutable_index_type<transaction_index>();
-   const chain_id_type& chain_id = get_chain_id();
    if( !(skip & skip_transaction_dupe_check) )
    {
       GRAPHENE_ASSERT( trx_idx.indices().get<by_trx_id>().find(trx.id()) == trx_idx.indices().get<by_trx_id>().end(),
@@ -660,17 +903,7 @@ processed_transaction database::_apply_transaction(const signed_transaction& trx
    eval_state._trx = &trx;
 
    if( !(skip & skip_transaction_signatures) )
-   {
-      bool allow_non_immediate_owner = true;
-      auto get_active = [this]( account_id_type id ) { return &id(*this).active; };
-      auto get_owner  = [this]( account_id_type id ) { return &id(*this).owner;  };
-      auto get_custom = [this]( account_id_type id, const operation& op, rejected_predicate_map* rejects ) {
-         return get_viable_custom_authorities(id, op, rejects);
-      };
-
-      trx.verify_authority(chain_id, get_active, get_owner, get_custom, allow_non_immediate_owner,
-                           false, get_global_properties().parameters.max_authority_depth);
-   }
+      _verify_authority( trx, _current_authority_reads, true );
 
    //Skip all manner of expiration and TaPoS checking if we're on block 1; It's impossible that the transaction is
    //expired, and TaPoS makes no sense as no blocks exist.
@@ -697,9 +930,16 @@ processed_transaction database::_apply_transaction(const signed_transaction& trx
    //Insert transaction into unique transactions database.
    if( !(skip & skip_transaction_dupe_check) )
    {
-      create<transaction_history_object>([&trx](transaction_history_object& transaction) {
+      create<transaction_history_object>([this,&trx,in_block](transaction_history_object& transaction) {
          transaction.trx_id = trx.id();
-         transaction.trx = trx;
+         transaction.expiration = trx.expiration;
+         if( in_block )
+         {
+            transaction.block_num = _current_block_num;
+            transaction.trx_in_block = _current_trx_in_block;
+         }
+         else // where _push_transaction() is going to add it
+            transaction.trx_in_block = _pending_tx.size();
       });
    }
 
@@ -831,6 +1071,17 @@ fc::future<void> database::precompute_parallel( const signed_block& block, const
    return *first;
 } FC_LOG_AND_RETHROW() }
 
+void database::precompute_block( const signed_block& block, const uint32_t skip )const
+{ try {
+   if( !block.transactions.empty() )
+      _precompute_parallel( &block.transactions[0], block.transactions.size(), skip );
+   if( !(skip&skip_witness_signature) )
+      block.signee();
+   if( !(skip&skip_merkle_check) )
+      block.calculate_merkle_root();
+   block.id();
+} FC_LOG_AND_RETHROW() }
+
 fc::future<void> database::precompute_parallel( const precomputable_transaction& trx )const
 {
    return fc::do_parallel([this,&trx] () {
@@ -29,6 +29,12 @@
 
 #include <fc/uint128.hpp>
 
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
 namespace graphene { namespace chain {
 
 template<class Index>
@@ -37,6 +43,24 @@ vector<std::reference_wrapper<const typename Index::object_type>> database::sort
    using ObjectType = typename Index::object_type;
    const auto& all_objects = get_index_type<Index>().indices();
    count = std::min(count, all_objects.size());
+
+   // The kept tallies rank the objects as they are counted
+   if( _vote_tally_cache && _vote_tally_cache->valid )
+   {
+      const auto& by_vote = all_objects.template get<by_vote_id>();
+      vector<std::reference_wrapper<const ObjectType>> refs;
+      refs.reserve(count);
+      for( const auto& ranked : _vote_tally_cache->rank )
+      {
+         if( refs.size() == count )
+            break;
+         auto itr = by_vote.find( ranked.second );
+         if( itr != by_vote.end() )
+            refs.push_back( std::cref( *itr ) );
+      }
+      return refs;
+   }
+
    vector<std::reference_wrapper<const ObjectType>> refs;
    refs.reserve(all_objects.size());
    std::transform(all_objects.begin(), all_objects.end(),
@@ -79,6 +103,26 @@ void database::perform_account_maintenance(Type tally_helper)
    }
 
    const auto& stats_idx = get_index_type< account_stats_index >().indices().get< by_maintenance_seq >();
+
+   // Kept tallies are only counted again for the accounts that changed
+   if( _vote_tally_cache )
+   {
+      tally_helper.count_incrementally( *_vote_tally_cache, stats_idx );
+      return;
+   }
+
+   // With parallel tallying, the tallies are computed up front from the state before any fees are processed. Fees
+   // paid out in the loop below can change the stake of accounts counted after them, those tallies are redone.
+   std::unique_ptr<write_tracker> fee_writes;
+   if( _parallel_vote_tally )
+   {
+      tally_helper.precompute( stats_idx.lower_bound( true ), stats_idx.end() );
+      fee_writes = std::make_unique<write_tracker>( *this );
+      fee_writes->watch<account_object>();
+      fee_writes->watch<account_statistics_object>();
+      fee_writes->watch<vesting_balance_object>();
+   }
+
    auto stats_itr = stats_idx.lower_bound( true );
 
    while( stats_itr != stats_idx.end() )
@@ -88,12 +132,19 @@ void database::perform_account_maintenance(Type tally_helper)
       ++stats_itr;
 
       if( acc_stat.has_some_core_voting() )
-         tally_helper( acc_obj, acc_stat );
+      {
+         if( fee_writes )
+            tally_helper.visit( acc_obj, acc_stat, *fee_writes );
+         else
+            tally_helper( acc_obj, acc_stat );
+      }
 
       if( acc_stat.has_pending_fees() )
          acc_stat.process_fees( acc_obj, *this );
    }
 
+   if( fee_writes )
+      tally_helper.finish();
 }
 
 /// @brief A visitor for @ref worker_type which calls pay_worker on the worker within
@@ -974,6 +1025,19 @@ namespace detail {
          stake_to_subtract /= GRAPHENE_100_PERCENT;
          return stake - static_cast<uint64_t>(stake_to_subtract);
       }
+
+      // return the first time after now at which the stake recalced for last_vote_time can differ from now
+      time_point_sec get_next_recalc_time( const time_point_sec last_vote_time,
+                                           const vote_recalc_times& recalc_times, const time_point_sec now ) const
+      {
+         if( last_vote_time > recalc_times.full_power_time )
+            return last_vote_time + full_power_seconds;
+         if( last_vote_time <= recalc_times.zero_power_time )
+            return time_point_sec::maximum();
+         uint32_t diff = recalc_times.full_power_time.sec_since_epoch() - last_vote_time.sec_since_epoch();
+         uint32_t steps_to_subtract = diff / seconds_per_step + 1;
+         return now + ( steps_to_subtract * seconds_per_step - diff );
+      }
    };
 
    const vote_recalc_options vote_recalc_options::witness()
@@ -998,6 +1062,29 @@ namespace detail {
    }
 }
 
+void database::enable_incremental_vote_tally( bool enable, bool check )
+{
+   // destroy the old write tracker before creating a new one, trackers have to be unwound in order
+   if( _vote_tally_cache && _vote_tally_cache->rank_changes )
+   {
+      get_mutable_index<witness_object>().remove_observer( _vote_tally_cache->rank_changes );
+      get_mutable_index<committee_member_object>().remove_observer( _vote_tally_cache->rank_changes );
+   }
+   _vote_tally_cache.reset();
+   if( !enable )
+      return;
+
+   _vote_tally_cache = std::make_unique<vote_tally_cache>();
+   _vote_tally_cache->check = check;
+   _vote_tally_cache->writes = std::make_unique<write_tracker>( *this );
+   _vote_tally_cache->writes->watch<account_object>();
+   _vote_tally_cache->writes->watch<account_statistics_object>();
+   _vote_tally_cache->writes->watch<vesting_balance_object>();
+   _vote_tally_cache->rank_changes = std::make_shared<vote_tally_cache::rank_observer>();
+   get_mutable_index<witness_object>().add_observer( _vote_tally_cache->rank_changes );
+   get_mutable_index<committee_member_object>().add_observer( _vote_tally_cache->rank_changes );
+}
+
 void database::perform_chain_maintenance(const signed_block& next_block, const global_property_object& global_props)
 { try {
    const auto& gpo = get_global_properties();
@@ -1052,136 +1139,606 @@ void database::perform_chain_maintenance(const signed_block& next_block, const g
          */
       }
 
-      void operator()( const account_object& stake_account, const account_statistics_object& stats )
+      /// Stake an account adds to the tallies, see tally()
+      struct contribution
+      {
+         /// Opinions of the account specifying them
+         const flat_set<vote_id_type>* votes = nullptr;
+         uint16_t num_witness = 0;
+         uint16_t num_committee = 0;
+         uint64_t voting_stake[3]; // 0=committee, 1=witness, 2=worker, as in vote_id_type::vote_type
+         uint64_t num_committee_voting_stake; // number of committee members
+      };
+
+      /// Buffers the contributions are added to
+      struct tally_target
+      {
+         vector<uint64_t>& vote_tally;
+         vector<uint64_t>& witness_count_histogram;
+         vector<uint64_t>& committee_count_histogram;
+         uint64_t*         total_voting_stake; // 0=committee, 1=witness
+      };
+
+      /// Tallies of a range of accounts, summed up on a worker thread
+      struct partial_tally
+      {
+         vector<uint64_t> vote_tally;
+         vector<uint64_t> witness_count_histogram;
+         vector<uint64_t> committee_count_histogram;
+         uint64_t         total_voting_stake[2] = { 0, 0 };
+
+         tally_target target()
+         {
+            return { vote_tally, witness_count_histogram, committee_count_histogram, total_voting_stake };
+         }
+      };
+
+      /// Tally of an account computed by precompute()
+      struct precomputed_tally
+      {
+         const account_statistics_object* stats = nullptr;
+         optional<contribution>           result;
+         /// Objects the tally was computed from
+         std::array<object_id_type, 5>    inputs;
+         uint8_t                          input_count = 0;
+         bool                             visited = false;
+      };
+
+      vector<precomputed_tally>                                           precomputed;
+      std::unordered_map<const account_statistics_object*, size_t>       precomputed_index;
+
+      tally_target main_target()
+      {
+         return { d._vote_tally_buffer, d._witness_count_histogram_buffer, d._committee_count_histogram_buffer,
+                  d._total_voting_stake };
+      }
+
+      bool is_committee_member( account_id_type account )const
+      {
+         auto itr = std::lower_bound(committee_members.begin(), committee_members.end(), account);
+         return itr != committee_members.end() && *itr == account;
+      }
+
+      /// @return the stake @p stake_account adds to the tallies, if any; only reads the database
+      optional<contribution> tally( const account_object& stake_account, const account_statistics_object& stats )const
       {
          // PoB activation
          if( pob_activated && stats.total_core_pob == 0 && stats.total_core_inactive == 0 )
-            return;
-
-         if( props.parameters.count_non_member_votes || stake_account.is_member( now ) )
+            return {};
+
+         if( !( props.parameters.count_non_member_votes || stake_account.is_member( now ) ) )
+            return {};
+
+         // There may be a difference between the account whose stake is voting and the one specifying opinions.
+         // Usually they're the same, but if the stake account has specified a voting_account, that account is the
+         // one specifying the opinions.
+         bool directly_voting = ( stake_account.options.voting_account == GRAPHENE_PROXY_TO_SELF_ACCOUNT );
+         const account_object& opinion_account = ( directly_voting ? stake_account
+                                                   : d.get(stake_account.options.voting_account) );
+
+         contribution c;
+         c.votes = &opinion_account.options.votes;
+         c.num_witness = opinion_account.options.num_witness;
+         c.num_committee = opinion_account.options.num_committee;
+         uint64_t* voting_stake = c.voting_stake;
+         voting_stake[2] = ( pob_activated ? 0 : stats.total_core_in_orders.value )
+               + (stake_account.cashback_vb.valid() ? (*stake_account.cashback_vb)(d).balance.amount.value: 0)
+               + stats.core_in_balance.value;
+
+         //PoB
+         const uint64_t pol_amount = stats.total_core_pol.value;
+         const uint64_t pol_value = stats.total_pol_value.value;
+         const uint64_t pob_amount = stats.total_core_pob.value;
+         const uint64_t pob_value = stats.total_pob_value.value;
+         if( pob_amount == 0 )
+         {
+            voting_stake[2] += pol_value;
+         }
+         else if( pol_amount == 0 ) // and pob_amount > 0
          {
-            // There may be a difference between the account whose stake is voting and the one specifying opinions.
-            // Usually they're the same, but if the stake account has specified a voting_account, that account is the
-            // one specifying the opinions.
-            bool directly_voting = ( stake_account.options.voting_account == GRAPHENE_PROXY_TO_SELF_ACCOUNT );
-            const account_object& opinion_account = ( directly_voting ? stake_account
-                                                      : d.get(stake_account.options.voting_account) );
-
-            uint64_t voting_stake[3]; // 0=committee, 1=witness, 2=worker, as in vote_id_type::vote_type
-            uint64_t num_committee_voting_stake; // number of committee members
-            voting_stake[2] = ( pob_activated ? 0 : stats.total_core_in_orders.value )
-                  + (stake_account.cashback_vb.valid() ? (*stake_account.cashback_vb)(d).balance.amount.value: 0)
-                  + stats.core_in_balance.value;
-
-            //PoB
-            const uint64_t pol_amount = stats.total_core_pol.value;
-            const uint64_t pol_value = stats.total_pol_value.value;
-            const uint64_t pob_amount = stats.total_core_pob.value;
-            const uint64_t pob_value = stats.total_pob_value.value;
-            if( pob_amount == 0 )
+            if( pob_amount <= voting_stake[2] )
             {
-               voting_stake[2] += pol_value;
+               voting_stake[2] += ( pob_value - pob_amount );
             }
-            else if( pol_amount == 0 ) // and pob_amount > 0
+            else
             {
-               if( pob_amount <= voting_stake[2] )
-               {
-                  voting_stake[2] += ( pob_value - pob_amount );
-               }
-               else
-               {
-                  auto base_value = static_cast<fc::uint128_t>( voting_stake[2] ) * pob_value / pob_amount;
-                  voting_stake[2] = static_cast<uint64_t>( base_value );
-               }
+               auto base_value = static_cast<fc::uint128_t>( voting_stake[2] ) * pob_value / pob_amount;
+               voting_stake[2] = static_cast<uint64_t>( base_value );
             }
-            else if( pob_amount <= pol_amount ) // pob_amount > 0 && pol_amount > 0
+         }
+         else if( pob_amount <= pol_amount ) // pob_amount > 0 && pol_amount > 0
+         {
+            auto base_value = static_cast<fc::uint128_t>( pob_value ) * pol_value / pol_amount;
+            auto diff_value = static_cast<fc::uint128_t>( pob_amount ) * pol_value / pol_amount;
+            base_value += ( pol_value - diff_value );
+            voting_stake[2] += static_cast<uint64_t>( base_value );
+         }
+         else // pob_amount > pol_amount > 0
+         {
+            auto base_value = static_cast<fc::uint128_t>( pol_value ) * pob_value / pob_amount;
+            fc::uint128_t diff_amount = pob_amount - pol_amount;
+            if( diff_amount <= voting_stake[2] )
             {
-               auto base_value = static_cast<fc::uint128_t>( pob_value ) * pol_value / pol_amount;
-               auto diff_value = static_cast<fc::uint128_t>( pob_amount ) * pol_value / pol_amount;
-               base_value += ( pol_value - diff_value );
-               voting_stake[2] += static_cast<uint64_t>( base_value );
+               auto diff_value = static_cast<fc::uint128_t>( pol_amount ) * pob_value / pob_amount;
+               base_value += ( pob_value - diff_value );
+               voting_stake[2] += static_cast<uint64_t>( base_value - diff_amount );
             }
-            else // pob_amount > pol_amount > 0
+            else // diff_amount > voting_stake[2]
             {
-               auto base_value = static_cast<fc::uint128_t>( pol_value ) * pob_value / pob_amount;
-               fc::uint128_t diff_amount = pob_amount - pol_amount;
-               if( diff_amount <= voting_stake[2] )
-               {
-                  auto diff_value = static_cast<fc::uint128_t>( pol_amount ) * pob_value / pob_amount;
-                  base_value += ( pob_value - diff_value );
-                  voting_stake[2] += static_cast<uint64_t>( base_value - diff_amount );
-               }
-               else // diff_amount > voting_stake[2]
-               {
-                  base_value += static_cast<fc::uint128_t>( voting_stake[2] ) * pob_value / pob_amount;
-                  voting_stake[2] = static_cast<uint64_t>( base_value );
-               }
+               base_value += static_cast<fc::uint128_t>( voting_stake[2] ) * pob_value / pob_amount;
+               voting_stake[2] = static_cast<uint64_t>( base_value );
             }
+         }
+
+         // Shortcut
+         if( voting_stake[2] == 0 )
+            return {};
 
-            // Shortcut
-            if( voting_stake[2] == 0 )
-               return;
+         // Recalculate votes
+         if( !directly_voting )
+         {
+            voting_stake[2] = detail::vote_recalc_options::delegator().get_recalced_voting_stake(
+                                    voting_stake[2], stats.last_vote_time, *delegator_recalc_times );
+         }
+         const account_statistics_object& opinion_account_stats = ( directly_voting ? stats
+                                    : opinion_account.statistics( d ) );
+         voting_stake[1] = detail::vote_recalc_options::witness().get_recalced_voting_stake(
+                              voting_stake[2], opinion_account_stats.last_vote_time, *witness_recalc_times );
+         voting_stake[0] = detail::vote_recalc_options::committee().get_recalced_voting_stake(
+                              voting_stake[2], opinion_account_stats.last_vote_time, *committee_recalc_times );
+         c.num_committee_voting_stake = voting_stake[0];
+         if( opinion_account.num_committee_voted > 1 )
+            voting_stake[0] /= opinion_account.num_committee_voted;
+         voting_stake[2] = detail::vote_recalc_options::worker().get_recalced_voting_stake(
+                              voting_stake[2], opinion_account_stats.last_vote_time, *worker_recalc_times );
+         return c;
+      }
 
-            // Recalculate votes
-            if( !directly_voting )
+      /**
+       * Adds @p c to @p target, or takes it back out if @p negate is set
+       *
+       * When added, the worker votes of committee members are also recorded in the committee member buffers of the
+       * database. That only happens on the thread applying the block, because the order of supporters counts.
+       */
+      void add( const tally_target& target, account_id_type account, const contribution& c, bool negate )const
+      {
+         auto apply = [negate]( uint64_t& slot, uint64_t amount ) {
+            if( negate )
+               slot -= amount;
+            else
+               slot += amount;
+         };
+         const uint64_t* voting_stake = c.voting_stake;
+         const bool is_committee_members = !negate && is_committee_member( account );
+         for( vote_id_type id : *c.votes )
+         {
+            uint32_t offset = id.instance();
+            uint32_t type = std::min( id.type(), vote_id_type::vote_type::worker ); // cap the data
+            // if they somehow managed to specify an illegal offset, ignore it.
+            if( offset >= target.vote_tally.size()
+               || offset >= d._cm_vote_for_worker_buffer.size()
+               || offset >= d._cm_support_worker_buffer.size() )
+               continue;
+
+            if (is_committee_members && type == vote_id_type::vote_type::worker)
             {
-               voting_stake[2] = detail::vote_recalc_options::delegator().get_recalced_voting_stake(
-                                       voting_stake[2], stats.last_vote_time, *delegator_recalc_times );
+               // Add up only the committee members votes
+               d._cm_vote_for_worker_buffer[offset] += voting_stake[type];
+               d._cm_support_worker_buffer[offset].push_back(account);
             }
-            const account_statistics_object& opinion_account_stats = ( directly_voting ? stats
-                                       : opinion_account.statistics( d ) );
-            voting_stake[1] = detail::vote_recalc_options::witness().get_recalced_voting_stake(
-                                 voting_stake[2], opinion_account_stats.last_vote_time, *witness_recalc_times );
-            voting_stake[0] = detail::vote_recalc_options::committee().get_recalced_voting_stake(
-                                 voting_stake[2], opinion_account_stats.last_vote_time, *committee_recalc_times );
-            num_committee_voting_stake = voting_stake[0];
-            if( opinion_account.num_committee_voted > 1 )
-               voting_stake[0] /= opinion_account.num_committee_voted;
-            voting_stake[2] = detail::vote_recalc_options::worker().get_recalced_voting_stake(
-                                 voting_stake[2], opinion_account_stats.last_vote_time, *worker_recalc_times );
-
-            bool is_committee_members = false;
-            const account_id_type account = stake_account.id;
-            auto itr = std::lower_bound(committee_members.begin(), committee_members.end(), account);
-            if( itr != committee_members.end() && *itr == account ) is_committee_members = true;
-            for( vote_id_type id : opinion_account.options.votes )
-            {
-               uint32_t offset = id.instance();
-               uint32_t type = std::min( id.type(), vote_id_type::vote_type::worker ); // cap the data
-               // if they somehow managed to specify an illegal offset, ignore it.
-               if( offset >= d._vote_tally_buffer.size()
-                  || offset >= d._cm_vote_for_worker_buffer.size()
-                  || offset >= d._cm_support_worker_buffer.size() )
-                  continue;
 
-               if (is_committee_members && type == vote_id_type::vote_type::worker)
+            apply( target.vote_tally[offset], voting_stake[type] );
+         }
+
+         // votes for a number greater than maximum_witness_count are skipped here
+         if( voting_stake[1] > 0
+               && c.num_witness <= props.parameters.maximum_witness_count )
+         {
+            uint16_t offset = c.num_witness / 2;
+            apply( target.witness_count_histogram[offset], voting_stake[1] );
+         }
+         // votes for a number greater than maximum_committee_count are skipped here
+         if( c.num_committee_voting_stake > 0
+               && c.num_committee <= props.parameters.maximum_committee_count )
+         {
+            uint16_t offset = c.num_committee / 2;
+            apply( target.committee_count_histogram[offset], c.num_committee_voting_stake );
+         }
+
+         apply( target.total_voting_stake[0], c.num_committee_voting_stake );
+         apply( target.total_voting_stake[1], voting_stake[1] );
+      }
+
+      void operator()( const account_object& stake_account, const account_statistics_object& stats )
+      {
+         auto c = tally( stake_account, stats );
+         if( c.valid() )
+            add( main_target(), stake_account.id, *c, false );
+      }
+
+      /**
+       * Computes the tallies of the voting accounts in [begin, end) on the worker threads and adds them up
+       *
+       * Committee members are left to the maintenance loop. The objects each tally was computed from are recorded,
+       * so that visit() can redo tallies whose inputs were changed by the fees processed before the account.
+       */
+      template<typename Iterator>
+      void precompute( Iterator begin, Iterator end )
+      {
+         for( auto itr = begin; itr != end; ++itr )
+         {
+            if( !itr->has_some_core_voting() || is_committee_member( itr->owner ) )
+               continue;
+            precomputed_tally pre;
+            pre.stats = &*itr;
+            precomputed_index[pre.stats] = precomputed.size();
+            precomputed.push_back( std::move( pre ) );
+         }
+
+         std::mutex partials_mutex;
+         vector<partial_tally> partials;
+         d._run_on_workers( precomputed.size(), [this,&partials,&partials_mutex]( size_t first, size_t last ) {
+            partial_tally partial;
+            partial.vote_tally.resize( d._vote_tally_buffer.size(), 0 );
+            partial.witness_count_histogram.resize( d._witness_count_histogram_buffer.size(), 0 );
+            partial.committee_count_histogram.resize( d._committee_count_histogram_buffer.size(), 0 );
+            const tally_target target = partial.target();
+            for( size_t i = first; i < last; ++i )
+            {
+               precomputed_tally& pre = precomputed[i];
+               const account_object& stake_account = pre.stats->owner( d );
+               pre.inputs[pre.input_count++] = stake_account.id;
+               pre.inputs[pre.input_count++] = pre.stats->id;
+               if( stake_account.cashback_vb.valid() )
+                  pre.inputs[pre.input_count++] = *stake_account.cashback_vb;
+               if( stake_account.options.voting_account != GRAPHENE_PROXY_TO_SELF_ACCOUNT )
                {
-                  // Add up only the committee members votes
-                  d._cm_vote_for_worker_buffer[offset] += voting_stake[type];
-                  d._cm_support_worker_buffer[offset].push_back(account);
+                  const account_object* opinion = d.find( stake_account.options.voting_account );
+                  pre.inputs[pre.input_count++] = stake_account.options.voting_account;
+                  if( opinion != nullptr )
+                     pre.inputs[pre.input_count++] = opinion->statistics;
                }
+               pre.result = tally( stake_account, *pre.stats );
+               if( pre.result.valid() )
+                  add( target, stake_account.id, *pre.result, false );
+            }
+            std::lock_guard<std::mutex> guard( partials_mutex );
+            partials.push_back( std::move( partial ) );
+         });
+
+         for( const auto& partial : partials )
+            add_to_main( partial );
+      }
+
+      /// Adds the sums of a partial_tally or a vote_tally_cache to the database buffers
+      template<typename Sums>
+      void add_to_main( const Sums& sums )
+      {
+         // sums of unsigned integers do not depend on the order they are added in
+         const tally_target target = main_target();
+         for( size_t i = 0; i < sums.vote_tally.size(); ++i )
+            target.vote_tally[i] += sums.vote_tally[i];
+         for( size_t i = 0; i < sums.witness_count_histogram.size(); ++i )
+            target.witness_count_histogram[i] += sums.witness_count_histogram[i];
+         for( size_t i = 0; i < sums.committee_count_histogram.size(); ++i )
+            target.committee_count_histogram[i] += sums.committee_count_histogram[i];
+         target.total_voting_stake[0] += sums.total_voting_stake[0];
+         target.total_voting_stake[1] += sums.total_voting_stake[1];
+      }
+
+      /// Counts @p stake_account in the maintenance loop, reusing its precomputed tally if none of its inputs changed
+      void visit( const account_object& stake_account, const account_statistics_object& stats,
+                  const write_tracker& fee_writes )
+      {
+         auto itr = precomputed_index.find( &stats );
+         if( itr == precomputed_index.end() )
+         {
+            (*this)( stake_account, stats );
+            return;
+         }
+         precomputed_tally& pre = precomputed[itr->second];
+         pre.visited = true;
+         if( std::none_of( pre.inputs.begin(), pre.inputs.begin() + pre.input_count,
+                           [&fee_writes]( object_id_type id ) { return fee_writes.written( id ); } ) )
+            return;
+         if( pre.result.valid() )
+            add( main_target(), stake_account.id, *pre.result, true );
+         (*this)( stake_account, stats );
+      }
+
+      /// Takes back the precomputed tallies of accounts the maintenance loop did not count
+      void finish()
+      {
+         for( const auto& pre : precomputed )
+            if( !pre.visited && pre.result.valid() )
+               add( main_target(), pre.stats->owner, *pre.result, true );
+      }
+
+      static tally_target cache_target( vote_tally_cache& cache )
+      {
+         return { cache.vote_tally, cache.witness_count_histogram, cache.committee_count_histogram,
+                  cache.total_voting_stake };
+      }
+
+      static contribution contribution_of( const vote_tally_cache::entry& e )
+      {
+         contribution c;
+         c.votes = &e.votes;
+         c.num_witness = e.num_witness;
+         c.num_committee = e.num_committee;
+         std::copy( e.voting_stake, e.voting_stake + 3, c.voting_stake );
+         c.num_committee_voting_stake = e.num_committee_voting_stake;
+         return c;
+      }
+
+      /// Takes the entry of @p account, if any, out of @p cache
+      void forget( vote_tally_cache& cache, account_id_type account )const
+      {
+         auto itr = cache.entries.find( account );
+         if( itr == cache.entries.end() )
+            return;
+         const vote_tally_cache::entry& e = itr->second;
+         add( cache_target( cache ), account, contribution_of( e ), true );
+         for( object_id_type input : e.inputs )
+         {
+            auto dependents = cache.dependents.find( input );
+            dependents->second.erase( account );
+            if( dependents->second.empty() )
+               cache.dependents.erase( dependents );
+         }
+         if( e.valid_until != time_point_sec::maximum() )
+            cache.expirations.erase( std::make_pair( e.valid_until, account ) );
+         cache.entries.erase( itr );
+      }
+
+      /// Replaces the entry of @p stake_account in @p cache with @p c, as computed by tally()
+      void remember( vote_tally_cache& cache, const account_object& stake_account,
+                     const account_statistics_object& stats, const optional<contribution>& c )const
+      {
+         forget( cache, stake_account.id );
+         if( !c.valid() )
+            return;
+
+         vote_tally_cache::entry e;
+         e.votes = *c->votes;
+         e.num_witness = c->num_witness;
+         e.num_committee = c->num_committee;
+         std::copy( c->voting_stake, c->voting_stake + 3, e.voting_stake );
+         e.num_committee_voting_stake = c->num_committee_voting_stake;
+
+         // the objects tally() reads
+         const bool directly_voting = ( stake_account.options.voting_account == GRAPHENE_PROXY_TO_SELF_ACCOUNT );
+         const account_statistics_object& opinion_stats = ( directly_voting ? stats
+                                    : d.get( stake_account.options.voting_account ).statistics( d ) );
+         e.inputs.push_back( stake_account.id );
+         e.inputs.push_back( stats.id );
+         if( stake_account.cashback_vb.valid() )
+            e.inputs.push_back( *stake_account.cashback_vb );
+         if( !directly_voting )
+         {
+            e.inputs.push_back( stake_account.options.voting_account );
+            e.inputs.push_back( opinion_stats.id );
+         }
+
+         // voting power decays with the time since the last vote, and the stake of non-members stops counting
+         time_point_sec& until = e.valid_until;
+         if( !directly_voting )
+            until = std::min( until, detail::vote_recalc_options::delegator().get_next_recalc_time(
+                                        stats.last_vote_time, *delegator_recalc_times, now ) );
+         until = std::min( until, detail::vote_recalc_options::witness().get_next_recalc_time(
+                                     opinion_stats.last_vote_time, *witness_recalc_times, now ) );
+         until = std::min( until, detail::vote_recalc_options::committee().get_next_recalc_time(
+                                     opinion_stats.last_vote_time, *committee_recalc_times, now ) );
+         until = std::min( until, detail::vote_recalc_options::worker().get_next_recalc_time(
+                                     opinion_stats.last_vote_time, *worker_recalc_times, now ) );
+         if( !props.parameters.count_non_member_votes && !stake_account.is_lifetime_member() )
+            until = std::min( until, stake_account.membership_expiration_date + 1 );
+
+         add( cache_target( cache ), stake_account.id, contribution_of( e ), false );
+         for( object_id_type input : e.inputs )
+            cache.dependents[input].insert( stake_account.id );
+         if( until != time_point_sec::maximum() )
+            cache.expirations.emplace( until, stake_account.id );
+         cache.entries.emplace( stake_account.id, std::move( e ) );
+      }
+
+      /// Collects the accounts whose tallies may have changed with a write of the object @p id
+      void collect_affected( const vote_tally_cache& cache, object_id_type id,
+                             flat_set<account_id_type>& affected )const
+      {
+         if( id.is<account_id_type>() )
+            affected.insert( account_id_type( id ) );
+         else if( id.is<account_statistics_id_type>() )
+         {
+            const auto* stats = d.find<account_statistics_object>( id );
+            if( stats != nullptr )
+               affected.insert( stats->owner );
+         }
+         auto itr = cache.dependents.find( id );
+         if( itr != cache.dependents.end() )
+            affected.insert( itr->second.begin(), itr->second.end() );
+      }
+
+      /**
+       * Counts the votes using the tallies kept in @p cache, and processes pending fees
+       *
+       * Only the accounts that may have changed since the last maintenance interval are visited, in the order of
+       * @p stats_idx. Each is counted at the point where the full loop of perform_account_maintenance would count
+       * it, so fees processed before it are included exactly as they would be. The cache is counted in full when it
+       * is not valid, and also compared against a full count if its check flag is set.
+       */
+      template<typename Index>
+      void count_incrementally( vote_tally_cache& cache, const Index& stats_idx )
+      { try {
+         const auto& params = props.parameters;
+         const bool rebuild = !cache.valid || now < cache.tally_time || cache.pob_activated != pob_activated
+               || cache.count_non_member_votes != params.count_non_member_votes
+               || cache.maximum_witness_count != params.maximum_witness_count
+               || cache.maximum_committee_count != params.maximum_committee_count
+               || cache.vote_tally.size() > d._vote_tally_buffer.size();
+         const bool check = cache.check && !rebuild;
+         // whatever is written from here on is seen in the next maintenance interval
+         const auto written = cache.writes->take();
+
+         flat_set<account_id_type> changed;
+         if( rebuild )
+         {
+            cache.reset();
+            cache.pob_activated = pob_activated;
+            cache.count_non_member_votes = params.count_non_member_votes;
+            cache.maximum_witness_count = params.maximum_witness_count;
+            cache.maximum_committee_count = params.maximum_committee_count;
+            cache.witness_count_histogram.resize( d._witness_count_histogram_buffer.size(), 0 );
+            cache.committee_count_histogram.resize( d._committee_count_histogram_buffer.size(), 0 );
+         }
+         else
+         {
+            for( object_id_type id : written )
+               collect_affected( cache, id, changed );
+            for( auto itr = cache.expirations.begin(); itr != cache.expirations.end() && itr->first <= now; ++itr )
+               changed.insert( itr->second );
+            // former committee members are counted like everyone else again
+            changed.insert( cache.committee_members.begin(), cache.committee_members.end() );
+         }
+         cache.vote_tally.resize( d._vote_tally_buffer.size(), 0 );
+         changed.insert( committee_members.begin(), committee_members.end() );
+         cache.committee_members = flat_set<account_id_type>( committee_members.begin(), committee_members.end() );
+
+         // accounts to visit, by name
+         std::map<string, account_id_type> queue;
+         for( account_id_type account : changed )
+         {
+            const account_object* acc = d.find( account );
+            if( acc != nullptr )
+               queue.emplace( acc->name, account );
+            else
+               forget( cache, account );
+         }
+
+         partial_tally recount;
+         if( check )
+         {
+            recount.vote_tally.resize( cache.vote_tally.size(), 0 );
+            recount.witness_count_histogram.resize( cache.witness_count_histogram.size(), 0 );
+            recount.committee_count_histogram.resize( cache.committee_count_histogram.size(), 0 );
+         }
 
-               d._vote_tally_buffer[offset] += voting_stake[type];
+         // with a full count, also walk every account that needs maintenance, as perform_account_maintenance does
+         auto stats_itr = ( rebuild || check ) ? stats_idx.lower_bound( true ) : stats_idx.end();
+         while( true )
+         {
+            const account_statistics_object* stats = nullptr;
+            bool queued = false;
+            if( stats_itr != stats_idx.end() && ( queue.empty() || stats_itr->name <= queue.begin()->first ) )
+            {
+               stats = &*stats_itr;
+               ++stats_itr;
+               queued = ( !queue.empty() && queue.begin()->first == stats->name );
+               if( queued )
+                  queue.erase( queue.begin() );
             }
+            else if( !queue.empty() )
+            {
+               stats = &queue.begin()->second( d ).statistics( d );
+               queue.erase( queue.begin() );
+               queued = true;
+            }
+            else
+               break;
 
-            // votes for a number greater than maximum_witness_count are skipped here
-            if( voting_stake[1] > 0
-                  && opinion_account.options.num_witness <= props.parameters.maximum_witness_count )
+            const account_object& stake_account = stats->owner( d );
+            const string name = stats->name;
+            if( is_committee_member( stake_account.id ) )
+            {
+               forget( cache, stake_account.id );
+               if( stats->has_some_core_voting() )
+                  (*this)( stake_account, *stats );
+            }
+            else
             {
-               uint16_t offset = opinion_account.options.num_witness / 2;
-               d._witness_count_histogram_buffer[offset] += voting_stake[1];
+               optional<contribution> c;
+               if( stats->has_some_core_voting() )
+                  c = tally( stake_account, *stats );
+               if( check && c.valid() )
+                  add( recount.target(), stake_account.id, *c, false );
+               if( rebuild || queued )
+                  remember( cache, stake_account, *stats, c );
             }
-            // votes for a number greater than maximum_committee_count are skipped here
-            if( num_committee_voting_stake > 0
-                  && opinion_account.options.num_committee <= props.parameters.maximum_committee_count )
+
+            if( stats->has_pending_fees() )
             {
-               uint16_t offset = opinion_account.options.num_committee / 2;
-               d._committee_count_histogram_buffer[offset] += num_committee_voting_stake;
+               write_tracker fee_writes( d );
+               fee_writes.watch<account_object>();
+               fee_writes.watch<account_statistics_object>();
+               fee_writes.watch<vesting_balance_object>();
+               stats->process_fees( stake_account, d );
+               if( rebuild )
+                  continue;
+               // accounts after this one see the fees in their tallies
+               flat_set<account_id_type> affected;
+               for( object_id_type id : fee_writes.written() )
+                  collect_affected( cache, id, affected );
+               for( account_id_type account : affected )
+               {
+                  const account_object* acc = d.find( account );
+                  if( acc != nullptr && acc->name > name )
+                     queue.emplace( acc->name, account );
+               }
             }
+         }
 
-            d._total_voting_stake[0] += num_committee_voting_stake;
-            d._total_voting_stake[1] += voting_stake[1];
+         if( check )
+            FC_ASSERT( recount.vote_tally == cache.vote_tally
+                       && recount.witness_count_histogram == cache.witness_count_histogram
+                       && recount.committee_count_histogram == cache.committee_count_histogram
+                       && recount.total_voting_stake[0] == cache.total_voting_stake[0]
+                       && recount.total_voting_stake[1] == cache.total_voting_stake[1],
+                       "The kept vote tallies differ from a full count" );
+
+         add_to_main( cache );
+         cache.tally_time = now;
+         cache.valid = true;
+         update_rank( cache );
+      } catch( ... ) {
+         cache.valid = false;
+         throw;
+      } }
+
+      /// Brings the rank of witnesses and committee members in @p cache up to date with the final vote tally
+      void update_rank( vote_tally_cache& cache )const
+      {
+         const vector<uint64_t>& tally = d._vote_tally_buffer;
+         const auto& witnesses = d.get_index_type<witness_index>().indices();
+         const auto& committee = d.get_index_type<committee_member_index>().indices();
+         if( cache.rank_changes->changed || cache.ranked_votes.size() != tally.size() )
+         {
+            cache.rank.clear();
+            for( const witness_object& wit : witnesses )
+               cache.rank.emplace( tally[wit.vote_id], wit.vote_id );
+            for( const committee_member_object& cm : committee )
+               cache.rank.emplace( tally[cm.vote_id], cm.vote_id );
+            cache.rank_changes->changed = false;
+         }
+         else
+         {
+            const auto& witnesses_by_vote = witnesses.get<by_vote_id>();
+            const auto& committee_by_vote = committee.get<by_vote_id>();
+            for( uint32_t offset = 0; offset < tally.size(); ++offset )
+            {
+               if( tally[offset] == cache.ranked_votes[offset] )
+                  continue;
+               vote_id_type id( vote_id_type::witness, offset );
+               if( witnesses_by_vote.find( id ) == witnesses_by_vote.end() )
+               {
+                  id = vote_id_type( vote_id_type::committee, offset );
+                  if( committee_by_vote.find( id ) == committee_by_vote.end() )
+                     continue;
+               }
+               cache.rank.erase( std::make_pair( cache.ranked_votes[offset], id ) );
+               cache.rank.emplace( tally[offset], id );
+            }
          }
+         cache.ranked_votes = tally;
       }
    } tally_helper(*this);
 
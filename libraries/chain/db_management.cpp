@@ -34,12 +34,13 @@
 #include <graphene/protocol/fee_schedule.hpp>
 
 #include <fc/io/fstream.hpp>
+#include <fc/thread/parallel.hpp>
 
+#include <deque>
 #include <fstream>
 #include <functional>
 #include <iostream>
-#include <queue>
-#include <tuple>
+#include <memory>
 
 namespace graphene { namespace chain {
 
@@ -55,6 +56,39 @@ database::~database()
    clear_pending();
 }
 
+namespace {
+   /// A block travelling through the replay pipeline of database::reindex()
+   struct replay_item
+   {
+      uint32_t                 block_num = 0;
+      block_database::block_extent extent;
+      size_t                   charge = 0;   ///< bytes accounted against the look-ahead window
+      optional<signed_block>   block;
+      fc::microseconds         read_time;    ///< time spent fetching and unpacking the block
+      fc::microseconds         precompute_time;
+      fc::future<void>         ready;
+   };
+
+   /// Accounts for in-memory overhead of small blocks, so that runs of empty blocks don't flood the pool
+   const size_t replay_item_overhead = 4096;
+
+   /// Per-stage counters reported in the replay progress log
+   struct replay_stats
+   {
+      uint64_t          blocks = 0;
+      uint64_t          bytes = 0;
+      fc::microseconds  read_time;
+      fc::microseconds  precompute_time;
+      fc::microseconds  apply_time;
+      fc::microseconds  stall_time;   ///< time the apply stage waited for the workers
+
+      static double per_second( double amount, const fc::microseconds& t )
+      {
+         return t.count() > 0 ? amount * 1000000.0 / t.count() : 0.0;
+      }
+   };
+}
+
 void database::reindex( fc::path data_dir )
 { try {
    auto last_block = _block_id_to_block.last();
@@ -80,85 +114,173 @@ void database::reindex( fc::path data_dir )
       _undo_db.disable();
 
    uint32_t skip = node_properties().skip_flags;
+   const uint32_t precompute_skip = skip;
+   const fc::time_point_sec dupe_check_start = last_block->timestamp
+                                               - get_global_properties().parameters.maximum_time_until_expiration;
 
+   // The replay runs as a pipeline: the reader stage below looks up block locations and reserves room in the
+   // look-ahead window, a pool of workers fetches, unpacks and precomputes blocks, and the apply stage applies
+   // them strictly in order.
    size_t total_block_size = _block_id_to_block.total_block_size();
-   const auto& gpo = get_global_properties();
-   std::queue< std::tuple< size_t, signed_block, fc::future< void > > > blocks;
+   const size_t lookahead = std::max<size_t>( _replay_lookahead_bytes, replay_item_overhead );
+   size_t in_flight = 0;
+   std::deque< std::shared_ptr<replay_item> > blocks;
+   replay_stats stats;
+   fc::time_point interval_start = fc::time_point::now();
    uint32_t next_block_num = head_block_num() + 1;
    uint32_t i = next_block_num;
+
+   auto handle_gap = [this,&next_block_num,&last_block_num]( uint32_t gap ) {
+      wlog( "Reindexing terminated due to gap:  Block ${i} does not exist!", ("i", gap) );
+      uint32_t dropped_count = 0;
+      while( true )
+      {
+         fc::optional< block_id_type > last_id = _block_id_to_block.last_id();
+         // this can trigger if we attempt to e.g. read a file that has block #2 but no block #1
+         if( !last_id.valid() )
+            break;
+         // we've caught up to the gap
+         if( block_header::num_from_id( *last_id ) <= gap )
+            break;
+         _block_id_to_block.remove( *last_id );
+         dropped_count++;
+      }
+      wlog( "Dropped ${n} blocks from after the gap", ("n", dropped_count) );
+      next_block_num = last_block_num + 1; // don't load more blocks
+   };
+
    while( next_block_num <= last_block_num || !blocks.empty() )
    {
-      if( next_block_num <= last_block_num && blocks.size() < 20 )
+      // reader stage
+      if( next_block_num <= last_block_num && ( blocks.empty() || in_flight < lookahead ) )
       {
-         const size_t processed_block_size = _block_id_to_block.blocks_current_position();
-         fc::optional< signed_block > block = _block_id_to_block.fetch_by_number( next_block_num++ );
-         if( block.valid() )
-         {
-            if( block->timestamp >= last_block->timestamp - gpo.parameters.maximum_time_until_expiration )
-               skip &= ~skip_transaction_dupe_check;
-            blocks.emplace( processed_block_size, std::move(*block), fc::future<void>() );
-            std::get<2>(blocks.back()) = precompute_parallel( std::get<1>(blocks.back()), skip );
-         }
-         else
+         const auto extent = _block_id_to_block.fetch_extent( next_block_num );
+         if( !extent.valid() )
          {
-            wlog( "Reindexing terminated due to gap:  Block ${i} does not exist!", ("i", i) );
-            uint32_t dropped_count = 0;
-            while( true )
-            {
-               fc::optional< block_id_type > last_id = _block_id_to_block.last_id();
-               // this can trigger if we attempt to e.g. read a file that has block #2 but no block #1
-               if( !last_id.valid() )
-                  break;
-               // we've caught up to the gap
-               if( block_header::num_from_id( *last_id ) <= i )
-                  break;
-               _block_id_to_block.remove( *last_id );
-               dropped_count++;
-            }
-            wlog( "Dropped ${n} blocks from after the gap", ("n", dropped_count) );
-            next_block_num = last_block_num + 1; // don't load more blocks
+            handle_gap( next_block_num );
+            continue;
          }
+         auto item = std::make_shared<replay_item>();
+         item->block_num = next_block_num++;
+         item->extent = *extent;
+         item->charge = extent->size + replay_item_overhead;
+         in_flight += item->charge;
+         item->ready = fc::do_parallel( [this,item,precompute_skip] () {
+            const fc::time_point read_start = fc::time_point::now();
+            item->block = _block_id_to_block.fetch_by_number( item->block_num );
+            const fc::time_point precompute_start = fc::time_point::now();
+            item->read_time = precompute_start - read_start;
+            if( item->block.valid() )
+               precompute_block( *item->block, precompute_skip );
+            item->precompute_time = fc::time_point::now() - precompute_start;
+         });
+         blocks.push_back( std::move(item) );
+         continue;
       }
-      else
+
+      // apply stage
+      const std::shared_ptr<replay_item> item = blocks.front();
+      blocks.pop_front();
+      in_flight -= item->charge;
+
+      const fc::time_point wait_start = fc::time_point::now();
+      item->ready.wait();
+      const fc::time_point apply_start = fc::time_point::now();
+
+      if( !item->block.valid() )
       {
-         std::get<2>(blocks.front()).wait();
-         const signed_block& block = std::get<1>(blocks.front());
+         // the block could not be read back, drop it and everything behind it
+         for( const auto& pending : blocks )
+            pending->ready.wait();
+         blocks.clear();
+         in_flight = 0;
+         handle_gap( item->block_num );
+         continue;
+      }
+      const signed_block& block = *item->block;
+      if( block.timestamp >= dupe_check_start )
+         skip &= ~skip_transaction_dupe_check;
 
-         if( i % 10000 == 0 )
+      if( i % 10000 == 0 )
+      {
+         std::stringstream bysize;
+         std::stringstream bynum;
+         size_t current_pos = item->extent.position;
+         if( current_pos > total_block_size )
+            total_block_size = current_pos;
+         bysize << std::fixed << std::setprecision(5) << double(current_pos) / total_block_size * 100;
+         bynum << std::fixed << std::setprecision(5) << double(i)*100/last_block_num;
+         ilog(
+            "   [by size: ${size}%   ${processed} of ${total}]   [by num: ${num}%   ${i} of ${last}]",
+            ("size", bysize.str())
+            ("processed", current_pos)
+            ("total", total_block_size)
+            ("num", bynum.str())
+            ("i", i)
+            ("last", last_block_num)
+         );
+         if( stats.blocks > 0 )
          {
-            std::stringstream bysize;
-            std::stringstream bynum;
-            size_t current_pos = std::get<0>(blocks.front());
-            if( current_pos > total_block_size )
-               total_block_size = current_pos;
-            bysize << std::fixed << std::setprecision(5) << double(current_pos) / total_block_size * 100;
-            bynum << std::fixed << std::setprecision(5) << double(i)*100/last_block_num;
+            const fc::microseconds elapsed = wait_start - interval_start;
+            std::stringstream read_rate, precompute_rate, apply_rate, stalled;
+            read_rate << std::fixed << std::setprecision(2)
+                      << replay_stats::per_second( stats.bytes / 1048576.0, stats.read_time );
+            precompute_rate << std::fixed << std::setprecision(1)
+                            << replay_stats::per_second( stats.blocks, stats.precompute_time );
+            apply_rate << std::fixed << std::setprecision(1) << replay_stats::per_second( stats.blocks, stats.apply_time );
+            stalled << std::fixed << std::setprecision(1)
+                    << ( elapsed.count() > 0 ? double(stats.stall_time.count()) * 100 / elapsed.count() : 0.0 );
             ilog(
-               "   [by size: ${size}%   ${processed} of ${total}]   [by num: ${num}%   ${i} of ${last}]",
-               ("size", bysize.str())
-               ("processed", current_pos)
-               ("total", total_block_size)
-               ("num", bynum.str())
-               ("i", i)
-               ("last", last_block_num)
+               "   [read: ${read} MiB/s per worker]   [precompute: ${pre} blocks/s per worker]   "
+               "[apply: ${apply} blocks/s, waited for workers ${stalled}% of the time]   [in flight: ${n} blocks, ${b} bytes]",
+               ("read", read_rate.str())
+               ("pre", precompute_rate.str())
+               ("apply", apply_rate.str())
+               ("stalled", stalled.str())
+               ("n", blocks.size())
+               ("b", in_flight)
+            );
+            const housekeeping_timings& timings = get_housekeeping_timings();
+            fc::microseconds housekeeping_time;
+            size_t costliest = 0;
+            for( size_t step = 0; step < timings.size(); ++step )
+            {
+               housekeeping_time += timings[step].total;
+               if( timings[step].total > timings[costliest].total )
+                  costliest = step;
+            }
+            ilog(
+               "   [housekeeping: ${t} us/block, most of it in ${step}: ${c} us/block, at most ${max} us]",
+               ("t", housekeeping_time.count() / int64_t(stats.blocks))
+               ("step", housekeeping_step_name( housekeeping_step(costliest) ))
+               ("c", timings[costliest].total.count() / int64_t(stats.blocks))
+               ("max", timings[costliest].longest.count())
             );
          }
-         if( i == undo_point )
-         {
-            ilog( "Writing database to disk at block ${i}", ("i",i) );
-            flush();
-            ilog( "Done" );
-         }
-         if( i < undo_point )
-            apply_block( block, skip );
-         else
-         {
-            _undo_db.enable();
-            push_block( block, skip );
-         }
-         blocks.pop();
-         i++;
+         stats = replay_stats();
+         reset_housekeeping_timings();
+         interval_start = wait_start;
+      }
+      stats.stall_time += apply_start - wait_start;
+      stats.read_time += item->read_time;
+      stats.precompute_time += item->precompute_time;
+      if( i == undo_point )
+      {
+         ilog( "Writing database to disk at block ${i}", ("i",i) );
+         flush();
+         ilog( "Done" );
       }
+      if( i < undo_point )
+         apply_block( block, skip );
+      else
+      {
+         _undo_db.enable();
+         push_block( block, skip );
+      }
+      stats.apply_time += fc::time_point::now() - apply_start;
+      stats.bytes += item->extent.size;
+      ++stats.blocks;
+      i++;
    }
    _undo_db.enable();
    auto end = fc::time_point::now();
@@ -183,6 +305,10 @@ void database::open(
 {
    try
    {
+      // objects loaded from disk are not seen as written, so kept vote tallies cannot be trusted any more
+      if( _vote_tally_cache )
+         _vote_tally_cache->valid = false;
+
       bool wipe_object_db = false;
       if( !fc::exists( data_dir / "db_version" ) )
          wipe_object_db = true;
@@ -528,8 +528,12 @@ void transaction_get_impacted_accounts( const transaction& tx, flat_set<account_
     operation_get_impacted_accounts( op, result, ignore_custom_operation_required_auths );
 }
 
+/// Adds the accounts impacted by the transaction of a dedup record, which only holds where to find the transaction
+typedef std::function<void(const transaction_history_object&, flat_set<account_id_type>&)> transaction_accounts_getter;
+
 void get_relevant_accounts( const object* obj, flat_set<account_id_type>& accounts,
-                            bool ignore_custom_operation_required_auths ) {
+                            bool ignore_custom_operation_required_auths,
+                            const transaction_accounts_getter& get_transaction_accounts ) {
    if( obj->id.space() == protocol_ids )
    {
       switch( (object_type)obj->id.type() )
@@ -739,10 +743,10 @@ void get_relevant_accounts( const object* obj, flat_set<account_id_type>& accoun
            } case impl_transaction_history_object_type:{
               const auto& aobj = dynamic_cast<const transaction_history_object*>(obj);
               FC_ASSERT( aobj != nullptr );
-              transaction_get_impacted_accounts( aobj->trx, accounts,
-                                                 ignore_custom_operation_required_auths );
+              get_transaction_accounts( *aobj, accounts );
               break;
-           } case impl_block_summary_object_type:
+           }
+            case impl_block_summary_object_type:
               break;
             case impl_reserved1_object_type:
               break;
@@ -813,56 +817,100 @@ void database::notify_changed_objects()
    if( _undo_db.enabled() ) 
    {
       const auto& head_undo = _undo_db.head();
+      const bool keep_objects = !object_changes.empty();
+      auto batch = std::make_shared<object_change_batch>();
+
+      // the transactions of dedup records are looked up in their block, which is fetched once for all records of
+      // the same block, or in the pending transactions
+      optional<signed_block> record_block;
+      const auto get_transaction_accounts = [this,&record_block]( const transaction_history_object& record,
+                                                                 flat_set<account_id_type>& accounts ) {
+         const signed_transaction* trx = nullptr;
+         if( record.block_num == 0 )
+            trx = _find_pending_transaction( record.trx_id, record.trx_in_block );
+         else
+         {
+            // the block being applied may not be the only one of its number in the fork database yet
+            if( !record_block.valid() || record_block->block_num() != record.block_num )
+               record_block = record.block_num == head_block_num() ? fetch_block_by_id( head_block_id() )
+                                                                   : fetch_block_by_number( record.block_num );
+            if( record_block.valid() && record.trx_in_block < record_block->transactions.size() )
+               trx = &record_block->transactions[record.trx_in_block];
+         }
+         if( trx != nullptr )
+            transaction_get_impacted_accounts( *trx, accounts, false );
+      };
+      batch->block_num = head_block_num();
 
       // New
-      if( !new_objects.empty() )
+      if( !new_objects.empty() || keep_objects )
       {
-        vector<object_id_type> new_ids;  new_ids.reserve(head_undo.new_ids.size());
-        flat_set<account_id_type> new_accounts_impacted;
-        for( const auto& item : head_undo.new_ids )
+        object_change_set& created = batch->created;
+        created.ids.assign( head_undo.new_ids.begin(), head_undo.new_ids.end() );
+        if( keep_objects )
+           created.objects = vector<object_change>( created.ids.size() );
+        for( size_t i = 0; i < created.ids.size(); ++i )
         {
-          new_ids.push_back(item);
-          auto obj = find_object(item);
+          auto obj = find_object(created.ids[i]);
           if(obj != nullptr)
-            get_relevant_accounts(obj, new_accounts_impacted, false);
+          {
+            get_relevant_accounts(obj, created.accounts_impacted, false, get_transaction_accounts);
+            if( keep_objects )
+               created.objects[i].value = obj->clone();
+          }
         }
 
-        if( new_ids.size() )
-           GRAPHENE_TRY_NOTIFY( new_objects, new_ids, new_accounts_impacted)
+        if( created.ids.size() && !new_objects.empty() )
+           GRAPHENE_TRY_NOTIFY( new_objects, created.ids, created.accounts_impacted)
       }
 
       // Changed
-      if( !changed_objects.empty() )
+      if( !changed_objects.empty() || keep_objects )
       {
-        vector<object_id_type> changed_ids;  changed_ids.reserve(head_undo.old_values.size());
-        flat_set<account_id_type> changed_accounts_impacted;
+        object_change_set& changed = batch->changed;
+        changed.ids.reserve(head_undo.old_values.size());
+        if( keep_objects )
+           changed.objects = vector<object_change>( head_undo.old_values.size() );
         for( const auto& item : head_undo.old_values )
         {
-          changed_ids.push_back(item.first);
-          get_relevant_accounts(item.second.get(), changed_accounts_impacted, false);
+          if( keep_objects )
+          {
+             auto obj = find_object(item.first);
+             if( obj != nullptr )
+                changed.objects[changed.ids.size()].value = obj->clone();
+          }
+          changed.ids.push_back(item.first);
+          get_relevant_accounts(item.second, changed.accounts_impacted, false, get_transaction_accounts);
         }
 
-        if( changed_ids.size() )
-           GRAPHENE_TRY_NOTIFY( changed_objects, changed_ids, changed_accounts_impacted)
+        if( changed.ids.size() && !changed_objects.empty() )
+           GRAPHENE_TRY_NOTIFY( changed_objects, changed.ids, changed.accounts_impacted)
       }
 
       // Removed
-      if( !removed_objects.empty() )
+      if( !removed_objects.empty() || keep_objects )
       {
-        vector<object_id_type> removed_ids; removed_ids.reserve( head_undo.removed.size() );
+        object_change_set& removed_set = batch->removed;
+        removed_set.ids.reserve( head_undo.removed.size() );
         vector<const object*> removed; removed.reserve( head_undo.removed.size() );
-        flat_set<account_id_type> removed_accounts_impacted;
+        if( keep_objects )
+           removed_set.objects = vector<object_change>( head_undo.removed.size() );
         for( const auto& item : head_undo.removed )
         {
-          removed_ids.emplace_back( item.first );
-          auto obj = item.second.get();
+          auto obj = item.second;
+          if( keep_objects )
+             removed_set.objects[removed_set.ids.size()].value = obj->clone();
+          removed_set.ids.emplace_back( item.first );
           removed.emplace_back( obj );
-          get_relevant_accounts(obj, removed_accounts_impacted, false);
+          get_relevant_accounts(obj, removed_set.accounts_impacted, false, get_transaction_accounts);
         }
 
-        if( removed_ids.size() )
-           GRAPHENE_TRY_NOTIFY( removed_objects, removed_ids, removed, removed_accounts_impacted )
+        if( removed_set.ids.size() && !removed_objects.empty() )
+           GRAPHENE_TRY_NOTIFY( removed_objects, removed_set.ids, removed, removed_set.accounts_impacted )
       }
+
+      if( keep_objects )
+         GRAPHENE_TRY_NOTIFY( object_changes, std::shared_ptr<const object_change_batch>( std::move(batch) ) )
    }
 } catch( const graphene::chain::plugin_exception& e ) {
    elog( "Caught plugin exception: ${e}", ("e", e.to_detail_string() ) );
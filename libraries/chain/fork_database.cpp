@@ -24,7 +24,20 @@
 #include <graphene/chain/fork_database.hpp>
 #include <graphene/chain/exceptions.hpp>
 
+#include <boost/pool/pool_alloc.hpp>
+
+#include <unordered_set>
+
 namespace graphene { namespace chain {
+
+namespace {
+   /// Allocates a node, with its reference count, from a pool that keeps released nodes for reuse
+   item_ptr make_item( shared_ptr<const signed_block> b )
+   {
+      return std::allocate_shared<fork_item>( boost::fast_pool_allocator<fork_item>(), std::move(b) );
+   }
+}
+
 fork_database::fork_database()
 {
 }
@@ -32,6 +45,7 @@ void fork_database::reset()
 {
    _head.reset();
    _index.clear();
+   _total_bytes = 0;
 }
 
 void fork_database::pop_block()
@@ -44,8 +58,13 @@ void fork_database::pop_block()
 
 void     fork_database::start_block(signed_block b)
 {
-   auto item = std::make_shared<fork_item>(std::move(b));
-   _index.insert(item);
+   start_block( std::make_shared<const signed_block>( std::move(b) ) );
+}
+
+void     fork_database::start_block(shared_ptr<const signed_block> b)
+{
+   auto item = make_item( std::move(b) );
+   _insert(item);
    _head = item;
 }
 
@@ -55,14 +74,19 @@ void     fork_database::start_block(signed_block b)
  */
 shared_ptr<fork_item>  fork_database::push_block(const signed_block& b)
 {
-   auto item = std::make_shared<fork_item>(b);
+   return push_block( std::make_shared<const signed_block>( b ) );
+}
+
+shared_ptr<fork_item>  fork_database::push_block(shared_ptr<const signed_block> b)
+{
+   auto item = make_item( std::move(b) );
    try {
       _push_block(item);
    }
    catch ( const unlinkable_block_exception& e )
    {
-      wlog( "Pushing block to fork database that failed to link: ${id}, ${num}", ("id",b.id())("num",b.block_num()) );
-      wlog( "Head: ${num}, ${id}", ("num",_head->data.block_num())("id",_head->data.id()) );
+      wlog( "Pushing block to fork database that failed to link: ${id}, ${num}", ("id",item->id)("num",item->num) );
+      wlog( "Head: ${num}, ${id}", ("num",_head->num)("id",_head->id) );
       throw;
    }
    return _head;
@@ -85,7 +109,9 @@ void  fork_database::_push_block(const item_ptr& item)
       item->prev = *itr;
    }
 
-   _index.insert(item);
+   // the database is still on the branch of the old head while it switches to a new one
+   const item_ptr applied_head = _head;
+   _insert(item);
    if( !_head ) _head = item;
    else if( item->num > _head->num )
    {
@@ -93,8 +119,68 @@ void  fork_database::_push_block(const item_ptr& item)
       uint32_t min_num = _head->num - std::min( _max_size, _head->num );
       auto& num_idx = _index.get<block_num>();
       while( num_idx.size() && (*num_idx.begin())->num < min_num )
-         num_idx.erase( num_idx.begin() );
+         _erase( *num_idx.begin() );
    }
+   if( _total_bytes > _max_bytes )
+      _prune_forks( applied_head );
+}
+
+void fork_database::_insert(const item_ptr& item)
+{
+   if( _index.insert(item).second )
+      _total_bytes += item->byte_size;
+}
+
+void fork_database::_erase(const item_ptr& item)
+{
+   // keep the node alive until it is out of the index, the caller may hold the only other reference
+   const item_ptr keep = item;
+   if( _index.get<block_id>().erase( keep->id ) )
+      _total_bytes -= keep->byte_size;
+}
+
+void fork_database::_prune_forks( const item_ptr& applied_head )
+{
+   if( !_head ) return;
+
+   // the head block's branch is not part of the budget, only what is off it
+   std::unordered_set<block_id_type, std::hash<fc::ripemd160>> head_branch;
+   head_branch.reserve( std::min( _max_size, _head->num ) + 1 );
+   uint64_t head_branch_bytes = 0;
+   for( const item_ptr& tip : { _head, applied_head } )
+      for( item_ptr item = tip; item; item = item->prev.lock() )
+         if( head_branch.insert( item->id ).second )
+            head_branch_bytes += item->byte_size;
+   uint64_t remaining = _total_bytes - head_branch_bytes;
+   if( remaining <= _max_bytes )
+      return;
+
+   // Oldest blocks go first. A block is also dropped when its parent was, it could not be linked anyway.
+   vector<item_ptr> removed;
+   std::unordered_set<block_id_type, std::hash<fc::ripemd160>> removed_ids;
+   for( const item_ptr& item : _index.get<block_num>() )
+   {
+      if( head_branch.find( item->id ) != head_branch.end() )
+         continue;
+      if( remaining > _max_bytes || removed_ids.find( item->previous_id() ) != removed_ids.end() )
+      {
+         remaining -= item->byte_size;
+         removed.push_back( item );
+         removed_ids.insert( item->id );
+      }
+   }
+   if( !removed.empty() )
+      wlog( "Fork database holds ${b} bytes off the head block's branch, dropping ${n} blocks",
+            ("b",_total_bytes - head_branch_bytes)("n",removed.size()) );
+   for( const item_ptr& item : removed )
+      _erase( item );
+}
+
+void fork_database::set_max_bytes( uint64_t s )
+{
+   _max_bytes = s;
+   if( _total_bytes > _max_bytes )
+      _prune_forks();
 }
 
 void fork_database::set_max_size( uint32_t s )
@@ -107,7 +193,7 @@ void fork_database::set_max_size( uint32_t s )
    while( itr != by_num_idx.end() )
    {
       if( (*itr)->num < std::max(int64_t(0),int64_t(_head->num) - _max_size) )
-         by_num_idx.erase(itr);
+         _erase(*itr);
       else
          break;
       itr = by_num_idx.begin();
@@ -160,19 +246,19 @@ pair<fork_database::branch_type,fork_database::branch_type>
    auto second_branch = *second_branch_itr;
 
 
-   while( first_branch->data.block_num() > second_branch->data.block_num() )
+   while( first_branch->num > second_branch->num )
    {
       result.first.push_back(first_branch);
       first_branch = first_branch->prev.lock();
       FC_ASSERT(first_branch);
    }
-   while( second_branch->data.block_num() > first_branch->data.block_num() )
+   while( second_branch->num > first_branch->num )
    {
       result.second.push_back( second_branch );
       second_branch = second_branch->prev.lock();
       FC_ASSERT(second_branch);
    }
-   while( first_branch->data.previous != second_branch->data.previous )
+   while( first_branch->previous_id() != second_branch->previous_id() )
    {
       result.first.push_back(first_branch);
       result.second.push_back(second_branch);
@@ -196,7 +282,10 @@ void fork_database::set_head(shared_ptr<fork_item> h)
 
 void fork_database::remove(block_id_type id)
 {
-   _index.get<block_id>().erase(id);
+   auto& index = _index.get<block_id>();
+   auto itr = index.find(id);
+   if( itr != index.end() )
+      _erase(*itr);
    // If we're removing head, try to pop it
    if( _head && _head->id == id )
    {
@@ -28,6 +28,8 @@
 
 #include <boost/multi_index/composite_key.hpp>
 
+#include <algorithm>
+
 /**
  * @defgroup prediction_market Prediction Market
  *
@@ -44,6 +46,28 @@ namespace graphene { namespace chain {
    class database;
    using namespace graphene::db;
 
+   /**
+    *  @brief the tickets sold by a lottery, as ranges of consecutive ticket numbers per holder
+    *
+    *  Ticket numbers follow the balance index, holders with more tickets first; a holder of n tickets covers n
+    *  consecutive numbers. The holder of a number is found by binary search over the ends of the ranges, so this
+    *  grows with the number of holders instead of the number of tickets sold.
+    */
+   struct lottery_ticket_ranges
+   {
+      vector<account_id_type> holders;
+      /// ends[i] is the number of tickets held by holders[0] to holders[i]
+      vector<uint64_t>        ends;
+
+      uint64_t total()const { return ends.empty() ? 0 : ends.back(); }
+      /// @return index in holders of the holder of ticket number @p ticket, which must be less than total()
+      size_t find( uint64_t ticket )const
+      { return std::upper_bound( ends.begin(), ends.end(), ticket ) - ends.begin(); }
+      /// @return position of ticket number @p ticket among the tickets of holders[@p holder]
+      uint64_t offset( uint64_t ticket, size_t holder )const
+      { return ticket - ( holder == 0 ? 0 : ends[holder - 1] ); }
+   };
+
    /**
     *  @brief tracks the asset information that changes frequently
     *  @ingroup object
@@ -146,8 +170,10 @@ namespace graphene { namespace chain {
        // Extra data associated with lottery options. This field is non-null if is_lottery() returns true
          optional<lottery_asset_options> lottery_options;
          time_point_sec get_lottery_expiration() const;
-         vector<account_id_type> get_holders( database& db ) const;
-         vector<uint64_t> get_ticket_ids( database& db ) const;
+         lottery_ticket_ranges get_ticket_ranges( database& db ) const;
+         /// @return id of the purchase of the ticket at position @p offset among those of @p holder, counting from
+         ///         the most recent purchase, if the account history holds it
+         optional<uint64_t> get_ticket_id( database& db, account_id_type holder, uint64_t offset ) const;
          void distribute_benefactors_part( database& db );
          map< account_id_type, vector< uint16_t > > distribute_winners_part( database& db );
          void distribute_sweeps_holders_part( database& db );
@@ -22,18 +22,49 @@
  * THE SOFTWARE.
  */
 #pragma once
-#include <fstream>
 #include <graphene/protocol/block.hpp>
 
 #include <fc/filesystem.hpp>
+#include <fc/interprocess/file_mapping.hpp>
+
+#include <memory>
+#include <shared_mutex>
 
 namespace graphene { namespace chain {
    struct index_entry;
    using namespace graphene::protocol;
 
+   /**
+    *  @class block_database
+    *  @brief Append-only block log backed by memory-mapped files
+    *
+    *  Blocks are kept in the "blocks" file, which is grown and mapped in fixed-size segments, and are
+    *  located through the "index" file, a fixed-width array of @ref index_entry records indexed by
+    *  block number which is mapped in chunks the same way. The on-disk layout is identical to the
+    *  one written by the former fstream-based implementation, so existing data directories keep working.
+    *
+    *  Mapped regions are never remapped while the database is open, so readers unpack blocks directly
+    *  from the mapping. The fetch methods and @ref contains may be called from several threads at once,
+    *  concurrently with a single writer calling @ref store or @ref remove.
+    */
    class block_database 
    {
       public:
+         /** Size of one mapped segment of the blocks file */
+         static constexpr uint64_t data_segment_size  = 64 * 1024 * 1024;
+         /** Number of index entries in one mapped chunk of the index file */
+         static constexpr uint64_t index_chunk_entries = 64 * 1024;
+
+         /** Location of a stored block in the blocks file */
+         struct block_extent
+         {
+            size_t position = 0; ///< offset of the first byte of the packed block
+            size_t size = 0;     ///< size of the packed block
+         };
+
+         block_database();
+         ~block_database();
+
          void open( const fc::path& dbdir );
          bool is_open()const;
          void flush();
@@ -46,14 +77,36 @@ namespace graphene { namespace chain {
          block_id_type          fetch_block_id( uint32_t block_num )const;
          optional<signed_block> fetch_optional( const block_id_type& id )const;
          optional<signed_block> fetch_by_number( uint32_t block_num )const;
+         /** @return where block @p block_num is stored without reading it, or nothing if it is not stored */
+         optional<block_extent> fetch_extent( uint32_t block_num )const;
          optional<signed_block> last()const;
          optional<block_id_type> last_id()const;
-         size_t                 blocks_current_position()const;
          size_t                 total_block_size()const;
       private:
+         typedef std::shared_ptr<fc::mapped_region> region_ptr;
+
          optional<index_entry> last_index_entry()const;
+         optional<index_entry> read_index_entry( uint32_t block_num )const;
+         optional<signed_block> read_block( const index_entry& e )const;
+
+         index_entry& entry_at( uint64_t block_num )const;
+         void         reserve_index( uint64_t entries );
+         void         reserve_data( uint64_t bytes );
+         void         write_data( uint64_t pos, const char* data, size_t size );
+
          fc::path _index_filename;
-         mutable std::fstream _blocks;
-         mutable std::fstream _block_num_to_pos;
+         fc::path _blocks_filename;
+
+         std::unique_ptr<fc::file_mapping> _index_file;
+         std::unique_ptr<fc::file_mapping> _blocks_file;
+         vector<region_ptr>                _index_chunks;
+         vector<region_ptr>                _data_segments;
+
+         /** Number of index entries in use, i.e. highest stored block number + 1 */
+         uint64_t                          _index_end = 0;
+         /** Logical end of the blocks file, new blocks are appended here */
+         uint64_t                          _data_end = 0;
+         /** Guards the region vectors and the logical sizes against concurrent growth */
+         mutable std::shared_timed_mutex   _mutex;
    };
 } }
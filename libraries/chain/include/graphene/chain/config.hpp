@@ -30,9 +30,12 @@
 #define GRAPHENE_MIN_UNDO_HISTORY 10
 #define GRAPHENE_MAX_UNDO_HISTORY 10000
 
+/// Default bytes of blocks read and precomputed ahead of the block being applied during replay
+#define GRAPHENE_DEFAULT_REPLAY_LOOKAHEAD_BYTES (64*1024*1024)
+
 #define GRAPHENE_MAX_NESTED_OBJECTS (200)
 
-const std::string GRAPHENE_CURRENT_DB_VERSION = "20220201";
+const std::string GRAPHENE_CURRENT_DB_VERSION = "20261017";
 
 #define GRAPHENE_RECENTLY_MISSED_COUNT_INCREMENT             4
 #define GRAPHENE_RECENTLY_MISSED_COUNT_DECREMENT             3
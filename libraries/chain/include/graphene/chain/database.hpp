@@ -1,6 +1,7 @@
 #pragma once
 
 #include <graphene/protocol/fee_schedule.hpp>
+#include <graphene/chain/config.hpp>
 #include <graphene/chain/global_property_object.hpp>
 #include <graphene/chain/node_property_object.hpp>
 #include <graphene/chain/account_object.hpp>
@@ -10,6 +11,8 @@
 #include <graphene/chain/block_database.hpp>
 #include <graphene/chain/genesis_state.hpp>
 #include <graphene/chain/evaluator.hpp>
+#include <graphene/chain/object_change_batch.hpp>
+#include <graphene/chain/vote_tally_cache.hpp>
 
 #include <graphene/db/object_database.hpp>
 #include <graphene/db/object.hpp>
@@ -24,7 +27,10 @@
 
 #include <fc/log/logger.hpp>
 #include <fc/crypto/hash_ctr_rng.hpp>
+#include <array>
+#include <functional>
 #include <map>
+#include <unordered_map>
 
 namespace graphene { namespace protocol { struct predicate_result; } }
 
@@ -120,7 +126,8 @@ namespace graphene { namespace chain {
          block_id_type              get_block_id_for_num( uint32_t block_num )const;
          optional<signed_block>     fetch_block_by_id( const block_id_type& id )const;
          optional<signed_block>     fetch_block_by_number( uint32_t num )const;
-         const signed_transaction&  get_recent_transaction( const transaction_id_type& trx_id )const;
+         /// @return a transaction that is pending or in a block within the expiration window
+         signed_transaction         get_recent_transaction( const transaction_id_type& trx_id )const;
          std::vector<block_id_type> get_block_ids_on_fork(block_id_type head_of_fork) const;
 
          /**
@@ -139,6 +146,16 @@ namespace graphene { namespace chain {
          processed_transaction push_transaction( const precomputable_transaction& trx, uint32_t skip = skip_nothing );
          bool _push_block( const signed_block& b );
          processed_transaction _push_transaction( const precomputable_transaction& trx );
+         /**
+          * Put transactions back into the pending state after a block was pushed or generated
+          *
+          * Expired and already included transactions are dropped without being applied. When exactly one block was
+          * applied on top of @p prior_head, transactions whose authority check only read accounts the block did not
+          * change are re-applied without verifying their signatures again. All others, and every popped transaction,
+          * go through the full @ref _push_transaction path.
+          */
+         void _restore_pending_transactions( std::vector<processed_transaction>&& pending,
+                                             const block_id_type& prior_head );
 
          ///@throws fc::exception if the proposed transaction fails to apply.
          processed_transaction push_proposal( const proposal_object& proposal );
@@ -214,6 +231,12 @@ namespace graphene { namespace chain {
           */
          fc::signal<void(const vector<object_id_type>&, const vector<const object*>&, const flat_set<account_id_type>&)>  removed_objects;
 
+         /**
+          *  Emitted after a block has been applied, with copies of all objects the block created, changed or removed.
+          *  The batch is computed once and shared by all subscribers; it may be kept and read from any thread.
+          */
+         fc::signal<void(const std::shared_ptr<const object_change_batch>&)> object_changes;
+
          //////////////////// db_witness_schedule.cpp ////////////////////
 
          /**
@@ -560,6 +583,46 @@ namespace graphene { namespace chain {
          /// Enable or disable tracking of votes of standby witnesses and committee members
          inline void enable_standby_votes_tracking(bool enable)  { _track_standby_votes = enable; }
 
+         /// Enable or disable computing the vote tallies of chain maintenance on the worker threads
+         inline void enable_parallel_vote_tally(bool enable)  { _parallel_vote_tally = enable; }
+
+         /**
+          * Enable or disable keeping the vote tallies of chain maintenance from one maintenance interval to the next,
+          * so that only accounts which changed are counted again. This takes precedence over the parallel vote tally.
+          *
+          * @param enable whether to keep the tallies
+          * @param check whether to also count all accounts in every maintenance interval and compare, for testing
+          */
+         void enable_incremental_vote_tally( bool enable, bool check = false );
+
+         /// Housekeeping steps run by _apply_block after the transactions of each block
+         enum housekeeping_step
+         {
+            housekeeping_tickets,
+            housekeeping_expired_transactions,
+            housekeeping_expired_proposals,
+            housekeeping_expired_orders,
+            housekeeping_expired_htlcs,
+            housekeeping_expired_feeds,
+            housekeeping_core_exchange_rates,
+            housekeeping_withdraw_permissions,
+            housekeeping_witness_schedule,
+            housekeeping_step_count
+         };
+
+         /// Time spent in one housekeeping step since the counters were last reset
+         struct housekeeping_timing
+         {
+            uint64_t          blocks = 0;
+            fc::microseconds  total;
+            fc::microseconds  longest;
+         };
+         typedef std::array< housekeeping_timing, housekeeping_step_count > housekeeping_timings;
+
+         static const char* housekeeping_step_name( housekeeping_step step );
+         const housekeeping_timings& get_housekeeping_timings()const { return _housekeeping_timings; }
+         void reset_housekeeping_timings() { _housekeeping_timings = housekeeping_timings(); }
+
          /** Precomputes digests, signatures and operation validations depending
           *  on skip flags. "Expensive" computations may be done in a parallel
           *  thread.
@@ -579,10 +642,53 @@ namespace graphene { namespace chain {
           *         precomputations applied
           */
          fc::future<void> precompute_parallel( const precomputable_transaction& trx )const;
+
+         /// Set the number of bytes of blocks that reindex() may read and precompute ahead of the applied block
+         inline void set_replay_lookahead( size_t bytes )  { _replay_lookahead_bytes = bytes; }
+
+         /**
+          * Whether to check the transaction authorities of a block on worker threads before applying it
+          *
+          * All checks run against the state before the block. A transaction whose check passed is then applied
+          * without checking its authorities again, unless an earlier transaction of the same block wrote one of the
+          * accounts the check read. Transactions that failed, or conflict, are checked again in block order, so the
+          * outcome is the same as with sequential checks.
+          */
+         inline void set_parallel_block_checks( bool enable ) { _parallel_block_checks = enable; }
    private:
          template<typename Trx>
          void _precompute_parallel( const Trx* trx, const size_t count, const uint32_t skip )const;
 
+         /// Inputs of the authority check of a transaction, see _restore_pending_transactions() and _apply_block()
+         struct authority_reads
+         {
+            flat_set<account_id_type> accounts;
+            /// custom authorities are only valid within a time window, so these are always verified again
+            bool                      uses_custom_authorities = false;
+         };
+         /**
+          * Verifies the signatures of @p trx against the authorities it requires
+          * @param reads if not null, the accounts whose authorities were looked up are added here
+          * @param with_custom_authorities whether custom authorities may satisfy the requirements
+          */
+         void _verify_authority( const signed_transaction& trx, authority_reads* reads,
+                                 bool with_custom_authorities )const;
+         /**
+          * Runs the authority checks of all transactions of @p block on worker threads, see set_parallel_block_checks()
+          * @return for each transaction, the accounts its check read if it passed
+          */
+         vector< optional<authority_reads> > _check_block_authorities( const signed_block& block )const;
+         /**
+          * Calls @p work for consecutive ranges covering [0, @p count) on the worker threads and waits for all of them
+          *
+          * The calling thread blocks instead of yielding to other tasks, so the state cannot change while the workers
+          * read it. The first exception thrown by @p work is rethrown after all ranges are done.
+          */
+         void _run_on_workers( size_t count, const std::function<void(size_t,size_t)>& work )const;
+
+         /// Performs the precomputations of precompute_parallel() for a whole block in the calling thread
+         void precompute_block( const signed_block& block, const uint32_t skip )const;
+
    protected:
          //Mark pop_undo() as protected -- we do not want outside calling pop_undo(); it should call pop_block() instead
          void pop_undo() { object_database::pop_undo(); }
@@ -607,7 +713,14 @@ namespace graphene { namespace chain {
 
       private:
          void                  _apply_block( const signed_block& next_block );
-         processed_transaction _apply_transaction( const signed_transaction& trx );
+         /// Runs one housekeeping step of _apply_block and adds the time it took to its counters
+         template< typename Step >
+         void                  _run_housekeeping( housekeeping_step step, Step&& run );
+         /// @param in_block whether @p trx is the transaction at _current_trx_in_block of block _current_block_num
+         processed_transaction _apply_transaction( const signed_transaction& trx, bool in_block = false );
+         /// @return the pending transaction @p trx_id recorded at @p position by _apply_transaction(), or nullptr
+         const processed_transaction* _find_pending_transaction( const transaction_id_type& trx_id,
+                                                                 uint16_t position )const;
          void                  _cancel_bids_and_revive_mpa( const asset_object& bitasset, const asset_bitasset_data_object& bad );
 
          ///Steps involved in applying a new block
@@ -665,6 +778,12 @@ namespace graphene { namespace chain {
          ///@}
 
          vector< processed_transaction >        _pending_tx;
+
+         /// What the authority checks of the pending transactions read, see _restore_pending_transactions()
+         std::unordered_map< transaction_id_type, authority_reads > _pending_authority_reads;
+         /// set by _push_transaction() while _apply_transaction() runs the authority check
+         authority_reads*                       _current_authority_reads = nullptr;
+
          fork_database                          _fork_db;
 
          /**
@@ -707,9 +826,22 @@ namespace graphene { namespace chain {
          /// Set it to true to provide accurate data to API clients, set to false to have better performance.
          bool                              _track_standby_votes = true;
 
+         /// Whether to compute vote tallies on the worker threads. The results are the same either way.
+         bool                              _parallel_vote_tally = false;
+
+         /// Vote tallies kept between maintenance intervals, if enabled
+         std::unique_ptr<vote_tally_cache> _vote_tally_cache;
+
+         housekeeping_timings              _housekeeping_timings;
+
          fc::hash_ctr_rng<secret_hash_type, 20> _random_number_generator;
           bool                              _slow_replays = false;
 
+         /// Upper bound of the bytes held by blocks that are read and precomputed ahead during reindex()
+         size_t                            _replay_lookahead_bytes = GRAPHENE_DEFAULT_REPLAY_LOOKAHEAD_BYTES;
+
+         bool                              _parallel_block_checks = false;
+
          /**
           * Whether database is successfully opened or not.
           *
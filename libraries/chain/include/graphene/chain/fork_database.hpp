@@ -27,6 +27,8 @@
 
 #include <graphene/chain/types.hpp>
 
+#include <fc/io/raw.hpp>
+
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -37,17 +39,26 @@ namespace graphene { namespace chain {
    using boost::multi_index_container;
    using namespace boost::multi_index;
 
+   /**
+    *  A node of the fork database.
+    *
+    *  The block itself is held through a shared pointer to an immutable block, so the fork database, the block
+    *  log writer and whoever handed the block in can all refer to one copy. The node only adds the fields the
+    *  database is indexed by, which are computed once when the node is created.
+    */
    struct fork_item
    {
-      fork_item( signed_block d )
-      :num(d.block_num()),id(d.id()),data( std::move(d) ){}
+      fork_item( shared_ptr<const signed_block> d )
+      :num(d->block_num()),id(d->id()),byte_size(fc::raw::pack_size(*d)),data( std::move(d) ){}
 
-      block_id_type previous_id()const { return data.previous; }
+      const block_id_type& previous_id()const { return data->previous; }
 
-      weak_ptr< fork_item > prev;
-      uint32_t              num;    // initialized in ctor
-      block_id_type         id;
-      signed_block          data;
+      weak_ptr< fork_item >           prev;
+      uint32_t                        num;    // initialized in ctor
+      block_id_type                   id;
+      /// Packed size of the block, what the node counts against the byte budget of the fork database
+      uint32_t                        byte_size;
+      shared_ptr<const signed_block>  data;
 
       // contains witness block signing keys scheduled *after* the block has been applied
       shared_ptr< vector< pair< witness_id_type, public_key_type > > > scheduled_witnesses;
@@ -64,6 +75,19 @@ namespace graphene { namespace chain {
     *  have a maximum depth of 1024 blocks after which
     *  the database will start lopping off forks.
     *
+    *  Besides the depth, the packed size of the blocks on branches other
+    *  than the one of the head block is bounded, see @ref set_max_bytes.
+    *  When it is exceeded, those blocks are dropped, oldest first, so that
+    *  a burst of competing forks cannot grow the database without limit.
+    *  The branch of the head block does not count against the budget and
+    *  is never pruned for size, it is needed to pop blocks back to the
+    *  last irreversible block.  Neither is the branch of the previous head
+    *  while a block that makes another branch the longest is pushed, the
+    *  caller switches forks along it afterwards.
+    *
+    *  Nodes are allocated from a pool and recycled once they are
+    *  released.
+    *
     *  Every time a block is pushed into the fork DB the
     *  block with the highest block_num will be returned.
     */
@@ -78,6 +102,7 @@ namespace graphene { namespace chain {
          void reset();
 
          void                             start_block(signed_block b);
+         void                             start_block(shared_ptr<const signed_block> b);
          void                             remove(block_id_type b);
          void                             set_head(shared_ptr<fork_item> h);
          bool                             is_known_block(const block_id_type& id)const;
@@ -88,6 +113,8 @@ namespace graphene { namespace chain {
           *  @return the new head block ( the longest fork )
           */
          shared_ptr<fork_item>            push_block(const signed_block& b);
+         /// Same as above, taking a reference to a block that is not copied
+         shared_ptr<fork_item>            push_block(shared_ptr<const signed_block> b);
          shared_ptr<fork_item>            head()const { return _head; }
          void                             pop_block();
 
@@ -109,13 +136,28 @@ namespace graphene { namespace chain {
          > fork_multi_index_type;
 
          void set_max_size( uint32_t s );
+         /// Sets the budget for the packed size of the blocks off the head block's branch, met by dropping them
+         void set_max_bytes( uint64_t s );
+         uint64_t get_max_bytes()const { return _max_bytes; }
+         /// @return the packed size of all blocks in the database
+         uint64_t total_bytes()const { return _total_bytes; }
+         size_t size()const { return _index.size(); }
 
       private:
          /** @return a pointer to the newly pushed item */
          void _push_block(const item_ptr& b );
          void _push_next(const item_ptr& newly_inserted);
+         void _insert(const item_ptr& item);
+         void _erase(const item_ptr& item);
+         /**
+          * Removes blocks off the branch of the head block, oldest first, until the byte budget is met.
+          * The branch of @p applied_head is kept as well, the database has not switched away from it yet
+          */
+         void _prune_forks( const item_ptr& applied_head = item_ptr() );
 
          uint32_t                 _max_size = 1024;
+         uint64_t                 _max_bytes = 256 * 1024 * 1024;
+         uint64_t                 _total_bytes = 0;
 
          fork_multi_index_type    _index;
          shared_ptr<fork_item>    _head;
@@ -112,7 +112,7 @@ namespace graphene { namespace chain {
 
    > htlc_object_index_type;
 
-   typedef generic_index< htlc_object, htlc_object_index_type > htlc_index;
+   typedef chunked_generic_index< htlc_object, htlc_object_index_type > htlc_index;
 
 } } // namespace graphene::chain
 
@@ -107,7 +107,7 @@ typedef multi_index_container<
    >
 > limit_order_multi_index_type;
 
-typedef generic_index<limit_order_object, limit_order_multi_index_type> limit_order_index;
+typedef chunked_generic_index<limit_order_object, limit_order_multi_index_type> limit_order_index;
 
 /**
  * @class call_order_object
@@ -229,7 +229,7 @@ typedef multi_index_container<
    >
 > force_settlement_object_multi_index_type;
 
-typedef generic_index<call_order_object, call_order_multi_index_type>                      call_order_index;
+typedef chunked_generic_index<call_order_object, call_order_multi_index_type>              call_order_index;
 typedef generic_index<force_settlement_object, force_settlement_object_multi_index_type>   force_settlement_index;
 
 } } // graphene::chain
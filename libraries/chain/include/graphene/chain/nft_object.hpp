@@ -31,6 +31,8 @@ namespace graphene { namespace chain {
       nft_lottery_balance_id_type lottery_balance_id;
    };
 
+   class nft_object;
+
    class nft_metadata_object : public abstract_object<nft_metadata_object>
    {
       public:
@@ -55,8 +57,8 @@ namespace graphene { namespace chain {
          time_point_sec get_lottery_expiration() const;
          asset get_lottery_jackpot(const database &db) const;
          share_type get_token_current_supply(const database &db) const;
-         vector<account_id_type> get_holders(const database &db) const;
-         vector<uint64_t> get_ticket_ids(const database &db) const;
+         /// Tickets at the given positions of the sold tickets, in the order of the positions
+         vector<const nft_object *> get_tickets(const database &db, const vector<uint64_t> &numbers) const;
          void distribute_benefactors_part(database &db);
          map<account_id_type, vector<uint16_t>> distribute_winners_part(database &db);
          void distribute_sweeps_holders_part(database &db);
@@ -167,7 +169,7 @@ namespace graphene { namespace chain {
          >
       >
    >;
-   using nft_index = generic_index<nft_object, nft_multi_index_type>;
+   using nft_index = chunked_generic_index<nft_object, nft_multi_index_type>;
 
    using nft_lottery_balance_index_type = multi_index_container<
       nft_lottery_balance_object,
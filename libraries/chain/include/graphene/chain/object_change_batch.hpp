@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/protocol/types.hpp>
+#include <graphene/db/object.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+namespace graphene { namespace chain {
+
+   /// An object created, changed or removed by a block, as it was when the block had been applied
+   class object_change
+   {
+      public:
+         /// Copy of the object, or its last value if it was removed; null if the object could not be found
+         std::shared_ptr<const object> value;
+
+         /// The value serialized to a variant, computed once on first use; safe to call from any thread
+         const variant& to_variant()const
+         {
+            std::call_once( _serialized, [this] {
+               if( value )
+                  _variant = value->to_variant();
+            });
+            return _variant;
+         }
+
+      private:
+         mutable std::once_flag _serialized;
+         mutable variant        _variant;
+   };
+
+   /// Objects with one kind of change in a block
+   struct object_change_set
+   {
+      vector<object_id_type>     ids;
+      /// Copies of the objects in the order of ids, only filled in batches handed to object_changes subscribers
+      vector<object_change>      objects;
+      flat_set<account_id_type>  accounts_impacted;
+
+      /// Returns the change of the object with the given id, or nullptr if it is not in the set
+      const object_change* find( object_id_type id )const
+      {
+         if( objects.empty() )
+            return nullptr;
+         auto itr = std::lower_bound( ids.begin(), ids.end(), id );
+         if( itr == ids.end() || *itr != id )
+            return nullptr;
+         return &objects[ itr - ids.begin() ];
+      }
+   };
+
+   /**
+    * @brief The objects created, changed and removed by one block
+    *
+    * Computed once per block by database::notify_changed_objects() and shared read-only by all subscribers. It does
+    * not refer to the live database, so it may be kept and processed on another thread after the next block.
+    */
+   struct object_change_batch
+   {
+      uint32_t           block_num = 0;
+      object_change_set  created;
+      object_change_set  changed;
+      object_change_set  removed;
+   };
+
+} } // graphene::chain
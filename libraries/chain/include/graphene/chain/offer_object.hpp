@@ -97,7 +97,7 @@ namespace graphene
                                           &offer_history_object::offer_expiration_date>,
                                    compare_by_expiration_date>>>;
 
-        using offer_index = generic_index<offer_object, offer_multi_index_type>;
+        using offer_index = chunked_generic_index<offer_object, offer_multi_index_type>;
 
         using offer_history_index =
             generic_index<offer_history_object, offer_history_multi_index_type>;
@@ -107,7 +107,7 @@ namespace graphene { namespace chain {
       >
    > operation_history_multi_index_type;
 
-   typedef generic_index<operation_history_object, operation_history_multi_index_type> operation_history_index;
+   typedef chunked_generic_index<operation_history_object, operation_history_multi_index_type> operation_history_index;
 
    struct by_seq;
    struct by_op;
@@ -103,7 +103,7 @@ typedef boost::multi_index_container<
       >
    >
 > proposal_multi_index_container;
-typedef generic_index<proposal_object, proposal_multi_index_container> proposal_index;
+typedef chunked_generic_index<proposal_object, proposal_multi_index_container> proposal_index;
 
 } } // graphene::chain
 
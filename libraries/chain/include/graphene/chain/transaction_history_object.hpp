@@ -40,6 +40,9 @@ namespace graphene { namespace chain {
     * The purpose of this object is to enable the detection of duplicate transactions. When a transaction is included
     * in a block a transaction_history_object is added. At the end of block processing all transaction_history_objects that
     * have expired can be removed from the index.
+    *
+    * Only the id, expiration and location of the transaction are kept, the transaction itself can be fetched from
+    * its block, see database::get_recent_transaction().
     */
    class transaction_history_object : public abstract_object<transaction_history_object>
    {
@@ -47,10 +50,14 @@ namespace graphene { namespace chain {
          static constexpr uint8_t space_id = implementation_ids;
          static constexpr uint8_t type_id  = impl_transaction_history_object_type;
 
-         signed_transaction  trx;
          transaction_id_type trx_id;
+         time_point_sec      expiration;
+         /// Number of the block containing the transaction, 0 while the transaction is pending
+         uint32_t            block_num = 0;
+         /// Position of the transaction in its block, or in database::_pending_tx while it is pending
+         uint16_t            trx_in_block = 0;
 
-         time_point_sec get_expiration()const { return trx.expiration; }
+         time_point_sec get_expiration()const { return expiration; }
    };
 
    struct by_expiration;
@@ -66,7 +73,7 @@ namespace graphene { namespace chain {
       >
    > transaction_multi_index_type;
 
-   typedef generic_index<transaction_history_object, transaction_multi_index_type> transaction_index;
+   typedef chunked_generic_index<transaction_history_object, transaction_multi_index_type> transaction_index;
 } }
 
 MAP_OBJECT_ID_TO_TYPE(graphene::chain::transaction_history_object)
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/protocol/transaction.hpp>
+
+#include <fc/thread/future.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace graphene { namespace chain {
+   using namespace graphene::protocol;
+   class database;
+
+   /**
+    * @brief Checks incoming transactions on worker threads before they are pushed to the database
+    *
+    * Everything that does not depend on the chain state is done on the asio worker threads: duplicates of transactions
+    * that are still being checked or pushed are rejected, the transaction is validated, its size is checked and its
+    * signature keys are recovered. Transactions that pass are handed to the thread that owns the database in batches, so that a
+    * flood of transactions costs that thread one task per batch plus the evaluation of each transaction.
+    */
+   class transaction_prevalidator
+   {
+      public:
+         struct counters
+         {
+            uint64_t submitted  = 0;
+            uint64_t duplicates = 0; ///< rejected because the same transaction was still being checked or pushed
+            uint64_t invalid    = 0; ///< rejected by the checks on the worker threads
+            uint64_t failed     = 0; ///< rejected by the database
+            uint64_t pushed     = 0;
+            uint64_t batches    = 0;
+         };
+
+         /** Must be created on the thread that owns @p db */
+         explicit transaction_prevalidator( database& db );
+         ~transaction_prevalidator();
+
+         /**
+          * Queues @p trx for checking and pushing, may be called from any thread
+          * @return a future holding the result of pushing the transaction, or the exception that rejected it
+          */
+         fc::future<processed_transaction> submit( const precomputable_transaction& trx );
+
+         counters get_counters()const;
+
+      private:
+         struct pending_item
+         {
+            precomputable_transaction                   trx;
+            fc::promise<processed_transaction>::ptr     result;
+            fc::exception_ptr                           error;
+         };
+         typedef std::shared_ptr<pending_item> pending_item_ptr;
+
+         /**
+          * Ids of the transactions being checked or waiting to be pushed, with their expiration, split into shards
+          * with a lock each so that workers rarely contend. Ids are forgotten once the database has the final say,
+          * which also rejects duplicates of the transactions it holds.
+          */
+         struct recent_shard
+         {
+            std::mutex                                                      mutex;
+            std::unordered_map< transaction_id_type, fc::time_point_sec >  ids;
+         };
+         static constexpr size_t recent_shards = 16;
+         /// Shards are pruned of expired ids when they grow beyond this size
+         static constexpr size_t recent_shard_prune_size = 4096;
+
+         recent_shard& shard_of( const transaction_id_type& id );
+         /** @return false if @p trx is still being checked or pushed */
+         bool remember( const precomputable_transaction& trx );
+         void forget( const transaction_id_type& id );
+
+         void check( pending_item& item );
+         void push_ready();
+
+         database&                              _db;
+         fc::thread*                            _db_thread;
+         const chain_id_type                    _chain_id;
+         /// maximum_transaction_size of the chain parameters, refreshed with every batch
+         std::atomic<uint32_t>                  _max_size;
+
+         std::array< recent_shard, recent_shards > _recent;
+
+         mutable std::mutex                     _ready_mutex;
+         vector< pending_item_ptr >             _ready;
+         bool                                   _push_scheduled = false;
+         fc::future<void>                       _push_task;
+
+         /// submitted transactions the workers are not done with, guarded by _ready_mutex
+         uint32_t                               _in_flight = 0;
+         /// completed by the last worker once the destructor waits for them
+         fc::promise<void>::ptr                 _drained;
+         std::atomic<bool>                      _closing{false};
+
+         std::atomic<uint64_t>                  _submitted{0};
+         std::atomic<uint64_t>                  _duplicates{0};
+         std::atomic<uint64_t>                  _invalid{0};
+         std::atomic<uint64_t>                  _failed{0};
+         std::atomic<uint64_t>                  _pushed{0};
+         std::atomic<uint64_t>                  _batches{0};
+   };
+
+} } // graphene::chain
@@ -269,7 +269,7 @@ namespace detail {
    /**
     * @ingroup object_index
     */
-   typedef generic_index<vesting_balance_object, vesting_balance_multi_index_type> vesting_balance_index;
+   typedef chunked_generic_index<vesting_balance_object, vesting_balance_multi_index_type> vesting_balance_index;
 
 } } // graphene::chain
 
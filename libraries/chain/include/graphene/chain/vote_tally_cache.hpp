@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/protocol/vote.hpp>
+#include <graphene/db/object_database.hpp>
+
+#include <memory>
+#include <set>
+#include <unordered_map>
+
+namespace graphene { namespace chain {
+
+   /**
+    * @brief Vote tallies of chain maintenance kept from one maintenance interval to the next
+    *
+    * Holds what each voting account other than the active committee members added to the tallies when it was last
+    * counted, and the sums of that. A maintenance interval counts again only the accounts whose objects were written
+    * since, the accounts whose voting power decays or whose membership runs out, and the committee members. This is
+    * not part of the consensus state; it is rebuilt with a full count whenever it cannot be trusted.
+    */
+   struct vote_tally_cache
+   {
+      /// What an account added to the tallies
+      struct entry
+      {
+         /// Votes of the account specifying the opinions when the entry was computed
+         flat_set<vote_id_type>   votes;
+         uint16_t                 num_witness = 0;
+         uint16_t                 num_committee = 0;
+         uint64_t                 voting_stake[3] = { 0, 0, 0 }; // 0=committee, 1=witness, 2=worker
+         uint64_t                 num_committee_voting_stake = 0;
+         /// Objects the entry was computed from
+         vector<object_id_type>   inputs;
+         /// The entry has to be computed again at maintenance intervals at or after this time
+         time_point_sec           valid_until = time_point_sec::maximum();
+      };
+
+      /// Orders vote ids by votes, descending, then by id, as database::sort_votable_objects does
+      struct rank_order
+      {
+         bool operator()( const std::pair<uint64_t,vote_id_type>& a, const std::pair<uint64_t,vote_id_type>& b )const
+         {
+            if( a.first != b.first )
+               return a.first > b.first;
+            return a.second < b.second;
+         }
+      };
+
+      /// Notices witnesses and committee members being created or removed, which invalidates the rank
+      struct rank_observer : public db::index_observer
+      {
+         void on_add( const db::object& obj )override { changed = true; }
+         void on_remove( const db::object& obj )override { changed = true; }
+         bool changed = true;
+      };
+
+      std::unordered_map<object_id_type, entry>                      entries;
+      /// Accounts whose entries were computed from each object
+      std::unordered_map<object_id_type, flat_set<account_id_type>> dependents;
+      std::set< std::pair<time_point_sec, account_id_type> >         expirations;
+
+      /// Sums of all entries
+      vector<uint64_t>  vote_tally;
+      vector<uint64_t>  witness_count_histogram;
+      vector<uint64_t>  committee_count_histogram;
+      uint64_t          total_voting_stake[2] = { 0, 0 }; // 0=committee, 1=witness
+
+      /// Whether the entries can be used; they are computed again from scratch if not
+      bool              valid = false;
+      /// Chain state the entries were computed with; a change of any of these invalidates them
+      time_point_sec    tally_time;
+      bool              pob_activated = false;
+      bool              count_non_member_votes = false;
+      uint16_t          maximum_witness_count = 0;
+      uint16_t          maximum_committee_count = 0;
+      /// Accounts counted in full every maintenance interval
+      flat_set<account_id_type> committee_members;
+
+      /// Accounts, statistics and vesting balances written since the last maintenance interval
+      std::unique_ptr<db::write_tracker> writes;
+      /// Compare every incremental count against a full count
+      bool              check = false;
+
+      /// Witness and committee member vote ids ordered by votes in the last maintenance interval
+      std::set< std::pair<uint64_t,vote_id_type>, rank_order > rank;
+      /// Votes of each vote id in the rank
+      vector<uint64_t>                                          ranked_votes;
+      std::shared_ptr<rank_observer>                            rank_changes;
+
+      void reset()
+      {
+         entries.clear();
+         dependents.clear();
+         expirations.clear();
+         vote_tally.clear();
+         witness_count_histogram.clear();
+         committee_count_histogram.clear();
+         total_voting_stake[0] = 0;
+         total_voting_stake[1] = 0;
+         committee_members.clear();
+         valid = false;
+      }
+   };
+
+} } // graphene::chain
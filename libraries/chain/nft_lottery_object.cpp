@@ -1,6 +1,9 @@
 #include <graphene/chain/database.hpp>
 #include <graphene/chain/nft_object.hpp>
 
+#include <algorithm>
+#include <numeric>
+
 namespace graphene
 {
     namespace chain
@@ -28,29 +31,20 @@ namespace graphene
             return current_supply;
         }
 
-        vector<account_id_type> nft_metadata_object::get_holders(const database &db) const
+        vector<const nft_object *> nft_metadata_object::get_tickets(const database &db, const vector<uint64_t> &numbers) const
         {
             const auto &idx_lottery_by_md = db.get_index_type<nft_index>().indices().get<by_metadata>();
             auto lottery_range = idx_lottery_by_md.equal_range(id);
-            vector<account_id_type> holders;
-            holders.reserve(std::distance(lottery_range.first, lottery_range.second));
-            std::for_each(lottery_range.first, lottery_range.second,
-                          [&](const nft_object &ticket) {
-                              holders.emplace_back(ticket.owner);
-                          });
-            return holders;
-        }
-
-        vector<uint64_t> nft_metadata_object::get_ticket_ids(const database &db) const
-        {
-            const auto &idx_lottery_by_md = db.get_index_type<nft_index>().indices().get<by_metadata>();
-            auto lottery_range = idx_lottery_by_md.equal_range(id);
-            vector<uint64_t> tickets;
-            tickets.reserve(std::distance(lottery_range.first, lottery_range.second));
-            std::for_each(lottery_range.first, lottery_range.second,
-                          [&](const nft_object &ticket) {
-                              tickets.emplace_back(ticket.id.instance());
-                          });
+            // visit the numbers in ascending order to walk the tickets once
+            vector<size_t> order(numbers.size());
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [&numbers](size_t a, size_t b) { return numbers[a] < numbers[b]; });
+            vector<const nft_object *> tickets(numbers.size(), nullptr);
+            auto next = order.begin();
+            uint64_t number = 0;
+            for (auto itr = lottery_range.first; itr != lottery_range.second && next != order.end(); ++itr, ++number)
+                for (; next != order.end() && numbers[*next] == number; ++next)
+                    tickets[*next] = &*itr;
             return tickets;
         }
 
@@ -78,50 +72,51 @@ namespace graphene
             auto current_supply = get_token_current_supply(db);
             auto &lottery_options = lottery_data->lottery_options;
 
-            auto holders = get_holders(db);
-            vector<uint64_t> ticket_ids = get_ticket_ids(db);
-            FC_ASSERT(current_supply.value == (int64_t)holders.size());
+            const uint64_t sold_count = current_supply.value;
             FC_ASSERT(get_lottery_jackpot(db).amount.value == current_supply.value * lottery_options.ticket_price.amount.value);
             map<account_id_type, vector<uint16_t>> structurized_participants;
-            for (account_id_type holder : holders)
-            {
-                if (!structurized_participants.count(holder))
-                    structurized_participants.emplace(holder, vector<uint16_t>());
-            }
+            const auto &idx_lottery_by_md = db.get_index_type<nft_index>().indices().get<by_metadata>();
+            auto lottery_range = idx_lottery_by_md.equal_range(id);
+            uint64_t indexed_count = 0;
+            std::for_each(lottery_range.first, lottery_range.second,
+                          [&](const nft_object &ticket) {
+                              structurized_participants.emplace(ticket.owner, vector<uint16_t>());
+                              ++indexed_count;
+                          });
+            FC_ASSERT(sold_count == indexed_count);
             uint64_t jackpot = get_lottery_jackpot(db).amount.value;
-            auto selections = lottery_options.winning_tickets.size() <= holders.size() ? lottery_options.winning_tickets.size() : holders.size();
-            auto winner_numbers = db.get_random_numbers(0, holders.size(), selections, false);
+            auto selections = lottery_options.winning_tickets.size() <= sold_count ? lottery_options.winning_tickets.size() : sold_count;
+            auto winner_numbers = db.get_random_numbers(0, sold_count, selections, false);
+            const vector<const nft_object *> winning_tickets = get_tickets(db, winner_numbers);
 
             auto &tickets(lottery_options.winning_tickets);
 
-            if (holders.size() < tickets.size())
+            if (sold_count < tickets.size())
             {
                 uint16_t percents_to_distribute = 0;
-                for (auto i = tickets.begin() + holders.size(); i != tickets.end();)
+                for (auto i = tickets.begin() + sold_count; i != tickets.end();)
                 {
                     percents_to_distribute += *i;
                     i = tickets.erase(i);
                 }
-                for (auto t = tickets.begin(); t != tickets.begin() + holders.size(); ++t)
-                    *t += percents_to_distribute / holders.size();
+                for (auto t = tickets.begin(); t != tickets.begin() + sold_count; ++t)
+                    *t += percents_to_distribute / sold_count;
             }
             auto sweeps_distribution_percentage = db.get_global_properties().parameters.sweeps_distribution_percentage();
             for (size_t c = 0; c < winner_numbers.size(); ++c)
             {
-                auto winner_num = winner_numbers[c];
+                FC_ASSERT(winning_tickets[c] != nullptr, "No ticket number ${n} in the lottery", ("n", winner_numbers[c]));
+                const nft_object &winning_ticket = *winning_tickets[c];
                 nft_lottery_reward_operation reward_op;
                 reward_op.lottery_id = id;
                 reward_op.is_benefactor_reward = false;
-                reward_op.winner = holders[winner_num];
-                if (ticket_ids.size() > winner_num)
-                {
-                    reward_op.winner_ticket_id = ticket_ids[winner_num];
-                }
+                reward_op.winner = winning_ticket.owner;
+                reward_op.winner_ticket_id = winning_ticket.id.instance();
                 reward_op.win_percentage = tickets[c];
                 reward_op.amount = asset(jackpot * tickets[c] * (1. - sweeps_distribution_percentage / (double)GRAPHENE_100_PERCENT) / GRAPHENE_100_PERCENT, lottery_options.ticket_price.asset_id);
                 db.apply_operation(eval, reward_op);
 
-                structurized_participants[holders[winner_num]].push_back(tickets[c]);
+                structurized_participants[winning_ticket.owner].push_back(tickets[c]);
             }
             return structurized_participants;
         }
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/transaction_prevalidator.hpp>
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/exceptions.hpp>
+#include <graphene/chain/global_property_object.hpp>
+
+#include <fc/asio.hpp>
+#include <fc/thread/parallel.hpp>
+
+namespace graphene { namespace chain {
+
+constexpr size_t transaction_prevalidator::recent_shards;
+constexpr size_t transaction_prevalidator::recent_shard_prune_size;
+
+transaction_prevalidator::transaction_prevalidator( database& db )
+   : _db( db ), _db_thread( &fc::thread::current() ), _chain_id( db.get_chain_id() ),
+     _max_size( db.get_global_properties().parameters.maximum_transaction_size )
+{
+}
+
+transaction_prevalidator::~transaction_prevalidator()
+{
+   _closing = true;
+   // workers refer to this object until they are done, the last one completes the promise
+   fc::promise<void>::ptr drained;
+   {
+      std::lock_guard<std::mutex> guard( _ready_mutex );
+      if( _in_flight > 0 )
+         _drained = drained = fc::promise<void>::create( "transaction_prevalidator drained" );
+   }
+   if( drained )
+      drained->wait();
+   if( _push_task.valid() && !_push_task.ready() )
+      _push_task.cancel_and_wait( "transaction_prevalidator destroyed" );
+   for( auto& item : _ready )
+      item->result->set_exception( std::make_shared<fc::canceled_exception>() );
+}
+
+transaction_prevalidator::recent_shard& transaction_prevalidator::shard_of( const transaction_id_type& id )
+{
+   return _recent[ id._hash[0] % recent_shards ];
+}
+
+bool transaction_prevalidator::remember( const precomputable_transaction& trx )
+{
+   auto& shard = shard_of( trx.id() );
+   std::lock_guard<std::mutex> guard( shard.mutex );
+   if( shard.ids.size() >= recent_shard_prune_size )
+   {
+      const fc::time_point_sec now = fc::time_point::now();
+      for( auto itr = shard.ids.begin(); itr != shard.ids.end(); )
+         itr = itr->second < now ? shard.ids.erase( itr ) : std::next( itr );
+   }
+   return shard.ids.emplace( trx.id(), trx.expiration ).second;
+}
+
+void transaction_prevalidator::forget( const transaction_id_type& id )
+{
+   auto& shard = shard_of( id );
+   std::lock_guard<std::mutex> guard( shard.mutex );
+   shard.ids.erase( id );
+}
+
+fc::future<processed_transaction> transaction_prevalidator::submit( const precomputable_transaction& trx )
+{
+   ++_submitted;
+
+   auto item = std::make_shared<pending_item>();
+   item->trx = trx;
+   item->result = fc::promise<processed_transaction>::create( "transaction_prevalidator::submit" );
+   fc::future<processed_transaction> result( item->result );
+
+   {
+      std::lock_guard<std::mutex> guard( _ready_mutex );
+      ++_in_flight;
+   }
+   fc::do_parallel( [this,item] () {
+      check( *item );
+      {
+         std::lock_guard<std::mutex> guard( _ready_mutex );
+         _ready.push_back( item );
+         if( !_push_scheduled && !_closing )
+         {
+            _push_scheduled = true;
+            _push_task = _db_thread->async( [this] () { push_ready(); }, "transaction_prevalidator::push_ready" );
+         }
+         if( --_in_flight == 0 && _drained )
+            _drained->set_value();
+      }
+   });
+   return result;
+}
+
+void transaction_prevalidator::check( pending_item& item )
+{
+   try {
+      // computes and caches the id
+      if( !remember( item.trx ) )
+      {
+         ++_duplicates;
+         FC_THROW_EXCEPTION( duplicate_transaction, "Transaction ${id} is already being processed",
+                             ("id",item.trx.id()) );
+      }
+      try {
+         item.trx.validate();
+         FC_ASSERT( item.trx.get_packed_size() <= _max_size.load(), "Transaction exceeds maximum transaction size." );
+         item.trx.get_signature_keys( _chain_id );
+      } catch( const fc::exception& ) {
+         ++_invalid;
+         forget( item.trx.id() );
+         throw;
+      }
+   } catch( const fc::exception& e ) {
+      item.error = e.dynamic_copy_exception();
+   } catch( const std::exception& e ) {
+      ++_invalid;
+      item.error = std::make_shared<fc::std_exception_wrapper>( fc::std_exception_wrapper::from_current_exception( e ) );
+   }
+}
+
+void transaction_prevalidator::push_ready()
+{
+   vector< pending_item_ptr > batch;
+   {
+      std::lock_guard<std::mutex> guard( _ready_mutex );
+      batch.swap( _ready );
+      _push_scheduled = false;
+   }
+   ++_batches;
+   _max_size = _db.get_global_properties().parameters.maximum_transaction_size;
+
+   for( const auto& item : batch )
+   {
+      // the id of a rejected duplicate belongs to the transaction that is still in progress
+      if( item->error )
+      {
+         item->result->set_exception( item->error );
+         continue;
+      }
+      // from here on the database rejects duplicates while it holds the transaction. A failed transaction may
+      // become valid later, e.g. after a transfer to its fee payer, and one that was pushed may be dropped from
+      // the pending state again, e.g. on a fork switch, so either may be submitted again
+      forget( item->trx.id() );
+      try {
+         auto processed = _db.push_transaction( item->trx );
+         ++_pushed;
+         item->result->set_value( std::move( processed ) );
+      } catch( const fc::exception& e ) {
+         ++_failed;
+         item->result->set_exception( e.dynamic_copy_exception() );
+      }
+   }
+}
+
+transaction_prevalidator::counters transaction_prevalidator::get_counters()const
+{
+   counters result;
+   result.submitted  = _submitted.load();
+   result.duplicates = _duplicates.load();
+   result.invalid    = _invalid.load();
+   result.failed     = _failed.load();
+   result.pushed     = _pushed.load();
+   result.batches    = _batches.load();
+   return result;
+}
+
+} } // graphene::chain
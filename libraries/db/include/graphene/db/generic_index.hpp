@@ -28,6 +28,8 @@
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/mem_fun.hpp>
 
+#include <array>
+
 namespace graphene { namespace db {
 
    using boost::multi_index_container;
@@ -54,6 +56,24 @@ namespace graphene { namespace db {
             return *insert_result.first;
          }
 
+         /**
+          *  Inserts an object that is being loaded from disk. Saved indexes are ordered by id, so
+          *  inserting at the end of the id index is a constant-time hint.
+          */
+         const object& insert_for_load( ObjectType&& obj )
+         {
+            const auto old_size = _indices.size();
+            auto itr = _indices.insert( _indices.end(), std::move( obj ) );
+            FC_ASSERT( _indices.size() > old_size, "Could not insert object, most likely a uniqueness constraint was violated" );
+            return *itr;
+         }
+
+         /**
+          * Prepares for loading @p count objects whose instances are all below @p instance_end,
+          * node based containers have nothing to reserve
+          */
+         void reserve_for_load( size_t count, uint64_t instance_end ) {}
+
          virtual const object&  create(const std::function<void(object&)>& constructor )override
          {
             ObjectType item;
@@ -116,6 +136,125 @@ namespace graphene { namespace db {
          index_type  _indices;
    };
 
+   /**
+    * @brief Maps object instances to objects through a vector of fixed size chunks
+    *
+    * Unlike direct_index this copes with arbitrary gaps in the id space: a chunk is allocated when the first object
+    * in its range is added and freed again when its last object is removed. It suits indexes whose live objects
+    * form a moving window over the id space, such as orders and proposals.
+    */
+   template<typename ObjectType, uint8_t ChunkBits>
+   class instance_chunk_table
+   {
+      static_assert( ChunkBits > 0 && ChunkBits < 32, "Unreasonable chunk size" );
+
+      public:
+         const ObjectType* find( uint64_t instance )const
+         {
+            const uint64_t c = instance >> ChunkBits;
+            if( c >= _chunks.size() || !_chunks[c] )
+               return nullptr;
+            return _chunks[c]->items[instance & mask];
+         }
+
+         void insert( uint64_t instance, const ObjectType* obj )
+         {
+            const uint64_t c = instance >> ChunkBits;
+            if( c >= _chunks.size() )
+               _chunks.resize( c + 1 );
+            if( !_chunks[c] )
+               _chunks[c] = std::make_unique<chunk>();
+            auto& item = _chunks[c]->items[instance & mask];
+            FC_ASSERT( item == nullptr, "Duplicate instance ${i}", ("i",instance) );
+            item = obj;
+            ++_chunks[c]->count;
+         }
+
+         void remove( uint64_t instance )
+         {
+            const uint64_t c = instance >> ChunkBits;
+            FC_ASSERT( c < _chunks.size() && _chunks[c] && _chunks[c]->items[instance & mask] != nullptr,
+                       "Removing unknown instance ${i}", ("i",instance) );
+            _chunks[c]->items[instance & mask] = nullptr;
+            if( --_chunks[c]->count == 0 )
+               _chunks[c].reset();
+         }
+
+         /** Prepares the chunk table for instances up to @p max_instance */
+         void reserve( uint64_t max_instance ) { _chunks.reserve( ( max_instance >> ChunkBits ) + 1 ); }
+
+      private:
+         static constexpr uint64_t mask = ( uint64_t(1) << ChunkBits ) - 1;
+
+         struct chunk
+         {
+            std::array< const ObjectType*, size_t(1) << ChunkBits > items{};
+            uint32_t                                                count = 0;
+         };
+
+         vector< unique_ptr<chunk> > _chunks;
+   };
+
+   /**
+    * @brief A generic_index that looks objects up by id in an instance_chunk_table
+    *
+    * The multi_index container keeps its ordered id index, so iteration order and all other indexes are
+    * unchanged; only find() by id becomes a constant-time array access. Meant for indexes with a lot of churn
+    * and frequent lookups by id that cannot use a direct_index because of their gaps.
+    */
+   template<typename ObjectType, typename MultiIndexType, uint8_t ChunkBits = 8>
+   class chunked_generic_index : public generic_index<ObjectType, MultiIndexType>
+   {
+      typedef generic_index<ObjectType, MultiIndexType> base_type;
+
+      public:
+         virtual const object& insert( object&& obj )override
+         {
+            const auto& result = base_type::insert( std::move( obj ) );
+            _by_instance.insert( result.id.instance(), &static_cast<const ObjectType&>( result ) );
+            return result;
+         }
+
+         const object& insert_for_load( ObjectType&& obj )
+         {
+            const auto& result = base_type::insert_for_load( std::move( obj ) );
+            _by_instance.insert( result.id.instance(), &static_cast<const ObjectType&>( result ) );
+            return result;
+         }
+
+         /** The instance table is indexed by instance, so it is sized by the highest one rather than the count */
+         void reserve_for_load( size_t count, uint64_t instance_end )
+         {
+            base_type::reserve_for_load( count, instance_end );
+            if( instance_end > 0 )
+               _by_instance.reserve( instance_end - 1 );
+         }
+
+         virtual const object& create( const std::function<void(object&)>& constructor )override
+         {
+            const auto& result = base_type::create( constructor );
+            _by_instance.insert( result.id.instance(), &static_cast<const ObjectType&>( result ) );
+            return result;
+         }
+
+         virtual void remove( const object& obj )override
+         {
+            const uint64_t instance = obj.id.instance();
+            base_type::remove( obj );
+            _by_instance.remove( instance );
+         }
+
+         virtual const object* find( object_id_type id )const override
+         {
+            if( id.space() != ObjectType::space_id || id.type() != ObjectType::type_id )
+               return nullptr;
+            return _by_instance.find( id.instance() );
+         }
+
+      private:
+         instance_chunk_table< ObjectType, ChunkBits > _by_instance;
+   };
+
    /**
     * @brief An index type for objects which may be deleted
     *
@@ -23,19 +23,58 @@
  */
 #pragma once
 #include <graphene/db/object.hpp>
+#include <graphene/db/read_view.hpp>
 
 #include <fc/interprocess/file_mapping.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/io/json.hpp>
 #include <fc/crypto/sha256.hpp>
 
+#include <algorithm>
 #include <fstream>
+#include <limits>
+#include <map>
 #include <stack>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace graphene { namespace db {
    class object_database;
    using fc::path;
 
+   /**
+    * @brief The changes of one index between two incremental checkpoints, as stored in its delta log
+    */
+   struct index_delta_batch
+   {
+      uint32_t                 checkpoint = 0;
+      object_id_type           next_id;
+      vector< vector<char> >   changed; ///< packed objects that were created or modified
+      vector< object_id_type > removed;
+   };
+
+   /** @return the delta log that incremental checkpoints append to for the index saved at @p db */
+   fc::path delta_log_path( const fc::path& db );
+   /** @return the delta log that is being merged into the index saved at @p db by a compaction */
+   fc::path compacting_log_path( const fc::path& db );
+
+   /**
+    * Appends a batch to a delta log, framed with its size and a checksum
+    * @return the number of bytes written
+    */
+   size_t append_delta_batch( const fc::path& log, const index_delta_batch& batch );
+
+   /** Waits until the file or directory at @p p has been written to disk */
+   void sync_to_disk( const fc::path& p );
+
+   /**
+    * Reads the batches of a delta log in order. Reading stops at the first batch that is incomplete, corrupt
+    * or belongs to a checkpoint after @p last_checkpoint, and the log is truncated there so that it can be
+    * appended to again.
+    */
+   void read_delta_log( const fc::path& log, uint32_t last_checkpoint,
+                        const std::function<void(index_delta_batch&&)>& handler );
+
    /**
     * @class index_observer
     * @brief used to get callbacks when objects change
@@ -131,9 +170,39 @@ namespace graphene { namespace db {
 
          virtual void               inspect_all_objects(std::function<void(const object&)> inspector)const = 0;
          virtual void               add_observer( const shared_ptr<index_observer>& ) = 0;
+         virtual void               remove_observer( const shared_ptr<index_observer>& ) = 0;
 
          virtual void               object_from_variant( const fc::variant& var, object& obj, uint32_t max_depth )const = 0;
          virtual void               object_default( object& obj )const = 0;
+
+         /**
+          *  Incremental checkpoints, see object_database::enable_incremental_checkpoints().
+          *  Indexes that do not support them are always saved in full.
+          */
+         ///@{
+         /** Start (or stop) recording changed objects, the current state becomes the baseline */
+         virtual void               track_changes( bool enable ) {}
+         /** Appends the objects changed since the baseline to the delta log, @return the bytes written */
+         virtual size_t             save_changes( const fc::path& db, uint32_t checkpoint ) { return 0; }
+         /** Applies the delta logs of the index saved at @p db on top of the loaded objects */
+         virtual void               load_changes( const fc::path& db, uint32_t last_checkpoint ) {}
+         /** Merges the compacting log into the saved index file. Works on files only, so it may run in any thread. */
+         virtual void               compact_changes( const fc::path& db )const {}
+         ///@}
+
+         /**
+          *  Read views, see object_database::publish_read_view().
+          *  Indexes that do not support them cannot be part of a view.
+          */
+         ///@{
+         /**
+          * @return @p previous with the objects changed since it was taken updated, @p previous itself if nothing
+          * changed, or a complete snapshot if @p previous is null; the index starts recording changes for the next
+          * snapshot
+          */
+         virtual std::shared_ptr<const index_snapshot> update_snapshot( const std::shared_ptr<const index_snapshot>& previous )
+         { return {}; }
+         ///@}
    };
 
    class secondary_index
@@ -188,6 +257,14 @@ namespace graphene { namespace db {
          vector< shared_ptr<index_observer> >   _observers;
          vector< unique_ptr<secondary_index> >  _sindex;
 
+         /// Objects that were added, modified or removed since the last incremental checkpoint
+         std::unordered_set<object_id_type>     _changed;
+         bool                                   _track_changes = false;
+
+         /// Objects that were added, modified or removed since the last read view snapshot
+         std::unordered_set<object_id_type>     _view_changed;
+         bool                                   _track_view_changes = false;
+
       private:
          object_database& _db;
    };
@@ -353,12 +430,37 @@ namespace graphene { namespace db {
             fc::raw::unpack(ds, _next_id);
             fc::raw::unpack(ds, open_ver);
             FC_ASSERT( open_ver == get_object_version(), "Incompatible Version, the serialization of objects in this index has changed" );
-            vector<char> tmp;
+
+            // count the records first so that the container is sized only once
+            size_t count = 0;
+            for( fc::datastream<const char*> scan( ds.pos(), ds.remaining() ); scan.remaining() > 0; ++count )
+            {
+               fc::unsigned_int size;
+               fc::raw::unpack( scan, size );
+               FC_ASSERT( scan.remaining() >= size.value, "Truncated object in ${f}", ("f",db) );
+               scan.skip( size.value );
+            }
+            // all stored ids are below the next id, which tables indexed by instance are sized by
+            DerivedIndex::reserve_for_load( count, _next_id.instance() );
+
+            // objects are unpacked straight from the mapping without an intermediate buffer
             while( ds.remaining() > 0 )
             {
-               fc::raw::unpack( ds, tmp );
-               load( tmp );
+               fc::unsigned_int size;
+               fc::raw::unpack( ds, size );
+               const char* const start = ds.pos();
+               object_type obj;
+               fc::raw::unpack( ds, obj );
+               FC_ASSERT( size_t( ds.pos() - start ) == size.value, "Object size mismatch in ${f}", ("f",db) );
+               DerivedIndex::insert_for_load( std::move( obj ) );
             }
+
+            // secondary indexes, including direct_index, are populated in one pass over the complete container
+            if( !_sindex.empty() )
+               DerivedIndex::inspect_all_objects( [this]( const object& o ) {
+                  for( const auto& item : _sindex )
+                     item->object_inserted( o );
+               });
          }
 
          virtual void save( const path& db ) override 
@@ -427,6 +529,11 @@ namespace graphene { namespace db {
             _observers.emplace_back( o );
          }
 
+         virtual void remove_observer( const shared_ptr<index_observer>& o ) override
+         {
+            _observers.erase( std::remove( _observers.begin(), _observers.end(), o ), _observers.end() );
+         }
+
          virtual void object_from_variant( const fc::variant& var, object& obj, uint32_t max_depth )const override
          {
             object_id_type id = obj.id;
@@ -445,9 +552,173 @@ namespace graphene { namespace db {
             obj.id = id;
          }
 
+         virtual std::shared_ptr<const index_snapshot> update_snapshot(
+               const std::shared_ptr<const index_snapshot>& previous ) override
+         {
+            if( previous && _view_changed.empty() )
+               return previous;
+            auto result = previous ? previous->update( *this, _view_changed ) : index_snapshot::build( *this );
+            _track_view_changes = true;
+            _view_changed.clear();
+            return result;
+         }
+
+         virtual void track_changes( bool enable ) override
+         {
+            _track_changes = enable;
+            _changed.clear();
+            _saved_next_id = _next_id;
+         }
+
+         virtual size_t save_changes( const path& db, uint32_t checkpoint ) override
+         {
+            if( _changed.empty() && _next_id == _saved_next_id )
+               return 0;
+            index_delta_batch batch;
+            batch.checkpoint = checkpoint;
+            batch.next_id = _next_id;
+            batch.changed.reserve( _changed.size() );
+            // direct indexes only accept new objects close to their end, so the log replays them in id order
+            vector<object_id_type> changed_ids( _changed.begin(), _changed.end() );
+            std::sort( changed_ids.begin(), changed_ids.end() );
+            for( const object_id_type& id : changed_ids )
+            {
+               const object* obj = find( id );
+               if( obj != nullptr )
+                  batch.changed.emplace_back( fc::raw::pack( static_cast<const object_type&>(*obj) ) );
+               else
+                  batch.removed.push_back( id );
+            }
+            const size_t written = append_delta_batch( delta_log_path( db ), batch );
+            _changed.clear();
+            _saved_next_id = _next_id;
+            return written;
+         }
+
+         virtual void load_changes( const path& db, uint32_t last_checkpoint ) override
+         {
+            // replaying a batch twice is harmless, so a compaction that was interrupted after replacing
+            // the index file but before removing its log does no damage
+            const auto apply = [this]( index_delta_batch&& batch ) {
+               for( const auto& data : batch.changed )
+               {
+                  object_type obj = fc::raw::unpack<object_type>( data );
+                  const object* existing = find( obj.id );
+                  if( existing == nullptr )
+                  {
+                     load( data );
+                     continue;
+                  }
+                  for( const auto& item : _sindex )
+                     item->about_to_modify( *existing );
+                  DerivedIndex::modify( *existing, [&obj]( object& o ) {
+                     static_cast<object_type&>(o) = std::move( obj );
+                  });
+                  for( const auto& item : _sindex )
+                     item->object_modified( *existing );
+               }
+               for( const object_id_type& id : batch.removed )
+               {
+                  const object* existing = find( id );
+                  if( existing == nullptr )
+                     continue;
+                  for( const auto& item : _sindex )
+                     item->object_removed( *existing );
+                  DerivedIndex::remove( *existing );
+               }
+               _next_id = batch.next_id;
+            };
+            read_delta_log( compacting_log_path( db ), last_checkpoint, apply );
+            read_delta_log( delta_log_path( db ), last_checkpoint, apply );
+         }
+
+         virtual void compact_changes( const path& db )const override
+         {
+            const fc::path log = compacting_log_path( db );
+            const fc::path tmp( db.generic_string() + ".tmp" );
+
+            // latest state of every object touched by the log, an empty vector marks a removal.
+            // Ordered, so objects created after the index file was written are appended in id order
+            std::map< object_id_type, vector<char> > latest;
+            object_id_type next_id( object_type::space_id, object_type::type_id, 0 );
+            bool has_next_id = false;
+            read_delta_log( log, std::numeric_limits<uint32_t>::max(), [&]( index_delta_batch&& batch ) {
+               for( auto& data : batch.changed )
+               {
+                  const object_id_type id = fc::raw::unpack<object_type>( data ).id;
+                  latest[id] = std::move( data );
+               }
+               for( const object_id_type& id : batch.removed )
+                  latest[id].clear();
+               next_id = batch.next_id;
+               has_next_id = true;
+            });
+
+            {
+               std::ofstream out( tmp.generic_string(),
+                                  std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+               FC_ASSERT( out );
+               const auto write_record = [&out]( const vector<char>& data ) {
+                  const auto packed_vec = fc::raw::pack( data );
+                  out.write( packed_vec.data(), packed_vec.size() );
+               };
+               if( fc::exists( db ) && fc::file_size( db ) > 0 )
+               {
+                  fc::file_mapping fm( db.generic_string().c_str(), fc::read_only );
+                  fc::mapped_region mr( fm, fc::read_only, 0, fc::file_size(db) );
+                  fc::datastream<const char*> ds( (const char*)mr.get_address(), mr.get_size() );
+                  object_id_type base_next_id;
+                  fc::sha256 open_ver;
+                  fc::raw::unpack( ds, base_next_id );
+                  fc::raw::unpack( ds, open_ver );
+                  FC_ASSERT( open_ver == get_object_version(), "Incompatible Version, the serialization of objects in this index has changed" );
+                  if( !has_next_id )
+                     next_id = base_next_id;
+                  fc::raw::pack( out, next_id );
+                  fc::raw::pack( out, open_ver );
+
+                  vector<char> tmp_data;
+                  while( ds.remaining() > 0 )
+                  {
+                     fc::raw::unpack( ds, tmp_data );
+                     const object_id_type id = fc::raw::unpack<object_type>( tmp_data ).id;
+                     auto itr = latest.find( id );
+                     if( itr == latest.end() )
+                        write_record( tmp_data );
+                     else
+                     {
+                        if( !itr->second.empty() )
+                           write_record( itr->second );
+                        latest.erase( itr );
+                     }
+                  }
+               }
+               else
+               {
+                  fc::raw::pack( out, next_id );
+                  fc::raw::pack( out, get_object_version() );
+               }
+               // objects created after the index file was written
+               for( const auto& item : latest )
+                  if( !item.second.empty() )
+                     write_record( item.second );
+               out.close();
+               FC_ASSERT( out, "Failed to write ${f}", ("f",tmp) );
+            }
+
+            // the log is only removed once the index file that replaces it is on disk
+            sync_to_disk( tmp );
+            fc::rename( tmp, db );
+            sync_to_disk( db.parent_path() );
+            fc::remove( log );
+         }
+
       private:
          object_id_type                                 _next_id;
+         object_id_type                                 _saved_next_id;
          const direct_index< object_type, DirectBits >* _direct_by_id = nullptr;
    };
 
 } } // graphene::db
+
+FC_REFLECT( graphene::db::index_delta_batch, (checkpoint)(next_id)(changed)(removed) )
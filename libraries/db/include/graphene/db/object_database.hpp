@@ -24,14 +24,55 @@
 #pragma once
 #include <graphene/db/object.hpp>
 #include <graphene/db/index.hpp>
+#include <graphene/db/read_view.hpp>
 #include <graphene/db/undo_database.hpp>
 
+#include <fc/crypto/sha256.hpp>
 #include <fc/log/logger.hpp>
+#include <fc/thread/future.hpp>
 
 #include <map>
+#include <unordered_set>
 
 namespace graphene { namespace db {
 
+   class object_database;
+
+   /**
+    * @brief Records the ids of the objects of selected types that are created, modified or removed while it is alive
+    *
+    * Trackers nest; every tracker alive sees the writes made after it was constructed.
+    */
+   class write_tracker
+   {
+      public:
+         explicit write_tracker( object_database& db );
+         ~write_tracker();
+
+         void watch( uint8_t space_id, uint8_t type_id ) { _watched.insert( (uint16_t(space_id) << 8) | type_id ); }
+         template<typename T>
+         void watch() { watch( T::space_id, T::type_id ); }
+
+         bool written( object_id_type id )const { return _written.find( id ) != _written.end(); }
+         const std::unordered_set<object_id_type>& written()const { return _written; }
+         /// @return the ids written so far, and starts over with none
+         std::unordered_set<object_id_type> take()
+         {
+            std::unordered_set<object_id_type> result;
+            result.swap( _written );
+            return result;
+         }
+
+      private:
+         friend class object_database;
+         void record( object_id_type id );
+
+         object_database&                   _db;
+         write_tracker*                     _outer;
+         flat_set<uint16_t>                 _watched;
+         std::unordered_set<object_id_type> _written;
+   };
+
    /**
     *   @class object_database
     *   @brief maintains a set of indexed objects that can be modified with multi-level rollback support
@@ -42,17 +83,59 @@ namespace graphene { namespace db {
          object_database();
          ~object_database();
 
-         void reset_indexes() { _index.clear(); _index.resize(255); }
+         void reset_indexes() { _index.clear(); _index.resize(255); std::atomic_store( &_read_view, {} ); }
 
          void open(const fc::path& data_dir );
 
          /**
-          * Saves the complete state of the object_database to disk, this could take a while
+          * Saves the complete state of the object_database to disk, this could take a while.
+          *
+          * With incremental checkpoints enabled, and once a complete state exists on disk, only the objects
+          * changed since the previous flush are appended to the delta logs of their indexes.
           */
          void flush();
          void wipe(const fc::path& data_dir); // remove from disk
          void close();
 
+         /**
+          * Enable or disable incremental checkpoints. When enabled, changed objects are recorded per index
+          * so that flush() only has to write those. Delta logs that grow too large compared to their index
+          * file are merged into it in the background. Delta logs found on disk are applied by open()
+          * regardless of this setting.
+          */
+         void enable_incremental_checkpoints( bool enable );
+         bool incremental_checkpoints_enabled()const { return _incremental_checkpoints; }
+
+         /**
+          * Read views are immutable copies of the state that readers on other threads can use without
+          * synchronizing with the thread that modifies the database. Each published view shares all objects that
+          * did not change with the previous one, so publishing costs a copy of the changed objects only. Readers
+          * never block publishing; a view stays alive as long as someone holds it.
+          */
+         ///@{
+         /** Makes the objects of the given index part of the read views published from now on */
+         void enable_read_view( uint8_t space_id, uint8_t type_id );
+         template<typename T>
+         void enable_read_view() { enable_read_view( T::space_id, T::type_id ); }
+         /** Makes all indexes part of the read views */
+         void enable_read_views();
+         /**
+          * Publishes the current state as the read view for @p revision, unless nothing changed since the last
+          * view was published. Call this from the thread that modifies the database.
+          * @return the latest read view, or nullptr if no index is enabled
+          */
+         std::shared_ptr<const read_view> publish_read_view( uint32_t revision );
+         /** @return the most recently published read view, or nullptr if there is none */
+         std::shared_ptr<const read_view> get_read_view()const { return std::atomic_load( &_read_view ); }
+         ///@}
+
+         /**
+          * @return digest of the serialized objects of all indexes, taken in index and id order
+          *
+          * Databases holding the same objects have the same digest. This walks the complete state.
+          */
+         fc::sha256 state_hash()const;
+
          template<typename T, typename F>
          const T& create( F&& constructor )
          {
@@ -170,12 +253,35 @@ namespace graphene { namespace db {
 
          friend class base_primary_index;
          friend class undo_database;
+         friend class write_tracker;
          void save_undo( const object& obj );
          void save_undo_add( const object& obj );
          void save_undo_remove( const object& obj );
 
+         /// Writes every index to a new directory and replaces the saved state with it
+         void save_full();
+         /// Appends the changes since the previous checkpoint to the delta logs and starts compactions
+         void save_checkpoint();
+         void wait_for_compactions();
+
          fc::path                                                  _data_dir;
          vector< vector< unique_ptr<index> > >                     _index;
+
+         bool                                                      _incremental_checkpoints = false;
+         /// Whether the saved state matches the baseline of the recorded changes
+         bool                                                      _checkpoint_ready = false;
+         /// Number of the last incremental checkpoint written since the last full save
+         uint32_t                                                  _checkpoint = 0;
+         /// Background compactions of delta logs, keyed by space and type
+         std::map< std::pair<uint8_t,uint8_t>, fc::future<void> >  _compactions;
+
+         /// Indexes that are part of read views
+         flat_set< std::pair<uint8_t,uint8_t> >                    _read_view_indexes;
+         /// The latest read view, only accessed through std::atomic_load and std::atomic_store
+         std::shared_ptr<const read_view>                          _read_view;
+
+         /// Innermost live write_tracker, if any
+         write_tracker*                                            _write_tracker = nullptr;
    };
 
 } } // graphene::db
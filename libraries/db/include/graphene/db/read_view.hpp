@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/db/object.hpp>
+
+#include <array>
+#include <unordered_set>
+
+namespace graphene { namespace db {
+   class index;
+
+   /**
+    * @brief Immutable copies of the objects of one index, as contained in a read_view
+    *
+    * Objects are kept in fixed size pages by instance, and pages in fixed size directories. A snapshot for a newer
+    * revision copies the directory table and only those directories and pages that hold changed objects; all other
+    * directories, pages and objects are shared with the previous snapshot. Pages and directories left empty are
+    * dropped.
+    */
+   class index_snapshot
+   {
+      public:
+         static constexpr size_t page_size = 256;
+         static constexpr size_t directory_size = 256;
+         typedef std::array< std::shared_ptr<const object>, page_size > page;
+         typedef std::array< std::shared_ptr<const page>, directory_size > directory;
+
+         /** @return a snapshot of all objects currently in @p idx */
+         static std::shared_ptr<const index_snapshot> build( const index& idx );
+
+         /** @return a copy of this snapshot in which the objects in @p changed have their current value in @p idx */
+         std::shared_ptr<const index_snapshot> update( const index& idx,
+                                                       const std::unordered_set<object_id_type>& changed )const;
+
+         const object* find( uint64_t instance )const
+         {
+            const uint64_t p = instance / page_size;
+            const uint64_t d = p / directory_size;
+            if( d >= _directories.size() || !_directories[d] )
+               return nullptr;
+            const auto& pg = (*_directories[d])[p % directory_size];
+            if( !pg )
+               return nullptr;
+            return (*pg)[instance % page_size].get();
+         }
+
+         /** Calls @p f for every object in the snapshot, in order of instance */
+         void for_each( const std::function<void(const object&)>& f )const;
+
+         size_t size()const { return _size; }
+         /** @return the number of pages holding objects */
+         size_t page_count()const;
+
+      private:
+         class writer;
+
+         vector< std::shared_ptr<const directory> > _directories;
+         size_t                                     _size = 0;
+   };
+
+   /**
+    * @brief Consistent, read-only state of the object database as of a published revision
+    *
+    * A view does not refer to the live indexes, so it may be used from any thread while blocks are being applied,
+    * and it does not change once published. Holding on to a view keeps the objects it contains alive; only the
+    * objects that changed since are held twice.
+    *
+    * Views only contain the indexes they were enabled for, see object_database::enable_read_view().
+    * Secondary indexes are not part of a view.
+    */
+   class read_view
+   {
+      public:
+         /**
+          * @return the revision, usually the head block number, the view was published at. The view contains the
+          * state as it was at that time, including pending transactions
+          */
+         uint32_t revision()const { return _revision; }
+
+         /** @return whether objects of the given index are contained in this view */
+         bool contains( uint8_t space_id, uint8_t type_id )const
+         {
+            return snapshot( space_id, type_id ) != nullptr;
+         }
+         bool contains( object_id_type id )const { return contains( id.space(), id.type() ); }
+
+         const object* find_object( object_id_type id )const
+         {
+            const index_snapshot* s = snapshot( id.space(), id.type() );
+            FC_ASSERT( s != nullptr, "Index of ${id} is not part of the read view", ("id",id) );
+            return s->find( id.instance() );
+         }
+         const object& get_object( object_id_type id )const
+         {
+            const object* result = find_object( id );
+            FC_ASSERT( result != nullptr, "Unable to find Object ${id}", ("id",id) );
+            return *result;
+         }
+
+         template<typename T>
+         const T* find( object_id_type id )const
+         {
+            const object* obj = find_object( id );
+            assert( !obj || nullptr != dynamic_cast<const T*>(obj) );
+            return static_cast<const T*>(obj);
+         }
+         template<uint8_t SpaceID, uint8_t TypeID>
+         auto find( object_id<SpaceID,TypeID> id )const -> const object_downcast_t<decltype(id)>* {
+            return find<object_downcast_t<decltype(id)>>(id);
+         }
+         template<uint8_t SpaceID, uint8_t TypeID>
+         auto get( object_id<SpaceID,TypeID> id )const -> const object_downcast_t<decltype(id)>& {
+            return static_cast<const object_downcast_t<decltype(id)>&>( get_object( id ) );
+         }
+
+         /** Calls @p f for every object of type T in the view, in order of id */
+         template<typename T>
+         void for_each( const std::function<void(const T&)>& f )const
+         {
+            const index_snapshot* s = snapshot( T::space_id, T::type_id );
+            FC_ASSERT( s != nullptr, "Index ${s}.${t} is not part of the read view",
+                       ("s",T::space_id)("t",T::type_id) );
+            s->for_each( [&f]( const object& obj ) { f( static_cast<const T&>( obj ) ); } );
+         }
+
+      private:
+         friend class object_database;
+
+         const index_snapshot* snapshot( uint8_t space_id, uint8_t type_id )const
+         {
+            if( space_id >= _indexes.size() || type_id >= _indexes[space_id].size() )
+               return nullptr;
+            return _indexes[space_id][type_id].get();
+         }
+
+         uint32_t                                                     _revision = 0;
+         vector< vector< std::shared_ptr<const index_snapshot> > >    _indexes;
+   };
+
+} } // graphene::db
@@ -69,6 +69,12 @@ namespace graphene { namespace db {
             return *_objects[instance];
          }
 
+         /** Inserts an object that is being loaded from disk */
+         const object& insert_for_load( T&& obj ) { return insert( std::move( obj ) ); }
+
+         /** Prepares for loading @p count objects whose instances are all below @p instance_end */
+         void reserve_for_load( size_t count, uint64_t instance_end ) { _objects.reserve( instance_end ); }
+
          virtual void remove( const object& obj ) override
          {
             assert( nullptr != dynamic_cast<const T*>(&obj) );
@@ -32,12 +32,112 @@ namespace graphene { namespace db {
    using fc::flat_set;
    class object_database;
 
+   /**
+    * @brief Net effect of the changes recorded by an undo session, see undo_database::head()
+    *
+    * The old values point into the arena of the session and stay valid until the session is undone, merged or
+    * dropped from the undo stack.
+    */
    struct undo_state
    {
-      unordered_map<object_id_type, unique_ptr<object> > old_values;
-      unordered_map<object_id_type, object_id_type>      old_index_next_ids;
-      std::unordered_set<object_id_type>                 new_ids;
-      unordered_map<object_id_type, unique_ptr<object> > removed;
+      flat_map<object_id_type, const object*>  old_values;
+      flat_map<object_id_type, object_id_type> old_index_next_ids;
+      flat_set<object_id_type>                 new_ids;
+      flat_map<object_id_type, const object*>  removed;
+   };
+
+   /**
+    * @brief Bump allocator holding the saved copies of one undo session
+    *
+    * Memory is handed out from large chunks and given back all at once. Released chunks are kept in a pool owned by
+    * the undo_database, so a node in steady state does not allocate for undo bookkeeping at all.
+    */
+   class undo_arena
+   {
+      public:
+         struct chunk
+         {
+            std::unique_ptr<char[]> data;
+            size_t                  size = 0;
+            size_t                  used = 0;
+         };
+         typedef vector<chunk> chunk_pool;
+
+         static constexpr size_t default_chunk_size = 64 * 1024;
+
+         void*  allocate( size_t size, size_t alignment, chunk_pool& pool );
+         /** Takes over all chunks of @p other, allocations made from them keep their addresses */
+         void   splice( undo_arena& other );
+         /** Gives all chunks back to @p pool, objects living in them must have been destroyed already */
+         void   release( chunk_pool& pool );
+         size_t bytes_used()const;
+
+      private:
+         vector<chunk> _chunks;
+   };
+
+   /**
+    * @brief Open addressing map from object id to a position in a session log
+    *
+    * clear() keeps the slot table, so maps recycled between sessions do not allocate once they have grown.
+    */
+   class undo_position_map
+   {
+      public:
+         /** @return the position stored for @p id, or nullptr if there is none */
+         const uint32_t* find( object_id_type id )const;
+         void            insert( object_id_type id, uint32_t position );
+         void            clear();
+         size_t          size()const { return _size; }
+
+      private:
+         static constexpr uint64_t empty_slot = ~uint64_t(0);
+
+         size_t slot_of( uint64_t key )const;
+         void   insert_key( uint64_t key, uint32_t position );
+         void   grow();
+
+         vector< std::pair<uint64_t,uint32_t> > _slots;
+         size_t                                 _size = 0;
+   };
+
+   /**
+    * @brief One entry in the change log of an undo session
+    */
+   struct undo_record
+   {
+      enum record_type : uint8_t
+      {
+         created,   ///< object was created
+         modified,  ///< object was modified for the first time, old_value holds its previous value
+         removed,   ///< object was removed, old_value holds its previous value
+         next_id,   ///< first object created in an index, id is the index (instance 0) and old_next_id its next id
+         cancelled  ///< object was created and removed again, nothing to undo
+      };
+
+      record_type     type;
+      object_id_type  id;
+      object*         old_value = nullptr;
+      object_id_type  old_next_id;
+   };
+
+   /**
+    * @brief The changes of one undo session, in the order they happened
+    *
+    * Undo replays the records backwards. Merging a session into its parent appends its records and arena to the
+    * parent's, so the parent may hold several records for the same object; replaying backwards still restores the
+    * value the object had before the oldest of them.
+    */
+   struct undo_session_log
+   {
+      vector<undo_record>    records;
+      undo_arena             arena;
+      /// position of the first record of each object written by this session itself, excluding merged children
+      undo_position_map      first_record;
+      /// indexes which already have a next_id record in this session
+      vector<object_id_type> touched_indexes;
+      /// records before this position may have records of merged children after them and must not be rewritten
+      uint32_t               merged_end = 0;
    };
 
 
@@ -50,6 +150,7 @@ namespace graphene { namespace db {
    {
       public:
          undo_database( object_database& db ):_db(db){}
+         ~undo_database();
 
          class session
          {
@@ -117,10 +218,17 @@ namespace graphene { namespace db {
          void pop_commit();
 
          std::size_t size()const { return _stack.size(); }
+         /** @return bytes held by the saved copies of all sessions on the stack */
+         size_t      arena_bytes()const;
          void set_max_size(size_t new_max_size) { _max_size = new_max_size; }
          size_t max_size()const { return _max_size; }
          uint32_t active_sessions()const { return _active_sessions; }
 
+         /**
+          * @return net effect of the changes recorded by the newest session on the stack
+          *
+          * The summary is built on first use and cached until the next change is recorded.
+          */
          const undo_state& head()const;
 
       private:
@@ -128,11 +236,24 @@ namespace graphene { namespace db {
          void merge();
          void commit();
 
-         uint32_t                _active_sessions = 0;
-         bool                    _disabled = true;
-         std::deque<undo_state>  _stack;
-         object_database&        _db;
-         size_t                  _max_size = 256;
+         undo_session_log& head_log();
+         void              push_log();
+         /** Reverts the changes recorded in @p log, newest first */
+         void              replay_backwards( const undo_session_log& log );
+         /** Destroys the saved copies of @p log and recycles its memory */
+         void              release_log( undo_session_log& log );
+         object*           save_copy( undo_session_log& log, const object& obj );
+
+         uint32_t                      _active_sessions = 0;
+         bool                          _disabled = true;
+         std::deque<undo_session_log>  _stack;
+         object_database&              _db;
+         size_t                        _max_size = 256;
+
+         undo_arena::chunk_pool        _chunk_pool;
+         vector<undo_position_map>     _position_map_pool;
+         mutable undo_state            _head_state;
+         mutable bool                  _head_state_valid = false;
    };
 
 } } // graphene::db
@@ -25,6 +25,14 @@
 #include <graphene/db/index.hpp>
 #include <graphene/db/object_database.hpp>
 
+#ifdef _WIN32
+# include <io.h>
+# include <fcntl.h>
+#else
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
 namespace graphene { namespace db {
    void base_primary_index::save_undo( const object& obj )
    { _db.save_undo( obj ); }
@@ -32,12 +40,119 @@ namespace graphene { namespace db {
    void base_primary_index::on_add( const object& obj )
    {
       _db.save_undo_add( obj );
+      if( _track_changes ) _changed.insert( obj.id );
+      if( _track_view_changes ) _view_changed.insert( obj.id );
       for( auto ob : _observers ) ob->on_add( obj );
    }
 
    void base_primary_index::on_remove( const object& obj )
-   { _db.save_undo_remove( obj ); for( auto ob : _observers ) ob->on_remove( obj ); }
+   {
+      _db.save_undo_remove( obj );
+      if( _track_changes ) _changed.insert( obj.id );
+      if( _track_view_changes ) _view_changed.insert( obj.id );
+      for( auto ob : _observers ) ob->on_remove( obj );
+   }
 
    void base_primary_index::on_modify( const object& obj )
-   {for( auto ob : _observers ) ob->on_modify(  obj ); }
-} } // graphene::chain
+   {
+      if( _track_changes ) _changed.insert( obj.id );
+      if( _track_view_changes ) _view_changed.insert( obj.id );
+      for( auto ob : _observers ) ob->on_modify(  obj );
+   }
+
+   fc::path delta_log_path( const fc::path& db )
+   {
+      return fc::path( db.generic_string() + ".delta" );
+   }
+
+   fc::path compacting_log_path( const fc::path& db )
+   {
+      return fc::path( db.generic_string() + ".delta.compacting" );
+   }
+
+   /// The checksum stored after each batch of a delta log
+   static uint64_t delta_batch_checksum( const vector<char>& packed )
+   {
+      return fc::sha256::hash( packed.data(), packed.size() )._hash[0];
+   }
+
+   size_t append_delta_batch( const fc::path& log, const index_delta_batch& batch )
+   {
+      const auto packed = fc::raw::pack( batch );
+      const uint32_t size = packed.size();
+      const uint64_t checksum = delta_batch_checksum( packed );
+
+      const bool created = !fc::exists( log );
+      std::ofstream out( log.generic_string(), std::ofstream::binary | std::ofstream::out | std::ofstream::app );
+      FC_ASSERT( out, "Failed to open ${f}", ("f",log) );
+      fc::raw::pack( out, size );
+      out.write( packed.data(), packed.size() );
+      fc::raw::pack( out, checksum );
+      out.close();
+      FC_ASSERT( out, "Failed to write ${f}", ("f",log) );
+      sync_to_disk( log );
+      if( created )
+         sync_to_disk( log.parent_path() );
+      return sizeof(size) + packed.size() + sizeof(checksum);
+   }
+
+   void sync_to_disk( const fc::path& p )
+   {
+#ifdef _WIN32
+      // directories can't be flushed on windows, the files in them are
+      if( fc::is_directory( p ) )
+         return;
+      const int fd = _open( p.generic_string().c_str(), _O_RDWR | _O_BINARY );
+      FC_ASSERT( fd >= 0, "Failed to open ${f}", ("f",p) );
+      const int result = _commit( fd );
+      _close( fd );
+#else
+      const int fd = ::open( p.generic_string().c_str(), O_RDONLY );
+      FC_ASSERT( fd >= 0, "Failed to open ${f}", ("f",p) );
+      const int result = ::fsync( fd );
+      ::close( fd );
+#endif
+      FC_ASSERT( result == 0, "Failed to write ${f} to disk", ("f",p) );
+   }
+
+   void read_delta_log( const fc::path& log, uint32_t last_checkpoint,
+                        const std::function<void(index_delta_batch&&)>& handler )
+   {
+      if( !fc::exists( log ) )
+         return;
+      const uint64_t log_size = fc::file_size( log );
+      uint64_t valid_size = 0;
+      if( log_size > 0 )
+      {
+         fc::file_mapping fm( log.generic_string().c_str(), fc::read_only );
+         fc::mapped_region mr( fm, fc::read_only, 0, log_size );
+         const char* data = (const char*)mr.get_address();
+         while( valid_size < log_size )
+         {
+            fc::datastream<const char*> ds( data + valid_size, log_size - valid_size );
+            if( ds.remaining() < sizeof(uint32_t) )
+               break;
+            uint32_t size;
+            fc::raw::unpack( ds, size );
+            if( ds.remaining() < size + sizeof(uint64_t) )
+               break;
+            vector<char> packed( ds.pos(), ds.pos() + size );
+            ds.skip( size );
+            uint64_t checksum;
+            fc::raw::unpack( ds, checksum );
+            if( checksum != delta_batch_checksum( packed ) )
+            {
+               wlog( "Ignoring corrupt tail of ${f}", ("f",log) );
+               break;
+            }
+            index_delta_batch batch = fc::raw::unpack<index_delta_batch>( packed );
+            if( batch.checkpoint > last_checkpoint )
+               break;
+            handler( std::move(batch) );
+            valid_size += sizeof(uint32_t) + size + sizeof(uint64_t);
+         }
+      }
+      if( valid_size < log_size )
+         fc::resize_file( log, valid_size );
+   }
+} } // graphene::db
@@ -23,6 +23,7 @@
  */
 #include <graphene/db/object_database.hpp>
 
+#include <fc/io/fstream.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/container/flat.hpp>
 #include <fc/thread/parallel.hpp>
@@ -36,10 +37,14 @@ object_database::object_database()
    _undo_db.enable();
 }
 
-object_database::~object_database(){}
+object_database::~object_database()
+{
+   wait_for_compactions();
+}
 
 void object_database::close()
 {
+   wait_for_compactions();
 }
 
 const object* object_database::find_object( object_id_type id )const
@@ -68,9 +73,28 @@ index& object_database::get_mutable_index(uint8_t space_id, uint8_t type_id)
    return *idx;
 }
 
+/// A delta log is merged into its index file once it has grown beyond this share of the index file
+static const uint64_t compaction_ratio_percent = 50;
+/// Delta logs smaller than this are never compacted
+static const uint64_t min_compaction_size = 1024 * 1024;
+
+static fc::path checkpoint_manifest( const fc::path& dir )
+{
+   return dir / "checkpoint";
+}
+
 void object_database::flush()
+{
+   if( _incremental_checkpoints && _checkpoint_ready && fc::exists( _data_dir / "object_database" ) )
+      save_checkpoint();
+   else
+      save_full();
+}
+
+void object_database::save_full()
 {
 //   ilog("Save object_database in ${d}", ("d", _data_dir));
+   wait_for_compactions();
    fc::create_directories( _data_dir / "object_database.tmp" / "lock" );
    std::vector<fc::future<void>> tasks;
    tasks.reserve(200);
@@ -91,11 +115,149 @@ void object_database::flush()
       fc::rename( _data_dir / "object_database", _data_dir / "object_database.old" );
    fc::rename( _data_dir / "object_database.tmp", _data_dir / "object_database" );
    fc::remove_all( _data_dir / "object_database.old" );
+
+   // the saved state is the new baseline for incremental checkpoints
+   _checkpoint = 0;
+   for( const auto& space : _index )
+      for( const auto& idx : space )
+         if( idx )
+            idx->track_changes( _incremental_checkpoints );
+   _checkpoint_ready = true;
+}
+
+void object_database::save_checkpoint()
+{
+   const fc::path dir = _data_dir / "object_database";
+   const uint32_t checkpoint = _checkpoint + 1;
+
+   std::vector<fc::future<void>> tasks;
+   tasks.reserve(200);
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type < _index[space].size(); ++type )
+         if( _index[space][type] )
+            tasks.push_back( fc::do_parallel( [this,&dir,space,type,checkpoint] () {
+               _index[space][type]->save_changes( dir / fc::to_string(space) / fc::to_string(type), checkpoint );
+            } ) );
+   for( auto& task : tasks )
+      task.wait();
+
+   // Batches only count once the manifest names their checkpoint, so a crash before this point
+   // leaves the previous checkpoint intact. The logs are on disk already, the manifest has to get there
+   // before the rename, and the rename itself after it
+   {
+      const fc::path tmp = dir / "checkpoint.tmp";
+      const auto packed = fc::raw::pack( checkpoint );
+      std::ofstream out( tmp.generic_string(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+      out.write( packed.data(), packed.size() );
+      out.close();
+      FC_ASSERT( out, "Failed to write ${f}", ("f",tmp) );
+      sync_to_disk( tmp );
+      fc::rename( tmp, checkpoint_manifest( dir ) );
+      sync_to_disk( dir );
+   }
+   _checkpoint = checkpoint;
+
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type < _index[space].size(); ++type )
+      {
+         if( !_index[space][type] )
+            continue;
+         auto& compaction = _compactions[ std::make_pair( uint8_t(space), uint8_t(type) ) ];
+         if( compaction.valid() && !compaction.ready() )
+            continue;
+         const fc::path db = dir / fc::to_string(space) / fc::to_string(type);
+         const fc::path log = delta_log_path( db );
+         // a leftover compacting log means the previous compaction failed, it is retried on the next open
+         if( !fc::exists( log ) || fc::exists( compacting_log_path( db ) ) )
+            continue;
+         const uint64_t log_size = fc::file_size( log );
+         const uint64_t db_size = fc::exists( db ) ? fc::file_size( db ) : 0;
+         if( log_size < min_compaction_size || log_size * 100 < db_size * compaction_ratio_percent )
+            continue;
+         fc::rename( log, compacting_log_path( db ) );
+         const index* idx = _index[space][type].get();
+         compaction = fc::do_parallel( [idx,db] () {
+            idx->compact_changes( db );
+         } );
+      }
+}
+
+void object_database::wait_for_compactions()
+{
+   for( auto& item : _compactions )
+   {
+      if( !item.second.valid() )
+         continue;
+      try
+      {
+         item.second.wait();
+      }
+      catch( const fc::exception& e )
+      {
+         wlog( "Compaction of index ${s}.${t} failed: ${e}",
+               ("s",item.first.first)("t",item.first.second)("e",e.to_detail_string()) );
+      }
+   }
+   _compactions.clear();
 }
 
+void object_database::enable_incremental_checkpoints( bool enable )
+{
+   _incremental_checkpoints = enable;
+   // changes made before tracking started are unknown, the next flush has to save everything
+   _checkpoint_ready = false;
+   for( const auto& space : _index )
+      for( const auto& idx : space )
+         if( idx )
+            idx->track_changes( enable );
+}
+
+void object_database::enable_read_view( uint8_t space_id, uint8_t type_id )
+{
+   get_index( space_id, type_id );
+   _read_view_indexes.insert( std::make_pair( space_id, type_id ) );
+}
+
+void object_database::enable_read_views()
+{
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type < _index[space].size(); ++type )
+         if( _index[space][type] )
+            _read_view_indexes.insert( std::make_pair( uint8_t(space), uint8_t(type) ) );
+}
+
+std::shared_ptr<const read_view> object_database::publish_read_view( uint32_t revision )
+{ try {
+   if( _read_view_indexes.empty() )
+      return {};
+
+   const auto previous = get_read_view();
+   bool changed = !previous;
+   auto view = std::make_shared<read_view>();
+   view->_revision = revision;
+   view->_indexes.resize( _index.size() );
+   for( const auto& item : _read_view_indexes )
+   {
+      auto& snapshots = view->_indexes[item.first];
+      if( snapshots.size() <= item.second )
+         snapshots.resize( _index[item.first].size() );
+      std::shared_ptr<const index_snapshot> prev_snapshot;
+      if( previous && previous->snapshot( item.first, item.second ) != nullptr )
+         prev_snapshot = previous->_indexes[item.first][item.second];
+      snapshots[item.second] = get_mutable_index( item.first, item.second ).update_snapshot( prev_snapshot );
+      changed = changed || snapshots[item.second] != prev_snapshot;
+   }
+   if( !changed )
+      return previous;
+   std::shared_ptr<const read_view> result( std::move( view ) );
+   std::atomic_store( &_read_view, result );
+   return result;
+} FC_CAPTURE_AND_RETHROW( (revision) ) }
+
 void object_database::wipe(const fc::path& data_dir)
 {
    close();
+   _checkpoint_ready = false;
    ilog("Wiping object database...");
    fc::remove_all(data_dir / "object_database");
    ilog("Done wiping object database.");
@@ -104,22 +266,38 @@ void object_database::wipe(const fc::path& data_dir)
 void object_database::open(const fc::path& data_dir)
 { try {
    _data_dir = data_dir;
+   _checkpoint = 0;
+   _checkpoint_ready = false;
    if( fc::exists( _data_dir / "object_database" / "lock" ) )
    {
        wlog("Ignoring locked object_database");
        return;
    }
+   const fc::path dir = _data_dir / "object_database";
+   if( fc::exists( checkpoint_manifest( dir ) ) )
+   {
+      std::string manifest;
+      fc::read_file_contents( checkpoint_manifest( dir ), manifest );
+      _checkpoint = fc::raw::unpack<uint32_t>( vector<char>( manifest.begin(), manifest.end() ) );
+   }
    std::vector<fc::future<void>> tasks;
    tasks.reserve(200);
    ilog("Opening object database from ${d} ...", ("d", data_dir));
    for( uint32_t space = 0; space < _index.size(); ++space )
       for( uint32_t type = 0; type  < _index[space].size(); ++type )
          if( _index[space][type] )
-            tasks.push_back( fc::do_parallel( [this,space,type] () {
-               _index[space][type]->open( _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type) );
+            tasks.push_back( fc::do_parallel( [this,&dir,space,type] () {
+               const fc::path db = dir / fc::to_string(space) / fc::to_string(type);
+               fc::remove( fc::path( db.generic_string() + ".tmp" ) ); // unfinished compaction
+               _index[space][type]->open( db );
+               _index[space][type]->load_changes( db, _checkpoint );
+               _index[space][type]->track_changes( _incremental_checkpoints );
             } ) );
    for( auto& task : tasks )
       task.wait();
+   _checkpoint_ready = fc::exists( dir );
+   if( _checkpoint > 0 )
+      ilog( "Applied incremental checkpoints up to #${n}", ("n", _checkpoint) );
    ilog( "Done opening object database." );
 
 } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
@@ -130,19 +308,57 @@ void object_database::pop_undo()
    _undo_db.pop_commit();
 } FC_CAPTURE_AND_RETHROW() }
 
+fc::sha256 object_database::state_hash()const
+{
+   fc::sha256::encoder enc;
+   for( const auto& space : _index )
+      for( const auto& idx : space )
+         if( idx )
+            idx->inspect_all_objects( [&enc]( const object& obj ) {
+               const vector<char> data = obj.pack();
+               enc.write( data.data(), data.size() );
+            });
+   return enc.result();
+}
+
 void object_database::save_undo( const object& obj )
 {
    _undo_db.on_modify( obj );
+   if( _write_tracker != nullptr )
+      _write_tracker->record( obj.id );
 }
 
 void object_database::save_undo_add( const object& obj )
 {
    _undo_db.on_create( obj );
+   if( _write_tracker != nullptr )
+      _write_tracker->record( obj.id );
 }
 
 void object_database::save_undo_remove(const object& obj)
 {
    _undo_db.on_remove( obj );
+   if( _write_tracker != nullptr )
+      _write_tracker->record( obj.id );
+}
+
+write_tracker::write_tracker( object_database& db )
+   : _db( db ), _outer( db._write_tracker )
+{
+   _db._write_tracker = this;
+}
+
+write_tracker::~write_tracker()
+{
+   _db._write_tracker = _outer;
+}
+
+void write_tracker::record( object_id_type id )
+{
+   if( _watched.find( uint16_t( id.number >> 48 ) ) != _watched.end() )
+      _written.insert( id );
+   if( _outer != nullptr )
+      _outer->record( id );
 }
 
 } } // namespace graphene::db
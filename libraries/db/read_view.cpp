@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/db/read_view.hpp>
+#include <graphene/db/index.hpp>
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace graphene { namespace db {
+
+constexpr size_t index_snapshot::page_size;
+constexpr size_t index_snapshot::directory_size;
+
+/**
+ * Writes objects into a snapshot that is not shared yet. Each directory and page that is written to is copied
+ * once, the first time, so that the snapshot it was shared with does not change.
+ */
+class index_snapshot::writer
+{
+   public:
+      explicit writer( index_snapshot& snapshot ) : _snapshot( snapshot ) {}
+
+      void set( uint64_t instance, std::shared_ptr<const object> obj )
+      {
+         auto& slot = writable_page( instance / page_size )[instance % page_size];
+         if( slot && !obj )
+            --_snapshot._size;
+         else if( !slot && obj )
+            ++_snapshot._size;
+         slot = std::move( obj );
+      }
+
+      /** Drops the pages and directories that were left empty */
+      void finish()
+      {
+         for( const auto& item : _pages )
+            if( std::none_of( item.second->begin(), item.second->end(),
+                              []( const std::shared_ptr<const object>& obj ) { return bool(obj); } ) )
+               (*_directories.at( item.first / directory_size ))[item.first % directory_size].reset();
+         for( const auto& item : _directories )
+            if( std::none_of( item.second->begin(), item.second->end(),
+                              []( const std::shared_ptr<const page>& pg ) { return bool(pg); } ) )
+               _snapshot._directories[item.first].reset();
+         while( !_snapshot._directories.empty() && !_snapshot._directories.back() )
+            _snapshot._directories.pop_back();
+      }
+
+   private:
+      directory& writable_directory( uint64_t d )
+      {
+         auto itr = _directories.find( d );
+         if( itr != _directories.end() )
+            return *itr->second;
+         if( _snapshot._directories.size() <= d )
+            _snapshot._directories.resize( d + 1 );
+         auto& current = _snapshot._directories[d];
+         auto fresh = current ? std::make_shared<directory>( *current ) : std::make_shared<directory>();
+         current = fresh;
+         return *_directories.emplace( d, std::move( fresh ) ).first->second;
+      }
+
+      page& writable_page( uint64_t p )
+      {
+         auto itr = _pages.find( p );
+         if( itr != _pages.end() )
+            return *itr->second;
+         auto& current = writable_directory( p / directory_size )[p % directory_size];
+         auto fresh = current ? std::make_shared<page>( *current ) : std::make_shared<page>();
+         current = fresh;
+         return *_pages.emplace( p, std::move( fresh ) ).first->second;
+      }
+
+      index_snapshot&                                              _snapshot;
+      std::unordered_map< uint64_t, std::shared_ptr<directory> >   _directories;
+      std::unordered_map< uint64_t, std::shared_ptr<page> >        _pages;
+};
+
+std::shared_ptr<const index_snapshot> index_snapshot::build( const index& idx )
+{
+   auto result = std::make_shared<index_snapshot>();
+   writer w( *result );
+   idx.inspect_all_objects( [&w]( const object& obj ) {
+      w.set( obj.id.instance(), std::shared_ptr<const object>( obj.clone() ) );
+   });
+   w.finish();
+   return result;
+}
+
+std::shared_ptr<const index_snapshot> index_snapshot::update( const index& idx,
+                                                              const std::unordered_set<object_id_type>& changed )const
+{
+   // only the directory table is copied here, the writer copies the directories and pages it changes
+   auto result = std::make_shared<index_snapshot>( *this );
+   writer w( *result );
+   for( const object_id_type& id : changed )
+   {
+      const object* obj = idx.find( id );
+      w.set( id.instance(), obj ? std::shared_ptr<const object>( obj->clone() ) : nullptr );
+   }
+   w.finish();
+   return result;
+}
+
+void index_snapshot::for_each( const std::function<void(const object&)>& f )const
+{
+   for( const auto& d : _directories )
+   {
+      if( !d )
+         continue;
+      for( const auto& p : *d )
+      {
+         if( !p )
+            continue;
+         for( const auto& obj : *p )
+            if( obj )
+               f( *obj );
+      }
+   }
+}
+
+size_t index_snapshot::page_count()const
+{
+   size_t result = 0;
+   for( const auto& d : _directories )
+      if( d )
+         result += std::count_if( d->begin(), d->end(), []( const std::shared_ptr<const page>& pg ) { return bool(pg); } );
+   return result;
+}
+
+} } // graphene::db
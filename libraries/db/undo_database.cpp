@@ -26,8 +26,146 @@
 #include <graphene/db/undo_database.hpp>
 #include <fc/reflect/variant.hpp>
 
+#include <algorithm>
+
 namespace graphene { namespace db {
 
+constexpr size_t undo_arena::default_chunk_size;
+constexpr uint64_t undo_position_map::empty_slot;
+
+void* undo_arena::allocate( size_t size, size_t alignment, chunk_pool& pool )
+{
+   if( !_chunks.empty() )
+   {
+      auto& c = _chunks.back();
+      size_t offset = ( c.used + alignment - 1 ) & ~( alignment - 1 );
+      if( offset + size <= c.size )
+      {
+         c.used = offset + size;
+         return c.data.get() + offset;
+      }
+   }
+
+   // chunks are allocated with new[] and thus aligned for any fundamental type
+   const size_t needed = size + alignment;
+   if( !pool.empty() && pool.back().size >= needed )
+   {
+      _chunks.emplace_back( std::move( pool.back() ) );
+      pool.pop_back();
+   }
+   else
+   {
+      chunk c;
+      c.size = std::max( needed, default_chunk_size );
+      c.data.reset( new char[c.size] );
+      _chunks.emplace_back( std::move(c) );
+   }
+   auto& c = _chunks.back();
+   c.used = size;
+   return c.data.get();
+}
+
+void undo_arena::splice( undo_arena& other )
+{
+   if( other._chunks.empty() )
+      return;
+   // keep the partially used chunk of this arena last so that it is still allocated from
+   if( !_chunks.empty() )
+   {
+      auto tail = std::move( _chunks.back() );
+      _chunks.pop_back();
+      std::move( other._chunks.begin(), other._chunks.end(), std::back_inserter( _chunks ) );
+      _chunks.emplace_back( std::move(tail) );
+   }
+   else
+      _chunks = std::move( other._chunks );
+   other._chunks.clear();
+}
+
+void undo_arena::release( chunk_pool& pool )
+{
+   for( auto& c : _chunks )
+   {
+      // oversized chunks belong to unusually large objects, don't keep them around
+      if( c.size != default_chunk_size )
+         continue;
+      c.used = 0;
+      pool.emplace_back( std::move(c) );
+   }
+   _chunks.clear();
+}
+
+size_t undo_arena::bytes_used()const
+{
+   size_t result = 0;
+   for( const auto& c : _chunks )
+      result += c.used;
+   return result;
+}
+
+size_t undo_position_map::slot_of( uint64_t key )const
+{
+   // Fibonacci hashing, instances of one index are consecutive
+   return size_t( ( key * 0x9E3779B97F4A7C15ull ) >> 32 ) & ( _slots.size() - 1 );
+}
+
+const uint32_t* undo_position_map::find( object_id_type id )const
+{
+   if( _size == 0 )
+      return nullptr;
+   const uint64_t key = id.number;
+   for( size_t slot = slot_of( key ); ; slot = ( slot + 1 ) & ( _slots.size() - 1 ) )
+   {
+      const auto& entry = _slots[slot];
+      if( entry.first == key )
+         return &entry.second;
+      if( entry.first == empty_slot )
+         return nullptr;
+   }
+}
+
+void undo_position_map::insert( object_id_type id, uint32_t position )
+{
+   if( ( _size + 1 ) * 2 > _slots.size() )
+      grow();
+   insert_key( id.number, position );
+}
+
+void undo_position_map::insert_key( uint64_t key, uint32_t position )
+{
+   size_t slot = slot_of( key );
+   while( _slots[slot].first != empty_slot && _slots[slot].first != key )
+      slot = ( slot + 1 ) & ( _slots.size() - 1 );
+   if( _slots[slot].first == empty_slot )
+      ++_size;
+   _slots[slot] = std::make_pair( key, position );
+}
+
+void undo_position_map::clear()
+{
+   if( _size == 0 )
+      return;
+   std::fill( _slots.begin(), _slots.end(), std::make_pair( empty_slot, uint32_t(0) ) );
+   _size = 0;
+}
+
+void undo_position_map::grow()
+{
+   vector< std::pair<uint64_t,uint32_t> > old_slots( std::max( _slots.size() * 2, size_t(64) ),
+                                                     std::make_pair( empty_slot, uint32_t(0) ) );
+   old_slots.swap( _slots );
+   _size = 0;
+   for( const auto& entry : old_slots )
+      if( entry.first != empty_slot )
+         insert_key( entry.first, entry.second );
+}
+
+undo_database::~undo_database()
+{
+   for( auto& log : _stack )
+      release_log( log );
+}
+
 void undo_database::enable()  { _disabled = false; }
 void undo_database::disable() { _disabled = true; }
 
@@ -44,6 +182,42 @@ undo_database::session::~session()
    if( _disable_on_exit ) _db.disable();
 }
 
+void undo_database::push_log()
+{
+   _stack.emplace_back();
+   if( !_position_map_pool.empty() )
+   {
+      _stack.back().first_record = std::move( _position_map_pool.back() );
+      _position_map_pool.pop_back();
+   }
+   _head_state_valid = false;
+}
+
+void undo_database::release_log( undo_session_log& log )
+{
+   for( auto& record : log.records )
+      if( record.old_value != nullptr )
+         record.old_value->~object();
+   log.records.clear();
+   log.arena.release( _chunk_pool );
+   log.first_record.clear();
+   _position_map_pool.emplace_back( std::move( log.first_record ) );
+}
+
+undo_session_log& undo_database::head_log()
+{
+   if( _stack.empty() )
+      push_log();
+   _head_state_valid = false;
+   return _stack.back();
+}
+
+object* undo_database::save_copy( undo_session_log& log, const object& obj )
+{
+   void* memory = log.arena.allocate( obj.object_size(), obj.object_alignment(), _chunk_pool );
+   return obj.clone_into( memory );
+}
+
 undo_database::session undo_database::start_undo_session( bool force_enable )
 {
    if( _disabled && !force_enable ) return session(*this);
@@ -52,9 +226,12 @@ undo_database::session undo_database::start_undo_session( bool force_enable )
       _disabled = false;
 
    while( size() > max_size() )
+   {
+      release_log( _stack.front() );
       _stack.pop_front();
+   }
 
-   _stack.emplace_back();
+   push_log();
    ++_active_sessions;
    return session(*this, disable_on_exit );
 }
@@ -62,48 +239,71 @@ void undo_database::on_create( const object& obj )
 {
    if( _disabled ) return;
 
-   if( _stack.empty() )
-      _stack.emplace_back();
-   auto& state = _stack.back();
+   auto& log = head_log();
    auto index_id = object_id_type( obj.id.space(), obj.id.type(), 0 );
-   auto itr = state.old_index_next_ids.find( index_id );
-   if( itr == state.old_index_next_ids.end() )
-      state.old_index_next_ids[index_id] = obj.id;
-   state.new_ids.insert(obj.id);
+   if( std::find( log.touched_indexes.begin(), log.touched_indexes.end(), index_id ) == log.touched_indexes.end() )
+   {
+      log.touched_indexes.push_back( index_id );
+      log.records.push_back( { undo_record::next_id, index_id, nullptr, obj.id } );
+   }
+   log.first_record.insert( obj.id, log.records.size() );
+   log.records.push_back( { undo_record::created, obj.id } );
 }
 void undo_database::on_modify( const object& obj )
 {
    if( _disabled ) return;
 
-   if( _stack.empty() )
-      _stack.emplace_back();
-   auto& state = _stack.back();
-   if( state.new_ids.find(obj.id) != state.new_ids.end() )
+   auto& log = head_log();
+   // created or already saved in this session
+   if( log.first_record.find( obj.id ) != nullptr )
       return;
-   auto itr =  state.old_values.find(obj.id);
-   if( itr != state.old_values.end() ) return;
-   state.old_values[obj.id] = obj.clone();
+   log.first_record.insert( obj.id, log.records.size() );
+   log.records.push_back( { undo_record::modified, obj.id, save_copy( log, obj ) } );
 }
 void undo_database::on_remove( const object& obj )
 {
    if( _disabled ) return;
 
-   if( _stack.empty() )
-      _stack.emplace_back();
-   undo_state& state = _stack.back();
-   if( state.new_ids.count(obj.id) > 0 )
+   auto& log = head_log();
+   const uint32_t* position = log.first_record.find( obj.id );
+   if( position != nullptr && *position >= log.merged_end )
    {
-      state.new_ids.erase(obj.id);
+      // no later record refers to this object, so the first record can absorb the removal
+      auto& record = log.records[*position];
+      if( record.type == undo_record::created )
+         record.type = undo_record::cancelled;
+      else if( record.type == undo_record::modified )
+         record.type = undo_record::removed;
       return;
    }
-   if( state.old_values.count(obj.id) > 0 )
-   {
-      state.removed[obj.id] = std::move(state.old_values[obj.id]);
-      state.old_values.erase(obj.id);
+   if( position != nullptr && log.records[*position].type == undo_record::removed )
       return;
+   log.records.push_back( { undo_record::removed, obj.id, save_copy( log, obj ) } );
+}
+
+void undo_database::replay_backwards( const undo_session_log& log )
+{
+   for( auto ritr = log.records.rbegin(); ritr != log.records.rend(); ++ritr )
+   {
+      const auto& record = *ritr;
+      switch( record.type )
+      {
+         case undo_record::created:
+            _db.remove( _db.get_object( record.id ) );
+            break;
+         case undo_record::modified:
+            _db.modify( _db.get_object( record.id ), [&]( object& obj ){ obj.move_from( *record.old_value ); } );
+            break;
+         case undo_record::removed:
+            _db.insert( std::move( *record.old_value ) );
+            break;
+         case undo_record::next_id:
+            _db.get_mutable_index( record.id.space(), record.id.type() ).set_next_id( record.old_next_id );
+            break;
+         case undo_record::cancelled:
+            break;
+      }
    }
-   if( state.removed.count(obj.id) > 0 ) return;
-   state.removed[obj.id] = obj.clone();
 }
 
 void undo_database::undo()
@@ -112,26 +312,12 @@ void undo_database::undo()
    FC_ASSERT( _active_sessions > 0 );
    disable();
 
-   auto& state = _stack.back();
-   for( auto& item : state.old_values )
-   {
-      _db.modify( _db.get_object( item.second->id ), [&]( object& obj ){ obj.move_from( *item.second ); } );
-   }
-
-   for( auto ritr = state.new_ids.begin(); ritr != state.new_ids.end(); ++ritr  )
-   {
-      _db.remove( _db.get_object(*ritr) );
-   }
-
-   for( auto& item : state.old_index_next_ids )
-   {
-      _db.get_mutable_index( item.first.space(), item.first.type() ).set_next_id( item.second );
-   }
-
-   for( auto& item : state.removed )
-      _db.insert( std::move(*item.second) );
+   auto& log = _stack.back();
+   replay_backwards( log );
+   release_log( log );
 
    _stack.pop_back();
+   _head_state_valid = false;
    enable();
    --_active_sessions;
 } FC_CAPTURE_AND_RETHROW() }
@@ -141,119 +327,26 @@ void undo_database::merge()
    FC_ASSERT( _active_sessions > 0 );
    if( _active_sessions == 1 && _stack.size() == 1 )
    {
+      release_log( _stack.back() );
       _stack.pop_back();
+      _head_state_valid = false;
       --_active_sessions;
       return;
    }
    FC_ASSERT( _stack.size() >=2 );
-   auto& state = _stack.back();
-   auto& prev_state = _stack[_stack.size()-2];
-
-   // An object's relationship to a state can be:
-   // in new_ids            : new
-   // in old_values (was=X) : upd(was=X)
-   // in removed (was=X)    : del(was=X)
-   // not in any of above   : nop
-   //
-   // When merging A=prev_state and B=state we have a 4x4 matrix of all possibilities:
-   //
-   //                   |--------------------- B ----------------------|
-   //
-   //                +------------+------------+------------+------------+
-   //                | new        | upd(was=Y) | del(was=Y) | nop        |
-   //   +------------+------------+------------+------------+------------+
-   // / | new        | N/A        | new       A| nop       C| new       A|
-   // | +------------+------------+------------+------------+------------+
-   // | | upd(was=X) | N/A        | upd(was=X)A| del(was=X)C| upd(was=X)A|
-   // A +------------+------------+------------+------------+------------+
-   // | | del(was=X) | N/A        | N/A        | N/A        | del(was=X)A|
-   // | +------------+------------+------------+------------+------------+
-   // \ | nop        | new       B| upd(was=Y)B| del(was=Y)B| nop      AB|
-   //   +------------+------------+------------+------------+------------+
-   //
-   // Each entry was composed by labelling what should occur in the given case.
-   //
-   // Type A means the composition of states contains the same entry as the first of the two merged states for that object.
-   // Type B means the composition of states contains the same entry as the second of the two merged states for that object.
-   // Type C means the composition of states contains an entry different from either of the merged states for that object.
-   // Type N/A means the composition of states violates causal timing.
-   // Type AB means both type A and type B simultaneously.
-   //
-   // The merge() operation is defined as modifying prev_state in-place to be the state object which represents the composition of
-   // state A and B.
-   //
-   // Type A (and AB) can be implemented as a no-op; prev_state already contains the correct value for the merged state.
-   // Type B (and AB) can be implemented by copying from state to prev_state.
-   // Type C needs special case-by-case logic.
-   // Type N/A can be ignored or assert(false) as it can only occur if prev_state and state have illegal values
-   // (a serious logic error which should never happen).
-   //
-
-   // We can only be outside type A/AB (the nop path) if B is not nop, so it suffices to iterate through B's three containers.
-
-   // *+upd
-   for( auto& obj : state.old_values )
-   {
-      if( prev_state.new_ids.find(obj.second->id) != prev_state.new_ids.end() )
-      {
-         // new+upd -> new, type A
-         continue;
-      }
-      if( prev_state.old_values.find(obj.second->id) != prev_state.old_values.end() )
-      {
-         // upd(was=X) + upd(was=Y) -> upd(was=X), type A
-         continue;
-      }
-      // del+upd -> N/A
-      assert( prev_state.removed.find(obj.second->id) == prev_state.removed.end() );
-      // nop+upd(was=Y) -> upd(was=Y), type B
-      prev_state.old_values[obj.second->id] = std::move(obj.second);
-   }
+   auto& log = _stack.back();
+   auto& prev_log = _stack[_stack.size()-2];
 
-   // *+new, but we assume the N/A cases don't happen, leaving type B nop+new -> new
-   for( auto id : state.new_ids )
-      prev_state.new_ids.insert(id);
-
-   // old_index_next_ids can only be updated, iterate over *+upd cases
-   for( auto& item : state.old_index_next_ids )
-   {
-      if( prev_state.old_index_next_ids.find( item.first ) == prev_state.old_index_next_ids.end() )
-      {
-         // nop+upd(was=Y) -> upd(was=Y), type B
-         prev_state.old_index_next_ids[item.first] = item.second;
-         continue;
-      }
-      else
-      {
-         // upd(was=X)+upd(was=Y) -> upd(was=X), type A
-         // type A implementation is a no-op, as discussed above, so there is no code here
-         continue;
-      }
-   }
+   // The merged session undoes the records of both sessions in reverse order, which composes to the state before
+   // prev_log without looking at individual objects. The saved copies move along with the arena.
+   prev_log.records.insert( prev_log.records.end(), log.records.begin(), log.records.end() );
+   prev_log.merged_end = prev_log.records.size();
+   prev_log.arena.splice( log.arena );
 
-   // *+del
-   for( auto& obj : state.removed )
-   {
-      if( prev_state.new_ids.find(obj.second->id) != prev_state.new_ids.end() )
-      {
-         // new + del -> nop (type C)
-         prev_state.new_ids.erase(obj.second->id);
-         continue;
-      }
-      auto it = prev_state.old_values.find(obj.second->id);
-      if( it != prev_state.old_values.end() )
-      {
-         // upd(was=X) + del(was=Y) -> del(was=X)
-         prev_state.removed[obj.second->id] = std::move(it->second);
-         prev_state.old_values.erase(obj.second->id);
-         continue;
-      }
-      // del + del -> N/A
-      assert( prev_state.removed.find( obj.second->id ) == prev_state.removed.end() );
-      // nop + del(was=Y) -> del(was=Y)
-      prev_state.removed[obj.second->id] = std::move(obj.second);
-   }
+   log.records.clear();
+   release_log( log );
    _stack.pop_back();
+   _head_state_valid = false;
    --_active_sessions;
 }
 void undo_database::commit()
@@ -269,27 +362,12 @@ void undo_database::pop_commit()
 
    disable();
    try {
-      auto& state = _stack.back();
-
-      for( auto& item : state.old_values )
-      {
-         _db.modify( _db.get_object( item.second->id ), [&]( object& obj ){ obj.move_from( *item.second ); } );
-      }
-
-      for( auto ritr = state.new_ids.begin(); ritr != state.new_ids.end(); ++ritr  )
-      {
-         _db.remove( _db.get_object(*ritr) );
-      }
-
-      for( auto& item : state.old_index_next_ids )
-      {
-         _db.get_mutable_index( item.first.space(), item.first.type() ).set_next_id( item.second );
-      }
-
-      for( auto& item : state.removed )
-         _db.insert( std::move(*item.second) );
+      auto& log = _stack.back();
+      replay_backwards( log );
+      release_log( log );
 
       _stack.pop_back();
+      _head_state_valid = false;
    }
    catch ( const fc::exception& e )
    {
@@ -299,10 +377,65 @@ void undo_database::pop_commit()
    }
    enable();
 }
+
+size_t undo_database::arena_bytes()const
+{
+   size_t result = 0;
+   for( const auto& log : _stack )
+      result += log.arena.bytes_used();
+   return result;
+}
+
 const undo_state& undo_database::head()const
 {
    FC_ASSERT( !_stack.empty() );
-   return _stack.back();
+   if( _head_state_valid )
+      return _head_state;
+
+   const auto& records = _stack.back().records;
+   _head_state.old_values.clear();
+   _head_state.old_index_next_ids.clear();
+   _head_state.new_ids.clear();
+   _head_state.removed.clear();
+
+   // Group the records of each object, keeping their order. The first record tells whether the object existed
+   // before the session and what it looked like, the last one whether it exists now.
+   vector<uint32_t> order;
+   order.reserve( records.size() );
+   for( uint32_t i = 0; i < records.size(); ++i )
+   {
+      const auto& record = records[i];
+      if( record.type == undo_record::next_id )
+      {
+         if( _head_state.old_index_next_ids.find( record.id ) == _head_state.old_index_next_ids.end() )
+            _head_state.old_index_next_ids[record.id] = record.old_next_id;
+      }
+      else if( record.type != undo_record::cancelled )
+         order.push_back( i );
+   }
+   std::stable_sort( order.begin(), order.end(), [&records]( uint32_t a, uint32_t b ) {
+      return records[a].id < records[b].id;
+   });
+
+   for( size_t first = 0; first < order.size(); )
+   {
+      size_t last = first;
+      while( last + 1 < order.size() && records[order[last + 1]].id == records[order[first]].id )
+         ++last;
+      const auto& oldest = records[order[first]];
+      const bool existed = oldest.type != undo_record::created;
+      const bool exists = records[order[last]].type != undo_record::removed;
+      if( !existed && exists )
+         _head_state.new_ids.emplace_hint( _head_state.new_ids.end(), oldest.id );
+      else if( existed && exists )
+         _head_state.old_values.emplace_hint( _head_state.old_values.end(), oldest.id, oldest.old_value );
+      else if( existed )
+         _head_state.removed.emplace_hint( _head_state.removed.end(), oldest.id, oldest.old_value );
+      first = last + 1;
+   }
+
+   _head_state_valid = true;
+   return _head_state;
 }
 
 } } // graphene::db
@@ -24,6 +24,9 @@
 #include <graphene/net/core_messages.hpp>
 
 #include <fc/io/raw.hpp>
+#include <fc/crypto/city.hpp>
+
+#include <cstring>
 
 namespace graphene { namespace net {
 
@@ -46,6 +49,44 @@ namespace graphene { namespace net {
   const core_message_type_enum check_firewall_reply_message::type            = core_message_type_enum::check_firewall_reply_message_type;
   const core_message_type_enum get_current_connections_request_message::type = core_message_type_enum::get_current_connections_request_message_type;
   const core_message_type_enum get_current_connections_reply_message::type   = core_message_type_enum::get_current_connections_reply_message_type;
+  const core_message_type_enum transport_upgrade_message::type               = core_message_type_enum::transport_upgrade_message_type;
+  const core_message_type_enum compact_block_message::type                   = core_message_type_enum::compact_block_message_type;
+  const core_message_type_enum get_block_transactions_message::type          = core_message_type_enum::get_block_transactions_message_type;
+  const core_message_type_enum block_transactions_message::type              = core_message_type_enum::block_transactions_message_type;
+
+  compact_block_message::compact_block_message(const item_hash_t& item_hash, const signed_block& block) :
+    item_hash(item_hash),
+    header(block)
+  {
+    transactions.resize(block.transactions.size());
+    for (size_t i = 0; i < block.transactions.size(); ++i)
+    {
+      transactions[i].short_id = short_id(item_hash, block.transactions[i].id());
+      transactions[i].operation_results = block.transactions[i].operation_results;
+    }
+  }
+
+  signed_block compact_block_message::rebuild(std::vector<signed_transaction>&& block_transactions) const
+  {
+    FC_ASSERT(block_transactions.size() == transactions.size());
+    signed_block block;
+    static_cast<graphene::protocol::signed_block_header&>(block) = header;
+    block.transactions.reserve(transactions.size());
+    for (size_t i = 0; i < transactions.size(); ++i)
+    {
+      block.transactions.emplace_back(std::move(block_transactions[i]));
+      block.transactions.back().operation_results = transactions[i].operation_results;
+    }
+    return block;
+  }
+
+  uint64_t compact_block_message::short_id(const item_hash_t& item_hash, const transaction_id_type& transaction_id)
+  {
+    char buffer[sizeof(item_hash_t) + sizeof(transaction_id_type)];
+    memcpy(buffer, item_hash.data(), sizeof(item_hash_t));
+    memcpy(buffer + sizeof(item_hash_t), transaction_id.data(), sizeof(transaction_id_type));
+    return fc::city_hash64(buffer, sizeof(buffer));
+  }
 
 } } // graphene::net
 
@@ -128,6 +169,19 @@ FC_REFLECT_DERIVED_NO_TYPENAME(graphene::net::get_current_connections_reply_mess
                                                             (upload_rate_one_hour)
                                                             (download_rate_one_hour)
                                                             (current_connections))
+FC_REFLECT_DERIVED_NO_TYPENAME(graphene::net::transport_upgrade_message, BOOST_PP_SEQ_NIL, (transport_version))
+FC_REFLECT_DERIVED_NO_TYPENAME(graphene::net::compact_transaction, BOOST_PP_SEQ_NIL, (short_id)(operation_results))
+FC_REFLECT_DERIVED_NO_TYPENAME(graphene::net::compact_block_message, BOOST_PP_SEQ_NIL,
+                                                    (item_hash)
+                                                    (header)
+                                                    (transactions))
+FC_REFLECT_DERIVED_NO_TYPENAME(graphene::net::get_block_transactions_message, BOOST_PP_SEQ_NIL,
+                                                             (item_hash)
+                                                             (block_id)
+                                                             (indexes))
+FC_REFLECT_DERIVED_NO_TYPENAME(graphene::net::block_transactions_message, BOOST_PP_SEQ_NIL,
+                                                         (item_hash)
+                                                         (transactions))
 
 GRAPHENE_IMPLEMENT_EXTERNAL_SERIALIZATION( graphene::net::trx_message )
 GRAPHENE_IMPLEMENT_EXTERNAL_SERIALIZATION( graphene::net::block_message )
@@ -151,3 +205,8 @@ GRAPHENE_IMPLEMENT_EXTERNAL_SERIALIZATION( graphene::net::check_firewall_reply_m
 GRAPHENE_IMPLEMENT_EXTERNAL_SERIALIZATION( graphene::net::get_current_connections_request_message )
 GRAPHENE_IMPLEMENT_EXTERNAL_SERIALIZATION( graphene::net::current_connection_data )
 GRAPHENE_IMPLEMENT_EXTERNAL_SERIALIZATION( graphene::net::get_current_connections_reply_message )
+GRAPHENE_IMPLEMENT_EXTERNAL_SERIALIZATION( graphene::net::transport_upgrade_message )
+GRAPHENE_IMPLEMENT_EXTERNAL_SERIALIZATION( graphene::net::compact_transaction )
+GRAPHENE_IMPLEMENT_EXTERNAL_SERIALIZATION( graphene::net::compact_block_message )
+GRAPHENE_IMPLEMENT_EXTERNAL_SERIALIZATION( graphene::net::get_block_transactions_message )
+GRAPHENE_IMPLEMENT_EXTERNAL_SERIALIZATION( graphene::net::block_transactions_message )
@@ -27,6 +27,13 @@
 
 #define GRAPHENE_NET_PROTOCOL_VERSION                        106
 
+/**
+ * Transport advertised as "transport_version" in the hello message.  Version 1,
+ * implied when it is missing, is the AES stream of stcp_socket.  Version 2 sends
+ * length-prefixed AES-256-GCM frames, see stcp_socket::start_sending_frames().
+ */
+#define GRAPHENE_NET_FRAMED_TRANSPORT_VERSION                2
+
 /**
  * Define this to enable debugging code in the p2p network interface.
  * This is code that would never be executed in normal operation, but is
@@ -62,6 +69,20 @@
 
 #define GRAPHENE_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES        (1024 * 1024)
 
+/**
+ * Number of threads that do the socket I/O, framing and encryption of the
+ * peer connections, connections are spread over them round robin.  The
+ * protocol itself is handled on the p2p thread.  0 keeps all I/O on the
+ * p2p thread; the "io_threads" advanced node parameter turns them on.
+ */
+#define GRAPHENE_NET_DEFAULT_IO_THREADS                      0
+
+/**
+ * How many bytes of received messages a connection may have waiting for
+ * the p2p thread before it stops reading from its socket
+ */
+#define GRAPHENE_NET_MAXIMUM_RECEIVED_MESSAGES_IN_BYTES      (2 * MAX_MESSAGE_SIZE)
+
 /**
  * When we receive a message from the network, we advertise it to
  * our peers and save a copy in a cache were we will find it if
@@ -73,6 +94,12 @@
  */
 #define GRAPHENE_NET_MESSAGE_CACHE_DURATION_IN_BLOCKS        5
 
+/**
+ * Most bytes of messages the cache holds.  Beyond this the oldest messages are
+ * dropped before their time, which bounds the cache during transaction floods.
+ */
+#define GRAPHENE_NET_MESSAGE_CACHE_MAX_BYTES                 (64 * 1024 * 1024)
+
 /**
  * We prevent a peer from offering us a list of blocks which, if we fetched them
  * all, would result in a blockchain that extended into the future.
@@ -86,6 +113,26 @@
 
 #define GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING      200
 
+/**
+ * During sync, each peer is sent as many block requests at once as it can
+ * deliver in its round trip time plus this many seconds, judging by the rate
+ * it has delivered blocks at so far.  The number of requests is kept between
+ * GRAPHENE_NET_MIN_SYNC_WINDOW and the maximum number of blocks per peer,
+ * and starts at GRAPHENE_NET_INITIAL_SYNC_WINDOW before the rate is known.
+ */
+#define GRAPHENE_NET_SYNC_WINDOW_SECONDS                     2
+#define GRAPHENE_NET_MIN_SYNC_WINDOW                         10
+#define GRAPHENE_NET_INITIAL_SYNC_WINDOW                     (GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING / 4)
+
+/**
+ * A sync block request a peer has not answered after this many times the
+ * time it usually takes to deliver a block (and at least the given number of
+ * seconds) is also sent to another peer, and the slow peer's number of
+ * outstanding requests is halved.
+ */
+#define GRAPHENE_NET_SYNC_REQUEST_REASSIGN_LATENCY_FACTOR    4
+#define GRAPHENE_NET_SYNC_REQUEST_REASSIGN_MIN_SECONDS       5
+
 /**
  * During normal operation, how many items will be fetched from each
  * peer at a time.  This will only come into play when the network
@@ -109,6 +156,15 @@
 
 #define GRAPHENE_NET_MAX_TRX_PER_SECOND                      1000
 
+/**
+ * Transactions from a peer are handed to the client one at a time, in the
+ * order they arrived.  No more transactions are fetched from a peer while
+ * this many of its transactions wait for the client, nor from any peer while
+ * the given total wait.
+ */
+#define GRAPHENE_NET_MAX_TRX_IN_FLIGHT_PER_PEER              100
+#define GRAPHENE_NET_MAX_TRX_IN_FLIGHT                       1000
+
 #define GRAPHENE_NET_MAX_NESTED_OBJECTS                      (250)
 
 #define MAXIMUM_PEERDB_SIZE 1000
@@ -85,6 +85,10 @@ namespace graphene { namespace net {
     check_firewall_reply_message_type            = 5015,
     get_current_connections_request_message_type = 5016,
     get_current_connections_reply_message_type   = 5017,
+    transport_upgrade_message_type               = 5018,
+    compact_block_message_type                   = 5019,
+    get_block_transactions_message_type          = 5020,
+    block_transactions_message_type              = 5021,
     core_message_type_last                       = 5099
   };
 
@@ -399,6 +403,87 @@ namespace graphene { namespace net {
     std::vector<current_connection_data> current_connections;
   };
 
+  /**
+   * Sent to a peer whose hello message advertised a transport_version we support, and in reply
+   * to it.  Everything the sender writes after this message uses that transport; the connection
+   * switches over as it writes or reads the message, before the node sees it.
+   */
+  struct transport_upgrade_message
+  {
+    static const core_message_type_enum type;
+
+    uint32_t transport_version = 0;
+
+    transport_upgrade_message() {}
+    explicit transport_upgrade_message(uint32_t transport_version) :
+      transport_version(transport_version)
+    {}
+  };
+
+  /// Stands in for a transaction of a compact block
+  struct compact_transaction
+  {
+    /// see compact_block_message::short_id()
+    uint64_t                                          short_id = 0;
+    std::vector<graphene::protocol::operation_result> operation_results;
+  };
+
+  /**
+   * A block sent as its signed header and short ids of its transactions, in reply to a
+   * fetch_items_message for compact_block_message_type.  The receiver takes the transactions
+   * from its message cache and asks for the ones it lacks with a get_block_transactions_message.
+   */
+  struct compact_block_message
+  {
+    static const core_message_type_enum type;
+
+    /// hash of the block_message that was requested
+    item_hash_t                             item_hash;
+    graphene::protocol::signed_block_header header;
+    std::vector<compact_transaction>        transactions;
+
+    compact_block_message() {}
+    compact_block_message(const item_hash_t& item_hash, const signed_block& block);
+
+    /// Puts the block back together from its transactions, in block order
+    signed_block rebuild(std::vector<signed_transaction>&& block_transactions) const;
+
+    /// Id of a transaction in the compact block of @p item_hash, salted so that collisions cannot be prepared ahead
+    static uint64_t short_id(const item_hash_t& item_hash, const transaction_id_type& transaction_id);
+  };
+
+  /// Asks for the transactions of a compact block the receiver does not have, by position in the block
+  struct get_block_transactions_message
+  {
+    static const core_message_type_enum type;
+
+    item_hash_t           item_hash;
+    block_id_type         block_id;
+    std::vector<uint32_t> indexes;
+
+    get_block_transactions_message() {}
+    get_block_transactions_message(const item_hash_t& item_hash, const block_id_type& block_id,
+                                   std::vector<uint32_t> indexes) :
+      item_hash(item_hash),
+      block_id(block_id),
+      indexes(std::move(indexes))
+    {}
+  };
+
+  /// Reply to a get_block_transactions_message, with the transactions in the order asked for
+  struct block_transactions_message
+  {
+    static const core_message_type_enum type;
+
+    item_hash_t                     item_hash;
+    std::vector<signed_transaction> transactions;
+
+    block_transactions_message() {}
+    explicit block_transactions_message(const item_hash_t& item_hash) :
+      item_hash(item_hash)
+    {}
+  };
+
 } } // graphene::net
 
 FC_REFLECT_ENUM( graphene::net::core_message_type_enum,
@@ -422,6 +507,10 @@ FC_REFLECT_ENUM( graphene::net::core_message_type_enum,
                  (check_firewall_reply_message_type)
                  (get_current_connections_request_message_type)
                  (get_current_connections_reply_message_type)
+                 (transport_upgrade_message_type)
+                 (compact_block_message_type)
+                 (get_block_transactions_message_type)
+                 (block_transactions_message_type)
                  (core_message_type_last) )
 FC_REFLECT_ENUM(graphene::net::rejection_reason_code, (unspecified)
                                                  (different_chain)
@@ -463,6 +552,11 @@ FC_REFLECT_TYPENAME( graphene::net::check_firewall_reply_message )
 FC_REFLECT_TYPENAME( graphene::net::get_current_connections_request_message )
 FC_REFLECT_TYPENAME( graphene::net::current_connection_data )
 FC_REFLECT_TYPENAME( graphene::net::get_current_connections_reply_message )
+FC_REFLECT_TYPENAME( graphene::net::transport_upgrade_message )
+FC_REFLECT_TYPENAME( graphene::net::compact_transaction )
+FC_REFLECT_TYPENAME( graphene::net::compact_block_message )
+FC_REFLECT_TYPENAME( graphene::net::get_block_transactions_message )
+FC_REFLECT_TYPENAME( graphene::net::block_transactions_message )
 
 GRAPHENE_DECLARE_EXTERNAL_SERIALIZATION( graphene::net::trx_message )
 GRAPHENE_DECLARE_EXTERNAL_SERIALIZATION( graphene::net::block_message )
@@ -486,6 +580,11 @@ GRAPHENE_DECLARE_EXTERNAL_SERIALIZATION( graphene::net::check_firewall_reply_mes
 GRAPHENE_DECLARE_EXTERNAL_SERIALIZATION( graphene::net::get_current_connections_request_message )
 GRAPHENE_DECLARE_EXTERNAL_SERIALIZATION( graphene::net::current_connection_data )
 GRAPHENE_DECLARE_EXTERNAL_SERIALIZATION( graphene::net::get_current_connections_reply_message )
+GRAPHENE_DECLARE_EXTERNAL_SERIALIZATION( graphene::net::transport_upgrade_message )
+GRAPHENE_DECLARE_EXTERNAL_SERIALIZATION( graphene::net::compact_transaction )
+GRAPHENE_DECLARE_EXTERNAL_SERIALIZATION( graphene::net::compact_block_message )
+GRAPHENE_DECLARE_EXTERNAL_SERIALIZATION( graphene::net::get_block_transactions_message )
+GRAPHENE_DECLARE_EXTERNAL_SERIALIZATION( graphene::net::block_transactions_message )
 
 #include <unordered_map>
 #include <fc/crypto/city.hpp>
@@ -25,6 +25,8 @@
 #include <fc/network/tcp_socket.hpp>
 #include <graphene/net/message.hpp>
 
+namespace fc { class thread; }
+
 namespace graphene { namespace net {
 
   namespace detail { class message_oriented_connection_impl; }
@@ -39,11 +41,17 @@ namespace graphene { namespace net {
     virtual void on_connection_closed(message_oriented_connection* originating_connection) = 0;
   };
 
-  /** uses a secure socket to create a connection that reads and writes a stream of `fc::net::message` objects */
+  /**
+   * uses a secure socket to create a connection that reads and writes a stream of `fc::net::message` objects
+   *
+   * The socket I/O, framing and encryption run on @p io_thread if one is given.  The delegate is always called
+   * on the thread that created the connection, one message at a time and in the order they were received.
+   */
   class message_oriented_connection
   {
      public:
-       message_oriented_connection(message_oriented_connection_delegate* delegate = nullptr);
+       message_oriented_connection(message_oriented_connection_delegate* delegate = nullptr,
+                                   fc::thread* io_thread = nullptr);
        ~message_oriented_connection();
        fc::tcp_socket& get_socket();
 
@@ -61,6 +69,8 @@ namespace graphene { namespace net {
        fc::time_point get_last_message_received_time() const;
        fc::time_point get_connection_time() const;
        fc::sha512     get_shared_secret() const;
+       /// @return the thread the socket I/O runs on
+       fc::thread*    get_io_thread() const;
      private:
        std::unique_ptr<detail::message_oriented_connection_impl> my;
   };
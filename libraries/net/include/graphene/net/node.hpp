@@ -284,6 +284,7 @@ namespace graphene { namespace net {
          */
         void clear_peer_database();
 
+        /// Limits the bandwidth of all connections, throws while some are on I/O threads, the limits cannot apply there
         void set_total_bandwidth_limit(uint32_t upload_bytes_per_second, uint32_t download_bytes_per_second);
 
         fc::variant_object network_get_info() const;
@@ -37,6 +37,7 @@
 #include <boost/multi_index/tag.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 
+#include <map>
 #include <queue>
 #include <boost/container/deque.hpp>
 #include <fc/thread/future.hpp>
@@ -58,6 +59,15 @@ namespace graphene { namespace net
       node_id_t        requesting_peer;
     };
 
+    /// A compact block waiting for the transactions we asked its sender for
+    struct partial_compact_block
+    {
+      compact_block_message           block;
+      /// transactions of the block, in block order; the ones at missing are still empty
+      std::vector<signed_transaction> transactions;
+      std::vector<uint32_t>           missing;
+    };
+
     class peer_connection;
     class peer_connection_delegate
     {
@@ -66,7 +76,9 @@ namespace graphene { namespace net
       virtual void on_message(peer_connection* originating_peer,
                               const message& received_message) = 0;
       virtual void on_connection_closed(peer_connection* originating_peer) = 0;
-      virtual message get_message_for_item(const item_id& item) = 0;
+      virtual std::shared_ptr<const message> get_message_for_item(const item_id& item) = 0;
+      /// @return the thread to run the socket I/O of a new connection on, nullptr for the calling thread
+      virtual fc::thread* get_io_thread() { return nullptr; }
     };
 
     using peer_connection_ptr = std::shared_ptr<peer_connection>;
@@ -120,7 +132,7 @@ namespace graphene { namespace net
           enqueue_time(enqueue_time)
         {}
 
-        virtual message get_message(peer_connection_delegate* node) = 0;
+        virtual std::shared_ptr<const message> get_message(peer_connection_delegate* node) = 0;
         /** returns roughly the number of bytes of memory the message is consuming while
          * it is sitting on the queue
          */
@@ -133,16 +145,31 @@ namespace graphene { namespace net
        */
       struct real_queued_message : queued_message
       {
-        message        message_to_send;
+        std::shared_ptr<message> message_to_send;
         size_t         message_send_time_field_offset;
 
         real_queued_message(message message_to_send,
                             size_t message_send_time_field_offset = (size_t)-1) :
-          message_to_send(std::move(message_to_send)),
+          message_to_send(std::make_shared<message>(std::move(message_to_send))),
           message_send_time_field_offset(message_send_time_field_offset)
         {}
 
-        message get_message(peer_connection_delegate* node) override;
+        std::shared_ptr<const message> get_message(peer_connection_delegate* node) override;
+        size_t get_size_in_queue() override;
+      };
+
+      /* a 'shared_queued_message' refers to a message that is also held elsewhere, like
+       * in the node's message cache, so queueing it does not copy it
+       */
+      struct shared_queued_message : queued_message
+      {
+        std::shared_ptr<const message> message_to_send;
+
+        explicit shared_queued_message(std::shared_ptr<const message> message_to_send) :
+          message_to_send(std::move(message_to_send))
+        {}
+
+        std::shared_ptr<const message> get_message(peer_connection_delegate* node) override;
         size_t get_size_in_queue() override;
       };
 
@@ -158,7 +185,7 @@ namespace graphene { namespace net
           item_to_send(std::move(the_item_to_send))
         {}
 
-        message get_message(peer_connection_delegate* node) override;
+        std::shared_ptr<const message> get_message(peer_connection_delegate* node) override;
         size_t get_size_in_queue() override;
       };
 
@@ -204,6 +231,14 @@ namespace graphene { namespace net
       fc::optional<fc::time_point_sec> fc_git_revision_unix_timestamp;
       fc::optional<std::string> platform;
       fc::optional<uint32_t> bitness;
+      /// highest transport version the peer advertised, 1 is the AES stream every node speaks
+      uint32_t         transport_version = 1;
+      /// we sent the peer a transport_upgrade_message, everything we send after it goes in frames
+      bool             transport_upgrade_sent = false;
+      /// the peer sent us a transport_upgrade_message, everything it sends after it comes in frames
+      bool             transport_upgrade_received = false;
+      /// the peer advertised it can send blocks as compact_block_messages
+      bool             supports_compact_blocks = false;
 
       // for inbound connections, these fields record what the peer sent us in
       // its hello message.  For outbound, they record what we sent the peer
@@ -224,12 +259,37 @@ namespace graphene { namespace net
       bool we_need_sync_items_from_peer = false;
       fc::optional<boost::tuple<std::vector<item_hash_t>, fc::time_point> > item_ids_requested_from_peer; /// we check this to detect a timed-out request and in busy()
       fc::time_point last_sync_item_received_time; /// the time we received the last sync item or the time we sent the last batch of sync item requests to this peer
-      std::set<item_hash_t> sync_items_requested_from_peer; /// ids of blocks we've requested from this peer during sync.  fetch from another peer if this peer disconnects
+      /// ids of blocks we've requested from this peer during sync and when.  fetch from another peer if this peer disconnects.
+      /// the time is fc::time_point::maximum() once the request was also sent to another peer, the request is dropped
+      /// once the block was received from another peer
+      std::map<item_hash_t, fc::time_point> sync_items_requested_from_peer;
+      /// requests dropped from sync_items_requested_from_peer because another peer sent the block first, so the copy
+      /// this peer may still send is not taken for one we didn't ask for.  Only the most recent ones are kept
+      boost::container::deque<item_hash_t> sync_items_received_elsewhere;
       item_hash_t last_block_delegate_has_seen; /// the hash of the last block  this peer has told us about that the peer knows
       fc::time_point_sec last_block_time_delegate_has_seen;
       bool inhibit_fetching_sync_blocks = false;
       /// @}
 
+      /// how fast this peer delivers sync blocks, used to decide how many and which blocks to request from it
+      /// @{
+      uint32_t sync_window = GRAPHENE_NET_INITIAL_SYNC_WINDOW; /// how many sync blocks we may have requested from this peer at once
+      double sync_blocks_per_second = 0; /// smoothed rate this peer has delivered sync blocks at, 0 until measured
+      fc::microseconds sync_block_latency; /// smoothed time between requesting a sync block and receiving it
+      uint64_t sync_blocks_received = 0;
+      uint64_t sync_requests_reassigned = 0; /// sync requests this peer was too slow to answer that were also sent to another peer
+      uint64_t sync_duplicates_dropped = 0; /// sync blocks this peer sent after another peer had sent them
+      fc::time_point sync_rate_interval_start; /// when we started counting the blocks the current rate sample is taken from
+      uint32_t sync_blocks_in_rate_interval = 0;
+      /// @}
+
+      /// bytes of a connection on an I/O thread already added to the node's bandwidth figures, the rate limiter
+      /// does not see them
+      /// @{
+      uint64_t bytes_received_counted = 0;
+      uint64_t bytes_sent_counted = 0;
+      /// @}
+
       /// non-synchronization state data
       /// @{
       struct timestamped_item_id
@@ -251,12 +311,26 @@ namespace graphene { namespace net
       timestamped_items_set_type inventory_advertised_to_peer;
 
       item_to_time_map_type items_requested_from_peer;  /// items we've requested from this peer during normal operation.  fetch from another peer if this peer disconnects
+      std::map<item_hash_t, partial_compact_block> compact_blocks_in_progress; /// requested blocks the peer sent compact, waiting for their missing transactions
       /// @}
 
       // if they're flooding us with transactions, we set this to avoid fetching for a few seconds to let the
       // blockchain catch up
       fc::time_point transaction_fetching_inhibited_until;
 
+      /// transactions received from this peer that wait to be handed to the client, in the order they arrived,
+      /// so that one depending on an earlier one is not rejected for coming first
+      /// @{
+      struct received_transaction
+      {
+        message           trx;
+        message_hash_type message_hash;
+        fc::time_point    receive_time;
+      };
+      std::queue<received_transaction> transactions_to_deliver;
+      bool delivering_transactions = false; /// whether a task is handing transactions_to_deliver to the client
+      /// @}
+
       uint32_t last_known_fork_block_number = 0;
 
       fc::future<void> accept_or_connect_task_done;
@@ -275,6 +349,8 @@ namespace graphene { namespace net
       virtual ~peer_connection();
 
       fc::tcp_socket& get_socket();
+      /// @return whether the socket I/O of this connection runs on a thread other than the one that created it
+      bool has_io_thread() const;
       void accept_connection();
       void connect_to(const fc::ip::endpoint& remote_endpoint, fc::optional<fc::ip::endpoint> local_endpoint = fc::optional<fc::ip::endpoint>());
 
@@ -283,6 +359,7 @@ namespace graphene { namespace net
 
       void send_queueable_message(std::unique_ptr<queued_message>&& message_to_send);
       void send_message(const message& message_to_send, size_t message_send_time_field_offset = (size_t)-1);
+      void send_message(std::shared_ptr<const message> message_to_send);
       void send_item(const item_id& item_to_send);
       void close_connection();
       void destroy_connection();
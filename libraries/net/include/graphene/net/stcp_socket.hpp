@@ -26,11 +26,23 @@
 #include <fc/crypto/aes.hpp>
 #include <fc/crypto/elliptic.hpp>
 
+#include <memory>
+#include <vector>
+
 namespace graphene { namespace net {
 
+namespace detail { class aead_channel; }
+
 /**
  *  Uses ECDH to negotiate a aes key for communicating
  *  with other nodes on the network.
+ *
+ *  Initially the socket is an AES stream, read and written in multiples of
+ *  16 bytes.  Either direction can be switched to frames once both sides
+ *  know the other supports them: each frame is a 4 byte little endian
+ *  length, the ciphertext of that many bytes and a 16 byte AES-256-GCM tag
+ *  over both.  Each direction has its own key, derived from the shared
+ *  secret and the sender's public key, and counts its frames for the nonce.
  */
 class stcp_socket : public virtual fc::iostream
 {
@@ -56,6 +68,25 @@ class stcp_socket : public virtual fc::iostream
     using istream::get;
     void             get( char& c ) { read( &c, 1 ); }
     fc::sha512       get_shared_secret() const { return _shared_secret; }
+
+    /** Everything written from now on has to go through @ref write_frame */
+    void             start_sending_frames();
+    /** Everything read from now on has to go through @ref read_frame */
+    void             start_receiving_frames();
+    bool             is_sending_frames() const { return bool(_send_frames); }
+    bool             is_receiving_frames() const { return bool(_recv_frames); }
+
+    /**
+     *  Encrypts @p head followed by @p body into one frame and writes it with a single write
+     *  @return the number of bytes written
+     */
+    size_t           write_frame( const char* head, size_t head_len, const char* body, size_t body_len );
+    /**
+     *  Reads a frame of up to @p max_len bytes, decrypting the first @p head_len bytes to @p head
+     *  and the rest to @p body
+     *  @return the number of bytes read
+     */
+    size_t           read_frame( char* head, size_t head_len, std::vector<char>& body, size_t max_len );
   private:
     void do_key_exchange();
 
@@ -66,6 +97,10 @@ class stcp_socket : public virtual fc::iostream
     fc::aes_decoder      _recv_aes;
     std::shared_ptr<char> _read_buffer;
     std::shared_ptr<char> _write_buffer;
+    fc::ecc::public_key_data              _remote_public_key;
+    std::unique_ptr<detail::aead_channel> _send_frames;
+    std::unique_ptr<detail::aead_channel> _recv_frames;
+    std::vector<char>                     _write_frame_buffer;
 #ifndef NDEBUG
     bool _read_buffer_in_use;
     bool _write_buffer_in_use;
@@ -30,9 +30,14 @@
 
 #include <graphene/net/message_oriented_connection.hpp>
 #include <graphene/net/stcp_socket.hpp>
+#include <graphene/net/core_messages.hpp>
 #include <graphene/net/config.hpp>
 
+#include <boost/scope_exit.hpp>
+
 #include <atomic>
+#include <deque>
+#include <mutex>
 
 #ifdef DEFAULT_LOGGER
 # undef DEFAULT_LOGGER
@@ -53,24 +58,51 @@ namespace graphene { namespace net {
     private:
       message_oriented_connection* _self;
       message_oriented_connection_delegate *_delegate;
+      /// The thread the connection was created on, the delegate is called there
+      fc::thread* _thread;
+      /// The thread doing the socket I/O, framing and encryption
+      fc::thread* _io_thread;
       stcp_socket _sock;
       fc::promise<void>::ptr _ready_for_sending;
+      fc::future<void> _connect_done;
       fc::future<void> _read_loop_done;
-      uint64_t _bytes_received;
-      uint64_t _bytes_sent;
+      fc::future<void> _send_done;
+      std::atomic<uint64_t> _bytes_received;
+      std::atomic<uint64_t> _bytes_sent;
 
       fc::time_point _connected_time;
-      fc::time_point _last_message_received_time;
-      fc::time_point _last_message_sent_time;
+      // microseconds since the epoch, written on the I/O thread
+      std::atomic<int64_t> _last_message_received_time;
+      std::atomic<int64_t> _last_message_sent_time;
 
       std::atomic_bool _send_message_in_progress;
       std::atomic_bool _read_loop_in_progress;
-#ifndef NDEBUG
-      fc::thread* _thread;
-#endif
+
+      // Messages read from the socket that have not been handed to the delegate yet
+      std::mutex             _received_mutex;
+      std::deque<message>    _received;
+      size_t                 _received_bytes = 0;
+      bool                   _delivery_scheduled = false;
+      bool                   _read_loop_closed = false; // the read loop ended, the delegate has to be told
+      bool                   _destroyed = false;
+      fc::future<void>       _delivery_done;
+      fc::promise<void>::ptr _received_drained;         // the read loop waits on this while too much is queued
+
+      // only used on _thread
+      bool                   _delivering = false;
+      /// Cleared by destroy_connection(), a delivery parked in the delegate checks it before touching this object
+      std::shared_ptr<bool>  _alive = std::make_shared<bool>(true);
+      bool                   _closed_notified = false;
+      bool                   _sending_frames = false;   // an upgrade to frames was sent
 
       void read_loop();
       void start_read_loop();
+      void queue_received_message(message&& received_message);
+      void schedule_delivery();
+      void deliver_received_messages();
+      void notify_connection_closed();
+      template<typename Functor>
+      void run_on_io_thread(Functor&& f, const char* description);
     public:
       fc::tcp_socket& get_socket();
       void accept();
@@ -78,7 +110,8 @@ namespace graphene { namespace net {
       void bind(const fc::ip::endpoint& local_endpoint);
 
       message_oriented_connection_impl(message_oriented_connection* self,
-                                       message_oriented_connection_delegate* delegate = nullptr);
+                                       message_oriented_connection_delegate* delegate = nullptr,
+                                       fc::thread* io_thread = nullptr);
       ~message_oriented_connection_impl();
 
       void send_message(const message& message_to_send);
@@ -92,20 +125,23 @@ namespace graphene { namespace net {
       fc::time_point get_last_message_received_time() const;
       fc::time_point get_connection_time() const { return _connected_time; }
       fc::sha512 get_shared_secret() const;
+      fc::thread* get_io_thread() const { return _io_thread; }
     };
 
     message_oriented_connection_impl::message_oriented_connection_impl(message_oriented_connection* self,
-                                                                       message_oriented_connection_delegate* delegate)
+                                                                       message_oriented_connection_delegate* delegate,
+                                                                       fc::thread* io_thread)
     : _self(self),
       _delegate(delegate),
+      _thread(&fc::thread::current()),
+      _io_thread(io_thread ? io_thread : &fc::thread::current()),
       _ready_for_sending(fc::promise<void>::create()),
       _bytes_received(0),
       _bytes_sent(0),
+      _last_message_received_time(0),
+      _last_message_sent_time(0),
       _send_message_in_progress(false),
       _read_loop_in_progress(false)
-#ifndef NDEBUG
-      ,_thread(&fc::thread::current())
-#endif
     {
     }
     message_oriented_connection_impl::~message_oriented_connection_impl()
@@ -114,6 +150,19 @@ namespace graphene { namespace net {
       destroy_connection();
     }
 
+    template<typename Functor>
+    void message_oriented_connection_impl::run_on_io_thread(Functor&& f, const char* description)
+    {
+      if (_io_thread->is_current())
+        f();
+      else
+      {
+        // kept so that destroy_connection() can stop it if the caller is canceled while waiting
+        _connect_done = _io_thread->async(std::forward<Functor>(f), description);
+        _connect_done.wait();
+      }
+    }
+
     fc::tcp_socket& message_oriented_connection_impl::get_socket()
     {
       VERIFY_CORRECT_THREAD();
@@ -123,18 +172,17 @@ namespace graphene { namespace net {
     void message_oriented_connection_impl::accept()
     {
       VERIFY_CORRECT_THREAD();
-      _sock.accept();
-      assert(!_read_loop_done.valid()); // check to be sure we never launch two read loops
-      _read_loop_done = fc::async([=](){ read_loop(); }, "message read_loop");
+      run_on_io_thread([this](){ _sock.accept(); }, "message_oriented_connection accept");
+      start_read_loop();
       _ready_for_sending->set_value();
     }
 
     void message_oriented_connection_impl::connect_to(const fc::ip::endpoint& remote_endpoint)
     {
       VERIFY_CORRECT_THREAD();
-      _sock.connect_to(remote_endpoint);
-      assert(!_read_loop_done.valid()); // check to be sure we never launch two read loops
-      _read_loop_done = fc::async([=](){ read_loop(); }, "message read_loop");
+      run_on_io_thread([this, remote_endpoint](){ _sock.connect_to(remote_endpoint); },
+                       "message_oriented_connection connect_to");
+      start_read_loop();
       _ready_for_sending->set_value();
     }
 
@@ -144,6 +192,14 @@ namespace graphene { namespace net {
       _sock.bind(local_endpoint);
     }
 
+    void message_oriented_connection_impl::start_read_loop()
+    {
+      VERIFY_CORRECT_THREAD();
+      assert(!_read_loop_done.valid()); // check to be sure we never launch two read loops
+      _connected_time = fc::time_point::now();
+      _read_loop_done = _io_thread->async([this](){ read_loop(); }, "message read_loop");
+    }
+
     class no_parallel_execution_guard final
     {
       std::atomic_bool* _flag;
@@ -161,15 +217,13 @@ namespace graphene { namespace net {
 
     void message_oriented_connection_impl::read_loop()
     {
-      VERIFY_CORRECT_THREAD();
+      assert(_io_thread->is_current());
       const int BUFFER_SIZE = 16;
       const int LEFTOVER = BUFFER_SIZE - sizeof(message_header);
       static_assert(BUFFER_SIZE >= sizeof(message_header), "insufficient buffer");
 
       no_parallel_execution_guard guard( &_read_loop_in_progress );
 
-      _connected_time = fc::time_point::now();
-
       fc::oexception exception_to_rethrow;
       bool call_on_connection_closed = false;
 
@@ -179,37 +233,44 @@ namespace graphene { namespace net {
         char buffer[BUFFER_SIZE];
         while( true )
         {
-          _sock.read(buffer, BUFFER_SIZE);
-          _bytes_received += BUFFER_SIZE;
-          memcpy((char*)&m, buffer, sizeof(message_header));
-          FC_ASSERT( m.size.value() <= MAX_MESSAGE_SIZE, "", ("m.size",m.size.value())("MAX_MESSAGE_SIZE",MAX_MESSAGE_SIZE) );
-
-          size_t remaining_bytes_with_padding = 16 * ((m.size.value() - LEFTOVER + 15) / 16);
-          m.data.resize(LEFTOVER + remaining_bytes_with_padding); //give extra 16 bytes to allow for padding added in send call
-          std::copy(buffer + sizeof(message_header), buffer + sizeof(buffer), m.data.begin());
-          if (remaining_bytes_with_padding)
+          if (_sock.is_receiving_frames())
           {
-            _sock.read(&m.data[LEFTOVER], remaining_bytes_with_padding);
-            _bytes_received += remaining_bytes_with_padding;
+            _bytes_received += _sock.read_frame((char*)&m, sizeof(message_header), m.data,
+                                                sizeof(message_header) + MAX_MESSAGE_SIZE);
+            FC_ASSERT( m.size.value() == m.data.size(), "frame does not hold the message it announces",
+                       ("m.size",m.size.value())("frame",m.data.size()) );
           }
-          m.data.resize(m.size.value()); // truncate off the padding bytes
-
-          _last_message_received_time = fc::time_point::now();
-
-          try
+          else
           {
-            // message handling errors are warnings...
-            _delegate->on_message(_self, m);
+            _sock.read(buffer, BUFFER_SIZE);
+            _bytes_received += BUFFER_SIZE;
+            memcpy((char*)&m, buffer, sizeof(message_header));
+            FC_ASSERT( m.size.value() <= MAX_MESSAGE_SIZE, "", ("m.size",m.size.value())("MAX_MESSAGE_SIZE",MAX_MESSAGE_SIZE) );
+
+            size_t remaining_bytes_with_padding = 16 * ((m.size.value() - LEFTOVER + 15) / 16);
+            m.data.resize(LEFTOVER + remaining_bytes_with_padding); //give extra 16 bytes to allow for padding added in send call
+            std::copy(buffer + sizeof(message_header), buffer + sizeof(buffer), m.data.begin());
+            if (remaining_bytes_with_padding)
+            {
+              _sock.read(&m.data[LEFTOVER], remaining_bytes_with_padding);
+              _bytes_received += remaining_bytes_with_padding;
+            }
+            m.data.resize(m.size.value()); // truncate off the padding bytes
           }
-          /// Dedicated catches needed to distinguish from general fc::exception
-          catch ( const fc::canceled_exception& e ) { throw; }
-          catch ( const fc::eof_exception& e ) { throw; }
-          catch ( const fc::exception& e)
+
+          _last_message_received_time = fc::time_point::now().time_since_epoch().count();
+
+          if (m.msg_type.value() == core_message_type_enum::transport_upgrade_message_type)
           {
-            /// Here loop should be continued so exception should be just caught locally.
-            wlog( "message transmission failed ${er}", ("er", e.to_detail_string() ) );
-            throw;
+            // everything after this message comes in frames
+            FC_ASSERT( !_sock.is_receiving_frames(), "transport upgraded twice" );
+            uint32_t version = m.as<transport_upgrade_message>().transport_version;
+            FC_ASSERT( version == GRAPHENE_NET_FRAMED_TRANSPORT_VERSION, "unsupported transport version ${v}",
+                       ("v",version) );
+            _sock.start_receiving_frames();
           }
+
+          queue_received_message(std::move(m));
         }
       }
       catch ( const fc::canceled_exception& e )
@@ -242,12 +303,133 @@ namespace graphene { namespace net {
       }
 
       if (call_on_connection_closed)
-        _delegate->on_connection_closed(_self);
+      {
+        // the delegate hears of it after the messages received before
+        std::lock_guard<std::mutex> lock(_received_mutex);
+        _read_loop_closed = true;
+        schedule_delivery();
+      }
 
       if (exception_to_rethrow)
         throw *exception_to_rethrow;
     }
 
+    void message_oriented_connection_impl::queue_received_message(message&& received_message)
+    {
+      fc::promise<void>::ptr drained;
+      {
+        std::lock_guard<std::mutex> lock(_received_mutex);
+        _received_bytes += received_message.data.size();
+        _received.push_back(std::move(received_message));
+        schedule_delivery();
+        if (_received_bytes > GRAPHENE_NET_MAXIMUM_RECEIVED_MESSAGES_IN_BYTES && !_destroyed)
+          drained = _received_drained = fc::promise<void>::create("message_oriented_connection received messages");
+      }
+      // stop reading until the delegate has caught up, the peer is throttled by TCP meanwhile
+      if (drained)
+        drained->wait();
+    }
+
+    // must be called with _received_mutex locked
+    void message_oriented_connection_impl::schedule_delivery()
+    {
+      if (_delivery_scheduled || _destroyed)
+        return;
+      _delivery_scheduled = true;
+      _delivery_done = _thread->async([this](){ deliver_received_messages(); },
+                                      "message_oriented_connection deliver_received_messages");
+    }
+
+    void message_oriented_connection_impl::deliver_received_messages()
+    {
+      VERIFY_CORRECT_THREAD();
+      // the delegate may yield, and this object may be destroyed before it returns
+      const std::shared_ptr<bool> alive = _alive;
+      _delivering = true;
+      BOOST_SCOPE_EXIT(this_, &alive) {
+        if (*alive)
+          this_->_delivering = false;
+      } BOOST_SCOPE_EXIT_END
+
+      while (true)
+      {
+        message m;
+        bool closed = false;
+        {
+          std::lock_guard<std::mutex> lock(_received_mutex);
+          if (_received_drained && _received_bytes <= GRAPHENE_NET_MAXIMUM_RECEIVED_MESSAGES_IN_BYTES / 2)
+          {
+            _received_drained->set_value();
+            _received_drained.reset();
+          }
+          if (_received.empty())
+          {
+            _delivery_scheduled = false;
+            if (!_read_loop_closed || _closed_notified)
+              return;
+            closed = true;
+          }
+          else
+          {
+            message& next = _received.front();
+            static_cast<message_header&>(m) = next;
+            m.data.swap(next.data);
+            _received.pop_front();
+            _received_bytes -= m.data.size();
+          }
+        }
+        if (closed)
+        {
+          notify_connection_closed();
+          return;
+        }
+
+        try
+        {
+          // message handling errors are warnings...
+          _delegate->on_message(_self, m);
+        }
+        /// Dedicated catches needed to distinguish from general fc::exception
+        catch ( const fc::canceled_exception& e ) { throw; }
+        catch ( const fc::exception& e )
+        {
+          // ...but they end the connection, as they did when messages were handled in the read loop
+          wlog( "message transmission failed ${er}", ("er", e.to_detail_string() ) );
+          elog( "disconnected ${er}", ("er", e.to_detail_string() ) );
+          if (!*alive)
+            return;
+          {
+            std::lock_guard<std::mutex> lock(_received_mutex);
+            _received.clear();
+            _received_bytes = 0;
+            _delivery_scheduled = false;
+          }
+          try
+          {
+            close_connection();
+          }
+          catch ( const fc::exception& close_error )
+          {
+            wlog( "Exception thrown while closing the connection, ignoring: ${e}", ("e", close_error) );
+          }
+          if (*alive)
+            notify_connection_closed();
+          return;
+        }
+        if (!*alive)
+          return;
+      }
+    }
+
+    void message_oriented_connection_impl::notify_connection_closed()
+    {
+      VERIFY_CORRECT_THREAD();
+      if (_closed_notified)
+        return;
+      _closed_notified = true;
+      _delegate->on_connection_closed(_self);
+    }
+
     void message_oriented_connection_impl::send_message(const message& message_to_send)
     {
       VERIFY_CORRECT_THREAD();
@@ -268,29 +450,61 @@ namespace graphene { namespace net {
 
       try
       {
-        size_t size_of_message_and_header = sizeof(message_header) + message_to_send.size.value();
         if( message_to_send.size.value() > MAX_MESSAGE_SIZE )
            elog("Trying to send a message larger than MAX_MESSAGE_SIZE. This probably won't work...");
+        // encryption and writing happen on the I/O thread, the buffer is shared in case we are canceled meanwhile
+        if (_sending_frames)
+        {
+          auto frame = std::make_shared<message>( message_to_send );
+          _send_done = _io_thread->async( [this, frame](){
+                _bytes_sent += _sock.write_frame( (const char*)static_cast<const message_header*>(frame.get()),
+                                                  sizeof(message_header), frame->data.data(), frame->data.size() );
+                _sock.flush();
+                _last_message_sent_time = fc::time_point::now().time_since_epoch().count();
+             }, "message_oriented_connection send_message" );
+          _send_done.wait();
+          return;
+        }
+
+        bool upgrade = message_to_send.msg_type.value() == core_message_type_enum::transport_upgrade_message_type;
+        if (upgrade)
+        {
+          uint32_t version = message_to_send.as<transport_upgrade_message>().transport_version;
+          FC_ASSERT( version == GRAPHENE_NET_FRAMED_TRANSPORT_VERSION, "unsupported transport version ${v}",
+                     ("v",version) );
+        }
+
+        size_t size_of_message_and_header = sizeof(message_header) + message_to_send.size.value();
         //pad the message we send to a multiple of 16 bytes
         size_t size_with_padding = 16 * ((size_of_message_and_header + 15) / 16);
-        std::vector<char> padded_message( size_with_padding );
+        auto padded_message = std::make_shared<std::vector<char>>( size_with_padding );
 
-        memcpy( padded_message.data(), (const char*)&message_to_send, sizeof(message_header) );
-        memcpy( padded_message.data() + sizeof(message_header), message_to_send.data.data(),
+        memcpy( padded_message->data(), (const char*)&message_to_send, sizeof(message_header) );
+        memcpy( padded_message->data() + sizeof(message_header), message_to_send.data.data(),
                 message_to_send.size.value() );
-        char* padding_space = padded_message.data() + sizeof(message_header) + message_to_send.size.value();
+        char* padding_space = padded_message->data() + sizeof(message_header) + message_to_send.size.value();
         memset(padding_space, 0, size_with_padding - size_of_message_and_header);
-        _sock.write( padded_message.data(), size_with_padding );
-        _sock.flush();
-        _bytes_sent += size_with_padding;
-        _last_message_sent_time = fc::time_point::now();
+        _send_done = _io_thread->async( [this, padded_message, upgrade](){
+              _sock.write( padded_message->data(), padded_message->size() );
+              _sock.flush();
+              if (upgrade)
+                _sock.start_sending_frames();
+              _bytes_sent += padded_message->size();
+              _last_message_sent_time = fc::time_point::now().time_since_epoch().count();
+           }, "message_oriented_connection send_message" );
+        _send_done.wait();
+        if (upgrade)
+          _sending_frames = true;
       } FC_RETHROW_EXCEPTIONS( warn, "unable to send message" )
     }
 
     void message_oriented_connection_impl::close_connection()
     {
       VERIFY_CORRECT_THREAD();
-      _sock.close();
+      if (_io_thread->is_current())
+        _sock.close();
+      else
+        _io_thread->async([this](){ _sock.close(); }, "message_oriented_connection close_connection").wait();
     }
 
     void message_oriented_connection_impl::destroy_connection()
@@ -307,17 +521,53 @@ namespace graphene { namespace net {
              "The task calling send_message() should have been canceled already");
       assert(!_send_message_in_progress);
 
-      try
       {
-        _read_loop_done.cancel_and_wait(__FUNCTION__);
+        // nothing is handed to the delegate anymore
+        std::lock_guard<std::mutex> lock(_received_mutex);
+        _destroyed = true;
+        _received.clear();
+        _received_bytes = 0;
+        if (_received_drained)
+        {
+          _received_drained->set_exception( std::make_shared<fc::canceled_exception>() );
+          _received_drained.reset();
+        }
       }
-      catch ( const fc::exception& e )
+
+      // the tasks on the I/O thread refer to this object, they have to be gone before it is
+      for (fc::future<void>* task : { &_connect_done, &_read_loop_done, &_send_done })
       {
-        wlog( "Exception thrown while canceling message_oriented_connection's read_loop, ignoring: ${e}", ("e",e) );
+        try
+        {
+          if (task->valid() && !task->ready())
+            task->cancel_and_wait(__FUNCTION__);
+        }
+        catch ( const fc::exception& e )
+        {
+          wlog( "Exception thrown while canceling message_oriented_connection's I/O task, ignoring: ${e}", ("e",e) );
+        }
+        catch (...)
+        {
+          wlog( "Exception thrown while canceling message_oriented_connection's I/O task, ignoring" );
+        }
       }
-      catch (...)
+      // A delivery that has not reached the delegate yet is stopped here. One that is in the delegate is not
+      // waited for, it may be the caller: peer_connection keeps itself, and so this object, alive while it
+      // handles a message, so this object is only freed while a delivery is in the delegate when the delivery
+      // task itself releases the peer. Either way the delivery is told this object is gone and leaves without
+      // touching it once the delegate returns.
+      *_alive = false;
+      if (_delivery_done.valid() && !_delivery_done.ready())
       {
-        wlog( "Exception thrown while canceling message_oriented_connection's read_loop, ignoring" );
+        try
+        {
+          if (!_delivering)
+            _delivery_done.cancel_and_wait(__FUNCTION__);
+        }
+        catch ( const fc::exception& e )
+        {
+          wlog( "Exception thrown while canceling message_oriented_connection's delivery task, ignoring: ${e}", ("e",e) );
+        }
       }
       _ready_for_sending->set_exception( std::make_shared<fc::canceled_exception>() );
     }
@@ -325,25 +575,25 @@ namespace graphene { namespace net {
     uint64_t message_oriented_connection_impl::get_total_bytes_sent() const
     {
       VERIFY_CORRECT_THREAD();
-      return _bytes_sent;
+      return _bytes_sent.load();
     }
 
     uint64_t message_oriented_connection_impl::get_total_bytes_received() const
     {
       VERIFY_CORRECT_THREAD();
-      return _bytes_received;
+      return _bytes_received.load();
     }
 
     fc::time_point message_oriented_connection_impl::get_last_message_sent_time() const
     {
       VERIFY_CORRECT_THREAD();
-      return _last_message_sent_time;
+      return fc::time_point( fc::microseconds( _last_message_sent_time.load() ) );
     }
 
     fc::time_point message_oriented_connection_impl::get_last_message_received_time() const
     {
       VERIFY_CORRECT_THREAD();
-      return _last_message_received_time;
+      return fc::time_point( fc::microseconds( _last_message_received_time.load() ) );
     }
 
     fc::sha512 message_oriented_connection_impl::get_shared_secret() const
@@ -355,8 +605,9 @@ namespace graphene { namespace net {
   } // end namespace graphene::net::detail
 
 
-  message_oriented_connection::message_oriented_connection(message_oriented_connection_delegate* delegate) :
-    my( std::make_unique<detail::message_oriented_connection_impl>(this, delegate) )
+  message_oriented_connection::message_oriented_connection(message_oriented_connection_delegate* delegate,
+                                                           fc::thread* io_thread) :
+    my( std::make_unique<detail::message_oriented_connection_impl>(this, delegate, io_thread) )
   {
   }
 
@@ -426,5 +677,9 @@ namespace graphene { namespace net {
   {
     return my->get_shared_secret();
   }
+  fc::thread* message_oriented_connection::get_io_thread() const
+  {
+    return my->get_io_thread();
+  }
 
 } } // end namespace graphene::net
@@ -26,6 +26,7 @@
 #include <iomanip>
 #include <deque>
 #include <unordered_set>
+#include <unordered_map>
 #include <list>
 #include <forward_list>
 #include <iostream>
@@ -94,12 +95,23 @@
 
 namespace graphene { namespace net { namespace detail {
 
+   void blockchain_tied_message_cache::erase_oldest()
+   {
+      auto& by_age = _message_cache.get<block_clock_index>();
+      _total_bytes -= by_age.front().byte_size;
+      by_age.pop_front();
+   }
+
    void blockchain_tied_message_cache::block_accepted()
    {
       ++block_clock;
       if( block_clock > cache_duration_in_blocks )
-         _message_cache.get<block_clock_index>().erase(_message_cache.get<block_clock_index>().begin(),
-               _message_cache.get<block_clock_index>().lower_bound(block_clock - cache_duration_in_blocks ) );
+      {
+         const auto& by_age = _message_cache.get<block_clock_index>();
+         while( !by_age.empty()
+                && by_age.front().block_clock_when_received < block_clock - cache_duration_in_blocks )
+            erase_oldest();
+      }
    }
 
    void blockchain_tied_message_cache::cache_message( const message& message_to_cache,
@@ -107,19 +119,51 @@ namespace graphene { namespace net { namespace detail {
                                                       const message_propagation_data& propagation_data,
                                                       const message_hash_type& message_content_hash )
    {
-      _message_cache.insert( message_info(hash_of_message_to_cache,
-                                         message_to_cache,
-                                         block_clock,
-                                         propagation_data,
-                                         message_content_hash ) );
+      auto result = _message_cache.insert( message_info(hash_of_message_to_cache,
+                                                        std::make_shared<const message>(message_to_cache),
+                                                        block_clock,
+                                                        propagation_data,
+                                                        message_content_hash ) );
+      if( !result.second )
+         return;
+      _total_bytes += result.first->byte_size;
+      // the message just cached stays, even if it alone is over the budget
+      while( _total_bytes > _max_bytes && _message_cache.size() > 1 )
+         erase_oldest();
+   }
+
+   void blockchain_tied_message_cache::set_max_bytes( size_t max_bytes )
+   {
+      _max_bytes = max_bytes;
+      while( _total_bytes > _max_bytes && !_message_cache.empty() )
+         erase_oldest();
    }
 
-   message blockchain_tied_message_cache::get_message( const message_hash_type& hash_of_message_to_lookup ) const
+   std::shared_ptr<const message> blockchain_tied_message_cache::get_message(
+         const message_hash_type& hash_of_message_to_lookup ) const
    {
-      message_cache_container::index<message_hash_index>::type::const_iterator iter =
-         _message_cache.get<message_hash_index>().find(hash_of_message_to_lookup );
-      if( iter != _message_cache.get<message_hash_index>().end() )
+      const auto& by_hash = _message_cache.get<message_hash_index>();
+      auto iter = by_hash.find( hash_of_message_to_lookup );
+      if( iter != by_hash.end() )
+      {
+         ++_hits;
          return iter->message_body;
+      }
+      ++_misses;
+      FC_THROW_EXCEPTION(  fc::key_not_found_exception, "Requested message not in cache" );
+   }
+
+   std::shared_ptr<const message> blockchain_tied_message_cache::get_message_by_contents(
+         const message_hash_type& hash_of_msg_contents_to_lookup ) const
+   {
+      const auto& by_contents = _message_cache.get<message_contents_hash_index>();
+      auto iter = by_contents.find( hash_of_msg_contents_to_lookup );
+      if( iter != by_contents.end() )
+      {
+         ++_hits;
+         return iter->message_body;
+      }
+      ++_misses;
       FC_THROW_EXCEPTION(  fc::key_not_found_exception, "Requested message not in cache" );
    }
 
@@ -128,9 +172,9 @@ namespace graphene { namespace net { namespace detail {
     {
       if( hash_of_msg_contents_to_lookup != message_hash_type() )
       {
-        message_cache_container::index<message_contents_hash_index>::type::const_iterator iter =
-           _message_cache.get<message_contents_hash_index>().find(hash_of_msg_contents_to_lookup );
-        if( iter != _message_cache.get<message_contents_hash_index>().end() )
+        const auto& by_contents = _message_cache.get<message_contents_hash_index>();
+        auto iter = by_contents.find( hash_of_msg_contents_to_lookup );
+        if( iter != by_contents.end() )
           return iter->propagation_data;
       }
       FC_THROW_EXCEPTION(  fc::key_not_found_exception, "Requested message not in cache" );
@@ -375,10 +419,7 @@ namespace graphene { namespace net { namespace detail {
     bool node_impl::have_already_received_sync_item( const item_hash_t& item_hash )
     {
       VERIFY_CORRECT_THREAD();
-      return std::find_if(_received_sync_items.begin(), _received_sync_items.end(),
-                          [&item_hash]( const graphene::net::block_message& message ) { return message.block_id == item_hash; } ) != _received_sync_items.end() ||
-             std::find_if(_new_received_sync_items.begin(), _new_received_sync_items.end(),
-                          [&item_hash]( const graphene::net::block_message& message ) { return message.block_id == item_hash; } ) != _new_received_sync_items.end();                          ;
+      return _received_sync_items.find( item_hash ) != _received_sync_items.end();
     }
 
     void node_impl::request_sync_item_from_peer( const peer_connection_ptr& peer, const item_hash_t& item_to_request )
@@ -386,9 +427,10 @@ namespace graphene { namespace net { namespace detail {
       VERIFY_CORRECT_THREAD();
       dlog( "requesting item ${item_hash} from peer ${endpoint}", ("item_hash", item_to_request )("endpoint", peer->get_remote_endpoint() ) );
       item_id item_id_to_request( graphene::net::block_message_type, item_to_request );
-      _active_sync_requests.insert( active_sync_requests_map::value_type(item_to_request, fc::time_point::now() ) );
-      peer->last_sync_item_received_time = fc::time_point::now();
-      peer->sync_items_requested_from_peer.insert(item_to_request);
+      const fc::time_point now = fc::time_point::now();
+      _active_sync_requests[item_to_request] = now;
+      peer->last_sync_item_received_time = now;
+      peer->sync_items_requested_from_peer[item_to_request] = now;
       peer->send_message( fetch_items_message(item_id_to_request.item_type, std::vector<item_hash_t>{item_id_to_request.item_hash} ) );
     }
 
@@ -397,15 +439,97 @@ namespace graphene { namespace net { namespace detail {
       VERIFY_CORRECT_THREAD();
       dlog( "requesting ${item_count} item(s) ${items_to_request} from peer ${endpoint}",
             ("item_count", items_to_request.size())("items_to_request", items_to_request)("endpoint", peer->get_remote_endpoint()) );
+      const fc::time_point now = fc::time_point::now();
       for (const item_hash_t& item_to_request : items_to_request)
       {
-        _active_sync_requests.insert( active_sync_requests_map::value_type(item_to_request, fc::time_point::now() ) );
-        peer->last_sync_item_received_time = fc::time_point::now();
-        peer->sync_items_requested_from_peer.insert(item_to_request);
+        _active_sync_requests[item_to_request] = now;
+        peer->last_sync_item_received_time = now;
+        peer->sync_items_requested_from_peer[item_to_request] = now;
       }
       peer->send_message(fetch_items_message(graphene::net::block_message_type, items_to_request));
     }
 
+    void node_impl::forget_sync_request( const item_hash_t& item, const fc::time_point& request_time )
+    {
+      VERIFY_CORRECT_THREAD();
+      // a request that was reassigned left its entry in _active_sync_requests to the peer it was reassigned to
+      if( request_time != fc::time_point::maximum() )
+        _active_sync_requests.erase( item );
+    }
+
+    void node_impl::record_sync_block_received( peer_connection* peer, const fc::time_point& request_time )
+    {
+      VERIFY_CORRECT_THREAD();
+      const fc::time_point now = fc::time_point::now();
+      ++peer->sync_blocks_received;
+
+      // the time of a reassigned request says nothing about how long the block took
+      if( request_time != fc::time_point::maximum() )
+      {
+        const fc::microseconds latency = now - request_time;
+        peer->sync_block_latency = peer->sync_block_latency.count() == 0 ? latency
+                                   : fc::microseconds( ( peer->sync_block_latency.count() * 7 + latency.count() ) / 8 );
+      }
+
+      // the rate is sampled over intervals of at least a second, the first block only starts the interval
+      if( peer->sync_rate_interval_start == fc::time_point() )
+      {
+        peer->sync_rate_interval_start = now;
+        peer->sync_blocks_in_rate_interval = 0;
+        return;
+      }
+      ++peer->sync_blocks_in_rate_interval;
+      const fc::microseconds interval = now - peer->sync_rate_interval_start;
+      if( interval < fc::seconds(1) )
+        return;
+      const double rate = peer->sync_blocks_in_rate_interval * 1000000.0 / interval.count();
+      peer->sync_blocks_per_second = peer->sync_blocks_per_second == 0 ? rate
+                                     : ( peer->sync_blocks_per_second * 3 + rate ) / 4;
+      peer->sync_rate_interval_start = now;
+      peer->sync_blocks_in_rate_interval = 0;
+
+      // keep enough requests outstanding to cover the round trip and a little more at the rate the peer delivers.
+      // A peer held back by its window delivers the window in less than that, so the window grows until the peer
+      // can't keep up
+      const double seconds_to_cover = ( peer->round_trip_delay.count() + GRAPHENE_NET_SYNC_WINDOW_SECONDS * 1000000 ) / 1000000.0;
+      const double window = std::min<double>( peer->sync_blocks_per_second * seconds_to_cover, _max_sync_blocks_per_peer );
+      peer->sync_window = std::max<uint32_t>( GRAPHENE_NET_MIN_SYNC_WINDOW, static_cast<uint32_t>( window ) );
+    }
+
+    void node_impl::reassign_overdue_sync_requests()
+    {
+      VERIFY_CORRECT_THREAD();
+      const fc::time_point now = fc::time_point::now();
+      fc::scoped_lock<fc::mutex> lock(_active_connections.get_mutex());
+      for( const peer_connection_ptr& peer : _active_connections )
+      {
+        const fc::microseconds overdue_after = std::max( fc::seconds( GRAPHENE_NET_SYNC_REQUEST_REASSIGN_MIN_SECONDS ),
+                                                         fc::microseconds( peer->sync_block_latency.count()
+                                                                           * GRAPHENE_NET_SYNC_REQUEST_REASSIGN_LATENCY_FACTOR ) );
+        const fc::time_point overdue_threshold = now - overdue_after;
+        uint32_t requests_reassigned = 0;
+        for( auto& item_and_time : peer->sync_items_requested_from_peer )
+        {
+          // reassigned requests are marked with the maximum time, so they are never overdue again
+          if( item_and_time.second < overdue_threshold )
+          {
+            item_and_time.second = fc::time_point::maximum();
+            // the block may now be requested from any other peer that has it, the first copy to arrive is used
+            _active_sync_requests.erase( item_and_time.first );
+            ++requests_reassigned;
+          }
+        }
+        if( requests_reassigned > 0 )
+        {
+          dlog( "reassigning ${count} overdue sync requests from peer ${endpoint}",
+                ("count", requests_reassigned)("endpoint", peer->get_remote_endpoint()) );
+          peer->sync_requests_reassigned += requests_reassigned;
+          peer->sync_window = std::max<uint32_t>( GRAPHENE_NET_MIN_SYNC_WINDOW, peer->sync_window / 2 );
+          _sync_items_to_fetch_updated = true;
+        }
+      }
+    }
+
     void node_impl::fetch_sync_items_loop()
     {
       VERIFY_CORRECT_THREAD();
@@ -414,6 +538,7 @@ namespace graphene { namespace net { namespace detail {
         _sync_items_to_fetch_updated = false;
         dlog( "beginning another iteration of the sync items loop" );
 
+        reassign_overdue_sync_requests();
         if (!_suspend_fetching_sync_blocks)
         {
           std::map<peer_connection_ptr, std::vector<item_hash_t> > sync_item_requests_to_send;
@@ -421,38 +546,50 @@ namespace graphene { namespace net { namespace detail {
           {
             std::set<item_hash_t> sync_items_to_request;
 
-            // for each idle peer that we're syncing with
             fc::scoped_lock<fc::mutex> lock(_active_connections.get_mutex());
-            for( const peer_connection_ptr& peer : _active_connections )
+            // the fastest peers get the first pick, so the blocks we need soonest come from them
+            std::vector<peer_connection_ptr> sync_peers( _active_connections.begin(), _active_connections.end() );
+            std::stable_sort( sync_peers.begin(), sync_peers.end(),
+                              []( const peer_connection_ptr& a, const peer_connection_ptr& b ) {
+                                 return a->sync_blocks_per_second > b->sync_blocks_per_second;
+                              } );
+
+            // for each peer that we're syncing with and that has room in its window
+            for( const peer_connection_ptr& peer : sync_peers )
             {
-              if( peer->we_need_sync_items_from_peer &&
-                  // if we've already scheduled a request for this peer, don't consider scheduling another
-                  sync_item_requests_to_send.find(peer) == sync_item_requests_to_send.end() &&
-                  peer->idle() )
+              const size_t window = std::min<size_t>( peer->sync_window, _max_sync_blocks_per_peer );
+              size_t requests_outstanding = peer->sync_items_requested_from_peer.size();
+              if( !peer->we_need_sync_items_from_peer || peer->inhibit_fetching_sync_blocks ||
+                  requests_outstanding >= window )
+                continue;
+
+              // loop through the items it has that we don't yet have on our blockchain.  Blocks more than
+              // _max_sync_blocks_to_prefetch ahead of the next one we need would only wait in _received_sync_items
+              std::vector<item_hash_t> items_to_request;
+              size_t position = 0;
+              for( const auto& item_to_potentially_request : peer->ids_of_items_to_get )
               {
-                if (!peer->inhibit_fetching_sync_blocks)
+                if( position++ >= _max_sync_blocks_to_prefetch || requests_outstanding >= window )
+                  break;
+                // if we don't already have this item in our temporary storage
+                // and we haven't requested from another syncing peer
+                if( // already got it, but for some reson it's still in our list of items to fetch
+                    !have_already_received_sync_item(item_to_potentially_request) &&
+                    // we have already decided to request it from another peer during this iteration
+                    sync_items_to_request.find(item_to_potentially_request) == sync_items_to_request.end() &&
+                    // we've requested it in a previous iteration and we're still waiting for it to arrive
+                    _active_sync_requests.find(item_to_potentially_request) == _active_sync_requests.end() &&
+                    // this peer is the one that was too slow to send it
+                    peer->sync_items_requested_from_peer.find(item_to_potentially_request) == peer->sync_items_requested_from_peer.end() )
                 {
-                  // loop through the items it has that we don't yet have on our blockchain
-                  for( const auto& item_to_potentially_request : peer->ids_of_items_to_get )
-                  {
-                    // if we don't already have this item in our temporary storage
-                    // and we haven't requested from another syncing peer
-                    if( // already got it, but for some reson it's still in our list of items to fetch
-                        !have_already_received_sync_item(item_to_potentially_request) &&
-                        // we have already decided to request it from another peer during this iteration
-                        sync_items_to_request.find(item_to_potentially_request) == sync_items_to_request.end() &&
-                        // we've requested it in a previous iteration and we're still waiting for it to arrive
-                        _active_sync_requests.find(item_to_potentially_request) == _active_sync_requests.end() )
-                    {
-                      // then schedule a request from this peer
-                      sync_item_requests_to_send[peer].push_back(item_to_potentially_request);
-                      sync_items_to_request.insert( item_to_potentially_request );
-                      if (sync_item_requests_to_send[peer].size() >= _max_sync_blocks_per_peer)
-                        break;
-                    }
-                  }
+                  // then schedule a request from this peer
+                  items_to_request.push_back(item_to_potentially_request);
+                  sync_items_to_request.insert( item_to_potentially_request );
+                  ++requests_outstanding;
                 }
               }
+              if( !items_to_request.empty() )
+                sync_item_requests_to_send[peer] = std::move(items_to_request);
             }
           } // end non-preemptable section
 
@@ -469,7 +606,17 @@ namespace graphene { namespace net { namespace detail {
           dlog( "no sync items to fetch right now, going to sleep" );
           _retrigger_fetch_sync_items_loop_promise
                 = fc::promise<void>::create("graphene::net::retrigger_fetch_sync_items_loop");
-          _retrigger_fetch_sync_items_loop_promise->wait();
+          try
+          {
+            // while requests are outstanding, wake up now and then to look for overdue ones
+            if( _active_sync_requests.empty() )
+              _retrigger_fetch_sync_items_loop_promise->wait();
+            else
+              _retrigger_fetch_sync_items_loop_promise->wait( fc::seconds(1) );
+          }
+          catch( const fc::timeout_exception& ) // intentionally not logged
+          {
+          }
           _retrigger_fetch_sync_items_loop_promise.reset();
         }
       } // while( !canceled )
@@ -562,6 +709,8 @@ namespace graphene { namespace net { namespace detail {
               {
                 if (item_iter->item.item_type == graphene::net::trx_message_type && peer->is_transaction_fetching_inhibited())
                   next_peer_unblocked_time = std::min(peer->transaction_fetching_inhibited_until, next_peer_unblocked_time);
+                else if (item_iter->item.item_type == graphene::net::trx_message_type && too_many_transactions_to_deliver(*peer))
+                  ; // fetched once the delegate has caught up, which triggers this loop again
                 else
                 {
                   //dlog("requesting item ${hash} from peer ${endpoint}",
@@ -594,12 +743,15 @@ namespace graphene { namespace net { namespace detail {
             items_to_fetch_by_type[item.item_type].push_back(item.item_hash);
           for (auto& items_by_type : items_to_fetch_by_type)
           {
+            // peers that can send compact blocks are asked for those, we track the request as a block
+            uint32_t item_type = items_by_type.first;
+            if (item_type == block_message_type && _compact_blocks_enabled && peer_and_items.peer->supports_compact_blocks)
+              item_type = compact_block_message_type;
             dlog("requesting ${count} items of type ${type} from peer ${endpoint}: ${hashes}",
-                 ("count", items_by_type.second.size())("type", (uint32_t)items_by_type.first)
+                 ("count", items_by_type.second.size())("type", item_type)
                  ("endpoint", peer_and_items.peer->get_remote_endpoint())
                  ("hashes", items_by_type.second));
-            peer_and_items.peer->send_message(fetch_items_message(items_by_type.first,
-                                                                  items_by_type.second));
+            peer_and_items.peer->send_message(fetch_items_message(item_type, items_by_type.second));
           }
         }
         items_by_peer.clear();
@@ -1041,6 +1193,26 @@ namespace graphene { namespace net { namespace detail {
       seconds_since_last_update = std::max(UINT32_C(1), seconds_since_last_update);
       uint32_t bytes_read_this_second = _rate_limiter.get_actual_download_rate();
       uint32_t bytes_written_this_second = _rate_limiter.get_actual_upload_rate();
+      // connections on I/O threads are not in the rate limiter, their bytes are counted from the connections
+      uint64_t io_bytes_read = 0;
+      uint64_t io_bytes_written = 0;
+      for (const auto* connections : { &_handshaking_connections, &_active_connections, &_closing_connections })
+      {
+        fc::scoped_lock<fc::mutex> lock(connections->get_mutex());
+        for (const peer_connection_ptr& peer : *connections)
+        {
+          if (!peer->has_io_thread())
+            continue;
+          const uint64_t received = peer->get_total_bytes_received();
+          const uint64_t sent = peer->get_total_bytes_sent();
+          io_bytes_read += received - peer->bytes_received_counted;
+          io_bytes_written += sent - peer->bytes_sent_counted;
+          peer->bytes_received_counted = received;
+          peer->bytes_sent_counted = sent;
+        }
+      }
+      bytes_read_this_second += (uint32_t)(io_bytes_read / seconds_since_last_update);
+      bytes_written_this_second += (uint32_t)(io_bytes_written / seconds_since_last_update);
       for (uint32_t i = 0; i < seconds_since_last_update - 1; ++i)
         update_bandwidth_data(0, 0);
       update_bandwidth_data(bytes_read_this_second, bytes_written_this_second);
@@ -1298,6 +1470,18 @@ namespace graphene { namespace net { namespace detail {
       case core_message_type_enum::block_message_type:
         process_block_message(originating_peer, received_message, message_hash);
         break;
+      case core_message_type_enum::transport_upgrade_message_type:
+        on_transport_upgrade_message(originating_peer, received_message.as<transport_upgrade_message>());
+        break;
+      case core_message_type_enum::compact_block_message_type:
+        on_compact_block_message(originating_peer, received_message.as<compact_block_message>());
+        break;
+      case core_message_type_enum::get_block_transactions_message_type:
+        on_get_block_transactions_message(originating_peer, received_message.as<get_block_transactions_message>());
+        break;
+      case core_message_type_enum::block_transactions_message_type:
+        on_block_transactions_message(originating_peer, received_message.as<block_transactions_message>());
+        break;
       case core_message_type_enum::current_time_request_message_type:
         on_current_time_request_message(originating_peer, received_message.as<current_time_request_message>());
         break;
@@ -1359,6 +1543,11 @@ namespace graphene { namespace net { namespace detail {
       if (!_hard_fork_block_numbers.empty())
         user_data["last_known_fork_block_number"] = _hard_fork_block_numbers.back();
 
+      if (_framed_transport_enabled)
+        user_data["transport_version"] = GRAPHENE_NET_FRAMED_TRANSPORT_VERSION;
+      if (_compact_blocks_enabled)
+        user_data["compact_blocks"] = true;
+
       return user_data;
     }
     void node_impl::parse_hello_user_data_for_peer(peer_connection* originating_peer, const fc::variant_object& user_data)
@@ -1383,6 +1572,10 @@ namespace graphene { namespace net { namespace detail {
         originating_peer->node_id = user_data["node_id"].as<node_id_t>(1);
       if (user_data.contains("last_known_fork_block_number"))
         originating_peer->last_known_fork_block_number = user_data["last_known_fork_block_number"].as<uint32_t>(1);
+      if (user_data.contains("transport_version"))
+        originating_peer->transport_version = user_data["transport_version"].as<uint32_t>(1);
+      if (user_data.contains("compact_blocks"))
+        originating_peer->supports_compact_blocks = user_data["compact_blocks"].as_bool();
     }
 
     void node_impl::on_hello_message( peer_connection* originating_peer, const hello_message& hello_message_received )
@@ -1496,6 +1689,9 @@ namespace graphene { namespace net { namespace detail {
             }
           }
         }
+        // the peer answers with an upgrade of its own, after which both directions are framed
+        if (_framed_transport_enabled && originating_peer->transport_version >= GRAPHENE_NET_FRAMED_TRANSPORT_VERSION)
+          send_transport_upgrade(originating_peer);
         if (already_connected_to_this_peer)
         {
 
@@ -1625,6 +1821,31 @@ namespace graphene { namespace net { namespace detail {
       }
     }
 
+    void node_impl::send_transport_upgrade( peer_connection* peer )
+    {
+      VERIFY_CORRECT_THREAD();
+      if (peer->transport_upgrade_sent)
+        return;
+      peer->transport_upgrade_sent = true;
+      peer->send_message(message(transport_upgrade_message(GRAPHENE_NET_FRAMED_TRANSPORT_VERSION)));
+    }
+
+    void node_impl::on_transport_upgrade_message( peer_connection* originating_peer,
+                                                  const transport_upgrade_message& )
+    {
+      VERIFY_CORRECT_THREAD();
+      // the connection already reads frames from here on, and the peer expects frames from us as well
+      if (!_framed_transport_enabled)
+      {
+        // we did not offer it in our hello message, the peer should not have sent this
+        disconnect_from_peer(originating_peer, "I did not offer the framed transport");
+        return;
+      }
+      dlog("Peer ${peer} switched to framed transport", ("peer", originating_peer->get_remote_endpoint()));
+      originating_peer->transport_upgrade_received = true;
+      send_transport_upgrade(originating_peer);
+    }
+
     void node_impl::on_connection_rejected_message(peer_connection* originating_peer, const connection_rejected_message& connection_rejected_message_received)
     {
       VERIFY_CORRECT_THREAD();
@@ -2256,21 +2477,36 @@ namespace graphene { namespace net { namespace detail {
       }
     }
 
-    message node_impl::get_message_for_item(const item_id& item)
+    fc::thread* node_impl::get_io_thread()
+    {
+      VERIFY_CORRECT_THREAD();
+      // the rate limiter works on the p2p thread, connections it has to throttle stay there
+      if (_io_thread_count == 0 || _rate_limiter.get_upload_limit() || _rate_limiter.get_download_limit())
+        return nullptr;
+      const size_t index = _next_io_thread++ % _io_thread_count;
+      while (_io_threads.size() <= index)
+        _io_threads.push_back(std::make_shared<fc::thread>("p2p io " + std::to_string(_io_threads.size())));
+      return _io_threads[index].get();
+    }
+
+    std::shared_ptr<const message> node_impl::get_message_for_item(const item_id& item)
     {
       try
       {
+        // blocks are queued by block id, which the cache knows as the hash of their contents
+        if (item.item_type == block_message_type)
+          return _message_cache.get_message_by_contents(item.item_hash);
         return _message_cache.get_message(item.item_hash);
       }
       catch (fc::key_not_found_exception&)
       {}
       try
       {
-        return _delegate->get_item(item);
+        return std::make_shared<const message>(_delegate->get_item(item));
       }
       catch (fc::key_not_found_exception&)
       {}
-      return item_not_available_message(item);
+      return std::make_shared<const message>(item_not_available_message(item));
     }
 
     void node_impl::on_fetch_items_message(peer_connection* originating_peer,
@@ -2282,20 +2518,22 @@ namespace graphene { namespace net { namespace detail {
            ("type", fetch_items_message_received.item_type)
            ("endpoint", originating_peer->get_remote_endpoint()));
 
-      fc::optional<message> last_block_message_sent;
+      if (fetch_items_message_received.item_type == compact_block_message_type)
+      {
+        send_compact_blocks(originating_peer, fetch_items_message_received.items_to_fetch);
+        return;
+      }
 
-      std::list<message> reply_messages;
+      // replies that come from the cache are shared with it, not copied
+      std::list<std::shared_ptr<const message>> reply_messages;
       for (const item_hash_t& item_hash : fetch_items_message_received.items_to_fetch)
       {
         try
         {
-          message requested_message = _message_cache.get_message(item_hash);
+          reply_messages.push_back(_message_cache.get_message(item_hash));
           dlog("received item request for item ${id} from peer ${endpoint}, returning the item from my message cache",
                ("endpoint", originating_peer->get_remote_endpoint())
-               ("id", requested_message.id()));
-          reply_messages.push_back(requested_message);
-          if (fetch_items_message_received.item_type == block_message_type)
-            last_block_message_sent = requested_message;
+               ("id", item_hash));
           continue;
         }
         catch (fc::key_not_found_exception&)
@@ -2306,45 +2544,219 @@ namespace graphene { namespace net { namespace detail {
         item_id item_to_fetch(fetch_items_message_received.item_type, item_hash);
         try
         {
-          message requested_message = _delegate->get_item(item_to_fetch);
+          reply_messages.push_back(std::make_shared<const message>(_delegate->get_item(item_to_fetch)));
           dlog("received item request from peer ${endpoint}, returning the item from delegate with id ${id} size ${size}",
-               ("id", requested_message.id())
-               ("size", requested_message.size)
+               ("id", item_hash)
+               ("size", reply_messages.back()->size)
                ("endpoint", originating_peer->get_remote_endpoint()));
-          reply_messages.push_back(requested_message);
-          if (fetch_items_message_received.item_type == block_message_type)
-            last_block_message_sent = requested_message;
           continue;
         }
         catch (fc::key_not_found_exception&)
         {
-          reply_messages.push_back(item_not_available_message(item_to_fetch));
+          reply_messages.push_back(std::make_shared<const message>(item_not_available_message(item_to_fetch)));
           dlog("received item request from peer ${endpoint} but we don't have it",
                ("endpoint", originating_peer->get_remote_endpoint()));
         }
       }
 
+      // blocks are queued by id and only packed when their turn comes
+      std::vector<block_id_type> block_ids;
+      for (const auto& reply : reply_messages)
+        if (reply->msg_type.value() == block_message_type)
+          block_ids.push_back(reply->as<graphene::net::block_message>().block_id);
+
       // if we sent them a block, update our record of the last block they've seen accordingly
-      if (last_block_message_sent)
+      if (!block_ids.empty())
       {
-        graphene::net::block_message block = last_block_message_sent->as<graphene::net::block_message>();
-        originating_peer->last_block_delegate_has_seen = block.block_id;
-        originating_peer->last_block_time_delegate_has_seen = _delegate->get_block_time(block.block_id);
+        originating_peer->last_block_delegate_has_seen = block_ids.back();
+        originating_peer->last_block_time_delegate_has_seen = _delegate->get_block_time(block_ids.back());
       }
 
-      for (const message& reply : reply_messages)
+      auto next_block_id = block_ids.begin();
+      for (auto& reply : reply_messages)
       {
-        if (reply.msg_type.value() == block_message_type)
-          originating_peer->send_item(item_id(block_message_type, reply.as<graphene::net::block_message>().block_id));
+        if (reply->msg_type.value() == block_message_type)
+          originating_peer->send_item(item_id(block_message_type, *next_block_id++));
         else
-          originating_peer->send_message(reply);
+          originating_peer->send_message(std::move(reply));
+      }
+    }
+
+    fc::optional<block_message> node_impl::find_block_message(const item_hash_t& item_hash,
+                                                              const block_id_type& block_id) const
+    {
+      try
+      {
+        std::shared_ptr<const message> cached_message = _message_cache.get_message(item_hash);
+        if (cached_message->msg_type.value() == block_message_type)
+          return cached_message->as<block_message>();
+      }
+      catch (fc::key_not_found_exception&)
+      {}
+      if (block_id == block_id_type())
+        return fc::optional<block_message>();
+      try
+      {
+        return _delegate->get_item(item_id(block_message_type, block_id)).as<block_message>();
+      }
+      catch (const fc::canceled_exception&)
+      {
+        throw;
+      }
+      catch (const fc::exception&)
+      {}
+      return fc::optional<block_message>();
+    }
+
+    void node_impl::send_compact_blocks(peer_connection* originating_peer,
+                                        const std::vector<item_hash_t>& items_to_fetch) const
+    {
+      VERIFY_CORRECT_THREAD();
+      // blocks are only requested compact in normal operation, so they are recent enough to be in our cache
+      for (const item_hash_t& item_hash : items_to_fetch)
+      {
+        fc::optional<block_message> block = find_block_message(item_hash, block_id_type());
+        if (!block)
+        {
+          originating_peer->send_message(item_not_available_message(item_id(block_message_type, item_hash)));
+          continue;
+        }
+        originating_peer->last_block_delegate_has_seen = block->block_id;
+        originating_peer->last_block_time_delegate_has_seen = block->block.timestamp;
+        originating_peer->send_message(compact_block_message(item_hash, block->block));
+      }
+    }
+
+    void node_impl::on_compact_block_message(peer_connection* originating_peer,
+                                             const compact_block_message& compact_block)
+    {
+      VERIFY_CORRECT_THREAD();
+      if (originating_peer->items_requested_from_peer.find(item_id(block_message_type, compact_block.item_hash))
+          == originating_peer->items_requested_from_peer.end() ||
+          originating_peer->compact_blocks_in_progress.count(compact_block.item_hash))
+      {
+        wlog("received a compact block ${hash} I didn't ask for from peer ${endpoint}, disconnecting from peer",
+             ("hash", compact_block.item_hash)("endpoint", originating_peer->get_remote_endpoint()));
+        disconnect_from_peer(originating_peer, "You sent me a compact block that I didn't ask for", true,
+                             fc::exception(FC_LOG_MESSAGE(error, "You sent me a compact block that I didn't ask for",
+                                                          ("item_hash", compact_block.item_hash))));
+        return;
+      }
+
+      // match the short ids against the transactions we have seen, anything left over we ask for
+      partial_compact_block partial;
+      partial.block = compact_block;
+      partial.transactions.resize(compact_block.transactions.size());
+      std::unordered_map<uint64_t, uint32_t> positions;
+      positions.reserve(compact_block.transactions.size());
+      for (uint32_t i = 0; i < compact_block.transactions.size(); ++i)
+        if (!positions.emplace(compact_block.transactions[i].short_id, i).second)
+          partial.missing.push_back(i);
+      _message_cache.visit_transactions([&](const message_hash_type& transaction_id, const message& trx) {
+        auto iter = positions.find(compact_block_message::short_id(compact_block.item_hash, transaction_id));
+        if (iter == positions.end())
+          return;
+        partial.transactions[iter->second] = trx.as<trx_message>().trx;
+        positions.erase(iter);
+      });
+      for (const auto& position : positions)
+        partial.missing.push_back(position.second);
+      _compact_block_transactions_from_cache += compact_block.transactions.size() - partial.missing.size();
+
+      if (partial.missing.empty())
+      {
+        finish_compact_block(originating_peer, std::move(partial));
+        return;
       }
+      std::sort(partial.missing.begin(), partial.missing.end());
+      dlog("asking peer ${endpoint} for ${count} of the ${total} transactions of compact block ${hash}",
+           ("endpoint", originating_peer->get_remote_endpoint())("count", partial.missing.size())
+           ("total", compact_block.transactions.size())("hash", compact_block.item_hash));
+      originating_peer->send_message(get_block_transactions_message(compact_block.item_hash,
+                                                                    compact_block.header.id(),
+                                                                    partial.missing));
+      originating_peer->compact_blocks_in_progress[compact_block.item_hash] = std::move(partial);
+    }
+
+    void node_impl::on_get_block_transactions_message(peer_connection* originating_peer,
+                                                      const get_block_transactions_message& request)
+    {
+      VERIFY_CORRECT_THREAD();
+      fc::optional<block_message> block = find_block_message(request.item_hash, request.block_id);
+      if (!block)
+      {
+        originating_peer->send_message(item_not_available_message(item_id(block_message_type, request.item_hash)));
+        return;
+      }
+      block_transactions_message reply(request.item_hash);
+      reply.transactions.reserve(request.indexes.size());
+      for (uint32_t index : request.indexes)
+      {
+        if (index >= block->block.transactions.size())
+        {
+          disconnect_from_peer(originating_peer, "You asked for a transaction the block does not have", true,
+                               fc::exception(FC_LOG_MESSAGE(error, "Transaction ${index} of block ${id} requested",
+                                                            ("index", index)("id", block->block_id))));
+          return;
+        }
+        reply.transactions.push_back(block->block.transactions[index]);
+      }
+      originating_peer->send_message(reply);
+    }
+
+    void node_impl::on_block_transactions_message(peer_connection* originating_peer,
+                                                  block_transactions_message&& reply)
+    {
+      VERIFY_CORRECT_THREAD();
+      auto iter = originating_peer->compact_blocks_in_progress.find(reply.item_hash);
+      if (iter == originating_peer->compact_blocks_in_progress.end())
+      {
+        dlog("received transactions of compact block ${hash} that we are no longer waiting for",
+             ("hash", reply.item_hash));
+        return;
+      }
+      partial_compact_block partial = std::move(iter->second);
+      originating_peer->compact_blocks_in_progress.erase(iter);
+      if (reply.transactions.size() != partial.missing.size())
+      {
+        wlog("peer ${endpoint} sent ${count} transactions of compact block ${hash} instead of ${expected}",
+             ("endpoint", originating_peer->get_remote_endpoint())("count", reply.transactions.size())
+             ("hash", reply.item_hash)("expected", partial.missing.size()));
+        ++_compact_block_fallbacks;
+        originating_peer->send_message(fetch_items_message(block_message_type, { reply.item_hash }));
+        return;
+      }
+      _compact_block_transactions_fetched += reply.transactions.size();
+      for (size_t i = 0; i < partial.missing.size(); ++i)
+        partial.transactions[partial.missing[i]] = std::move(reply.transactions[i]);
+      finish_compact_block(originating_peer, std::move(partial));
+    }
+
+    void node_impl::finish_compact_block(peer_connection* originating_peer, partial_compact_block&& partial)
+    {
+      VERIFY_CORRECT_THREAD();
+      const item_hash_t item_hash = partial.block.item_hash;
+      message block_to_process(block_message(partial.block.rebuild(std::move(partial.transactions))));
+      message_hash_type message_hash = block_to_process.id();
+      if (message_hash != item_hash)
+      {
+        // a short id matched the wrong transaction, or our copy of one carries other signatures
+        dlog("compact block ${hash} did not rebuild to the block that was advertised, fetching it in full",
+             ("hash", item_hash));
+        ++_compact_block_fallbacks;
+        originating_peer->send_message(fetch_items_message(block_message_type, { item_hash }));
+        return;
+      }
+      ++_compact_blocks_rebuilt;
+      process_block_message(originating_peer, block_to_process, message_hash);
     }
 
     void node_impl::on_item_not_available_message( peer_connection* originating_peer, const item_not_available_message& item_not_available_message_received )
     {
       VERIFY_CORRECT_THREAD();
       const item_id& requested_item = item_not_available_message_received.requested_item;
+      if (requested_item.item_type == block_message_type)
+        originating_peer->compact_blocks_in_progress.erase(requested_item.item_hash);
       auto regular_item_iter = originating_peer->items_requested_from_peer.find(requested_item);
       if (regular_item_iter != originating_peer->items_requested_from_peer.end())
       {
@@ -2363,7 +2775,7 @@ namespace graphene { namespace net { namespace detail {
       auto sync_item_iter = originating_peer->sync_items_requested_from_peer.find(requested_item.item_hash);
       if (sync_item_iter != originating_peer->sync_items_requested_from_peer.end())
       {
-        _active_sync_requests.erase(*sync_item_iter);
+        forget_sync_request(sync_item_iter->first, sync_item_iter->second);
         originating_peer->sync_items_requested_from_peer.erase(sync_item_iter);
 
         if (originating_peer->peer_needs_sync_items_from_us)
@@ -2560,8 +2972,8 @@ namespace graphene { namespace net { namespace detail {
       // received yet, reschedule them to be fetched from another peer
       if (!originating_peer->sync_items_requested_from_peer.empty())
       {
-        for (auto sync_item : originating_peer->sync_items_requested_from_peer)
-          _active_sync_requests.erase(sync_item);
+        for (const auto& sync_item_and_time : originating_peer->sync_items_requested_from_peer)
+          forget_sync_request(sync_item_and_time.first, sync_item_and_time.second);
         trigger_fetch_sync_items_loop();
       }
 
@@ -2769,29 +3181,19 @@ namespace graphene { namespace net { namespace detail {
     void node_impl::process_backlog_of_sync_blocks()
     {
       VERIFY_CORRECT_THREAD();
-      // garbage-collect the list of async tasks here for lack of a better place
-      for (auto calls_iter = _handle_message_calls_in_progress.begin();
-            calls_iter != _handle_message_calls_in_progress.end();)
-      {
-        if (calls_iter->ready())
-          calls_iter = _handle_message_calls_in_progress.erase(calls_iter);
-        else
-          ++calls_iter;
-      }
-
       dlog("in process_backlog_of_sync_blocks");
-      if (_handle_message_calls_in_progress.size() >= _max_blocks_to_handle_at_once)
+      if (_sync_blocks_being_handled >= _max_blocks_to_handle_at_once)
       {
         dlog("leaving process_backlog_of_sync_blocks because we're already processing too many blocks");
         return; // we will be rescheduled when the next block finishes its processing
       }
-      dlog("currently ${count} blocks in the process of being handled", ("count", _handle_message_calls_in_progress.size()));
+      dlog("currently ${count} blocks in the process of being handled", ("count", _sync_blocks_being_handled));
 
 
       if (_suspend_fetching_sync_blocks)
       {
         dlog("resuming processing sync block backlog because we only ${count} blocks in progress",
-             ("count", _handle_message_calls_in_progress.size()));
+             ("count", _sync_blocks_being_handled));
         _suspend_fetching_sync_blocks = false;
       }
 
@@ -2811,94 +3213,109 @@ namespace graphene { namespace net { namespace detail {
 
       do
       {
-        std::copy(std::make_move_iterator(_new_received_sync_items.begin()),
-                  std::make_move_iterator(_new_received_sync_items.end()),
-                  std::front_inserter(_received_sync_items));
-        _new_received_sync_items.clear();
         dlog("currently ${count} sync items to consider", ("count", _received_sync_items.size()));
 
         block_processed_this_iteration = false;
-        for (auto received_block_iter = _received_sync_items.begin();
-             received_block_iter != _received_sync_items.end();
-             ++received_block_iter)
-        {
 
-          // find out if this block is the next block on the active chain or one of the forks
-          bool potential_first_block = false;
+        // the next block on the active chain or one of the forks is the first one some peer still has to
+        // give us, find out if we have received it
+        auto received_block_iter = _received_sync_items.end();
+        {
+          fc::scoped_lock<fc::mutex> lock(_active_connections.get_mutex());
+          for (const peer_connection_ptr& peer : _active_connections)
+          {
+            if (!peer->ids_of_items_to_get.empty())
+            {
+              received_block_iter = _received_sync_items.find(peer->ids_of_items_to_get.front());
+              if (received_block_iter != _received_sync_items.end())
+                break;
+            }
+          }
+          if (received_block_iter != _received_sync_items.end())
           {
-            fc::scoped_lock<fc::mutex> lock(_active_connections.get_mutex());
             for (const peer_connection_ptr& peer : _active_connections)
             {
                if (!peer->ids_of_items_to_get.empty() &&
-                     peer->ids_of_items_to_get.front() == received_block_iter->block_id)
+                     peer->ids_of_items_to_get.front() == received_block_iter->first)
                {
-                  potential_first_block = true;
                   peer->ids_of_items_to_get.pop_front();
-                  peer->ids_of_items_being_processed.insert(received_block_iter->block_id);
+                  peer->ids_of_items_being_processed.insert(received_block_iter->first);
                }
             }
           }
+        }
 
-          // if it is, process it, remove it from all sync peers lists
-          if (potential_first_block)
+        // if it is, process it, remove it from all sync peers lists
+        if (received_block_iter != _received_sync_items.end())
+        {
+          graphene::net::block_message block_message_to_process = std::move(received_block_iter->second);
+          _received_sync_items.erase(received_block_iter);
+
+          // we can get into an interesting situation near the end of synchronization.  We can be in
+          // sync with one peer who is sending us the last block on the chain via a regular inventory
+          // message, while at the same time still be synchronizing with a peer who is sending us the
+          // block through the sync mechanism.  Further, we must request both blocks because
+          // we don't know they're the same (for the peer in normal operation, it has only told us the
+          // message id, for the peer in the sync case we only known the block_id).
+          if (std::find(_most_recent_blocks_accepted.begin(), _most_recent_blocks_accepted.end(),
+                        block_message_to_process.block_id) == _most_recent_blocks_accepted.end())
           {
-            // we can get into an interesting situation near the end of synchronization.  We can be in
-            // sync with one peer who is sending us the last block on the chain via a regular inventory
-            // message, while at the same time still be synchronizing with a peer who is sending us the
-            // block through the sync mechanism.  Further, we must request both blocks because
-            // we don't know they're the same (for the peer in normal operation, it has only told us the
-            // message id, for the peer in the sync case we only known the block_id).
-            if (std::find(_most_recent_blocks_accepted.begin(), _most_recent_blocks_accepted.end(),
-                          received_block_iter->block_id) == _most_recent_blocks_accepted.end())
-            {
-              graphene::net::block_message block_message_to_process = *received_block_iter;
-              _received_sync_items.erase(received_block_iter);
-              _handle_message_calls_in_progress.emplace_back(fc::async([this, block_message_to_process](){
+            // calls finish in about the order they were made, so finished ones are dropped from the front
+            while (!_handle_message_calls_in_progress.empty() && _handle_message_calls_in_progress.front().ready())
+              _handle_message_calls_in_progress.pop_front();
+            ++_sync_blocks_being_handled;
+            _handle_message_calls_in_progress.emplace_back(fc::async([this, block_message_to_process](){
+              try
+              {
                 send_sync_block_to_node_delegate(block_message_to_process);
-              }, "send_sync_block_to_node_delegate"));
-              ++blocks_processed;
-              block_processed_this_iteration = true;
-            }
-            else
+              }
+              catch (...)
+              {
+                --_sync_blocks_being_handled;
+                throw;
+              }
+              --_sync_blocks_being_handled;
+            }, "send_sync_block_to_node_delegate"));
+            ++blocks_processed;
+          }
+          else
+          {
+            dlog("Already received and accepted this block (presumably through normal inventory mechanism), treating it as accepted");
+            std::vector< peer_connection_ptr > peers_needing_next_batch;
+            fc::scoped_lock<fc::mutex> lock(_active_connections.get_mutex());
+            for (const peer_connection_ptr& peer : _active_connections)
             {
-              dlog("Already received and accepted this block (presumably through normal inventory mechanism), treating it as accepted");
-              std::vector< peer_connection_ptr > peers_needing_next_batch;
-              fc::scoped_lock<fc::mutex> lock(_active_connections.get_mutex());
-              for (const peer_connection_ptr& peer : _active_connections)
+              auto items_being_processed_iter = peer->ids_of_items_being_processed.find(block_message_to_process.block_id);
+              if (items_being_processed_iter != peer->ids_of_items_being_processed.end())
               {
-                auto items_being_processed_iter = peer->ids_of_items_being_processed.find(received_block_iter->block_id);
-                if (items_being_processed_iter != peer->ids_of_items_being_processed.end())
+                peer->ids_of_items_being_processed.erase(items_being_processed_iter);
+                dlog("Removed item from ${endpoint}'s list of items being processed, still processing ${len} blocks",
+                     ("endpoint", peer->get_remote_endpoint())("len", peer->ids_of_items_being_processed.size()));
+
+                // if we just processed the last item in our list from this peer, we will want to
+                // send another request to find out if we are now in sync (this is normally handled in
+                // send_sync_block_to_node_delegate)
+                if (peer->ids_of_items_to_get.empty() &&
+                    peer->number_of_unfetched_item_ids == 0 &&
+                    peer->ids_of_items_being_processed.empty())
                 {
-                  peer->ids_of_items_being_processed.erase(items_being_processed_iter);
-                  dlog("Removed item from ${endpoint}'s list of items being processed, still processing ${len} blocks",
-                       ("endpoint", peer->get_remote_endpoint())("len", peer->ids_of_items_being_processed.size()));
-
-                  // if we just processed the last item in our list from this peer, we will want to
-                  // send another request to find out if we are now in sync (this is normally handled in
-                  // send_sync_block_to_node_delegate)
-                  if (peer->ids_of_items_to_get.empty() &&
-                      peer->number_of_unfetched_item_ids == 0 &&
-                      peer->ids_of_items_being_processed.empty())
-                  {
-                    dlog("We received last item in our list for peer ${endpoint}, setup to do a sync check", ("endpoint", peer->get_remote_endpoint()));
-                    peers_needing_next_batch.push_back( peer );
-                  }
+                  dlog("We received last item in our list for peer ${endpoint}, setup to do a sync check", ("endpoint", peer->get_remote_endpoint()));
+                  peers_needing_next_batch.push_back( peer );
                 }
               }
-              for( const peer_connection_ptr& peer : peers_needing_next_batch )
-                fetch_next_batch_of_item_ids_from_peer(peer.get());
             }
+            for( const peer_connection_ptr& peer : peers_needing_next_batch )
+              fetch_next_batch_of_item_ids_from_peer(peer.get());
+          }
+          block_processed_this_iteration = true;
+        } // end if we have the next block
 
-            break; // start iterating _received_sync_items from the beginning
-          } // end if potential_first_block
-        } // end for each block in _received_sync_items
-
-        if (_handle_message_calls_in_progress.size() >= _max_blocks_to_handle_at_once)
+        if (_sync_blocks_being_handled >= _max_blocks_to_handle_at_once)
         {
           dlog("stopping processing sync block backlog because we have ${count} blocks in progress",
-               ("count", _handle_message_calls_in_progress.size()));
+               ("count", _sync_blocks_being_handled));
           //ulog("stopping processing sync block backlog because we have ${count} blocks in progress, total on hand: ${received}",
-          //     ("count", _handle_message_calls_in_progress.size())("received", _received_sync_items.size()));
+          //     ("count", _sync_blocks_being_handled)("received", _received_sync_items.size()));
           if (_received_sync_items.size() >= _max_sync_blocks_to_prefetch)
             _suspend_fetching_sync_blocks = true;
           break;
@@ -2926,9 +3343,9 @@ namespace graphene { namespace net { namespace detail {
       VERIFY_CORRECT_THREAD();
       dlog( "received a sync block from peer ${endpoint}", ("endpoint", originating_peer->get_remote_endpoint() ) );
 
-      // add it to the front of _received_sync_items, then process _received_sync_items to try to
+      // add it to _received_sync_items, then process _received_sync_items to try to
       // pass as many messages as possible to the client.
-      _new_received_sync_items.push_front( block_message_to_process );
+      _received_sync_items.emplace( block_message_to_process.block_id, block_message_to_process );
       trigger_process_backlog_of_sync_blocks();
     }
 
@@ -3120,6 +3537,7 @@ namespace graphene { namespace net { namespace detail {
         auto sync_item_iter = originating_peer->sync_items_requested_from_peer.find( block_message_to_process.block_id);
         if (sync_item_iter != originating_peer->sync_items_requested_from_peer.end())
         {
+          const fc::time_point request_time = sync_item_iter->second;
           originating_peer->sync_items_requested_from_peer.erase(sync_item_iter);
           // if exceptions are throw here after removing the sync item from the list (above),
           // it could leave our sync in a stalled state.  Wrap a try/catch around the rest
@@ -3127,18 +3545,31 @@ namespace graphene { namespace net { namespace detail {
           try
           {
             originating_peer->last_sync_item_received_time = fc::time_point::now();
+            record_sync_block_received(originating_peer, request_time);
+
             _active_sync_requests.erase(block_message_to_process.block_id);
-            process_block_during_syncing(originating_peer, block_message_to_process, message_hash);
-            if (originating_peer->idle())
             {
-              // we have finished fetching a batch of items, so we either need to grab another batch of items
-              // or we need to get another list of item ids.
-              if (originating_peer->number_of_unfetched_item_ids > 0 &&
-                  originating_peer->ids_of_items_to_get.size() < GRAPHENE_NET_MIN_BLOCK_IDS_TO_PREFETCH)
-                fetch_next_batch_of_item_ids_from_peer(originating_peer);
-              else
-                trigger_fetch_sync_items_loop();
+              // if the request was reassigned, the copy still on its way from the other peer is not needed anymore.
+              // Its request is dropped so it doesn't hold a place in that peer's window
+              fc::scoped_lock<fc::mutex> lock(_active_connections.get_mutex());
+              for (const peer_connection_ptr& peer : _active_connections)
+                if (peer.get() != originating_peer &&
+                    peer->sync_items_requested_from_peer.erase(block_message_to_process.block_id))
+                {
+                  peer->sync_items_received_elsewhere.push_back(block_message_to_process.block_id);
+                  if (peer->sync_items_received_elsewhere.size() > _max_sync_blocks_per_peer)
+                    peer->sync_items_received_elsewhere.pop_front();
+                }
             }
+            process_block_during_syncing(originating_peer, block_message_to_process, message_hash);
+
+            // the peer keeps its window of block requests filled while we get the next list of item ids from it,
+            // so it doesn't sit idle waiting for the ids
+            if (!originating_peer->item_ids_requested_from_peer &&
+                originating_peer->number_of_unfetched_item_ids > 0 &&
+                originating_peer->ids_of_items_to_get.size() < GRAPHENE_NET_MIN_BLOCK_IDS_TO_PREFETCH)
+              fetch_next_batch_of_item_ids_from_peer(originating_peer);
+            trigger_fetch_sync_items_loop();
             return;
           }
           catch (const fc::canceled_exception& e)
@@ -3160,6 +3591,20 @@ namespace graphene { namespace net { namespace detail {
             elog("Caught unexpected exception, could break sync operation");
           }
         }
+
+        auto received_elsewhere_iter = std::find(originating_peer->sync_items_received_elsewhere.begin(),
+                                                 originating_peer->sync_items_received_elsewhere.end(),
+                                                 block_message_to_process.block_id);
+        if (received_elsewhere_iter != originating_peer->sync_items_received_elsewhere.end())
+        {
+          dlog("already received sync block ${block_id} from another peer, dropping the copy from ${endpoint}",
+               ("block_id", block_message_to_process.block_id)("endpoint", originating_peer->get_remote_endpoint()));
+          originating_peer->sync_items_received_elsewhere.erase(received_elsewhere_iter);
+          originating_peer->last_sync_item_received_time = fc::time_point::now();
+          record_sync_block_received(originating_peer, fc::time_point::maximum());
+          ++originating_peer->sync_duplicates_dropped;
+          return;
+        }
       }
 
       // if we get here, we didn't request the message, we must have a misbehaving peer
@@ -3404,59 +3849,111 @@ namespace graphene { namespace net { namespace detail {
         if (originating_peer->idle())
           trigger_fetch_items_loop();
 
-        // Next: have the delegate process the message
-        fc::time_point message_validated_time;
-        try
+        // Next: have the delegate process the message.  Transactions are queued per peer, so the next messages
+        // from this peer are taken in while the delegate is still busy, and peers don't wait for each other
+        if (message_to_process.msg_type.value() == trx_message_type)
         {
-          if (message_to_process.msg_type.value() == trx_message_type)
+          originating_peer->transactions_to_deliver.push(
+                peer_connection::received_transaction{ message_to_process, message_hash, message_receive_time });
+          ++_transactions_to_deliver;
+          if (!originating_peer->delivering_transactions)
           {
-            trx_message transaction_message_to_process = message_to_process.as<trx_message>();
-            dlog( "passing message containing transaction ${trx} to client",
-                  ("trx", transaction_message_to_process.trx.id()) );
-            _delegate->handle_transaction(transaction_message_to_process);
+            while (!_handle_message_calls_in_progress.empty() && _handle_message_calls_in_progress.front().ready())
+              _handle_message_calls_in_progress.pop_front();
+            originating_peer->delivering_transactions = true;
+            peer_connection_ptr originating_peer_ptr = originating_peer->shared_from_this();
+            _handle_message_calls_in_progress.emplace_back(fc::async([this, originating_peer_ptr](){
+              deliver_transactions_from_peer(originating_peer_ptr);
+            }, "deliver transactions to client"));
           }
-          else
-            _delegate->handle_message( message_to_process );
-          message_validated_time = fc::time_point::now();
         }
-        catch ( const fc::canceled_exception& )
+        else
+          deliver_ordinary_message(originating_peer, message_to_process, message_hash, message_receive_time);
+      }
+    }
+
+    void node_impl::deliver_transactions_from_peer(const peer_connection_ptr& peer)
+    {
+      VERIFY_CORRECT_THREAD();
+      // a transaction may depend on an earlier one from the same peer, so each waits until the delegate is done
+      // with the one before
+      while (!peer->transactions_to_deliver.empty())
+      {
+        const peer_connection::received_transaction& received = peer->transactions_to_deliver.front();
+        deliver_ordinary_message(peer.get(), received.trx, received.message_hash, received.receive_time);
+        const bool was_full = too_many_transactions_to_deliver(*peer);
+        peer->transactions_to_deliver.pop();
+        --_transactions_to_deliver;
+        if (was_full)
+          trigger_fetch_items_loop();
+      }
+      peer->delivering_transactions = false;
+    }
+
+    bool node_impl::too_many_transactions_to_deliver(const peer_connection& peer) const
+    {
+      VERIFY_CORRECT_THREAD();
+      return peer.transactions_to_deliver.size() >= GRAPHENE_NET_MAX_TRX_IN_FLIGHT_PER_PEER ||
+             _transactions_to_deliver >= GRAPHENE_NET_MAX_TRX_IN_FLIGHT;
+    }
+
+    void node_impl::deliver_ordinary_message( peer_connection* originating_peer,
+                                              const message& message_to_process,
+                                              const message_hash_type& message_hash,
+                                              const fc::time_point& message_receive_time )
+    {
+      VERIFY_CORRECT_THREAD();
+      fc::time_point message_validated_time;
+      try
+      {
+        if (message_to_process.msg_type.value() == trx_message_type)
         {
-          throw;
+          trx_message transaction_message_to_process = message_to_process.as<trx_message>();
+          dlog( "passing message containing transaction ${trx} to client",
+                ("trx", transaction_message_to_process.trx.id()) );
+          _delegate->handle_transaction(transaction_message_to_process);
         }
-        catch ( const fc::exception& e )
+        else
+          _delegate->handle_message( message_to_process );
+        message_validated_time = fc::time_point::now();
+      }
+      catch ( const fc::canceled_exception& )
+      {
+        throw;
+      }
+      catch ( const fc::exception& e )
+      {
+        switch( e.code() )
         {
-          switch( e.code() )
-          {
-          // log common exceptions in debug level
-          case graphene::chain::duplicate_transaction::code_enum::code_value :
-          case graphene::chain::limit_order_create_kill_unfilled::code_enum::code_value :
-          case graphene::chain::limit_order_create_market_not_whitelisted::code_enum::code_value :
-          case graphene::chain::limit_order_create_market_blacklisted::code_enum::code_value :
-          case graphene::chain::limit_order_create_selling_asset_unauthorized::code_enum::code_value :
-          case graphene::chain::limit_order_create_receiving_asset_unauthorized::code_enum::code_value :
-          case graphene::chain::limit_order_create_insufficient_balance::code_enum::code_value :
-          case graphene::chain::limit_order_cancel_nonexist_order::code_enum::code_value :
-          case graphene::chain::limit_order_cancel_owner_mismatch::code_enum::code_value :
-             dlog( "client rejected message sent by peer ${peer}, ${e}",
-                   ("peer", originating_peer->get_remote_endpoint() )("e", e) );
-             break;
-          // log rarer exceptions in warn level
-          default:
-             wlog( "client rejected message sent by peer ${peer}, ${e}",
-                   ("peer", originating_peer->get_remote_endpoint() )("e", e) );
-             break;
-          }
-          // record it so we don't try to fetch this item again
-          _recently_failed_items.insert( peer_connection::timestamped_item_id(
-                item_id( message_to_process.msg_type.value(), message_hash ), fc::time_point::now() ) );
-          return;
+        // log common exceptions in debug level
+        case graphene::chain::duplicate_transaction::code_enum::code_value :
+        case graphene::chain::limit_order_create_kill_unfilled::code_enum::code_value :
+        case graphene::chain::limit_order_create_market_not_whitelisted::code_enum::code_value :
+        case graphene::chain::limit_order_create_market_blacklisted::code_enum::code_value :
+        case graphene::chain::limit_order_create_selling_asset_unauthorized::code_enum::code_value :
+        case graphene::chain::limit_order_create_receiving_asset_unauthorized::code_enum::code_value :
+        case graphene::chain::limit_order_create_insufficient_balance::code_enum::code_value :
+        case graphene::chain::limit_order_cancel_nonexist_order::code_enum::code_value :
+        case graphene::chain::limit_order_cancel_owner_mismatch::code_enum::code_value :
+           dlog( "client rejected message sent by peer ${peer}, ${e}",
+                 ("peer", originating_peer->get_remote_endpoint() )("e", e) );
+           break;
+        // log rarer exceptions in warn level
+        default:
+           wlog( "client rejected message sent by peer ${peer}, ${e}",
+                 ("peer", originating_peer->get_remote_endpoint() )("e", e) );
+           break;
         }
-
-        // finally, if the delegate validated the message, broadcast it to our other peers
-        message_propagation_data propagation_data { message_receive_time, message_validated_time,
-                                                    originating_peer->node_id };
-        broadcast( message_to_process, propagation_data );
+        // record it so we don't try to fetch this item again
+        _recently_failed_items.insert( peer_connection::timestamped_item_id(
+              item_id( message_to_process.msg_type.value(), message_hash ), fc::time_point::now() ) );
+        return;
       }
+
+      // finally, if the delegate validated the message, broadcast it to our other peers
+      message_propagation_data propagation_data { message_receive_time, message_validated_time,
+                                                  originating_peer->node_id };
+      broadcast( message_to_process, propagation_data );
     }
 
     void node_impl::start_synchronizing_with_peer( const peer_connection_ptr& peer )
@@ -3831,7 +4328,8 @@ namespace graphene { namespace net { namespace detail {
             return;
           new_peer->connection_initiation_time = fc::time_point::now();
           _handshaking_connections.insert( new_peer );
-          _rate_limiter.add_tcp_socket( &new_peer->get_socket() );
+          if( !new_peer->has_io_thread() )
+            _rate_limiter.add_tcp_socket( &new_peer->get_socket() );
           std::weak_ptr<peer_connection> new_weak_peer(new_peer);
           new_peer->accept_or_connect_task_done = fc::async( [this, new_weak_peer]() {
             peer_connection_ptr new_peer(new_weak_peer.lock());
@@ -4265,7 +4763,8 @@ namespace graphene { namespace net { namespace detail {
       new_peer->get_socket().set_reuse_address();
       new_peer->connection_initiation_time = fc::time_point::now();
       _handshaking_connections.insert(new_peer);
-      _rate_limiter.add_tcp_socket(&new_peer->get_socket());
+      if (!new_peer->has_io_thread())
+        _rate_limiter.add_tcp_socket(&new_peer->get_socket());
 
       if (_node_is_shutting_down)
         return;
@@ -4382,10 +4881,16 @@ namespace graphene { namespace net { namespace detail {
       ilog( "--------- MEMORY USAGE ------------" );
       ilog( "node._active_sync_requests size: ${size}", ("size", _active_sync_requests.size() ) );
       ilog( "node._received_sync_items size: ${size}", ("size", _received_sync_items.size() ) );
-      ilog( "node._new_received_sync_items size: ${size}", ("size", _new_received_sync_items.size() ) );
+      ilog( "node._sync_blocks_being_handled: ${count}", ("count", _sync_blocks_being_handled ) );
+      ilog( "node._transactions_to_deliver: ${count}", ("count", _transactions_to_deliver ) );
       ilog( "node._items_to_fetch size: ${size}", ("size", _items_to_fetch.size() ) );
       ilog( "node._new_inventory size: ${size}", ("size", _new_inventory.size() ) );
-      ilog( "node._message_cache size: ${size}", ("size", _message_cache.size() ) );
+      ilog( "node._message_cache size: ${size}, ${bytes} bytes, ${hits} hits, ${misses} misses",
+            ("size", _message_cache.size() )("bytes", _message_cache.total_bytes() )
+            ("hits", _message_cache.hits() )("misses", _message_cache.misses() ) );
+      ilog( "compact blocks: ${rebuilt} rebuilt, ${cached} transactions from cache, ${fetched} fetched, ${fallbacks} fetched in full",
+            ("rebuilt", _compact_blocks_rebuilt)("cached", _compact_block_transactions_from_cache)
+            ("fetched", _compact_block_transactions_fetched)("fallbacks", _compact_block_fallbacks) );
       fc::scoped_lock<fc::mutex> lock(_active_connections.get_mutex());
       for( const peer_connection_ptr& peer : _active_connections )
       {
@@ -4395,6 +4900,11 @@ namespace graphene { namespace net { namespace detail {
         ilog( "    peer.inventory_advertised_to_peer size: ${size}", ("size", peer->inventory_advertised_to_peer.size() ) );
         ilog( "    peer.items_requested_from_peer size: ${size}", ("size", peer->items_requested_from_peer.size() ) );
         ilog( "    peer.sync_items_requested_from_peer size: ${size}", ("size", peer->sync_items_requested_from_peer.size() ) );
+        ilog( "    sync: ${rate} blocks/s, window ${window}, latency ${latency} us, ${received} blocks received, ${reassigned} requests reassigned, ${dropped} duplicates dropped",
+              ("rate", peer->sync_blocks_per_second)("window", peer->sync_window)("latency", peer->sync_block_latency.count())
+              ("received", peer->sync_blocks_received)("reassigned", peer->sync_requests_reassigned)
+              ("dropped", peer->sync_duplicates_dropped) );
+        ilog( "    peer.compact_blocks_in_progress size: ${size}", ("size", peer->compact_blocks_in_progress.size() ) );
       }
       ilog( "--------- END MEMORY USAGE ------------" );
     }
@@ -4507,6 +5017,7 @@ namespace graphene { namespace net { namespace detail {
         peer_details["subver"] = peer->user_agent;
         peer_details["inbound"] = peer->direction == peer_connection_direction::inbound;
         peer_details["firewall_status"] = fc::variant( peer->is_firewalled, 1 );
+        peer_details["framed_transport"] = peer->transport_upgrade_sent && peer->transport_upgrade_received;
         peer_details["startingheight"] = "";
         peer_details["banscore"] = "";
         peer_details["syncnode"] = "";
@@ -4546,6 +5057,9 @@ namespace graphene { namespace net { namespace detail {
 
         peer_details["peer_needs_sync_items_from_us"] = peer->peer_needs_sync_items_from_us;
         peer_details["we_need_sync_items_from_peer"] = peer->we_need_sync_items_from_peer;
+        peer_details["sync_blocks_received"] = peer->sync_blocks_received;
+        peer_details["sync_requests_reassigned"] = peer->sync_requests_reassigned;
+        peer_details["sync_duplicates_dropped"] = peer->sync_duplicates_dropped;
 
         this_peer_status.info = peer_details;
         statuses.push_back(this_peer_status);
@@ -4630,6 +5144,14 @@ namespace graphene { namespace net { namespace detail {
         _max_sync_blocks_to_prefetch = params["max_sync_blocks_to_prefetch"].as<uint32_t>(1);
       if (params.contains("max_sync_blocks_per_peer"))
         _max_sync_blocks_per_peer = params["max_sync_blocks_per_peer"].as<uint32_t>(1);
+      if (params.contains("io_threads"))
+        _io_thread_count = params["io_threads"].as<uint32_t>(1); // applies to connections made from now on
+      if (params.contains("framed_transport"))
+        _framed_transport_enabled = params["framed_transport"].as_bool(); // applies to connections made from now on
+      if (params.contains("compact_blocks"))
+        _compact_blocks_enabled = params["compact_blocks"].as_bool(); // offered to connections made from now on
+      if (params.contains("message_cache_max_bytes"))
+        _message_cache.set_max_bytes(params["message_cache_max_bytes"].as<uint64_t>(1));
 
       _desired_number_of_connections = std::min(_desired_number_of_connections, _maximum_number_of_connections);
 
@@ -4649,6 +5171,19 @@ namespace graphene { namespace net { namespace detail {
       result["max_blocks_to_handle_at_once"] = _max_blocks_to_handle_at_once;
       result["max_sync_blocks_to_prefetch"] = _max_sync_blocks_to_prefetch;
       result["max_sync_blocks_per_peer"] = _max_sync_blocks_per_peer;
+      result["io_threads"] = _io_thread_count;
+      result["framed_transport"] = _framed_transport_enabled;
+      result["compact_blocks"] = _compact_blocks_enabled;
+      result["message_cache_max_bytes"] = _message_cache.get_max_bytes();
+      // read only
+      result["message_cache_size"] = _message_cache.size();
+      result["message_cache_bytes"] = _message_cache.total_bytes();
+      result["message_cache_hits"] = _message_cache.hits();
+      result["message_cache_misses"] = _message_cache.misses();
+      result["compact_blocks_rebuilt"] = _compact_blocks_rebuilt;
+      result["compact_block_transactions_from_cache"] = _compact_block_transactions_from_cache;
+      result["compact_block_transactions_fetched"] = _compact_block_transactions_fetched;
+      result["compact_block_fallbacks"] = _compact_block_fallbacks;
       return result;
     }
 
@@ -4696,6 +5231,16 @@ namespace graphene { namespace net { namespace detail {
     void node_impl::set_total_bandwidth_limit( uint32_t upload_bytes_per_second, uint32_t download_bytes_per_second )
     {
       VERIFY_CORRECT_THREAD();
+      // the rate limiter works on the p2p thread and cannot throttle connections on I/O threads
+      if (upload_bytes_per_second || download_bytes_per_second)
+        for (const auto* connections : { &_handshaking_connections, &_active_connections, &_closing_connections })
+        {
+          fc::scoped_lock<fc::mutex> lock(connections->get_mutex());
+          for (const peer_connection_ptr& peer : *connections)
+            FC_ASSERT( !peer->has_io_thread(),
+                       "Cannot limit the bandwidth while connections are on I/O threads, set io_threads to 0 and "
+                       "reconnect them first" );
+        }
       _rate_limiter.set_upload_limit( upload_bytes_per_second );
       _rate_limiter.set_download_limit( download_bytes_per_second );
     }
@@ -159,8 +159,10 @@ private:
    struct message_info
    {
       message_hash_type message_hash;
-      message           message_body;
+      /// shared with the send queues of the peers it is sent to
+      std::shared_ptr<const message> message_body;
       uint32_t          block_clock_when_received;
+      size_t            byte_size;
 
       /// for network performance stats
       message_propagation_data propagation_data;
@@ -169,30 +171,39 @@ private:
       message_hash_type message_contents_hash;
 
       message_info( const message_hash_type& message_hash,
-                    const message&           message_body,
+                    std::shared_ptr<const message> message_body,
                     uint32_t                 block_clock_when_received,
                     const message_propagation_data& propagation_data,
                     message_hash_type        message_contents_hash ) :
             message_hash( message_hash ),
-            message_body( message_body ),
+            message_body( std::move(message_body) ),
             block_clock_when_received( block_clock_when_received ),
+            byte_size( sizeof(message_header) + this->message_body->data.size() ),
             propagation_data( propagation_data ),
             message_contents_hash( message_contents_hash )
       {}
    };
 
+   /// the sequenced index is in order of insertion, which is also the order of the block clock
    using message_cache_container = boost::multi_index_container < message_info,
                bmi::indexed_by<
-                  bmi::ordered_unique< bmi::tag<message_hash_index>,
-                     bmi::member<message_info, message_hash_type, &message_info::message_hash> >,
-                  bmi::ordered_non_unique< bmi::tag<message_contents_hash_index>,
-                     bmi::member<message_info, message_hash_type, &message_info::message_contents_hash> >,
-                  bmi::ordered_non_unique< bmi::tag<block_clock_index>,
-                     bmi::member<message_info, uint32_t, &message_info::block_clock_when_received> > > >;
+                  bmi::hashed_unique< bmi::tag<message_hash_index>,
+                     bmi::member<message_info, message_hash_type, &message_info::message_hash>,
+                     std::hash<fc::ripemd160> >,
+                  bmi::hashed_non_unique< bmi::tag<message_contents_hash_index>,
+                     bmi::member<message_info, message_hash_type, &message_info::message_contents_hash>,
+                     std::hash<fc::ripemd160> >,
+                  bmi::sequenced< bmi::tag<block_clock_index> > > >;
 
    message_cache_container _message_cache;
 
    uint32_t block_clock = 0;
+   size_t   _max_bytes = GRAPHENE_NET_MESSAGE_CACHE_MAX_BYTES;
+   size_t   _total_bytes = 0;
+   mutable uint64_t _hits = 0;
+   mutable uint64_t _misses = 0;
+
+   void erase_oldest();
 
 public:
    void block_accepted();
@@ -200,10 +211,30 @@ public:
                        const message_hash_type& hash_of_message_to_cache,
                        const message_propagation_data& propagation_data,
                        const message_hash_type& message_content_hash );
-   message get_message( const message_hash_type& hash_of_message_to_lookup ) const;
+   /// @return the cached message, which must not be modified
+   /// @throws fc::key_not_found_exception if it is not cached
+   std::shared_ptr<const message> get_message( const message_hash_type& hash_of_message_to_lookup ) const;
+   /// Same as get_message, looking the message up by the hash of its contents, e.g. a block id
+   std::shared_ptr<const message> get_message_by_contents( const message_hash_type& hash_of_msg_contents_to_lookup ) const;
    message_propagation_data get_message_propagation_data(
          const message_hash_type& hash_of_msg_contents_to_lookup ) const;
    size_t size() const { return _message_cache.size(); }
+   /// Calls @p visitor with the transaction id and the message of each cached transaction
+   template<typename Visitor>
+   void visit_transactions( Visitor&& visitor ) const
+   {
+      for( const message_info& info : _message_cache )
+         if( info.message_body->msg_type.value() == trx_message_type )
+            visitor( info.message_contents_hash, *info.message_body );
+   }
+
+   /// Drops the oldest messages until the cache holds at most @p max_bytes
+   void set_max_bytes( size_t max_bytes );
+   size_t get_max_bytes() const { return _max_bytes; }
+   size_t total_bytes() const { return _total_bytes; }
+   /// lookups of get_message that found the message, and that did not
+   uint64_t hits() const { return _hits; }
+   uint64_t misses() const { return _misses; }
 };
 
 /// When requesting items from peers, we want to prioritize any blocks before
@@ -383,6 +414,9 @@ class node_impl : public peer_connection_delegate, public std::enable_shared_fro
 #ifdef P2P_IN_DEDICATED_THREAD
       std::shared_ptr<fc::thread> _thread = std::make_shared<fc::thread>("p2p");
 #endif // P2P_IN_DEDICATED_THREAD
+      /// Threads doing the socket I/O of the peer connections, started as connections need them.
+      /// Declared early so that they outlive the connections
+      std::vector<std::shared_ptr<fc::thread>> _io_threads;
       std::unique_ptr<statistics_gathering_node_delegate_wrapper> _delegate;
       fc::sha256           _chain_id;
 
@@ -424,11 +458,9 @@ class node_impl : public peer_connection_delegate, public std::enable_shared_fro
 
       /// List of sync blocks we've asked for from peers but have not yet received
       active_sync_requests_map              _active_sync_requests;
-      /// List of sync blocks we've just received but haven't yet tried to process
-      std::list<graphene::net::block_message> _new_received_sync_items;
-      /// List of sync blocks we've received, but can't yet process because we are still missing blocks
+      /// Sync blocks we've received, but can't yet process because we are still missing blocks
       /// that come earlier in the chain
-      std::list<graphene::net::block_message> _received_sync_items;
+      std::unordered_map<graphene::net::block_id_type, graphene::net::block_message> _received_sync_items;
       /// @}
 
       fc::future<void> _process_backlog_of_sync_blocks_done;
@@ -524,6 +556,12 @@ class node_impl : public peer_connection_delegate, public std::enable_shared_fro
       /// Cache message we have received and might be required to provide to other peers via inventory requests
       blockchain_tied_message_cache _message_cache;
 
+      /// Compact block relay statistics, for dump_node_status
+      uint64_t _compact_blocks_rebuilt = 0;
+      uint64_t _compact_block_transactions_from_cache = 0;
+      uint64_t _compact_block_transactions_fetched = 0;
+      uint64_t _compact_block_fallbacks = 0;
+
       fc::rate_limiting_group _rate_limiter { 0, 0 };
 
       /// Number of connections last reported to the client (to avoid sending duplicate messages)
@@ -587,8 +625,20 @@ class node_impl : public peer_connection_delegate, public std::enable_shared_fro
       size_t _max_sync_blocks_to_prefetch = MAX_SYNC_BLOCKS_TO_PREFETCH;
       /// Maximum number of blocks per peer during syncing
       size_t _max_sync_blocks_per_peer = GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING;
+      /// Number of I/O threads new connections are spread over, 0 keeps their I/O on the p2p thread
+      uint32_t _io_thread_count = GRAPHENE_NET_DEFAULT_IO_THREADS;
+      /// The I/O thread the next connection goes to, modulo _io_thread_count
+      uint32_t _next_io_thread = 0;
+      /// Whether hello messages offer the framed transport, and upgrades to it are accepted
+      bool _framed_transport_enabled = false;
+      /// Whether hello messages offer compact blocks, and blocks are requested compact from peers that offer them
+      bool _compact_blocks_enabled = false;
 
       std::list<fc::future<void> > _handle_message_calls_in_progress;
+      /// Number of the calls above that are still handing a sync block to the delegate
+      size_t _sync_blocks_being_handled = 0;
+      /// Number of transactions received from all peers that have not been handed to the delegate yet
+      size_t _transactions_to_deliver = 0;
 
       /// Used by the task that checks whether addresses of seed nodes have been updated
       /// @{
@@ -609,6 +659,9 @@ class node_impl : public peer_connection_delegate, public std::enable_shared_fro
       bool have_already_received_sync_item( const item_hash_t& item_hash );
       void request_sync_item_from_peer( const peer_connection_ptr& peer, const item_hash_t& item_to_request );
       void request_sync_items_from_peer( const peer_connection_ptr& peer, const std::vector<item_hash_t>& items_to_request );
+      void forget_sync_request( const item_hash_t& item, const fc::time_point& request_time );
+      void record_sync_block_received( peer_connection* peer, const fc::time_point& request_time );
+      void reassign_overdue_sync_requests();
       void fetch_sync_items_loop();
       void trigger_fetch_sync_items_loop();
 
@@ -672,9 +725,21 @@ class node_impl : public peer_connection_delegate, public std::enable_shared_fro
       void on_item_ids_inventory_message( peer_connection* originating_peer,
                                           const item_ids_inventory_message& item_ids_inventory_message_received );
 
+      void send_transport_upgrade( peer_connection* peer );
+
       void on_closing_connection_message( peer_connection* originating_peer,
                                           const closing_connection_message& closing_connection_message_received );
 
+      void on_transport_upgrade_message( peer_connection* originating_peer, const transport_upgrade_message& );
+
+      fc::optional<block_message> find_block_message( const item_hash_t& item_hash,
+                                                      const block_id_type& block_id ) const;
+      void send_compact_blocks( peer_connection* originating_peer, const std::vector<item_hash_t>& items_to_fetch ) const;
+      void on_compact_block_message( peer_connection* originating_peer, const compact_block_message& );
+      void on_get_block_transactions_message( peer_connection* originating_peer, const get_block_transactions_message& );
+      void on_block_transactions_message( peer_connection* originating_peer, block_transactions_message&& );
+      void finish_compact_block( peer_connection* originating_peer, partial_compact_block&& partial );
+
       void on_current_time_request_message( peer_connection* originating_peer,
                                             const current_time_request_message& current_time_request_message_received );
 
@@ -711,6 +776,15 @@ class node_impl : public peer_connection_delegate, public std::enable_shared_fro
                   peer_connection* originating_peer,
                   const message& message_to_process,
                   const message_hash_type& message_hash);
+      void deliver_ordinary_message(
+                  peer_connection* originating_peer,
+                  const message& message_to_process,
+                  const message_hash_type& message_hash,
+                  const fc::time_point& message_receive_time);
+      /// Hands the transactions of @p peer to the delegate one after another, until none are left
+      void deliver_transactions_from_peer(const peer_connection_ptr& peer);
+      /// @return whether no more transactions may be fetched from @p peer until the delegate has caught up
+      bool too_many_transactions_to_deliver(const peer_connection& peer) const;
 
       void start_synchronizing();
       void start_synchronizing_with_peer(const peer_connection_ptr& peer);
@@ -777,7 +851,8 @@ class node_impl : public peer_connection_delegate, public std::enable_shared_fro
       void                       set_total_bandwidth_limit( uint32_t upload_bytes_per_second, uint32_t download_bytes_per_second );
       void                       disable_peer_advertising();
       fc::variant_object         get_call_statistics() const;
-      message                    get_message_for_item(const item_id& item) override;
+      std::shared_ptr<const message> get_message_for_item(const item_id& item) override;
+      fc::thread*                get_io_thread() override;
 
       fc::variant_object         network_get_info() const;
       fc::variant_object         network_get_usage_stats() const;
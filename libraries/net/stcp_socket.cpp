@@ -24,18 +24,101 @@
 #include <assert.h>
 
 #include <algorithm>
+#include <limits>
 
 #include <fc/crypto/hex.hpp>
 #include <fc/crypto/aes.hpp>
 #include <fc/crypto/city.hpp>
+#include <fc/crypto/sha256.hpp>
 #include <fc/log/logger.hpp>
 #include <fc/network/ip.hpp>
 #include <fc/exception/exception.hpp>
 
 #include <graphene/net/stcp_socket.hpp>
 
+#include <boost/endian/buffers.hpp>
+
+#include <openssl/evp.h>
+
 namespace graphene { namespace net {
 
+namespace detail {
+
+/**
+ *  One direction of the framed transport: AES-256-GCM, keyed once, with the number of the frame as nonce.
+ *  OpenSSL picks the AES-NI and carry-less multiplication code paths where the CPU has them.
+ */
+class aead_channel
+{
+   public:
+      static constexpr size_t tag_size = 16;
+
+      aead_channel( const fc::sha256& key, bool encrypt )
+      : _ctx( EVP_CIPHER_CTX_new() )
+      {
+         FC_ASSERT( _ctx, "unable to allocate a cipher context" );
+         FC_ASSERT( EVP_CipherInit_ex( _ctx, EVP_aes_256_gcm(), nullptr, (const unsigned char*)key.data(), nullptr,
+                                       encrypt ? 1 : 0 ) == 1, "unable to initialize AES-256-GCM" );
+      }
+      ~aead_channel()
+      {
+         EVP_CIPHER_CTX_free( _ctx );
+      }
+
+      /** Starts the next frame, @p aad is authenticated but not encrypted */
+      void begin( const char* aad, size_t aad_len )
+      {
+         unsigned char iv[12] = {};
+         ++_frames;
+         for( size_t i = 0; i < sizeof(_frames); ++i )
+            iv[4 + i] = uint8_t( _frames >> (8 * i) );
+         FC_ASSERT( EVP_CipherInit_ex( _ctx, nullptr, nullptr, nullptr, iv, -1 ) == 1 );
+         int out_len = 0;
+         FC_ASSERT( EVP_CipherUpdate( _ctx, nullptr, &out_len, (const unsigned char*)aad, int(aad_len) ) == 1 );
+      }
+      /** Encrypts or decrypts the next @p len bytes of the frame, @p in and @p out may be the same */
+      void update( const char* in, size_t len, char* out )
+      {
+         if( len == 0 )
+            return;
+         int out_len = 0;
+         FC_ASSERT( EVP_CipherUpdate( _ctx, (unsigned char*)out, &out_len, (const unsigned char*)in, int(len) ) == 1
+                    && size_t(out_len) == len );
+      }
+      /** Ends an encrypted frame, writing its tag to @p tag */
+      void finish_encrypt( char* tag )
+      {
+         int out_len = 0;
+         FC_ASSERT( EVP_CipherFinal_ex( _ctx, nullptr, &out_len ) == 1 );
+         FC_ASSERT( EVP_CIPHER_CTX_ctrl( _ctx, EVP_CTRL_GCM_GET_TAG, tag_size, tag ) == 1 );
+      }
+      /** Ends a decrypted frame, throws if @p tag does not authenticate it */
+      void finish_decrypt( const char* tag )
+      {
+         int out_len = 0;
+         FC_ASSERT( EVP_CIPHER_CTX_ctrl( _ctx, EVP_CTRL_GCM_SET_TAG, tag_size, (void*)tag ) == 1 );
+         FC_ASSERT( EVP_CipherFinal_ex( _ctx, nullptr, &out_len ) == 1, "frame ${n} failed authentication",
+                    ("n",_frames) );
+      }
+
+   private:
+      EVP_CIPHER_CTX* _ctx;
+      uint64_t        _frames = 0;
+};
+
+} // detail
+
+namespace {
+   /// Key of the frames sent by the owner of @p sender_key
+   fc::sha256 frame_key( const fc::sha512& shared_secret, const fc::ecc::public_key_data& sender_key )
+   {
+      fc::sha256::encoder enc;
+      enc.write( (const char*)&shared_secret, sizeof(shared_secret) );
+      enc.write( (const char*)&sender_key, sizeof(sender_key) );
+      return enc.result();
+   }
+}
+
 stcp_socket::stcp_socket()
 //:_buf_len(0)
 #ifndef NDEBUG
@@ -59,6 +142,7 @@ void stcp_socket::do_key_exchange()
   _sock.read( serialized_key_buffer, sizeof(fc::ecc::public_key_data) );
   fc::ecc::public_key_data rpub;
   memcpy((char*)&rpub, serialized_key_buffer.get(), sizeof(fc::ecc::public_key_data));
+  _remote_public_key = rpub;
 
   _shared_secret = _priv_key.get_shared_secret( rpub );
 //    ilog("shared secret ${s}", ("s", shared_secret) );
@@ -163,6 +247,62 @@ size_t stcp_socket::writesome( const std::shared_ptr<const char>& buf, size_t le
   return writesome(buf.get() + offset, len);
 }
 
+void stcp_socket::start_sending_frames()
+{
+  FC_ASSERT( !_send_frames, "already sending frames" );
+  _send_frames = std::make_unique<detail::aead_channel>(
+        frame_key( _shared_secret, _priv_key.get_public_key().serialize() ), true );
+}
+
+void stcp_socket::start_receiving_frames()
+{
+  FC_ASSERT( !_recv_frames, "already receiving frames" );
+  _recv_frames = std::make_unique<detail::aead_channel>( frame_key( _shared_secret, _remote_public_key ), false );
+}
+
+size_t stcp_socket::write_frame( const char* head, size_t head_len, const char* body, size_t body_len )
+{ try {
+    FC_ASSERT( _send_frames, "frames have not been negotiated" );
+    const size_t len = head_len + body_len;
+    FC_ASSERT( len <= std::numeric_limits<int32_t>::max() );
+
+    _write_frame_buffer.resize( sizeof(uint32_t) + len + detail::aead_channel::tag_size );
+    char* frame = _write_frame_buffer.data();
+    const boost::endian::little_uint32_buf_t prefix( uint32_t(len) );
+    memcpy( frame, &prefix, sizeof(prefix) );
+    _send_frames->begin( frame, sizeof(prefix) );
+    _send_frames->update( head, head_len, frame + sizeof(prefix) );
+    _send_frames->update( body, body_len, frame + sizeof(prefix) + head_len );
+    _send_frames->finish_encrypt( frame + sizeof(prefix) + len );
+
+    _sock.write( frame, _write_frame_buffer.size() );
+    return _write_frame_buffer.size();
+} FC_RETHROW_EXCEPTIONS( warn, "", ("len",head_len + body_len) ) }
+
+size_t stcp_socket::read_frame( char* head, size_t head_len, std::vector<char>& body, size_t max_len )
+{ try {
+    FC_ASSERT( _recv_frames, "frames have not been negotiated" );
+    char start[sizeof(uint32_t) + 64];
+    FC_ASSERT( head_len <= sizeof(start) - sizeof(uint32_t) );
+
+    // the length and the head in one read, the body and the tag in another
+    _sock.read( start, sizeof(uint32_t) + head_len );
+    boost::endian::little_uint32_buf_t prefix;
+    memcpy( &prefix, start, sizeof(prefix) );
+    const size_t len = prefix.value();
+    FC_ASSERT( len >= head_len && len <= max_len, "invalid frame length", ("len",len)("max_len",max_len) );
+    const size_t body_len = len - head_len;
+    body.resize( body_len + detail::aead_channel::tag_size );
+    _sock.read( body.data(), body.size() );
+
+    _recv_frames->begin( start, sizeof(prefix) );
+    _recv_frames->update( start + sizeof(prefix), head_len, head );
+    _recv_frames->update( body.data(), body_len, body.data() );
+    _recv_frames->finish_decrypt( body.data() + body_len );
+    body.resize( body_len );
+    return sizeof(prefix) + len + detail::aead_channel::tag_size;
+} FC_RETHROW_EXCEPTIONS( warn, "", ("head_len",head_len)("max_len",max_len) ) }
+
 void stcp_socket::flush()
 {
   _sock.flush();
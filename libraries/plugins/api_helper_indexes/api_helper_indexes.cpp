@@ -92,6 +92,106 @@ share_type amount_in_collateral_index::get_backing_collateral( const asset_id_ty
    return itr->second;
 } FC_CAPTURE_AND_RETHROW( (asst) ) }
 
+void order_book_index::object_inserted( const object& objct )
+{ try {
+   const limit_order_object& o = static_cast<const limit_order_object&>( objct );
+   price_level& level = levels[o.sell_price];
+   level.for_sale += o.for_sale;
+   ++level.orders;
+} FC_CAPTURE_AND_RETHROW( (objct) ) }
+
+void order_book_index::object_removed( const object& objct )
+{ try {
+   const limit_order_object& o = static_cast<const limit_order_object&>( objct );
+   auto itr = levels.find( o.sell_price );
+   if( itr == levels.end() ) // should never happen
+      return;
+   itr->second.for_sale -= o.for_sale;
+   if( --itr->second.orders == 0 )
+      levels.erase( itr );
+} FC_CAPTURE_AND_RETHROW( (objct) ) }
+
+void order_book_index::about_to_modify( const object& objct )
+{ try {
+   object_removed( objct );
+} FC_CAPTURE_AND_RETHROW( (objct) ) }
+
+void order_book_index::object_modified( const object& objct )
+{ try {
+   object_inserted( objct );
+} FC_CAPTURE_AND_RETHROW( (objct) ) }
+
+const order_book_index::price_level* order_book_index::find_level( const price& sell_price )const
+{
+   auto itr = levels.find( sell_price );
+   if( itr == levels.end() ) return nullptr;
+   return &itr->second;
+}
+
+std::pair< order_book_index::levels_type::const_iterator, order_book_index::levels_type::const_iterator >
+order_book_index::get_levels( asset_id_type sell, asset_id_type receive )const
+{
+   return std::make_pair( levels.lower_bound( price::max( sell, receive ) ),
+                          levels.upper_bound( price::min( sell, receive ) ) );
+}
+
+void asset_holders_index::object_inserted( const object& objct )
+{ try {
+   const account_balance_object& b = static_cast<const account_balance_object&>( objct );
+   counts& c = asset_counts[b.asset_type];
+   ++c.balances;
+   if( b.balance != 0 )
+   {
+      holders.insert( holder{ b.asset_type, b.balance, b.owner } );
+      ++c.holders;
+   }
+} FC_CAPTURE_AND_RETHROW( (objct) ) }
+
+void asset_holders_index::object_removed( const object& objct )
+{ try {
+   const account_balance_object& b = static_cast<const account_balance_object&>( objct );
+   auto itr = asset_counts.find( b.asset_type );
+   if( itr == asset_counts.end() ) // should never happen
+      return;
+   --itr->second.balances;
+   if( b.balance != 0 && holders.erase( boost::make_tuple( b.asset_type, b.balance, b.owner ) ) > 0 )
+      --itr->second.holders;
+} FC_CAPTURE_AND_RETHROW( (objct) ) }
+
+void asset_holders_index::about_to_modify( const object& objct )
+{ try {
+   object_removed( objct );
+} FC_CAPTURE_AND_RETHROW( (objct) ) }
+
+void asset_holders_index::object_modified( const object& objct )
+{ try {
+   object_inserted( objct );
+} FC_CAPTURE_AND_RETHROW( (objct) ) }
+
+uint64_t asset_holders_index::get_balance_count( const asset_id_type& asst )const
+{
+   auto itr = asset_counts.find( asst );
+   if( itr == asset_counts.end() ) return 0;
+   return itr->second.balances;
+}
+
+uint64_t asset_holders_index::get_holder_count( const asset_id_type& asst )const
+{
+   auto itr = asset_counts.find( asst );
+   if( itr == asset_counts.end() ) return 0;
+   return itr->second.holders;
+}
+
+std::pair< asset_holders_index::holders_type::const_iterator, asset_holders_index::holders_type::const_iterator >
+asset_holders_index::get_holders( const asset_id_type& asst, uint64_t start )const
+{
+   auto end = holders.upper_bound( boost::make_tuple( asst ) );
+   auto first_rank = holders.rank( holders.lower_bound( boost::make_tuple( asst ) ) );
+   if( start >= holders.rank( end ) - first_rank )
+      return std::make_pair( end, end );
+   return std::make_pair( holders.nth( first_rank + start ), end );
+}
+
 namespace detail
 {
 
@@ -150,6 +250,14 @@ void api_helper_indexes::plugin_startup()
    for( const auto& call : database().get_index_type<call_order_index>().indices() )
       amount_in_collateral_idx->object_inserted( call );
 
+   order_book_idx = database().add_secondary_index< primary_index<limit_order_index>, order_book_index >();
+   for( const auto& order : database().get_index_type<limit_order_index>().indices() )
+      order_book_idx->object_inserted( order );
+
+   asset_holders_idx = database().add_secondary_index< primary_index<account_balance_index>, asset_holders_index >();
+   for( const auto& balance : database().get_index_type<account_balance_index>().indices() )
+      asset_holders_idx->object_inserted( balance );
+
    auto& account_members = *database().add_secondary_index< primary_index<account_index>, account_member_index >();
    for( const auto& account : database().get_index_type< account_index >().indices() )
       account_members.object_inserted( account );
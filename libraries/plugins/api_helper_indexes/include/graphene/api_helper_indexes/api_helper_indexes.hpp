@@ -24,8 +24,16 @@
 #pragma once
 
 #include <graphene/app/plugin.hpp>
+#include <graphene/protocol/asset.hpp>
 #include <graphene/protocol/types.hpp>
 
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/composite_key.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/ranked_index.hpp>
+
+#include <map>
+
 namespace graphene { namespace api_helper_indexes {
 using namespace chain;
 
@@ -51,6 +59,92 @@ class amount_in_collateral_index : public secondary_index
       flat_map<asset_id_type, share_type> backing_collateral;
 };
 
+/**
+ *  @brief This secondary index keeps the open limit orders aggregated into price levels, so that the depth of a
+ *         market can be read without visiting every order.
+ *  @note Levels of all markets are kept in one map; since prices compare by asset ids first, the levels of the
+ *        orders selling one asset for another form a contiguous range, ordered like the \c by_price index.
+ */
+class order_book_index : public secondary_index
+{
+   public:
+      /// Orders selling at one price
+      struct price_level
+      {
+         share_type for_sale;
+         uint32_t   orders = 0;
+      };
+      typedef std::map< price, price_level, std::greater<price> > levels_type;
+
+      void object_inserted( const object& obj ) override;
+      void object_removed( const object& obj ) override;
+      void about_to_modify( const object& before ) override;
+      void object_modified( const object& after ) override;
+
+      /// Returns the level of the orders selling at @p sell_price, or nullptr if there is no such order
+      const price_level* find_level( const price& sell_price )const;
+      /// Returns the levels of the orders selling @p sell for @p receive, best price first
+      std::pair< levels_type::const_iterator, levels_type::const_iterator > get_levels( asset_id_type sell,
+                                                                                         asset_id_type receive )const;
+
+   private:
+      levels_type levels;
+};
+
+/**
+ *  @brief This secondary index keeps the non-zero balances of each asset in a ranked tree, so that holders can be
+ *         paged by offset and counted without walking the balances.
+ */
+class asset_holders_index : public secondary_index
+{
+   public:
+      /// A non-zero balance, ordered like the \c by_asset_balance index
+      struct holder
+      {
+         asset_id_type   asset_type;
+         share_type      balance;
+         account_id_type owner;
+      };
+      typedef boost::multi_index_container< holder,
+         boost::multi_index::indexed_by<
+            boost::multi_index::ranked_unique<
+               boost::multi_index::composite_key< holder,
+                  boost::multi_index::member< holder, asset_id_type, &holder::asset_type >,
+                  boost::multi_index::member< holder, share_type, &holder::balance >,
+                  boost::multi_index::member< holder, account_id_type, &holder::owner >
+               >,
+               boost::multi_index::composite_key_compare<
+                  std::less< asset_id_type >,
+                  std::greater< share_type >,
+                  std::less< account_id_type >
+               >
+            >
+         >
+      > holders_type;
+
+      void object_inserted( const object& obj ) override;
+      void object_removed( const object& obj ) override;
+      void about_to_modify( const object& before ) override;
+      void object_modified( const object& after ) override;
+
+      /// Number of balance objects of an asset, including zero balances
+      uint64_t get_balance_count( const asset_id_type& asset )const;
+      /// Number of accounts holding a non-zero balance of an asset
+      uint64_t get_holder_count( const asset_id_type& asset )const;
+      /// Returns the non-zero balances of an asset from the @p start-th on, biggest first
+      std::pair< holders_type::const_iterator, holders_type::const_iterator > get_holders( const asset_id_type& asset,
+                                                                                         uint64_t start )const;
+
+   private:
+      struct counts
+      {
+         uint64_t balances = 0;
+         uint64_t holders = 0;
+      };
+      holders_type                    holders;
+      flat_map<asset_id_type, counts> asset_counts;
+};
+
 namespace detail
 {
     class api_helper_indexes_impl;
@@ -75,6 +169,8 @@ class api_helper_indexes : public graphene::app::plugin
    private:
       std::unique_ptr<detail::api_helper_indexes_impl> my;
       amount_in_collateral_index* amount_in_collateral_idx = nullptr;
+      order_book_index* order_book_idx = nullptr;
+      asset_holders_index* asset_holders_idx = nullptr;
 };
 
 } } //graphene::template
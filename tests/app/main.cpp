@@ -34,11 +34,14 @@
 #include <graphene/account_history/account_history_plugin.hpp>
 #include <graphene/witness/witness.hpp>
 
+#include <graphene/net/stcp_socket.hpp>
+
 #include <fc/thread/thread.hpp>
 #include <fc/log/appender.hpp>
 #include <fc/log/console_appender.hpp>
 #include <fc/log/logger.hpp>
 #include <fc/log/logger_config.hpp>
+#include <fc/network/tcp_socket.hpp>
 
 #include <boost/filesystem/path.hpp>
 
@@ -57,6 +60,62 @@ namespace fc {
    extern std::unordered_map<std::string, appender::ptr> &get_appender_map();
 }
 
+namespace {
+
+/////////////
+/// @brief an application whose P2P node listens on a free loopback port and has no seed nodes
+///
+/// The advanced node parameters are set before the node makes or accepts any connection, connect_to() connects it.
+/////////////
+struct test_network_node
+{
+   fc::temp_directory dir { graphene::utilities::temp_directory_path() };
+   graphene::app::application app;
+   fc::ip::endpoint endpoint;
+
+   explicit test_network_node( const boost::filesystem::path& genesis_file,
+                               const fc::variant_object& node_parameters = fc::variant_object() )
+   {
+      app.register_plugin< graphene::account_history::account_history_plugin >();
+      app.register_plugin< graphene::witness_plugin::witness_plugin >();
+      const auto port = fc::network::get_available_port();
+      endpoint = fc::ip::endpoint( fc::ip::address( "127.0.0.1" ), port );
+      auto cfg = std::make_shared<boost::program_options::variables_map>();
+      fc::set_option( *cfg, "p2p-endpoint", std::string( endpoint ) );
+      fc::set_option( *cfg, "genesis-json", genesis_file );
+      fc::set_option( *cfg, "seed-nodes", std::string( "[]" ) );
+      app.initialize( dir.path(), cfg );
+      app.startup();
+      fc::wait_for( fc::seconds(15), [this] () {
+         const auto status = app.p2p_node()->network_get_info();
+         return status["listening_on"].as<fc::ip::endpoint>( 5 ).port() == endpoint.port();
+      });
+      if( node_parameters.size() > 0 )
+         app.p2p_node()->set_advanced_node_parameters( node_parameters );
+   }
+
+   void connect_to( const test_network_node& other )
+   {
+      app.p2p_node()->connect_to_endpoint( other.endpoint );
+   }
+
+   /// @return whether the node has @p count connections, all of them done with the initial handshake and sync
+   bool has_settled_connections( uint32_t count )
+   {
+      if( app.p2p_node()->get_connection_count() != count )
+         return false;
+      for( const auto& peer : app.p2p_node()->get_connected_peers() )
+      {
+         auto itr = peer.info.find( "peer_needs_sync_items_from_us" );
+         if( itr == peer.info.end() || itr->value().as<bool>(1) )
+            return false;
+      }
+      return true;
+   }
+};
+
+} // anonymous namespace
+
 BOOST_AUTO_TEST_CASE(load_configuration_options_test_config_logging_files_created)
 {
    fc::temp_directory app_dir(graphene::utilities::temp_directory_path());
@@ -387,6 +446,437 @@ BOOST_AUTO_TEST_CASE( two_node_network )
    }
 }
 
+/////////////
+/// @brief blocks are relayed compact between nodes that enable it: rebuilt from the transactions the receiver has,
+/// completed with the ones it has to fetch, and fetched in full when they don't rebuild to the advertised block
+/////////////
+BOOST_AUTO_TEST_CASE( compact_block_relay )
+{
+   using namespace graphene::chain;
+   try {
+      fc::temp_directory genesis_dir( graphene::utilities::temp_directory_path() );
+      const auto genesis_file = create_genesis_file( genesis_dir );
+      const fc::variant_object node_parameters = fc::mutable_variant_object( "compact_blocks", true );
+      test_network_node producer( genesis_file, node_parameters );
+      test_network_node receiver( genesis_file, node_parameters );
+      receiver.connect_to( producer );
+      fc::wait_for( fc::seconds(15), [&] () {
+         return producer.has_settled_connections( 1 ) && receiver.has_settled_connections( 1 );
+      });
+      BOOST_REQUIRE_EQUAL( receiver.app.p2p_node()->get_connection_count(), 1u );
+
+      std::shared_ptr<database> db = producer.app.chain_database();
+      const fc::ecc::private_key rsquaredchp1_key = fc::ecc::private_key::regenerate(
+            fc::sha256::hash( string( "rsquaredchp1" ) ) );
+      const account_id_type rsquaredchp1_id = db->get_index_type<account_index>().indices().get<by_name>()
+                                                 .find( "rsquaredchp1" )->id;
+      // the first transfer claims the balance the others spend
+      const auto make_transfer = [&]( int64_t amount, bool claim ) {
+         precomputable_transaction trx;
+         if( claim )
+         {
+            balance_claim_operation claim_op;
+            claim_op.deposit_to_account = rsquaredchp1_id;
+            claim_op.balance_to_claim = balance_id_type();
+            claim_op.balance_owner_key = rsquaredchp1_key.get_public_key();
+            claim_op.total_claimed = balance_id_type()(*db).balance;
+            trx.operations.push_back( claim_op );
+            db->current_fee_schedule().set_fee( trx.operations.back() );
+         }
+         transfer_operation xfer_op;
+         xfer_op.from = rsquaredchp1_id;
+         xfer_op.to = GRAPHENE_NULL_ACCOUNT;
+         xfer_op.amount = asset( amount );
+         trx.operations.push_back( xfer_op );
+         db->current_fee_schedule().set_fee( trx.operations.back() );
+         trx.set_expiration( db->get_slot_time( 10 ) );
+         trx.sign( rsquaredchp1_key, db->get_chain_id() );
+         return trx;
+      };
+      const auto relay_block = [&]() {
+         // the receiver rejects blocks from the future
+         fc::wait_for( fc::seconds(15), [db] () {
+            return db->get_slot_time(1) <= fc::time_point::now();
+         });
+         const signed_block block = db->generate_block( db->get_slot_time(1), db->get_scheduled_witness(1),
+                                                        rsquaredchp1_key, database::skip_nothing );
+         BOOST_REQUIRE_EQUAL( block.transactions.size(), 1u );
+         producer.app.p2p_node()->broadcast( graphene::net::block_message( block ) );
+         fc::wait_for( fc::seconds(15), [&receiver, &block] () {
+            return receiver.app.chain_database()->head_block_id() == block.id();
+         });
+         BOOST_REQUIRE( receiver.app.chain_database()->head_block_id() == block.id() );
+      };
+      const auto counters = [&receiver]() {
+         const auto parameters = receiver.app.p2p_node()->get_advanced_node_parameters();
+         return std::vector<uint64_t>{ parameters["compact_blocks_rebuilt"].as<uint64_t>(1),
+                                       parameters["compact_block_transactions_from_cache"].as<uint64_t>(1),
+                                       parameters["compact_block_transactions_fetched"].as<uint64_t>(1),
+                                       parameters["compact_block_fallbacks"].as<uint64_t>(1) };
+      };
+      const auto check_counters = [&counters]( const std::vector<uint64_t>& before, uint64_t rebuilt,
+                                               uint64_t from_cache, uint64_t fetched, uint64_t fallbacks ) {
+         const auto after = counters();
+         BOOST_CHECK_EQUAL( after[0] - before[0], rebuilt );
+         BOOST_CHECK_EQUAL( after[1] - before[1], from_cache );
+         BOOST_CHECK_EQUAL( after[2] - before[2], fetched );
+         BOOST_CHECK_EQUAL( after[3] - before[3], fallbacks );
+      };
+
+      BOOST_TEST_MESSAGE( "Relaying a block whose transaction the receiver has" );
+      {
+         const auto trx = make_transfer( 1000000, true );
+         db->push_transaction( trx );
+         producer.app.p2p_node()->broadcast( graphene::net::trx_message( trx ) );
+         fc::wait_for( fc::seconds(15), [&receiver] () {
+            return receiver.app.chain_database()->get_balance( GRAPHENE_NULL_ACCOUNT, asset_id_type() )
+                         .amount.value == 1000000;
+         });
+         const auto before = counters();
+         relay_block();
+         check_counters( before, 1, 1, 0, 0 );
+      }
+
+      BOOST_TEST_MESSAGE( "Relaying a block whose transaction the receiver has to fetch" );
+      {
+         db->push_transaction( make_transfer( 2000, false ) );
+         const auto before = counters();
+         relay_block();
+         check_counters( before, 1, 0, 1, 0 );
+      }
+
+      BOOST_TEST_MESSAGE( "Relaying a block the receiver has a differently signed copy of the transaction of" );
+      {
+         const auto trx = make_transfer( 3000, false );
+         db->push_transaction( trx );
+         // same transaction id, other signatures, so the rebuilt block is not the one that was advertised
+         auto copy = trx;
+         copy.sign( fc::ecc::private_key::regenerate( fc::sha256::hash( string( "other" ) ) ), db->get_chain_id() );
+         receiver.app.p2p_node()->broadcast( graphene::net::trx_message( copy ) );
+         const auto before = counters();
+         relay_block();
+         check_counters( before, 0, 1, 0, 1 );
+      }
+
+      BOOST_CHECK_EQUAL( receiver.app.p2p_node()->get_connection_count(), 1u );
+   } catch( fc::exception& e ) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+/////////////
+/// @brief frames of the framed transport read back as written, changed or replayed frames are rejected
+/////////////
+BOOST_AUTO_TEST_CASE( framed_transport_codec )
+{
+   using graphene::net::stcp_socket;
+   try {
+      fc::tcp_server server;
+      server.listen( 0 );
+      stcp_socket accepted;
+      stcp_socket connecting;
+      auto accepting = fc::async( [&] () {
+         server.accept( accepted.get_socket() );
+         accepted.accept();
+      }, "framed_transport_codec accept" );
+      connecting.connect_to( fc::ip::endpoint( fc::ip::address( "127.0.0.1" ), server.get_port() ) );
+      accepting.wait();
+
+      connecting.start_sending_frames();
+      accepted.start_receiving_frames();
+      BOOST_CHECK( connecting.is_sending_frames() );
+      BOOST_CHECK( !connecting.is_receiving_frames() );
+      BOOST_CHECK( accepted.is_receiving_frames() );
+
+      const std::string head = "a message header";
+      std::vector<char> body( 1000 );
+      for( size_t i = 0; i < body.size(); ++i )
+         body[i] = char( i * 7 );
+      const size_t frame_size = sizeof(uint32_t) + head.size() + body.size() + 16;
+      char head_read[64];
+      std::vector<char> body_read;
+
+      BOOST_TEST_MESSAGE( "A frame reads back as written" );
+      BOOST_CHECK_EQUAL( connecting.write_frame( head.data(), head.size(), body.data(), body.size() ), frame_size );
+      BOOST_CHECK_EQUAL( accepted.read_frame( head_read, head.size(), body_read, head.size() + body.size() ),
+                         frame_size );
+      BOOST_CHECK_EQUAL( std::string( head_read, head.size() ), head );
+      BOOST_CHECK( body_read == body );
+
+      BOOST_TEST_MESSAGE( "An empty body reads back as well" );
+      connecting.write_frame( head.data(), head.size(), nullptr, 0 );
+      accepted.read_frame( head_read, head.size(), body_read, head.size() + body.size() );
+      BOOST_CHECK_EQUAL( std::string( head_read, head.size() ), head );
+      BOOST_CHECK( body_read.empty() );
+
+      // frames are taken off the wire as they are, then written again in place of the original
+      auto capture_frame = [&] () {
+         connecting.write_frame( head.data(), head.size(), body.data(), body.size() );
+         std::vector<char> wire( frame_size );
+         accepted.get_socket().read( wire.data(), wire.size() );
+         return wire;
+      };
+
+      BOOST_TEST_MESSAGE( "A frame passed on unchanged is accepted" );
+      const std::vector<char> original = capture_frame();
+      connecting.get_socket().write( original.data(), original.size() );
+      accepted.read_frame( head_read, head.size(), body_read, head.size() + body.size() );
+      BOOST_CHECK( body_read == body );
+
+      BOOST_TEST_MESSAGE( "A frame with a bit flipped in its body is rejected" );
+      std::vector<char> tampered = capture_frame();
+      tampered[ sizeof(uint32_t) + head.size() + 10 ] ^= 1;
+      connecting.get_socket().write( tampered.data(), tampered.size() );
+      BOOST_CHECK_THROW( accepted.read_frame( head_read, head.size(), body_read, head.size() + body.size() ),
+                         fc::exception );
+
+      BOOST_TEST_MESSAGE( "A frame sent again is rejected, it was sealed for an earlier position" );
+      capture_frame();
+      connecting.get_socket().write( original.data(), original.size() );
+      BOOST_CHECK_THROW( accepted.read_frame( head_read, head.size(), body_read, head.size() + body.size() ),
+                         fc::exception );
+
+      BOOST_TEST_MESSAGE( "A frame longer than the reader allows is rejected before it is read" );
+      connecting.write_frame( head.data(), head.size(), body.data(), body.size() );
+      BOOST_CHECK_THROW( accepted.read_frame( head_read, head.size(), body_read, head.size() + body.size() - 1 ),
+                         fc::exception );
+
+      connecting.close();
+      accepted.close();
+   } catch( fc::exception& e ) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+/////////////
+/// @brief nodes switch to the framed transport only when both have it enabled, and stay connected either way
+/////////////
+BOOST_AUTO_TEST_CASE( framed_transport_negotiation )
+{
+   try {
+      fc::temp_directory genesis_dir( graphene::utilities::temp_directory_path() );
+      const auto genesis_file = create_genesis_file( genesis_dir );
+
+      struct negotiation
+      {
+         bool connecting_enabled;
+         bool accepting_enabled;
+      };
+      // a node that has the framed transport disabled does not advertise it, as a node predating it
+      for( const negotiation& n : { negotiation{ true, true }, negotiation{ true, false },
+                                    negotiation{ false, true }, negotiation{ false, false } } )
+      {
+         BOOST_TEST_MESSAGE( "Connecting a node with the framed transport "
+                             << ( n.connecting_enabled ? "enabled" : "disabled" ) << " to a node with it "
+                             << ( n.accepting_enabled ? "enabled" : "disabled" ) );
+         test_network_node accepting( genesis_file, fc::mutable_variant_object( "framed_transport",
+                                                                                n.accepting_enabled ) );
+         test_network_node connecting( genesis_file, fc::mutable_variant_object( "framed_transport",
+                                                                                 n.connecting_enabled ) );
+         BOOST_CHECK_EQUAL( accepting.app.p2p_node()->get_advanced_node_parameters()["framed_transport"].as_bool(),
+                            n.accepting_enabled );
+         connecting.connect_to( accepting );
+
+         // the handshake and sync messages after the upgrade went through, so both directions work
+         fc::wait_for( fc::seconds(15), [&] () {
+            return accepting.has_settled_connections( 1 ) && connecting.has_settled_connections( 1 );
+         });
+         const bool expected = n.connecting_enabled && n.accepting_enabled;
+         BOOST_CHECK_EQUAL( accepting.app.p2p_node()->get_connected_peers().front().info["framed_transport"].as_bool(),
+                            expected );
+         BOOST_CHECK_EQUAL( connecting.app.p2p_node()->get_connected_peers().front().info["framed_transport"].as_bool(),
+                            expected );
+      }
+   } catch( fc::exception& e ) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+/////////////
+/// @brief a fresh node syncs from two seed nodes, requests the slow seed is late with go to the other one,
+/// and the copies the slow seed sends afterwards are dropped without disconnecting it
+/////////////
+BOOST_AUTO_TEST_CASE( sync_from_several_peers )
+{
+   using namespace graphene::chain;
+   try {
+      // the chain starts an hour ago, so the seed has all the blocks up to now to produce right away
+      fc::temp_directory genesis_dir( graphene::utilities::temp_directory_path() );
+      const auto genesis_file = create_genesis_file( genesis_dir );
+      auto genesis = fc::json::from_file( genesis_file ).as<genesis_state_type>( GRAPHENE_MAX_NESTED_OBJECTS );
+      genesis.initial_timestamp = fc::time_point_sec( genesis.initial_timestamp.sec_since_epoch() - 3600 );
+      fc::json::save_to_file( genesis, genesis_file );
+
+      const uint32_t block_count = 60;
+      test_network_node fast_seed( genesis_file );
+      {
+         std::shared_ptr<database> db = fast_seed.app.chain_database();
+         const fc::ecc::private_key committee_key = fc::ecc::private_key::regenerate(
+               fc::sha256::hash( string( "rsquaredchp1" ) ) );
+         for( uint32_t i = 0; i < block_count; ++i )
+            db->generate_block( db->get_slot_time(1), db->get_scheduled_witness(1), committee_key,
+                                database::skip_nothing );
+         BOOST_REQUIRE_EQUAL( db->head_block_num(), block_count );
+      }
+
+      test_network_node slow_seed( genesis_file );
+      slow_seed.connect_to( fast_seed );
+      fc::wait_for( fc::seconds(30), [&slow_seed, block_count] () {
+         return slow_seed.app.chain_database()->head_block_num() == block_count;
+      });
+      BOOST_REQUIRE_EQUAL( slow_seed.app.chain_database()->head_block_num(), block_count );
+      // a window of ten blocks takes the slow seed longer to send than it may keep a request waiting
+      slow_seed.app.p2p_node()->set_total_bandwidth_limit( 200, 0 );
+
+      // small windows spread the requests over both seeds
+      BOOST_TEST_MESSAGE( "Syncing a fresh node from both seeds" );
+      test_network_node fresh( genesis_file, fc::mutable_variant_object( "max_sync_blocks_per_peer", 10 ) );
+      fresh.connect_to( fast_seed );
+      fresh.connect_to( slow_seed );
+      const auto sync_details = [&fresh] ( const std::string& name ) {
+         uint64_t total = 0;
+         for( const auto& peer : fresh.app.p2p_node()->get_connected_peers() )
+         {
+            auto itr = peer.info.find( name );
+            if( itr != peer.info.end() )
+               total += itr->value().as<uint64_t>( 1 );
+         }
+         return total;
+      };
+      fc::wait_for( fc::seconds(120), [&] () {
+         return fresh.app.chain_database()->head_block_num() == block_count
+                && sync_details( "sync_duplicates_dropped" ) > 0;
+      });
+
+      BOOST_CHECK_EQUAL( fresh.app.chain_database()->head_block_num(), block_count );
+      BOOST_CHECK_EQUAL( fresh.app.chain_database()->head_block_id().str(),
+                         fast_seed.app.chain_database()->head_block_id().str() );
+      BOOST_CHECK_EQUAL( fresh.app.p2p_node()->get_connection_count(), 2u );
+      BOOST_CHECK_GT( sync_details( "sync_requests_reassigned" ), 0u );
+      BOOST_CHECK_GT( sync_details( "sync_duplicates_dropped" ), 0u );
+      // every block came from one of the seeds, the duplicates on top of that
+      BOOST_CHECK_EQUAL( sync_details( "sync_blocks_received" ),
+                         block_count + sync_details( "sync_duplicates_dropped" ) );
+   } catch( fc::exception& e ) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+/////////////
+/// @brief the message cache drops its oldest messages to stay within its byte budget
+/////////////
+BOOST_AUTO_TEST_CASE( message_cache_byte_budget )
+{
+   try {
+      fc::temp_directory genesis_dir( graphene::utilities::temp_directory_path() );
+      test_network_node node( create_genesis_file( genesis_dir ) );
+      auto p2p = node.app.p2p_node();
+
+      // transactions that only differ in their expiration, so their messages are all of the same size
+      std::vector<graphene::protocol::signed_transaction> trxs( 3 );
+      for( uint32_t i = 0; i < trxs.size(); ++i )
+         trxs[i].set_expiration( fc::time_point_sec( i + 1 ) );
+      const size_t message_bytes = sizeof( graphene::net::message_header )
+            + graphene::net::message( graphene::net::trx_message( trxs[0] ) ).data.size();
+      const auto cached = [&p2p] ( const graphene::protocol::signed_transaction& trx ) {
+         try {
+            p2p->get_transaction_propagation_data( trx.id() );
+            return true;
+         } catch( const fc::key_not_found_exception& ) {
+            return false;
+         }
+      };
+      const auto parameter = [&p2p] ( const std::string& name ) {
+         return p2p->get_advanced_node_parameters()[name].as<uint64_t>( 1 );
+      };
+
+      // the node has no peers, so it only caches what it broadcasts
+      BOOST_CHECK_EQUAL( parameter( "message_cache_size" ), 0u );
+      p2p->set_advanced_node_parameters( fc::mutable_variant_object( "message_cache_max_bytes", 2 * message_bytes ) );
+      BOOST_CHECK_EQUAL( parameter( "message_cache_max_bytes" ), 2 * message_bytes );
+      for( const auto& trx : trxs )
+         p2p->broadcast( graphene::net::trx_message( trx ) );
+      BOOST_CHECK_EQUAL( parameter( "message_cache_size" ), 2u );
+      BOOST_CHECK_EQUAL( parameter( "message_cache_bytes" ), 2 * message_bytes );
+      BOOST_CHECK( !cached( trxs[0] ) );
+      BOOST_CHECK( cached( trxs[1] ) );
+      BOOST_CHECK( cached( trxs[2] ) );
+
+      BOOST_TEST_MESSAGE( "Shrinking the cache" );
+      p2p->set_advanced_node_parameters( fc::mutable_variant_object( "message_cache_max_bytes", message_bytes ) );
+      BOOST_CHECK_EQUAL( parameter( "message_cache_size" ), 1u );
+      BOOST_CHECK_EQUAL( parameter( "message_cache_bytes" ), message_bytes );
+      BOOST_CHECK( !cached( trxs[1] ) );
+      BOOST_CHECK( cached( trxs[2] ) );
+
+      p2p->set_advanced_node_parameters( fc::mutable_variant_object( "message_cache_max_bytes", 0 ) );
+      BOOST_CHECK_EQUAL( parameter( "message_cache_size" ), 0u );
+      BOOST_CHECK_EQUAL( parameter( "message_cache_bytes" ), 0u );
+
+      // a message over the budget on its own is still kept until the next one comes
+      p2p->broadcast( graphene::net::trx_message( trxs[0] ) );
+      BOOST_CHECK_EQUAL( parameter( "message_cache_size" ), 1u );
+      BOOST_CHECK( cached( trxs[0] ) );
+      p2p->broadcast( graphene::net::trx_message( trxs[1] ) );
+      BOOST_CHECK_EQUAL( parameter( "message_cache_size" ), 1u );
+      BOOST_CHECK( !cached( trxs[0] ) );
+      BOOST_CHECK( cached( trxs[1] ) );
+   } catch( fc::exception& e ) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+/////////////
+/// @brief a block a peer fetches is served from the message cache, by message id and then by block id
+/////////////
+BOOST_AUTO_TEST_CASE( message_cache_serves_blocks )
+{
+   using namespace graphene::chain;
+   try {
+      fc::temp_directory genesis_dir( graphene::utilities::temp_directory_path() );
+      const auto genesis_file = create_genesis_file( genesis_dir );
+      test_network_node producer( genesis_file );
+      test_network_node receiver( genesis_file );
+      receiver.connect_to( producer );
+      fc::wait_for( fc::seconds(15), [&] () {
+         return producer.has_settled_connections( 1 ) && receiver.has_settled_connections( 1 );
+      });
+      BOOST_REQUIRE_EQUAL( producer.app.p2p_node()->get_connection_count(), 1u );
+
+      std::shared_ptr<database> db = producer.app.chain_database();
+      // the receiver rejects blocks from the future
+      fc::wait_for( fc::seconds(15), [db] () {
+         return db->get_slot_time(1) <= fc::time_point::now();
+      });
+      const fc::ecc::private_key committee_key = fc::ecc::private_key::regenerate(
+            fc::sha256::hash( string( "rsquaredchp1" ) ) );
+      const signed_block block = db->generate_block( db->get_slot_time(1), db->get_scheduled_witness(1),
+                                                     committee_key, database::skip_nothing );
+
+      const auto parameters_before = producer.app.p2p_node()->get_advanced_node_parameters();
+      producer.app.p2p_node()->broadcast( graphene::net::block_message( block ) );
+      fc::wait_for( fc::seconds(15), [&receiver] () {
+         return receiver.app.chain_database()->head_block_num() == 1;
+      });
+      BOOST_REQUIRE_EQUAL( receiver.app.chain_database()->head_block_num(), 1u );
+
+      // the fetch request names the message id, the send queue then packs the block by its id
+      const auto parameters_after = producer.app.p2p_node()->get_advanced_node_parameters();
+      BOOST_CHECK_EQUAL( parameters_after["message_cache_hits"].as<uint64_t>(1),
+                         parameters_before["message_cache_hits"].as<uint64_t>(1) + 2 );
+      BOOST_CHECK_EQUAL( parameters_after["message_cache_misses"].as<uint64_t>(1),
+                         parameters_before["message_cache_misses"].as<uint64_t>(1) );
+   } catch( fc::exception& e ) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 // a contrived example to test the breaking out of application_impl to a header file
 BOOST_AUTO_TEST_CASE(application_impl_breakout) {
 
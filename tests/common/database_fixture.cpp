@@ -366,6 +366,7 @@ std::shared_ptr<boost::program_options::variables_map> database_fixture_base::in
    }
 
    if( fixture.current_test_name == "asset_in_collateral"
+            || fixture.current_test_name == "asset_holders_index"
             || fixture.current_test_name == "htlc_database_api"
             || fixture.current_suite_name == "database_api_tests"
             || fixture.current_suite_name == "api_limit_tests"
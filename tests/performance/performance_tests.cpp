@@ -30,18 +30,211 @@
 
 #include <graphene/chain/account_object.hpp>
 #include <graphene/chain/asset_object.hpp>
+#include <graphene/chain/market_object.hpp>
+#include <graphene/chain/operation_history_object.hpp>
 #include <graphene/chain/proposal_object.hpp>
 
 #include <graphene/db/simple_index.hpp>
 
+#include <graphene/net/config.hpp>
+#include <graphene/net/core_messages.hpp>
+#include <graphene/net/message_oriented_connection.hpp>
+
 #include <fc/crypto/digest.hpp>
+#include <fc/network/tcp_socket.hpp>
+#include <fc/thread/thread.hpp>
 
 #include "../common/database_fixture.hpp"
 #include <cstdlib>
+#include <deque>
 #include <iostream>
+#include <unordered_set>
 
 using namespace graphene::chain;
 
+namespace {
+
+/// Undo bookkeeping as done before undo_database kept per-session logs in arenas, for comparison only
+class hash_map_undo_tracker
+{
+   public:
+      struct state
+      {
+         std::unordered_map<object_id_type, std::unique_ptr<object> > old_values;
+         std::unordered_map<object_id_type, object_id_type>          old_index_next_ids;
+         std::unordered_set<object_id_type>                          new_ids;
+      };
+
+      void start_session()
+      {
+         while( _stack.size() > 256 )
+            _stack.pop_front();
+         _stack.emplace_back();
+      }
+      void on_create( const object& obj )
+      {
+         auto& s = _stack.back();
+         auto index_id = object_id_type( obj.id.space(), obj.id.type(), 0 );
+         if( s.old_index_next_ids.find( index_id ) == s.old_index_next_ids.end() )
+            s.old_index_next_ids[index_id] = obj.id;
+         s.new_ids.insert( obj.id );
+      }
+      void on_modify( const object& obj )
+      {
+         auto& s = _stack.back();
+         if( s.new_ids.find( obj.id ) != s.new_ids.end() || s.old_values.find( obj.id ) != s.old_values.end() )
+            return;
+         s.old_values[obj.id] = obj.clone();
+      }
+      void merge()
+      {
+         auto& s = _stack.back();
+         auto& prev = _stack[_stack.size()-2];
+         for( auto& item : s.old_values )
+            if( prev.new_ids.find( item.first ) == prev.new_ids.end()
+                && prev.old_values.find( item.first ) == prev.old_values.end() )
+               prev.old_values[item.first] = std::move( item.second );
+         for( auto id : s.new_ids )
+            prev.new_ids.insert( id );
+         for( auto& item : s.old_index_next_ids )
+            if( prev.old_index_next_ids.find( item.first ) == prev.old_index_next_ids.end() )
+               prev.old_index_next_ids[item.first] = item.second;
+         _stack.pop_back();
+      }
+
+   private:
+      std::deque<state> _stack;
+};
+
+/// Times creating, looking up and removing objects in a stand-alone instance of Index
+template<typename Index>
+void benchmark_index( graphene::db::object_database& db, const std::string& name,
+                      const std::function<void(typename Index::object_type&, uint32_t)>& init )
+{
+   typedef typename Index::object_type object_type;
+   const uint32_t objects = 200000;
+   const uint32_t lookups = 2000000;
+
+   graphene::db::primary_index< Index > idx( db );
+   auto start = fc::time_point::now();
+   for( uint32_t i = 0; i < objects; ++i )
+      idx.create( [&init,i]( object& o ) { init( static_cast<object_type&>( o ), i ); } );
+   auto insert_time = fc::time_point::now() - start;
+
+   uint32_t seed = 1;
+   uint32_t found = 0;
+   start = fc::time_point::now();
+   for( uint32_t i = 0; i < lookups; ++i )
+   {
+      seed = seed * 1103515245 + 12345;
+      if( idx.find( object_id_type( object_type::space_id, object_type::type_id, ( seed >> 8 ) % objects ) ) )
+         ++found;
+   }
+   auto lookup_time = fc::time_point::now() - start;
+   BOOST_CHECK_EQUAL( found, lookups );
+
+   // remove every other object, leaving gaps behind like filled orders do
+   start = fc::time_point::now();
+   for( uint32_t i = 0; i < objects; i += 2 )
+      idx.remove( *idx.find( object_id_type( object_type::space_id, object_type::type_id, i ) ) );
+   auto remove_time = fc::time_point::now() - start;
+
+   wlog( "${name}: ${ins} inserts/s, ${look} lookups/s, ${rem} removes/s",
+         ("name",name)
+         ("ins",(uint64_t(objects)*1000000)/insert_time.count())
+         ("look",(uint64_t(lookups)*1000000)/lookup_time.count())
+         ("rem",(uint64_t(objects/2)*1000000)/remove_time.count()) );
+}
+
+/// Counts what arrives on the connections of the loopback benchmark
+class counting_connection_delegate : public graphene::net::message_oriented_connection_delegate
+{
+   public:
+      void on_message( graphene::net::message_oriented_connection*, const graphene::net::message& m )override
+      {
+         if( m.msg_type.value() == graphene::net::core_message_type_enum::transport_upgrade_message_type )
+            return;
+         ++messages;
+         bytes += m.data.size();
+      }
+      void on_connection_closed( graphene::net::message_oriented_connection* )override {}
+
+      uint64_t messages = 0;
+      uint64_t bytes = 0;
+};
+
+/// Connects @p peers pairs of connections over loopback and sends @p messages_per_peer messages of @p message_size
+/// bytes over each, with the I/O of the connections spread over @p io_threads threads, or on this thread if it is 0.
+/// If @p framed, the connections are upgraded to the framed transport before sending.
+fc::microseconds run_loopback_peers( uint32_t peers, uint32_t messages_per_peer, uint32_t message_size,
+                                     uint32_t io_threads, bool framed = false )
+{
+   using graphene::net::message_oriented_connection;
+   std::vector< std::shared_ptr<fc::thread> > threads;
+   for( uint32_t i = 0; i < io_threads; ++i )
+      threads.push_back( std::make_shared<fc::thread>( "loopback io " + std::to_string( i ) ) );
+   auto io_thread = [&threads]( uint32_t i ) -> fc::thread* {
+      return threads.empty() ? nullptr : threads[ i % threads.size() ].get();
+   };
+
+   counting_connection_delegate receiver;
+   counting_connection_delegate sender;
+   std::vector< std::unique_ptr<message_oriented_connection> > incoming;
+   std::vector< std::unique_ptr<message_oriented_connection> > outgoing;
+
+   fc::tcp_server server;
+   server.listen( 0 );
+   const fc::ip::endpoint endpoint( fc::ip::address( "127.0.0.1" ), server.get_port() );
+   auto accepting = fc::async( [&]() {
+      for( uint32_t i = 0; i < peers; ++i )
+      {
+         incoming.emplace_back( new message_oriented_connection( &receiver, io_thread( i ) ) );
+         server.accept( incoming.back()->get_socket() );
+         incoming.back()->accept();
+      }
+   }, "loopback accept" );
+   for( uint32_t i = 0; i < peers; ++i )
+   {
+      outgoing.emplace_back( new message_oriented_connection( &sender, io_thread( i ) ) );
+      outgoing.back()->connect_to( endpoint );
+   }
+   accepting.wait();
+   if( framed )
+      for( auto& connection : outgoing )
+         connection->send_message( graphene::net::message( graphene::net::transport_upgrade_message(
+                                      GRAPHENE_NET_FRAMED_TRANSPORT_VERSION ) ) );
+
+   graphene::net::message msg;
+   msg.msg_type = 1000;
+   msg.data.resize( message_size, 'x' );
+   msg.size = message_size;
+
+   // one sending task per peer, as the node has
+   const auto start = fc::time_point::now();
+   std::vector< fc::future<void> > sending;
+   for( auto& connection : outgoing )
+   {
+      message_oriented_connection* c = connection.get();
+      sending.push_back( fc::async( [c,&msg,messages_per_peer]() {
+         for( uint32_t i = 0; i < messages_per_peer; ++i )
+            c->send_message( msg );
+      }, "loopback send" ) );
+   }
+   const uint64_t expected = uint64_t( peers ) * messages_per_peer;
+   while( receiver.messages < expected )
+      fc::usleep( fc::milliseconds( 1 ) );
+   const auto elapsed = fc::time_point::now() - start;
+   for( auto& f : sending )
+      f.wait();
+   BOOST_CHECK_EQUAL( receiver.bytes, expected * message_size );
+
+   outgoing.clear();
+   incoming.clear();
+   return elapsed;
+}
+
+} // anonymous namespace
+
 BOOST_FIXTURE_TEST_SUITE( performance_tests, database_fixture )
 
 BOOST_AUTO_TEST_CASE( sigcheck_benchmark )
@@ -210,4 +403,143 @@ BOOST_AUTO_TEST_CASE( one_hundred_k_benchmark )
    db._undo_db.enable();
 } FC_LOG_AND_RETHROW() }
 
+BOOST_AUTO_TEST_CASE( undo_session_benchmark )
+{ try {
+   const uint32_t blocks = 2000;
+   const uint32_t trxs_per_block = 100;
+   const uint32_t objects = 10000;
+
+   // Stand-alone objects are enough to drive the bookkeeping, nothing is undone against the database here
+   std::vector<account_object> accounts( objects );
+   for( uint32_t i = 0; i < objects; ++i )
+   {
+      accounts[i].id = account_id_type( i );
+      accounts[i].name = "account" + std::to_string( i );
+   }
+   std::vector<account_object> created( trxs_per_block );
+
+   // every transaction modifies two existing objects and creates one
+   auto run = [&]( auto&& start_session, auto&& on_create, auto&& on_modify, auto&& merge, auto&& end_block ) {
+      uint64_t next_id = objects;
+      uint32_t seed = 1;
+      auto start = fc::time_point::now();
+      for( uint32_t b = 0; b < blocks; ++b )
+      {
+         start_session();
+         for( uint32_t t = 0; t < trxs_per_block; ++t )
+         {
+            start_session();
+            seed = seed * 1103515245 + 12345;
+            on_modify( accounts[ seed % objects ] );
+            on_modify( accounts[ ( seed >> 16 ) % objects ] );
+            created[t].id = account_id_type( next_id++ );
+            on_create( created[t] );
+            merge();
+         }
+         end_block();
+      }
+      return fc::time_point::now() - start;
+   };
+
+   hash_map_undo_tracker reference;
+   auto reference_time = run( [&]{ reference.start_session(); },
+                              [&]( const object& o ){ reference.on_create( o ); },
+                              [&]( const object& o ){ reference.on_modify( o ); },
+                              [&]{ reference.merge(); },
+                              []{} );
+
+   graphene::db::undo_database undo( db );
+   undo.enable();
+   std::vector<graphene::db::undo_database::session> sessions;
+   auto log_time = run( [&]{ sessions.emplace_back( undo.start_undo_session() ); },
+                        [&]( const object& o ){ undo.on_create( o ); },
+                        [&]( const object& o ){ undo.on_modify( o ); },
+                        [&]{ sessions.back().merge(); sessions.pop_back(); },
+                        [&]{ undo.head(); sessions.back().commit(); sessions.pop_back(); } );
+   undo.disable();
+
+   const uint64_t total = uint64_t(blocks) * trxs_per_block;
+   wlog( "hash map undo states: ${tps} transaction sessions/s over ${ms}ms",
+         ("tps",(total*1000000)/reference_time.count())("ms",reference_time.count()/1000) );
+   wlog( "session logs: ${tps} transaction sessions/s over ${ms}ms, ${kb}KiB in arenas",
+         ("tps",(total*1000000)/log_time.count())("ms",log_time.count()/1000)("kb",undo.arena_bytes()/1024) );
+
+   // undo real sessions against the database
+   std::vector<const account_object*> existing;
+   for( const auto& a : db.get_index_type<account_index>().indices() )
+      existing.push_back( &a );
+   const uint32_t cycles = 100000;
+   auto start = fc::time_point::now();
+   for( uint32_t i = 0; i < cycles; ++i )
+   {
+      auto session = db._undo_db.start_undo_session();
+      db.modify( *existing[ i % existing.size() ], []( account_object& a ) { a.referrer_rewards_percentage++; } );
+      db.create<account_balance_object>( []( account_balance_object& b ) { b.balance = 1; } );
+   }
+   auto elapsed = fc::time_point::now() - start;
+   wlog( "${sps} sessions/s modified, created and undone over ${ms}ms",
+         ("sps",(uint64_t(cycles)*1000000)/elapsed.count())("ms",elapsed.count()/1000) );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( index_lookup_benchmark )
+{ try {
+   db._undo_db.disable();
+
+   auto init_order = []( limit_order_object& o, uint32_t i ) {
+      o.seller = account_id_type( i % 1000 );
+      o.sell_price = price( asset( 1000 + i % 977 ), asset( 1000, asset_id_type(1) ) );
+   };
+   benchmark_index< graphene::db::generic_index<limit_order_object, limit_order_multi_index_type> >(
+         db, "limit orders, ordered by id", init_order );
+   benchmark_index< limit_order_index >( db, "limit orders, chunked", init_order );
+
+   auto init_proposal = []( proposal_object& o, uint32_t i ) {
+      o.expiration_time = fc::time_point_sec( 1000000 + i % 3600 );
+   };
+   benchmark_index< graphene::db::generic_index<proposal_object, proposal_multi_index_container> >(
+         db, "proposals, ordered by id", init_proposal );
+   benchmark_index< proposal_index >( db, "proposals, chunked", init_proposal );
+
+   auto init_history = []( operation_history_object& o, uint32_t i ) {
+      o.block_num = i / 100;
+   };
+   benchmark_index< graphene::db::generic_index<operation_history_object, operation_history_multi_index_type> >(
+         db, "operation history, ordered by id", init_history );
+   benchmark_index< operation_history_index >( db, "operation history, chunked", init_history );
+
+   db._undo_db.enable();
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( p2p_loopback_benchmark )
+{ try {
+   const uint32_t peers = 100;
+   const uint32_t messages_per_peer = 200;
+   const uint32_t message_size = 16 * 1024;
+   for( uint32_t io_threads : { 0u, 2u, 4u } )
+   {
+      const auto elapsed = run_loopback_peers( peers, messages_per_peer, message_size, io_threads );
+      const uint64_t messages = uint64_t( peers ) * messages_per_peer;
+      wlog( "${p} peers, ${t} I/O threads: ${mps} messages/s, ${mbs} MiB/s",
+            ("p",peers)("t",io_threads)
+            ("mps",(messages*1000000)/elapsed.count())
+            ("mbs",(messages*message_size*1000000)/elapsed.count()/(1024*1024)) );
+   }
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( p2p_transport_benchmark )
+{ try {
+   const uint32_t peers = 8;
+   const uint32_t messages_per_peer = 200;
+   for( uint32_t message_size : { 1024u, 256u * 1024 } )
+      for( bool framed : { false, true } )
+      {
+         const auto elapsed = run_loopback_peers( peers, messages_per_peer, message_size, 0, framed );
+         const uint64_t messages = uint64_t( peers ) * messages_per_peer;
+         wlog( "${kind} transport, ${s} byte messages: ${mps} messages/s, ${mbs} MiB/s",
+               ("kind",framed ? "framed" : "stream")("s",message_size)
+               ("mps",(messages*1000000)/elapsed.count())
+               ("mbs",(messages*message_size*1000000)/elapsed.count()/(1024*1024)) );
+      }
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_SUITE_END()
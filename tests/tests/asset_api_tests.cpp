@@ -85,4 +85,52 @@ BOOST_AUTO_TEST_CASE( api_limit_get_asset_holders )
    BOOST_REQUIRE_EQUAL( holders.size(), 4u );
 }
 
+BOOST_AUTO_TEST_CASE( asset_holders_index )
+{ try {
+   graphene::app::asset_api asset_api(app);
+   BOOST_REQUIRE( app.get_options().has_api_helper_indexes_plugin );
+
+   auto dan = create_account("dan");
+   auto bob = create_account("bob");
+   auto alice = create_account("alice");
+   auto carol = create_account("carol");
+
+   transfer(account_id_type()(db), dan, asset(100));
+   transfer(account_id_type()(db), alice, asset(200));
+   transfer(account_id_type()(db), bob, asset(300));
+   transfer(account_id_type()(db), carol, asset(200));
+   // a zero balance is counted as a balance, but not listed as a holder
+   transfer(dan, bob, asset(100));
+   generate_block();
+
+   const string core = std::string( static_cast<object_id_type>(asset_id_type()) );
+   const auto& bal_idx = db.get_index_type< account_balance_index >().indices().get< by_asset_balance >();
+   auto range = bal_idx.equal_range( boost::make_tuple( asset_id_type() ) );
+   vector<account_id_type> expected;
+   for( const account_balance_object& bal : boost::make_iterator_range( range.first, range.second ) )
+      if( bal.balance != 0 )
+         expected.push_back( bal.owner );
+   BOOST_CHECK_EQUAL( asset_api.get_asset_holders_count( core ), int( boost::distance( range ) ) - 1 );
+
+   for( uint32_t start = 0; start <= expected.size(); ++start )
+   {
+      vector<account_asset_balance> holders = asset_api.get_asset_holders( core, start, 2 );
+      BOOST_REQUIRE_EQUAL( holders.size(), std::min<size_t>( 2, expected.size() - start ) );
+      for( size_t i = 0; i < holders.size(); ++i )
+         BOOST_CHECK( holders[i].account_id == expected[start + i] );
+   }
+   BOOST_CHECK( asset_api.get_asset_holders( core, expected.size() + 10, 2 ).empty() );
+
+   // the order follows balance changes
+   transfer(alice, dan, asset(150));
+   vector<account_asset_balance> holders = asset_api.get_asset_holders( core, 0, 100 );
+   BOOST_REQUIRE_EQUAL( holders.size(), expected.size() + 1 );
+   for( size_t i = 1; i < holders.size(); ++i )
+      BOOST_CHECK( holders[i-1].amount >= holders[i].amount );
+   auto alice_holder = std::find_if( holders.begin(), holders.end(),
+                                     []( const account_asset_balance& h ) { return h.name == "alice"; } );
+   BOOST_REQUIRE( alice_holder != holders.end() );
+   BOOST_CHECK_EQUAL( alice_holder->amount.value, 50 );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_SUITE_END()
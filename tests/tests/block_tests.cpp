@@ -34,6 +34,8 @@
 #include <graphene/chain/committee_member_object.hpp>
 #include <graphene/chain/proposal_object.hpp>
 #include <graphene/chain/market_object.hpp>
+#include <graphene/chain/transaction_history_object.hpp>
+#include <graphene/chain/transaction_prevalidator.hpp>
 #include <graphene/chain/hardfork.hpp>
 #include <graphene/chain/witness_schedule_object.hpp>
 #include <graphene/chain/witness_object.hpp>
@@ -43,6 +45,9 @@
 #include <fc/crypto/digest.hpp>
 #include <fc/io/fstream.hpp>
 
+#include <atomic>
+#include <thread>
+
 #include "../common/database_fixture.hpp"
 
 using namespace graphene::chain;
@@ -135,6 +140,78 @@ BOOST_AUTO_TEST_CASE( block_database_test )
    }
 }
 
+BOOST_AUTO_TEST_CASE( block_database_remove_and_concurrent_read_test )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      block_database bdb;
+      bdb.open( data_dir.path() );
+
+      std::vector<block_id_type> ids;
+      clearable_block b;
+      for( uint32_t i = 0; i < 200; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         b.clear();
+         bdb.store( b.id(), b );
+         ids.push_back( b.id() );
+      }
+      BOOST_CHECK_GT( bdb.total_block_size(), 0u );
+
+      // several readers fetch the same blocks while the main thread keeps appending
+      std::vector<std::thread> readers;
+      std::atomic<uint32_t> failures(0);
+      for( int t = 0; t < 4; ++t )
+         readers.emplace_back( [&bdb,&ids,&failures]() {
+            for( uint32_t i = 0; i < ids.size(); ++i )
+            {
+               auto blk = bdb.fetch_by_number( i+1 );
+               if( !blk.valid() || blk->witness != witness_id_type(i+1) || !bdb.contains( ids[i] ) )
+                  ++failures;
+            }
+         });
+      for( uint32_t i = 200; i < 300; ++i )
+      {
+         b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         b.clear();
+         bdb.store( b.id(), b );
+      }
+      for( auto& t : readers )
+         t.join();
+      BOOST_CHECK_EQUAL( failures.load(), 0u );
+
+      // removed blocks are skipped by last() and fetch_optional()
+      const block_id_type last_id = b.id();
+      bdb.remove( last_id );
+      BOOST_CHECK( !bdb.contains( last_id ) );
+      BOOST_CHECK( !bdb.fetch_optional( last_id ).valid() );
+      BOOST_REQUIRE( bdb.last_id().valid() );
+      BOOST_CHECK_EQUAL( block_header::num_from_id( *bdb.last_id() ), 299u );
+
+      // a block from another fork replaces the index entry
+      clearable_block fork_block;
+      fork_block.previous = *bdb.last_id();
+      fork_block.witness = witness_id_type(1000);
+      bdb.store( fork_block.id(), fork_block );
+      BOOST_CHECK( bdb.contains( fork_block.id() ) );
+      BOOST_CHECK( bdb.fetch_by_number( 300 )->witness == witness_id_type(1000) );
+
+      // the files are trimmed on close and survive a reopen
+      bdb.close();
+      bdb.open( data_dir.path() );
+      BOOST_REQUIRE( bdb.last_id().valid() );
+      BOOST_CHECK( *bdb.last_id() == fork_block.id() );
+      BOOST_CHECK( bdb.fetch_optional( ids[42] )->witness == witness_id_type(43) );
+      bdb.close();
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( generate_empty_blocks )
 {
    try {
@@ -194,6 +271,38 @@ BOOST_AUTO_TEST_CASE( generate_empty_blocks )
    }
 }
 
+BOOST_AUTO_TEST_CASE( replay_with_small_lookahead )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      block_id_type head_id;
+      uint32_t head_num;
+      {
+         database db;
+         db.open(data_dir.path(), make_genesis, "TEST" );
+         for( uint32_t i = 0; i < 50; ++i )
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         head_id = db.head_block_id();
+         head_num = db.head_block_num();
+         db.close();
+      }
+      {
+         // a look-ahead window smaller than one block still replays everything in order
+         database db;
+         db.wipe( data_dir.path(), false );
+         db.set_replay_lookahead( 1 );
+         db.open(data_dir.path(), make_genesis, "TEST" );
+         BOOST_CHECK_EQUAL( db.head_block_num(), head_num );
+         BOOST_CHECK( db.head_block_id() == head_id );
+         db.close();
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( undo_block )
 {
    try {
@@ -567,6 +676,195 @@ BOOST_AUTO_TEST_CASE( out_of_order_blocks )
 }
  */
 
+BOOST_AUTO_TEST_CASE( fork_db_byte_budget )
+{
+   try {
+      fork_database fdb;
+      vector<shared_ptr<const signed_block>> chain;
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         auto b = std::make_shared<signed_block>();
+         if( !chain.empty() )
+            b->previous = chain.back()->id();
+         b->timestamp = fc::time_point_sec( 1000 + i );
+         chain.push_back( b );
+         fdb.push_block( chain.back() );
+      }
+      BOOST_REQUIRE( fdb.head() );
+      BOOST_CHECK_EQUAL( fdb.head()->num, 10u );
+      // the block is referenced, not copied
+      BOOST_CHECK( fdb.fetch_block( chain[3]->id() )->data == chain[3] );
+
+      uint64_t chain_bytes = 0;
+      for( const auto& b : chain )
+         chain_bytes += fdb.fetch_block( b->id() )->byte_size;
+      BOOST_CHECK_EQUAL( fdb.total_bytes(), chain_bytes );
+
+      // a competing branch forking off block 5
+      vector<shared_ptr<const signed_block>> fork;
+      for( uint32_t i = 0; i < 3; ++i )
+      {
+         auto b = std::make_shared<signed_block>();
+         b->previous = fork.empty() ? chain[4]->id() : fork.back()->id();
+         b->timestamp = fc::time_point_sec( 2000 + i );
+         fork.push_back( b );
+         fdb.push_block( fork.back() );
+      }
+      BOOST_CHECK_EQUAL( fdb.size(), 13u );
+      BOOST_CHECK( fdb.head()->id == chain.back()->id() );
+      const uint64_t fork_bytes = fdb.total_bytes() - chain_bytes;
+
+      // the head block's branch does not count against the budget
+      fdb.set_max_bytes( fork_bytes );
+      BOOST_CHECK_EQUAL( fdb.size(), 13u );
+
+      // a budget too small for the whole branch drops it from its root, the head block's branch stays
+      fdb.set_max_bytes( fork_bytes - 1 );
+      BOOST_CHECK_EQUAL( fdb.size(), 10u );
+      BOOST_CHECK_EQUAL( fdb.total_bytes(), chain_bytes );
+      for( const auto& b : chain )
+         BOOST_CHECK( fdb.is_known_block( b->id() ) );
+      for( const auto& b : fork )
+         BOOST_CHECK( !fdb.is_known_block( b->id() ) );
+
+      signed_block orphan;
+      orphan.previous = fork.back()->id();
+      GRAPHENE_REQUIRE_THROW( fdb.push_block( orphan ), unlinkable_block_exception );
+
+      // even a budget of nothing keeps the head block's branch
+      fdb.set_max_bytes( 0 );
+      BOOST_CHECK_EQUAL( fdb.size(), 10u );
+
+      fdb.set_max_size( 3 );
+      BOOST_CHECK_EQUAL( fdb.size(), 4u );
+      uint64_t kept_bytes = 0;
+      for( uint32_t i = 6; i < 10; ++i )
+         kept_bytes += fdb.fetch_block( chain[i]->id() )->byte_size;
+      BOOST_CHECK_EQUAL( fdb.total_bytes(), kept_bytes );
+
+      fdb.reset();
+      BOOST_CHECK_EQUAL( fdb.total_bytes(), 0u );
+   } FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_CASE( fork_db_fork_with_head_branch_over_budget )
+{
+   try {
+      fork_database fdb;
+      auto make_block = []( const shared_ptr<const signed_block>& prev, uint32_t time ) {
+         auto b = std::make_shared<signed_block>();
+         if( prev )
+            b->previous = prev->id();
+         b->timestamp = fc::time_point_sec( time );
+         return shared_ptr<const signed_block>( b );
+      };
+      vector<shared_ptr<const signed_block>> chain;
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         chain.push_back( make_block( chain.empty() ? nullptr : chain.back(), 1000 + i ) );
+         fdb.push_block( chain.back() );
+      }
+      // empty blocks all have the same packed size
+      const uint64_t block_bytes = fdb.fetch_block( chain[0]->id() )->byte_size;
+
+      // the head block's branch alone is over the budget
+      fdb.set_max_bytes( 2 * block_bytes );
+      BOOST_CHECK_GT( fdb.total_bytes(), fdb.get_max_bytes() );
+      BOOST_CHECK_EQUAL( fdb.size(), 10u );
+
+      BOOST_TEST_MESSAGE( "A competing fork within the budget is kept right after it is pushed" );
+      const auto f1 = make_block( chain[7], 2000 );
+      const auto f2 = make_block( f1, 2001 );
+      fdb.push_block( f1 );
+      fdb.push_block( f2 );
+      BOOST_CHECK_EQUAL( fdb.size(), 12u );
+      BOOST_CHECK( fdb.is_known_block( f1->id() ) );
+      BOOST_CHECK( fdb.is_known_block( f2->id() ) );
+      BOOST_CHECK( fdb.head()->id == chain.back()->id() );
+
+      BOOST_TEST_MESSAGE( "The fork can become the head block's branch" );
+      const auto f3 = make_block( f2, 2002 );
+      fdb.push_block( f3 );
+      BOOST_CHECK( fdb.head()->id == f3->id() );
+      BOOST_CHECK_EQUAL( fdb.size(), 13u );
+      for( const auto& b : chain )
+         BOOST_CHECK( fdb.is_known_block( b->id() ) );
+
+      BOOST_TEST_MESSAGE( "Blocks off the head block's branch beyond the budget are dropped, oldest first" );
+      const auto late = make_block( chain.back(), 3000 );
+      fdb.push_block( late );
+      BOOST_CHECK( fdb.head()->id == f3->id() );
+      BOOST_CHECK( !fdb.is_known_block( chain[8]->id() ) );
+      BOOST_CHECK( !fdb.is_known_block( chain[9]->id() ) );
+      BOOST_CHECK( !fdb.is_known_block( late->id() ) );
+      BOOST_CHECK_EQUAL( fdb.size(), 11u );
+      BOOST_CHECK_EQUAL( fdb.total_bytes(), 11 * block_bytes );
+   } FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_CASE( fork_db_switch_with_old_branch_over_budget )
+{
+   try {
+      fork_database fdb;
+      // blocks with transactions on the branch the database is on, empty ones on the fork that overtakes it
+      auto make_block = []( const shared_ptr<const signed_block>& prev, uint32_t time, uint32_t transfers ) {
+         auto b = std::make_shared<signed_block>();
+         if( prev )
+            b->previous = prev->id();
+         b->timestamp = fc::time_point_sec( time );
+         if( transfers > 0 )
+         {
+            b->transactions.emplace_back();
+            for( uint32_t i = 0; i < transfers; ++i )
+               b->transactions.back().operations.emplace_back( transfer_operation() );
+         }
+         return shared_ptr<const signed_block>( b );
+      };
+      vector<shared_ptr<const signed_block>> chain;
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         chain.push_back( make_block( chain.empty() ? nullptr : chain.back(), 1000 + i, i < 5 ? 0 : 20 ) );
+         fdb.push_block( chain.back() );
+      }
+      const uint64_t empty_block_bytes = fdb.fetch_block( chain[0]->id() )->byte_size;
+      uint64_t old_branch_bytes = 0;
+      for( uint32_t i = 5; i < 10; ++i )
+         old_branch_bytes += fdb.fetch_block( chain[i]->id() )->byte_size;
+
+      // the fork fits the budget until it overtakes the old branch, which does not
+      fdb.set_max_bytes( 6 * empty_block_bytes );
+      BOOST_REQUIRE_GT( old_branch_bytes, fdb.get_max_bytes() );
+      vector<shared_ptr<const signed_block>> fork;
+      for( uint32_t i = 0; i < 5; ++i )
+      {
+         fork.push_back( make_block( fork.empty() ? chain[4] : fork.back(), 2000 + i, 0 ) );
+         fdb.push_block( fork.back() );
+      }
+      BOOST_CHECK( fdb.head()->id == chain.back()->id() );
+      BOOST_CHECK_EQUAL( fdb.size(), 15u );
+
+      BOOST_TEST_MESSAGE( "The old branch is kept while the database switches away from it" );
+      fork.push_back( make_block( fork.back(), 2005, 0 ) );
+      BOOST_CHECK( fdb.push_block( fork.back() )->id == fork.back()->id() );
+      for( const auto& b : chain )
+         BOOST_CHECK( fdb.is_known_block( b->id() ) );
+      const auto branches = fdb.fetch_branch_from( fork.back()->id(), chain.back()->id() );
+      BOOST_CHECK_EQUAL( branches.first.size(), 6u );
+      BOOST_CHECK_EQUAL( branches.second.size(), 5u );
+      BOOST_CHECK( branches.second.back()->previous_id() == chain[4]->id() );
+
+      BOOST_TEST_MESSAGE( "Once the database is on the new branch, the old one is over the budget" );
+      fork.push_back( make_block( fork.back(), 2006, 0 ) );
+      fdb.push_block( fork.back() );
+      BOOST_CHECK( fdb.head()->id == fork.back()->id() );
+      for( uint32_t i = 5; i < 10; ++i )
+         BOOST_CHECK( !fdb.is_known_block( chain[i]->id() ) );
+      for( const auto& b : fork )
+         BOOST_CHECK( fdb.is_known_block( b->id() ) );
+      BOOST_CHECK_EQUAL( fdb.size(), 12u );
+   } FC_LOG_AND_RETHROW()
+}
+
 BOOST_AUTO_TEST_CASE( undo_pending )
 {
    try {
@@ -742,6 +1040,166 @@ BOOST_AUTO_TEST_CASE( duplicate_transactions )
    }
 }
 
+BOOST_AUTO_TEST_CASE( restore_pending_after_block )
+{
+   try {
+      fc::temp_directory dir1( graphene::utilities::temp_directory_path() ),
+                         dir2( graphene::utilities::temp_directory_path() );
+      database db1,
+               db2;
+      db1.open(dir1.path(), make_genesis, "TEST");
+      db2.open(dir2.path(), make_genesis, "TEST");
+
+      auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      auto new_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("new_key")) );
+      const auto& by_name_idx = db1.get_index_type<account_index>().indices().get<by_name>();
+      const account_object& init1 = *by_name_idx.find("init1");
+      const account_object& init2 = *by_name_idx.find("init2");
+      const account_object& init3 = *by_name_idx.find("init3");
+
+      auto make_update = [&]( const account_object& acct, const fc::ecc::private_key& memo_key ) {
+         signed_transaction trx;
+         set_expiration( db1, trx );
+         account_update_operation op;
+         op.account = acct.id;
+         op.new_options = acct.options;
+         op.new_options->memo_key = memo_key.get_public_key();
+         trx.operations.push_back(op);
+         trx.sign( init_account_priv_key, db1.get_chain_id() );
+         return trx;
+      };
+
+      // pending on db1: one transaction per account, one of them about to expire
+      signed_transaction trx1 = make_update( init1, new_priv_key );
+      signed_transaction trx2 = make_update( init2, new_priv_key );
+      signed_transaction trx3 = make_update( init3, new_priv_key );
+      trx3.expiration = db1.head_block_time() + 1;
+      trx3.clear_signatures();
+      trx3.sign( init_account_priv_key, db1.get_chain_id() );
+      PUSH_TX( db1, trx1 );
+      PUSH_TX( db1, trx2 );
+      PUSH_TX( db1, trx3 );
+
+      // db2 produces a block which takes the keys of init1 away
+      {
+         signed_transaction trx;
+         set_expiration( db2, trx );
+         account_update_operation op;
+         op.account = init1.id;
+         op.owner = authority( 1, public_key_type( new_priv_key.get_public_key() ), 1 );
+         op.active = op.owner;
+         trx.operations.push_back(op);
+         trx.sign( init_account_priv_key, db2.get_chain_id() );
+         PUSH_TX( db2, trx );
+      }
+      auto b = db2.generate_block( db2.get_slot_time(1), db2.get_scheduled_witness(1), init_account_priv_key,
+                                   database::skip_nothing );
+      PUSH_BLOCK( db1, b );
+
+      // the block changed init1, so its transaction was verified again and rejected
+      BOOST_CHECK( !db1.is_known_transaction( trx1.id() ) );
+      // init2 was untouched, its transaction is still pending
+      BOOST_CHECK( db1.is_known_transaction( trx2.id() ) );
+      BOOST_CHECK( init2.options.memo_key == public_key_type( new_priv_key.get_public_key() ) );
+      // expired transactions are dropped
+      BOOST_CHECK( !db1.is_known_transaction( trx3.id() ) );
+
+      // the restored transaction is included in the next block as usual
+      b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness(1), init_account_priv_key,
+                              database::skip_nothing );
+      BOOST_REQUIRE_EQUAL( b.transactions.size(), 1u );
+      BOOST_CHECK( b.transactions[0].id() == trx2.id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( parallel_block_checks )
+{
+   try {
+      fc::temp_directory dir1( graphene::utilities::temp_directory_path() ),
+                         dir2( graphene::utilities::temp_directory_path() ),
+                         dir3( graphene::utilities::temp_directory_path() ),
+                         dir4( graphene::utilities::temp_directory_path() );
+      database producer,  // generates the blocks
+               serial,    // applies them with sequential authority checks
+               parallel,  // applies them with parallel authority checks
+               forger;    // generates a block with an invalid signature
+      producer.open(dir1.path(), make_genesis, "TEST");
+      serial.open(dir2.path(), make_genesis, "TEST");
+      parallel.open(dir3.path(), make_genesis, "TEST");
+      forger.open(dir4.path(), make_genesis, "TEST");
+      parallel.set_parallel_block_checks( true );
+
+      auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      auto new_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("new_key")) );
+      const auto& by_name_idx = producer.get_index_type<account_index>().indices().get<by_name>();
+
+      auto update_memo = [&]( database& db, const string& name, const fc::ecc::private_key& signer ) {
+         const account_object& acct = *by_name_idx.find( name );
+         signed_transaction trx;
+         set_expiration( db, trx );
+         account_update_operation op;
+         op.account = acct.id;
+         op.new_options = acct.options;
+         op.new_options->memo_key = signer.get_public_key();
+         trx.operations.push_back(op);
+         trx.sign( signer, db.get_chain_id() );
+         return trx;
+      };
+      auto update_keys = [&]( database& db, const string& name ) {
+         signed_transaction trx;
+         set_expiration( db, trx );
+         account_update_operation op;
+         op.account = by_name_idx.find( name )->id;
+         op.owner = authority( 1, public_key_type( new_priv_key.get_public_key() ), 1 );
+         op.active = op.owner;
+         trx.operations.push_back(op);
+         trx.sign( init_account_priv_key, db.get_chain_id() );
+         return trx;
+      };
+      auto produce = [&]( database& db, uint32_t skip ) {
+         return db.generate_block( db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, skip );
+      };
+      auto push_to_followers = [&]( const signed_block& b ) {
+         PUSH_BLOCK( serial, b );
+         PUSH_BLOCK( parallel, b );
+         PUSH_BLOCK( forger, b );
+      };
+
+      // independent transactions
+      for( int i = 0; i < 6; ++i )
+         PUSH_TX( producer, update_memo( producer, "init" + fc::to_string(i), init_account_priv_key ) );
+      push_to_followers( produce( producer, database::skip_nothing ) );
+
+      // a key change followed by a transaction signed with the new key, which fails the early check
+      PUSH_TX( producer, update_keys( producer, "init1" ) );
+      PUSH_TX( producer, update_memo( producer, "init1", new_priv_key ) );
+      PUSH_TX( producer, update_memo( producer, "init2", init_account_priv_key ) );
+
+      // a key change followed by a transaction signed with the old key, which passes the early check only
+      PUSH_TX( forger, update_keys( forger, "init3" ), database::skip_transaction_signatures );
+      PUSH_TX( forger, update_memo( forger, "init3", init_account_priv_key ), database::skip_transaction_signatures );
+      signed_block forged = produce( forger, database::skip_transaction_signatures );
+      BOOST_REQUIRE_EQUAL( forged.transactions.size(), 2u );
+      GRAPHENE_REQUIRE_THROW( PUSH_BLOCK( serial, forged ), fc::exception );
+      GRAPHENE_REQUIRE_THROW( PUSH_BLOCK( parallel, forged ), fc::exception );
+
+      signed_block b = produce( producer, database::skip_nothing );
+      BOOST_REQUIRE_EQUAL( b.transactions.size(), 3u );
+      PUSH_BLOCK( serial, b );
+      PUSH_BLOCK( parallel, b );
+
+      BOOST_CHECK_EQUAL( parallel.head_block_num(), producer.head_block_num() );
+      BOOST_CHECK( serial.state_hash() == producer.state_hash() );
+      BOOST_CHECK( parallel.state_hash() == serial.state_hash() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( tapos )
 {
    try {
@@ -951,6 +1409,129 @@ BOOST_FIXTURE_TEST_CASE( double_sign_check, database_fixture )
 
 } FC_LOG_AND_RETHROW() }
 
+BOOST_FIXTURE_TEST_CASE( transaction_prevalidator_test, database_fixture )
+{ try {
+   generate_block();
+   ACTORS( (alice)(bob) );
+   fund( alice, asset(100000) );
+   generate_block();
+   transaction_prevalidator prevalidator( db );
+
+   set_expiration( db, trx );
+   transfer_operation t;
+   t.from = alice_id;
+   t.to = bob_id;
+   t.amount = asset(1000);
+   trx.operations.push_back(t);
+   for( auto& op : trx.operations ) db.current_fee_schedule().set_fee(op);
+   sign( trx, alice_private_key );
+   const precomputable_transaction to_bob( trx );
+
+   BOOST_TEST_MESSAGE( "Verify that a transaction submitted twice at once is only pushed once" );
+   fc::future<processed_transaction> first = prevalidator.submit( to_bob );
+   fc::future<processed_transaction> second = prevalidator.submit( to_bob );
+   uint32_t rejected = 0;
+   for( auto* result : { &first, &second } )
+   {
+      try {
+         result->wait();
+      } catch( const duplicate_transaction& ) {
+         ++rejected;
+      }
+   }
+   BOOST_CHECK_EQUAL( rejected, 1u );
+   BOOST_CHECK_EQUAL( get_balance( bob_id, asset_id_type() ), 1000 );
+
+   BOOST_TEST_MESSAGE( "Verify that the database rejects a transaction it already holds" );
+   GRAPHENE_REQUIRE_THROW( prevalidator.submit( to_bob ).wait(), duplicate_transaction );
+
+   BOOST_TEST_MESSAGE( "Verify that a transaction dropped from the pending state can be submitted again" );
+   db.clear_pending();
+   BOOST_CHECK_EQUAL( get_balance( bob_id, asset_id_type() ), 0 );
+   prevalidator.submit( to_bob ).wait();
+   BOOST_CHECK_EQUAL( get_balance( bob_id, asset_id_type() ), 1000 );
+
+   BOOST_TEST_MESSAGE( "Verify that a transaction rejected by the database can be submitted again" );
+   trx.clear();
+   set_expiration( db, trx );
+   t.from = bob_id;
+   t.to = alice_id;
+   t.amount = asset(500);
+   trx.operations.push_back(t);
+   for( auto& op : trx.operations ) db.current_fee_schedule().set_fee(op);
+   GRAPHENE_REQUIRE_THROW( prevalidator.submit( precomputable_transaction( trx ) ).wait(), fc::exception );
+   sign( trx, bob_private_key );
+   prevalidator.submit( precomputable_transaction( trx ) ).wait();
+   BOOST_CHECK_EQUAL( get_balance( bob_id, asset_id_type() ), 500 - trx.operations[0].get<transfer_operation>().fee.amount.value );
+
+   const auto counters = prevalidator.get_counters();
+   BOOST_CHECK_EQUAL( counters.submitted, 6u );
+   BOOST_CHECK_EQUAL( counters.duplicates, 1u );
+   BOOST_CHECK_EQUAL( counters.failed, 2u );
+   BOOST_CHECK_EQUAL( counters.pushed, 3u );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_FIXTURE_TEST_CASE( recent_transaction_lookup, database_fixture )
+{ try {
+   generate_block();
+   ACTORS( (alice)(bob) );
+   fund( alice, asset(100000) );
+   generate_block();
+
+   auto make_transfer = [&]( int64_t amount ) {
+      signed_transaction tx;
+      set_expiration( db, tx );
+      transfer_operation t;
+      t.from = alice_id;
+      t.to = bob_id;
+      t.amount = asset(amount);
+      tx.operations.push_back(t);
+      for( auto& op : tx.operations ) db.current_fee_schedule().set_fee(op);
+      sign( tx, alice_private_key );
+      return tx;
+   };
+   signed_transaction first = make_transfer( 1000 );
+   signed_transaction second = make_transfer( 2000 );
+   PUSH_TX( db, first );
+   PUSH_TX( db, second );
+
+   BOOST_TEST_MESSAGE( "Pending transactions are found in the pending state" );
+   const auto& by_trx_id_idx = db.get_index_type<transaction_index>().indices().get<by_trx_id>();
+   BOOST_CHECK_EQUAL( by_trx_id_idx.find( second.id() )->block_num, 0u );
+   BOOST_CHECK_EQUAL( by_trx_id_idx.find( first.id() )->trx_in_block, 0u );
+   BOOST_CHECK_EQUAL( by_trx_id_idx.find( second.id() )->trx_in_block, 1u );
+   BOOST_CHECK( db.get_recent_transaction( first.id() ).id() == first.id() );
+   BOOST_CHECK( db.get_recent_transaction( second.id() ).id() == second.id() );
+
+   BOOST_TEST_MESSAGE( "Included transactions are read back from their block" );
+   const signed_block b = generate_block();
+   BOOST_REQUIRE_EQUAL( b.transactions.size(), 2u );
+   const transaction_history_object& record = *by_trx_id_idx.find( second.id() );
+   BOOST_CHECK_EQUAL( record.block_num, b.block_num() );
+   BOOST_CHECK_EQUAL( record.trx_in_block, 1u );
+   BOOST_CHECK( record.expiration == second.expiration );
+   BOOST_CHECK( db.get_recent_transaction( first.id() ).id() == first.id() );
+   BOOST_CHECK( db.get_recent_transaction( second.id() ).operations.front().get<transfer_operation>().amount
+                == asset(2000) );
+
+   BOOST_TEST_MESSAGE( "Expired transactions are forgotten" );
+   const object_id_type record_id = record.id;
+   flat_set<account_id_type> removed_accounts;
+   auto connection = db.removed_objects.connect( [&]( const vector<object_id_type>& ids, const vector<const object*>&,
+                                                      const flat_set<account_id_type>& accounts ) {
+      if( std::find( ids.begin(), ids.end(), record_id ) != ids.end() )
+         removed_accounts = accounts;
+   });
+   generate_blocks( second.expiration + db.get_global_properties().parameters.block_interval );
+   connection.disconnect();
+   BOOST_CHECK( !db.is_known_transaction( second.id() ) );
+
+   BOOST_TEST_MESSAGE( "Removing a record reports the accounts of its transaction, read back from its block" );
+   BOOST_CHECK( removed_accounts.count( alice_id ) > 0 );
+   BOOST_CHECK( removed_accounts.count( bob_id ) > 0 );
+   GRAPHENE_REQUIRE_THROW( db.get_recent_transaction( second.id() ), fc::exception );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_FIXTURE_TEST_CASE( change_block_interval, database_fixture )
 { try {
    // Initialize committee by voting for each memeber and for desired count
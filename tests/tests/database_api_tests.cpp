@@ -1051,6 +1051,74 @@ BOOST_AUTO_TEST_CASE( subscription_notification_test )
    } FC_LOG_AND_RETHROW()
 }
 
+BOOST_AUTO_TEST_CASE( get_order_book_levels_test )
+{
+   try {
+      ACTORS( (alice)(bob) );
+
+      const asset_object& usd = create_user_issued_asset( "USDTEST", bob, 0 );
+      const asset_object& core = asset_id_type()(db);
+      issue_uia( bob_id, usd.amount(1000000) );
+      transfer( committee_account, alice_id, asset(1000000) );
+
+      // alice sells core at two prices, with two orders at the better one
+      create_sell_order( alice_id, core.amount(100), usd.amount(200) );
+      const limit_order_id_type order2 = create_sell_order( alice_id, core.amount(300), usd.amount(600) )->id;
+      const limit_order_id_type order3 = create_sell_order( alice_id, core.amount(100), usd.amount(300) )->id;
+      create_sell_order( bob_id, usd.amount(100), core.amount(100) );
+      generate_block();
+
+      graphene::app::application_options opt = app.get_options();
+      opt.has_api_helper_indexes_plugin = true;
+      graphene::app::database_api db_api( db, &opt );
+
+      graphene::app::order_book book = db_api.get_order_book_levels( core.symbol, "USDTEST", 10 );
+      BOOST_REQUIRE_EQUAL( 2u, book.bids.size() );
+      BOOST_CHECK_EQUAL( core.amount_to_string(400), book.bids[0].base );
+      BOOST_CHECK_EQUAL( usd.amount_to_string(800), book.bids[0].quote );
+      BOOST_CHECK_EQUAL( core.amount_to_string(100), book.bids[1].base );
+      BOOST_REQUIRE_EQUAL( 1u, book.asks.size() );
+      BOOST_CHECK_EQUAL( usd.amount_to_string(100), book.asks[0].quote );
+
+      book = db_api.get_order_book_levels( core.symbol, "USDTEST", 1 );
+      BOOST_CHECK_EQUAL( 1u, book.bids.size() );
+
+      vector<variant> updates;
+      db_api.subscribe_to_market_depth( [&updates]( const variant& v ) { updates.push_back( v ); },
+                                        core.symbol, "USDTEST" );
+
+      cancel_limit_order( order2(db) );
+      generate_block();
+      fc::usleep(fc::milliseconds(200)); // sleep a while to execute callback in another thread
+
+      BOOST_REQUIRE_EQUAL( 1u, updates.size() );
+      graphene::app::order_book_update update
+            = updates[0].as<graphene::app::order_book_update>( GRAPHENE_MAX_NESTED_OBJECTS );
+      BOOST_CHECK_EQUAL( db.head_block_num(), update.block_num );
+      BOOST_REQUIRE_EQUAL( 1u, update.bids.size() );
+      BOOST_CHECK_EQUAL( core.amount_to_string(100), update.bids[0].base );
+      BOOST_CHECK( update.asks.empty() );
+
+      // the last order of a level going away is sent as a level with zero amounts
+      cancel_limit_order( order3(db) );
+      generate_block();
+      fc::usleep(fc::milliseconds(200));
+
+      BOOST_REQUIRE_EQUAL( 2u, updates.size() );
+      update = updates[1].as<graphene::app::order_book_update>( GRAPHENE_MAX_NESTED_OBJECTS );
+      BOOST_REQUIRE_EQUAL( 1u, update.bids.size() );
+      BOOST_CHECK_EQUAL( core.amount_to_string(0), update.bids[0].base );
+      BOOST_CHECK_EQUAL( 1u, db_api.get_order_book_levels( core.symbol, "USDTEST", 10 ).bids.size() );
+
+      db_api.unsubscribe_from_market_depth( core.symbol, "USDTEST" );
+      create_sell_order( alice_id, core.amount(100), usd.amount(300) );
+      generate_block();
+      fc::usleep(fc::milliseconds(200));
+      BOOST_CHECK_EQUAL( 2u, updates.size() );
+
+   } FC_LOG_AND_RETHROW()
+}
+
 BOOST_AUTO_TEST_CASE( get_all_workers )
 { try {
    graphene::app::database_api db_api( db, &( app.get_options() ));
@@ -28,8 +28,11 @@
 #include <graphene/chain/database.hpp>
 
 #include <graphene/chain/account_object.hpp>
+#include <graphene/chain/market_object.hpp>
 #include <graphene/chain/proposal_object.hpp>
 
+#include <graphene/utilities/tempdir.hpp>
+
 #include <fc/crypto/digest.hpp>
 
 #include "../common/database_fixture.hpp"
@@ -109,6 +112,198 @@ BOOST_AUTO_TEST_CASE( merge_test )
    }
 }
 
+BOOST_AUTO_TEST_CASE( merged_sessions_undo_test )
+{ try {
+   database db;
+   auto set_balance = []( int64_t amount ) {
+      return [amount]( account_balance_object& obj ){ obj.balance = amount; };
+   };
+   const auto& a = db.create<account_balance_object>( set_balance(1) );
+   const auto& b = db.create<account_balance_object>( set_balance(2) );
+   account_balance_id_type a_id = a.id;
+   account_balance_id_type b_id = b.id;
+
+   db._undo_db.enable();
+   auto outer = db._undo_db.start_undo_session();
+   account_balance_id_type c_id;
+   {
+      auto inner = db._undo_db.start_undo_session();
+      db.modify( a, set_balance(10) );
+      c_id = db.create<account_balance_object>( set_balance(5) ).id;
+      inner.merge();
+   }
+   {
+      auto inner = db._undo_db.start_undo_session();
+      db.modify( a, set_balance(20) );
+      db.remove( b );
+      db.modify( c_id(db), set_balance(6) );
+      inner.merge();
+   }
+   db.remove( c_id(db) );
+   db.modify( a_id(db), set_balance(30) );
+
+   const auto& head = db._undo_db.head();
+   BOOST_CHECK( head.new_ids.empty() );
+   BOOST_REQUIRE_EQUAL( head.old_values.size(), 1u );
+   BOOST_CHECK( head.old_values.begin()->first == a_id );
+   BOOST_CHECK_EQUAL( static_cast<const account_balance_object*>( head.old_values.begin()->second )->balance.value, 1 );
+   BOOST_REQUIRE_EQUAL( head.removed.size(), 1u );
+   BOOST_CHECK( head.removed.begin()->first == b_id );
+   BOOST_CHECK_EQUAL( head.old_index_next_ids.size(), 1u );
+
+   outer.undo();
+   BOOST_CHECK_EQUAL( a_id(db).balance.value, 1 );
+   BOOST_REQUIRE( db.find( b_id ) );
+   BOOST_CHECK_EQUAL( b_id(db).balance.value, 2 );
+   BOOST_CHECK( !db.find( c_id ) );
+   BOOST_CHECK( db.create<account_balance_object>( set_balance(7) ).id == c_id );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( read_view_test )
+{ try {
+   database db;
+   auto set_balance = []( int64_t amount ) {
+      return [amount]( account_balance_object& obj ){ obj.balance = amount; };
+   };
+   account_balance_id_type a_id = db.create<account_balance_object>( set_balance(1) ).id;
+   account_balance_id_type b_id = db.create<account_balance_object>( set_balance(2) ).id;
+
+   BOOST_CHECK( !db.get_read_view() );
+   db.publish_read_view( 1 );
+   BOOST_CHECK( !db.get_read_view() ); // no index enabled
+
+   db.enable_read_view<account_balance_object>();
+   db.publish_read_view( 1 );
+   const auto first = db.get_read_view();
+   BOOST_REQUIRE( first );
+   BOOST_CHECK_EQUAL( first->revision(), 1u );
+   BOOST_CHECK( first->contains( a_id ) );
+   BOOST_CHECK( !first->contains( account_id_type() ) );
+   BOOST_CHECK_EQUAL( first->get( a_id ).balance.value, 1 );
+
+   db.modify( a_id(db), set_balance(10) );
+   db.remove( b_id(db) );
+   account_balance_id_type c_id = db.create<account_balance_object>( set_balance(3) ).id;
+
+   // published views do not change
+   BOOST_CHECK_EQUAL( first->get( a_id ).balance.value, 1 );
+   BOOST_CHECK( first->find( b_id ) );
+   BOOST_CHECK( !first->find( c_id ) );
+
+   db.publish_read_view( 2 );
+   const auto second = db.get_read_view();
+   BOOST_CHECK_EQUAL( second->revision(), 2u );
+   BOOST_CHECK_EQUAL( second->get( a_id ).balance.value, 10 );
+   BOOST_CHECK( !second->find( b_id ) );
+   BOOST_CHECK_EQUAL( second->get( c_id ).balance.value, 3 );
+
+   share_type total = 0;
+   second->for_each<account_balance_object>( [&total]( const account_balance_object& b ) { total += b.balance; } );
+   BOOST_CHECK_EQUAL( total.value, 13 );
+
+   // nothing changed, so the view is kept
+   BOOST_CHECK( db.publish_read_view( 3 ) == second );
+   BOOST_CHECK_EQUAL( db.get_read_view()->revision(), 2u );
+
+   // unchanged objects are shared between views
+   db.modify( a_id(db), set_balance(11) );
+   BOOST_CHECK( db.publish_read_view( 4 ) != second );
+   BOOST_CHECK_EQUAL( db.get_read_view()->get( a_id ).balance.value, 11 );
+   BOOST_CHECK( db.get_read_view()->find( c_id ) == second->find( c_id ) );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( index_snapshot_pages_test )
+{ try {
+   database db;
+   const size_t count = 3 * graphene::db::index_snapshot::page_size;
+   for( size_t i = 0; i < count; ++i )
+      db.create<account_balance_object>( []( account_balance_object& ){} );
+   const graphene::db::index& idx = db.get_index( account_balance_object::space_id, account_balance_object::type_id );
+
+   const auto full = graphene::db::index_snapshot::build( idx );
+   BOOST_CHECK_EQUAL( full->size(), count );
+   BOOST_CHECK_EQUAL( full->page_count(), 3u );
+
+   // emptying the middle page drops it, the other pages are shared
+   std::unordered_set<object_id_type> changed;
+   for( size_t i = graphene::db::index_snapshot::page_size; i < 2 * graphene::db::index_snapshot::page_size; ++i )
+   {
+      const account_balance_id_type id( i );
+      db.remove( id(db) );
+      changed.insert( id );
+   }
+   const auto updated = full->update( idx, changed );
+   BOOST_CHECK_EQUAL( updated->size(), count - graphene::db::index_snapshot::page_size );
+   BOOST_CHECK_EQUAL( updated->page_count(), 2u );
+   BOOST_CHECK( updated->find( 0 ) == full->find( 0 ) );
+   BOOST_CHECK( updated->find( graphene::db::index_snapshot::page_size ) == nullptr );
+   BOOST_CHECK( full->find( graphene::db::index_snapshot::page_size ) != nullptr );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( incremental_checkpoint_test )
+{ try {
+   fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+   const fc::path balance_index = data_dir.path() / "object_database"
+                              / fc::to_string( uint32_t(account_balance_object::space_id) )
+                              / fc::to_string( uint32_t(account_balance_object::type_id) );
+   account_balance_id_type kept_id, changed_id, removed_id, added_id;
+   // more new accounts than the direct index accepts out of order, so the logs must replay them in id order
+   const uint32_t account_count = 150;
+   vector<account_id_type> account_ids;
+   {
+      database db;
+      graphene::db::object_database& odb = db;
+      odb.enable_incremental_checkpoints( true );
+      odb.open( data_dir.path() );
+      kept_id = db.create<account_balance_object>( []( account_balance_object& obj ) { obj.balance = 1; } ).id;
+      changed_id = db.create<account_balance_object>( []( account_balance_object& obj ) { obj.balance = 2; } ).id;
+      removed_id = db.create<account_balance_object>( []( account_balance_object& obj ) { obj.balance = 3; } ).id;
+      // nothing has been saved yet, so this is a full save
+      odb.flush();
+      BOOST_CHECK( !fc::exists( graphene::db::delta_log_path( balance_index ) ) );
+
+      db.modify( changed_id(db), []( account_balance_object& obj ) { obj.balance = 20; } );
+      db.remove( removed_id(db) );
+      added_id = db.create<account_balance_object>( []( account_balance_object& obj ) { obj.balance = 4; } ).id;
+      for( uint32_t i = 0; i < account_count; ++i )
+         account_ids.push_back( db.create<account_object>( [i]( account_object& obj ) {
+            obj.name = "checkpoint" + fc::to_string( i );
+         }).id );
+      odb.flush();
+      BOOST_CHECK( fc::exists( graphene::db::delta_log_path( balance_index ) ) );
+      BOOST_CHECK( fc::exists( data_dir.path() / "object_database" / "checkpoint" ) );
+
+      // changes after the last checkpoint are lost when the process dies without a flush
+      db.modify( kept_id(db), []( account_balance_object& obj ) { obj.balance = 100; } );
+   }
+   {
+      database db;
+      graphene::db::object_database& odb = db;
+      odb.open( data_dir.path() );
+      BOOST_CHECK_EQUAL( kept_id(db).balance.value, 1 );
+      BOOST_CHECK_EQUAL( changed_id(db).balance.value, 20 );
+      BOOST_CHECK( db.find( removed_id ) == nullptr );
+      BOOST_CHECK_EQUAL( added_id(db).balance.value, 4 );
+      for( uint32_t i = 0; i < account_count; ++i )
+         BOOST_CHECK_EQUAL( account_ids[i](db).name, "checkpoint" + fc::to_string( i ) );
+      const auto& next = db.create<account_balance_object>( []( account_balance_object& obj ) {} );
+      BOOST_CHECK( next.id.instance() == added_id.instance.value + 1 );
+
+      // a full save folds the delta logs back into the index files
+      odb.flush();
+      BOOST_CHECK( !fc::exists( graphene::db::delta_log_path( balance_index ) ) );
+   }
+   {
+      // the folded index files load as well
+      database db;
+      graphene::db::object_database& odb = db;
+      odb.open( data_dir.path() );
+      BOOST_CHECK_EQUAL( added_id(db).balance.value, 4 );
+      for( uint32_t i = 0; i < account_count; ++i )
+         BOOST_CHECK_EQUAL( account_ids[i](db).name, "checkpoint" + fc::to_string( i ) );
+   }
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_CASE( direct_index_test )
 { try {
    try {
@@ -194,6 +389,70 @@ BOOST_AUTO_TEST_CASE( direct_index_test )
    // but the secondary has not updated its representation
 } FC_LOG_AND_RETHROW() }
 
+BOOST_AUTO_TEST_CASE( chunked_index_test )
+{ try {
+   graphene::db::primary_index< limit_order_index > orders( db );
+   for( uint32_t i = 0; i < 1000; ++i )
+      orders.create( [i]( object& o ) { static_cast<limit_order_object&>( o ).for_sale = i; } );
+
+   // leave a gap spanning several whole chunks
+   for( uint32_t i = 100; i < 900; ++i )
+      orders.remove( *orders.find( limit_order_id_type( i ) ) );
+
+   BOOST_CHECK_EQUAL( orders.indices().size(), 200u );
+   BOOST_CHECK( orders.find( limit_order_id_type( 500 ) ) == nullptr );
+   BOOST_CHECK( orders.find( limit_order_id_type( 5000 ) ) == nullptr );
+   BOOST_CHECK( orders.find( account_id_type( 950 ) ) == nullptr );
+   const auto* order = static_cast<const limit_order_object*>( orders.find( limit_order_id_type( 950 ) ) );
+   BOOST_REQUIRE( order != nullptr );
+   BOOST_CHECK_EQUAL( order->for_sale.value, 950 );
+
+   // removed instances can be filled again, e.g. by undo
+   limit_order_object restored;
+   restored.id = limit_order_id_type( 500 );
+   restored.for_sale = 42;
+   orders.insert( std::move( restored ) );
+   BOOST_REQUIRE( orders.find( limit_order_id_type( 500 ) ) != nullptr );
+   BOOST_CHECK_EQUAL( orders.get( limit_order_id_type( 500 ) ).id.instance(), 500u );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( index_save_and_open_test )
+{ try {
+   fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+   const fc::path file = data_dir.path() / "accounts";
+   {
+      graphene::db::primary_index< account_index, 8 > my_accounts( db );
+      for( uint32_t i = 0; i < 300; ++i )
+      {
+         if( i % 7 == 3 ) continue; // leave some small holes
+         account_object test_account;
+         test_account.id = account_id_type(i);
+         test_account.name = "account" + std::to_string( i );
+         my_accounts.load( fc::raw::pack( test_account ) );
+      }
+      my_accounts.set_next_id( account_id_type( 300 ) );
+      my_accounts.save( file );
+   }
+
+   graphene::db::primary_index< account_index, 8 > reloaded( db );
+   reloaded.open( file );
+   const auto& direct = reloaded.get_secondary_index<graphene::db::direct_index< account_object, 8 >>();
+   const auto& by_name = reloaded.indices().get<by_name>();
+   BOOST_CHECK( reloaded.get_next_id() == object_id_type( account_id_type( 300 ) ) );
+   for( uint32_t i = 0; i < 300; ++i )
+   {
+      const account_object* acct = direct.find( account_id_type(i) );
+      if( i % 7 == 3 )
+      {
+         BOOST_CHECK( acct == nullptr );
+         continue;
+      }
+      BOOST_REQUIRE( acct != nullptr );
+      BOOST_CHECK_EQUAL( "account" + std::to_string( i ), acct->name );
+      BOOST_CHECK( by_name.find( acct->name ) != by_name.end() );
+   }
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_CASE( required_approval_index_test ) // see https://github.com/bitshares/bitshares-core/issues/1719
 { try {
    ACTORS( (alice)(bob)(charlie)(agnetha)(benny)(carlos) );
@@ -281,4 +540,89 @@ BOOST_AUTO_TEST_CASE( required_approval_index_test ) // see https://github.com/b
 
 } FC_LOG_AND_RETHROW() }
 
+BOOST_AUTO_TEST_CASE( index_observer_test )
+{ try {
+   struct counting_observer : public graphene::db::index_observer
+   {
+      void on_add( const graphene::db::object& obj )override { ++added; }
+      uint32_t added = 0;
+   };
+   auto first = std::make_shared<counting_observer>();
+   auto second = std::make_shared<counting_observer>();
+   auto& accounts = const_cast< graphene::db::index& >( db.get_index<account_object>() );
+   accounts.add_observer( first );
+   accounts.add_observer( second );
+
+   ACTOR( alice );
+   BOOST_CHECK_EQUAL( 1u, first->added );
+   BOOST_CHECK_EQUAL( 1u, second->added );
+
+   // a removed observer is not notified any more, the others still are
+   accounts.remove_observer( first );
+   ACTOR( bob );
+   BOOST_CHECK_EQUAL( 1u, first->added );
+   BOOST_CHECK_EQUAL( 2u, second->added );
+
+   // enabling the incremental vote tally again replaces its observers instead of adding more
+   db.enable_incremental_vote_tally( true );
+   db.enable_incremental_vote_tally( true );
+   db.enable_incremental_vote_tally( false );
+   accounts.remove_observer( second );
+   ACTOR( carol );
+   BOOST_CHECK_EQUAL( 2u, second->added );
+   generate_blocks( db.get_dynamic_global_properties().next_maintenance_time );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( object_change_batch_test )
+{ try {
+   std::shared_ptr<const object_change_batch> batch;
+   auto connection = db.object_changes.connect( [&batch]( const std::shared_ptr<const object_change_batch>& b ) {
+      batch = b;
+   });
+
+   ACTOR( alice );
+   generate_block();
+
+   BOOST_REQUIRE( batch );
+   BOOST_CHECK_EQUAL( db.head_block_num(), batch->block_num );
+   BOOST_CHECK( std::is_sorted( batch->created.ids.begin(), batch->created.ids.end() ) );
+   BOOST_CHECK( batch->created.accounts_impacted.count( alice_id ) > 0 );
+   const object_change* created = batch->created.find( alice_id );
+   BOOST_REQUIRE( created != nullptr );
+   BOOST_REQUIRE( created->value );
+   BOOST_CHECK_EQUAL( "alice", static_cast<const account_object&>( *created->value ).name );
+   BOOST_CHECK( batch->changed.find( alice_id ) == nullptr );
+
+   // the batch does not refer to the live database, so it outlives the block
+   const std::shared_ptr<const object_change_batch> first = batch;
+   db.pop_block();
+   BOOST_CHECK( db.find_object( alice_id ) == nullptr );
+   BOOST_CHECK_EQUAL( "alice", created->to_variant()["name"].as_string() );
+   BOOST_CHECK( &created->to_variant() == &first->created.find( alice_id )->to_variant() );
+
+   connection.disconnect();
+
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE( housekeeping_timings_test )
+{ try {
+   db.reset_housekeeping_timings();
+   for( const auto& timing : db.get_housekeeping_timings() )
+      BOOST_CHECK_EQUAL( 0u, timing.blocks );
+
+   generate_blocks( 3 );
+
+   for( const auto& timing : db.get_housekeeping_timings() )
+   {
+      BOOST_CHECK_EQUAL( 3u, timing.blocks );
+      BOOST_CHECK( timing.longest <= timing.total );
+   }
+   BOOST_CHECK_EQUAL( std::string( "expired orders" ),
+                      database::housekeeping_step_name( database::housekeeping_expired_orders ) );
+
+   db.reset_housekeeping_timings();
+   BOOST_CHECK_EQUAL( 0u, db.get_housekeeping_timings()[database::housekeeping_witness_schedule].blocks );
+
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -25,7 +25,8 @@
 #include <boost/test/unit_test.hpp>
 
 #include <graphene/chain/database.hpp>
-
+#include <graphene/net/core_messages.hpp>
+#include <graphene/net/message.hpp>
 
 #include <fc/crypto/digest.hpp>
 #include <fc/crypto/elliptic.hpp>
@@ -112,4 +113,43 @@ BOOST_AUTO_TEST_CASE( extension_serialization_test )
    }
 }
 
+BOOST_AUTO_TEST_CASE( compact_block_test )
+{
+   try
+   {
+      using graphene::net::block_message;
+      using graphene::net::compact_block_message;
+      using graphene::net::message;
+
+      ACTOR( alice );
+      transfer( account_id_type(), alice_id, asset( 1000 ) );
+      const signed_block block = generate_block();
+      BOOST_REQUIRE( !block.transactions.empty() );
+
+      const message full{ block_message( block ) };
+      const compact_block_message compact = fc::raw::unpack<compact_block_message>(
+            fc::raw::pack( compact_block_message( full.id(), block ) ) );
+      BOOST_CHECK_LT( fc::raw::pack_size( compact ), fc::raw::pack_size( block ) );
+      for( size_t i = 0; i < block.transactions.size(); ++i )
+         BOOST_CHECK_EQUAL( compact.transactions[i].short_id,
+                            compact_block_message::short_id( full.id(), block.transactions[i].id() ) );
+
+      // the transactions as they were relayed rebuild the block
+      vector<signed_transaction> transactions( block.transactions.begin(), block.transactions.end() );
+      const message rebuilt{ block_message( compact.rebuild( std::move( transactions ) ) ) };
+      BOOST_CHECK( rebuilt.id() == full.id() );
+
+      // a copy with other signatures has the same id, but does not rebuild the block
+      transactions.assign( block.transactions.begin(), block.transactions.end() );
+      transactions.back().signatures.push_back( signature_type() );
+      const message mismatched{ block_message( compact.rebuild( std::move( transactions ) ) ) };
+      BOOST_CHECK( mismatched.id() != full.id() );
+   }
+   catch ( const fc::exception& e )
+   {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
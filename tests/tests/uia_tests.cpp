@@ -33,9 +33,12 @@
 
 #include <graphene/chain/account_object.hpp>
 #include <graphene/chain/asset_object.hpp>
+#include <graphene/chain/nft_object.hpp>
 
 #include <fc/crypto/digest.hpp>
 
+#include <numeric>
+
 #include "../common/database_fixture.hpp"
 
 using namespace graphene::chain;
@@ -675,4 +678,79 @@ BOOST_AUTO_TEST_CASE( asset_name_test )
    }
 }
 
+BOOST_AUTO_TEST_CASE( lottery_winners_match_ticket_expansion )
+{ try {
+   ACTORS( (alice)(bob)(carol)(dan) );
+   fund( alice, asset(1000000) );
+   const asset_object& tickets = create_user_issued_asset( "TICKETS", alice, 0 );
+   const asset_id_type tickets_id = tickets.id;
+   issue_uia( alice, asset( 3, tickets_id ) );
+   issue_uia( bob, asset( 1, tickets_id ) );
+   issue_uia( carol, asset( 7, tickets_id ) );
+   issue_uia( dan, asset( 2, tickets_id ) );
+   generate_block();
+
+   BOOST_TEST_MESSAGE( "Asset lottery: ticket ranges give the holders of the expanded ticket list" );
+   // the list every ticket was expanded into before, one entry per ticket in balance index order
+   vector<account_id_type> expanded_holders;
+   const auto& bal_idx = db.get_index_type< account_balance_index >().indices().get< by_asset_balance >();
+   const auto bal_range = bal_idx.equal_range( boost::make_tuple( tickets_id ) );
+   for( const account_balance_object& bal : boost::make_iterator_range( bal_range.first, bal_range.second ) )
+      for( int64_t i = 0; i < bal.balance.value; ++i )
+         expanded_holders.push_back( bal.owner );
+
+   const lottery_ticket_ranges sold = tickets_id(db).get_ticket_ranges( db );
+   BOOST_REQUIRE_EQUAL( sold.total(), expanded_holders.size() );
+   for( uint64_t n = 0; n < sold.total(); ++n )
+      BOOST_CHECK( sold.holders[ sold.find( n ) ] == expanded_holders[n] );
+
+   // the numbers drawn for the lottery are fixed by the chain state
+   const auto winner_numbers = db.get_winner_numbers( tickets_id, sold.total(), 5 );
+   BOOST_REQUIRE_EQUAL( winner_numbers.size(), 5u );
+   BOOST_CHECK( winner_numbers == db.get_winner_numbers( tickets_id, sold.total(), 5 ) );
+   for( uint32_t n : winner_numbers )
+      BOOST_CHECK( sold.holders[ sold.find( n ) ] == expanded_holders[n] );
+
+   BOOST_TEST_MESSAGE( "NFT lottery: the tickets found for the numbers are those of the expanded ticket list" );
+   const nft_metadata_object& lottery = db.create<nft_metadata_object>( [&]( nft_metadata_object& md ) {
+      md.owner = alice_id;
+      md.name = "TICKETS";
+      md.symbol = "TKT";
+   });
+   const nft_metadata_id_type lottery_id = lottery.id;
+   const account_id_type owners[] = { carol_id, alice_id, dan_id, alice_id, bob_id, carol_id, carol_id, dan_id };
+   for( account_id_type owner : owners )
+      db.create<nft_object>( [&]( nft_object& ticket ) {
+         ticket.nft_metadata_id = lottery_id;
+         ticket.owner = owner;
+      });
+
+   vector<nft_id_type> expanded_tickets;
+   const auto& nft_by_md = db.get_index_type<nft_index>().indices().get<by_metadata>();
+   const auto nft_range = nft_by_md.equal_range( lottery_id );
+   for( const nft_object& ticket : boost::make_iterator_range( nft_range.first, nft_range.second ) )
+      expanded_tickets.push_back( ticket.id );
+   BOOST_REQUIRE_EQUAL( expanded_tickets.size(), 8u );
+
+   vector<uint64_t> all_numbers( expanded_tickets.size() );
+   std::iota( all_numbers.rbegin(), all_numbers.rend(), 0 );
+   const vector<const nft_object*> all_tickets = lottery_id(db).get_tickets( db, all_numbers );
+   for( size_t c = 0; c < all_numbers.size(); ++c )
+   {
+      BOOST_REQUIRE( all_tickets[c] != nullptr );
+      BOOST_CHECK( all_tickets[c]->id == expanded_tickets[ all_numbers[c] ] );
+   }
+
+   const vector<uint64_t> drawn = db.get_random_numbers( 0, expanded_tickets.size(), 3, false );
+   const vector<const nft_object*> drawn_tickets = lottery_id(db).get_tickets( db, drawn );
+   for( size_t c = 0; c < drawn.size(); ++c )
+   {
+      BOOST_REQUIRE( drawn_tickets[c] != nullptr );
+      BOOST_CHECK( drawn_tickets[c]->id == expanded_tickets[ drawn[c] ] );
+   }
+
+   // numbers past the sold tickets have no ticket, distribute_winners_part refuses them
+   BOOST_CHECK( lottery_id(db).get_tickets( db, { expanded_tickets.size() } ).front() == nullptr );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -951,4 +951,145 @@ BOOST_AUTO_TEST_CASE( committee_votes_calculation )
    } FC_LOG_AND_RETHROW()
 }
 
+BOOST_AUTO_TEST_CASE( parallel_vote_tally )
+{
+   try
+   {
+      INVOKE( put_my_witnesses );
+
+      GET_ACTOR( witness0 );
+      GET_ACTOR( witness1 );
+      GET_ACTOR( witness2 );
+
+      const auto& wit_by_account = db.get_index_type<witness_index>().indices().get<by_account>();
+      const vote_id_type witness0_vote = wit_by_account.find( witness0_id )->vote_id;
+      const vote_id_type witness2_vote = wit_by_account.find( witness2_id )->vote_id;
+
+      // Voters registered by witness1 pay it cashback when fees are processed, which happens before the
+      // tally loop reaches witness1, so its precomputed tally has to be redone
+      vector<account_id_type> voters;
+      for( int i = 0; i < 8; ++i )
+      {
+         const account_object& voter = create_account( "voter" + fc::to_string(i), witness1_id(db),
+                                                       witness1_id(db), 50 );
+         voters.push_back( voter.id );
+         fund( voter, asset(1000000) );
+      }
+
+      for( size_t i = 0; i < voters.size(); ++i )
+      {
+         account_update_operation op;
+         op.account = voters[i];
+         op.new_options = voters[i](db).options;
+         if( i % 2 == 0 )
+         {
+            op.new_options->votes.insert( witness0_vote );
+            op.new_options->votes.insert( witness2_vote );
+            op.new_options->num_witness = 2;
+         }
+         else
+            op.new_options->voting_account = witness0_id;
+         set_expiration( db, trx );
+         trx.operations.clear();
+         trx.operations.push_back( op );
+         PUSH_TX( db, trx, ~0 );
+         trx.clear();
+
+         transfer( voters[i], witness2_id, asset(1000) );
+      }
+      generate_block();
+
+      generate_blocks( db.get_dynamic_global_properties().next_maintenance_time );
+      const uint32_t maint_block_num = db.head_block_num();
+      const fc::sha256 serial_hash = db.state_hash();
+      const uint64_t serial_votes = wit_by_account.find( witness0_id )->total_votes;
+      BOOST_CHECK_GT( serial_votes, 0u );
+
+      // Replay the maintenance block with the parallel tally and compare the resulting state
+      const signed_block maint_block = *db.fetch_block_by_number( maint_block_num );
+      db.pop_block();
+      db.enable_parallel_vote_tally( true );
+      PUSH_BLOCK( db, maint_block, ~0 );
+
+      BOOST_CHECK_EQUAL( db.head_block_num(), maint_block_num );
+      BOOST_CHECK_EQUAL( wit_by_account.find( witness0_id )->total_votes, serial_votes );
+      BOOST_CHECK( db.state_hash() == serial_hash );
+   } FC_LOG_AND_RETHROW()
+}
+
+BOOST_AUTO_TEST_CASE( incremental_vote_tally )
+{
+   try
+   {
+      // every maintenance interval also counts all accounts and fails if the kept tallies differ
+      db.enable_incremental_vote_tally( true, true );
+
+      INVOKE( put_my_witnesses );
+
+      GET_ACTOR( witness0 );
+      GET_ACTOR( witness1 );
+      GET_ACTOR( witness2 );
+
+      const auto& wit_by_account = db.get_index_type<witness_index>().indices().get<by_account>();
+      const vote_id_type witness0_vote = wit_by_account.find( witness0_id )->vote_id;
+      const vote_id_type witness2_vote = wit_by_account.find( witness2_id )->vote_id;
+
+      auto update_votes = [this]( account_id_type voter, const std::function<void(account_options&)>& change ) {
+         account_update_operation op;
+         op.account = voter;
+         op.new_options = voter(db).options;
+         change( *op.new_options );
+         set_expiration( db, trx );
+         trx.operations.clear();
+         trx.operations.push_back( op );
+         PUSH_TX( db, trx, ~0 );
+         trx.clear();
+      };
+
+      vector<account_id_type> voters;
+      for( int i = 0; i < 6; ++i )
+      {
+         const account_object& voter = create_account( "voter" + fc::to_string(i), witness1_id(db),
+                                                       witness1_id(db), 50 );
+         voters.push_back( voter.id );
+         fund( voter, asset(1000000) );
+         update_votes( voter.id, [&]( account_options& o ) {
+            if( i % 2 == 0 )
+            {
+               o.votes.insert( witness0_vote );
+               o.num_witness = 1;
+            }
+            else
+               o.voting_account = voters.front();
+         });
+      }
+      generate_blocks( db.get_dynamic_global_properties().next_maintenance_time );
+
+      // change opinions, proxies and stakes between maintenance intervals
+      update_votes( voters[0], [&]( account_options& o ) { o.votes.insert( witness2_vote ); o.num_witness = 2; } );
+      update_votes( voters[1], [&]( account_options& o ) { o.voting_account = GRAPHENE_PROXY_TO_SELF_ACCOUNT; } );
+      transfer( voters[2], witness2_id, asset(300000) );
+      transfer( voters[3], voters[4], asset(100000) );
+      generate_blocks( db.get_dynamic_global_properties().next_maintenance_time );
+      BOOST_CHECK_GT( wit_by_account.find( witness2_id )->total_votes, 0u );
+
+      // let the voting power of the voters decay
+      generate_blocks( db.head_block_time() + 400 * 86400 );
+      generate_blocks( db.get_dynamic_global_properties().next_maintenance_time );
+      update_votes( voters[4], [&]( account_options& o ) { o.votes.erase( witness0_vote ); o.num_witness = 0; } );
+      generate_blocks( db.get_dynamic_global_properties().next_maintenance_time );
+
+      // the same block applied with a full count gives the same state, including the active witnesses
+      const uint32_t maint_block_num = db.head_block_num();
+      const fc::sha256 incremental_hash = db.state_hash();
+      const signed_block maint_block = *db.fetch_block_by_number( maint_block_num );
+      db.pop_block();
+      db.enable_incremental_vote_tally( false );
+      PUSH_BLOCK( db, maint_block, ~0 );
+
+      BOOST_CHECK_EQUAL( db.head_block_num(), maint_block_num );
+      BOOST_CHECK( db.state_hash() == incremental_hash );
+   } FC_LOG_AND_RETHROW()
+}
+
 BOOST_AUTO_TEST_SUITE_END()